@@ -0,0 +1,297 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Program to show using libiso9660 to build an ISO 9660 image from a
+   directory tree, and to time doing so.
+
+     isobuild [-R] [-J] [-t THREADS] SOURCE-DIR IMAGE
+
+   builds IMAGE from SOURCE-DIR, with Rock Ridge (-R) and Joliet (-J)
+   extensions if asked for.
+
+     isobuild -b [-s MBYTES] [-t THREADS] IMAGE
+
+   is a benchmark: it fills a scratch directory next to IMAGE with a
+   tree the size of a single-layer DVD (or MBYTES megabytes), shaped
+   like one - a few large files, some medium-sized ones, many small
+   ones - then times building IMAGE from it with Rock Ridge and Joliet,
+   and compares that with just copying the same data with read() and
+   write(). The scratch tree and IMAGE are removed afterwards.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <sys/types.h>
+#include <cdio/cdio.h>
+#include <cdio/iso9660.h>
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#include <sys/time.h>
+
+/* A single-layer DVD holds 2,295,104 blocks of 2048 bytes. */
+#define DVD5_BYTES ((uint64_t) 2295104 * 2048)
+
+#define MB (1024 * 1024)
+#define FILES_PER_DIR 100
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+report(const char psz_what[], uint64_t i_bytes, double d_secs)
+{
+  printf("%-22s %8.2f s", psz_what, d_secs);
+  if (i_bytes && d_secs > 0)
+    printf("  %8.1f MB/s", i_bytes / d_secs / MB);
+  printf("\n");
+}
+
+/* Make the scratch tree: 75% of i_total in files of up to 1 GB, 20%
+   in 4 MB files and the rest in 16 KB files, FILES_PER_DIR to a
+   directory. Return the number of files made, 0 on error. */
+static unsigned int
+make_tree(const char psz_dir[], uint64_t i_total, char ***ppsz_paths)
+{
+  static const struct { double d_share; uint64_t i_size; } kinds[] = {
+    { 0.75, 1024 * MB }, { 0.20, 4 * MB }, { 0.05, 16 * 1024 }
+  };
+  uint8_t *p_buf = malloc(MB);
+  unsigned int i_files = 0, i_max = 0, k;
+
+  if (!p_buf) return 0;
+  for (k = 0; k < MB; k++) p_buf[k] = k * 31 + (k >> 11);
+
+  for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    uint64_t i_left = kinds[k].d_share * i_total;
+
+    while (i_left > 0) {
+      uint64_t i_size = i_left < kinds[k].i_size ? i_left : kinds[k].i_size;
+      char psz_path[2048];
+      FILE *p_file;
+
+      if (0 == i_files % FILES_PER_DIR) {
+        snprintf(psz_path, sizeof(psz_path), "%s/dir%04u", psz_dir,
+                 i_files / FILES_PER_DIR);
+        mkdir(psz_path, 0755);
+      }
+      snprintf(psz_path, sizeof(psz_path), "%s/dir%04u/file%06u.dat",
+               psz_dir, i_files / FILES_PER_DIR, i_files);
+      p_file = fopen(psz_path, "wb");
+      if (!p_file) {
+        perror(psz_path);
+        free(p_buf);
+        return 0;
+      }
+      i_left -= i_size;
+      while (i_size > 0) {
+        size_t i_chunk = i_size < MB ? i_size : MB;
+        fwrite(p_buf, 1, i_chunk, p_file);
+        i_size -= i_chunk;
+      }
+      fclose(p_file);
+
+      if (i_files == i_max) {
+        i_max = i_max ? 2 * i_max : 64;
+        *ppsz_paths = realloc(*ppsz_paths, i_max * sizeof(char *));
+      }
+      (*ppsz_paths)[i_files++] = strdup(psz_path);
+    }
+  }
+  free(p_buf);
+  return i_files;
+}
+
+/* Copy every file into psz_out with read() and write(), which is the
+   least any image builder has to do. */
+static uint64_t
+copy_files(char **ppsz_paths, unsigned int i_files, const char psz_out[])
+{
+  uint8_t *p_buf = malloc(MB);
+  int fd_out = open(psz_out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  uint64_t i_bytes = 0;
+  unsigned int i;
+
+  for (i = 0; p_buf && fd_out >= 0 && i < i_files; i++) {
+    int fd_in = open(ppsz_paths[i], O_RDONLY);
+    ssize_t i_read;
+    while (fd_in >= 0 && (i_read = read(fd_in, p_buf, MB)) > 0)
+      i_bytes += write(fd_out, p_buf, i_read);
+    if (fd_in >= 0) close(fd_in);
+  }
+  if (fd_out >= 0) {
+    fsync(fd_out);
+    close(fd_out);
+  }
+  free(p_buf);
+  return i_bytes;
+}
+
+static bool
+build(const char psz_source[], const char psz_image[], unsigned int flags,
+      unsigned int i_threads, bool b_report)
+{
+  iso9660_builder_t *p_builder =
+    iso9660_builder_new("CDROM", NULL, NULL, "LIBCDIO ISOBUILD", flags);
+  uint32_t i_blocks;
+  double d_start, d_scanned, d_planned, d_written;
+  int fd;
+  bool b_ok;
+
+  if (!p_builder) return false;
+  d_start = now();
+  b_ok = iso9660_builder_scan(p_builder, psz_source, i_threads);
+  d_scanned = now();
+  i_blocks = iso9660_builder_get_blocks(p_builder);
+  d_planned = now();
+  if (!i_blocks) {
+    fprintf(stderr, "%s does not fit in an ISO 9660 image\n", psz_source);
+    iso9660_builder_free(p_builder);
+    return false;
+  }
+
+  fd = open(psz_image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(psz_image);
+    iso9660_builder_free(p_builder);
+    return false;
+  }
+  b_ok = iso9660_builder_write(p_builder, fd) && b_ok;
+  fsync(fd);
+  close(fd);
+  d_written = now();
+  iso9660_builder_free(p_builder);
+
+  if (b_report) {
+    uint64_t i_bytes = (uint64_t) i_blocks * ISO_BLOCKSIZE;
+    report("scan", 0, d_scanned - d_start);
+    report("plan", 0, d_planned - d_scanned);
+    report("write", i_bytes, d_written - d_planned);
+    report("build (total)", i_bytes, d_written - d_start);
+  } else {
+    printf("%s: %u blocks\n", psz_image, (unsigned int) i_blocks);
+  }
+  return b_ok;
+}
+
+static int
+benchmark(const char psz_image[], uint64_t i_total, unsigned int i_threads)
+{
+  char psz_dir[1024], psz_copy[1024];
+  char **ppsz_paths = NULL;
+  unsigned int i_files, i;
+  uint64_t i_copied;
+  double d_start;
+  bool b_ok;
+
+  snprintf(psz_dir, sizeof(psz_dir), "%s.tree.XXXXXX", psz_image);
+  snprintf(psz_copy, sizeof(psz_copy), "%s.copy", psz_image);
+  if (!mkdtemp(psz_dir)) {
+    perror(psz_dir);
+    return 1;
+  }
+  printf("Making a %lu MB tree in %s...\n",
+         (long unsigned int) (i_total / MB), psz_dir);
+  i_files = make_tree(psz_dir, i_total, &ppsz_paths);
+  sync();
+  printf("%u files in %u directories\n", i_files,
+         (i_files + FILES_PER_DIR - 1) / FILES_PER_DIR);
+
+  d_start = now();
+  i_copied = copy_files(ppsz_paths, i_files, psz_copy);
+  report("read()/write() copy", i_copied, now() - d_start);
+  unlink(psz_copy);
+
+  b_ok = i_files && build(psz_dir, psz_image,
+                          ISO9660_BUILD_ROCK | ISO9660_BUILD_JOLIET,
+                          i_threads, true);
+
+  for (i = 0; i < i_files; i++) {
+    unlink(ppsz_paths[i]);
+    free(ppsz_paths[i]);
+  }
+  for (i = 0; i < (i_files + FILES_PER_DIR - 1) / FILES_PER_DIR; i++) {
+    char psz_sub[1100];
+    snprintf(psz_sub, sizeof(psz_sub), "%s/dir%04u", psz_dir, i);
+    rmdir(psz_sub);
+  }
+  rmdir(psz_dir);
+  free(ppsz_paths);
+  unlink(psz_image);
+  return b_ok ? 0 : 2;
+}
+
+static void
+usage(const char psz_prog[])
+{
+  fprintf(stderr,
+          "Usage: %s [-R] [-J] [-t THREADS] SOURCE-DIR IMAGE\n"
+          "       %s -b [-s MBYTES] [-t THREADS] IMAGE\n",
+          psz_prog, psz_prog);
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned int flags = 0;
+  unsigned int i_threads = 0;
+  uint64_t i_total = DVD5_BYTES;
+  bool b_bench = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "RJbs:t:")) != -1) {
+    switch (opt) {
+    case 'R': flags |= ISO9660_BUILD_ROCK;   break;
+    case 'J': flags |= ISO9660_BUILD_JOLIET; break;
+    case 'b': b_bench = true;                break;
+    case 's': i_total = (uint64_t) strtoul(optarg, NULL, 10) * MB; break;
+    case 't': i_threads = strtoul(optarg, NULL, 10); break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (b_bench && optind + 1 == argc)
+    return benchmark(argv[optind], i_total, i_threads);
+  if (!b_bench && optind + 2 == argc)
+    return build(argv[optind], argv[optind+1], flags, i_threads, false)
+      ? 0 : 2;
+  usage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,226 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Program to show what choosing the parts of a directory entry to
+   decode with iso9660_ifs_set_decode() saves, and to time it.
+
+     isoscan [-r REPEAT] IMAGE
+
+   reads every directory of IMAGE REPEAT times (default 100) for each
+   set of decode flags and reports the time taken.
+
+     isoscan [-n FILES] [-r REPEAT]
+
+   does the same on a Rock Ridge image like ../test/copying-rr.iso but
+   with FILES files (default 20000), a tenth of them symbolic links,
+   which it builds in the current directory and removes afterwards.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <sys/types.h>
+#include <cdio/cdio.h>
+#include <cdio/iso9660.h>
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#include <sys/time.h>
+
+#define FILES_PER_DIR 100
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+count_entries(const char psz_path[], iso9660_stat_t **pp_entries,
+              unsigned int i_entries, void *p_user_data)
+{
+  *(unsigned long int *) p_user_data += i_entries;
+  return 0;
+}
+
+/* Make a tree of i_files files, FILES_PER_DIR to a directory, every
+   tenth of them a symbolic link, in psz_dir. */
+static bool
+make_tree(const char psz_dir[], unsigned int i_files)
+{
+  unsigned int i;
+
+  for (i = 0; i < i_files; i++) {
+    char psz_path[2048];
+
+    if (0 == i % FILES_PER_DIR) {
+      snprintf(psz_path, sizeof(psz_path), "%s/dir%04u", psz_dir,
+               i / FILES_PER_DIR);
+      mkdir(psz_path, 0755);
+    }
+    snprintf(psz_path, sizeof(psz_path), "%s/dir%04u/file-%06u.txt",
+             psz_dir, i / FILES_PER_DIR, i);
+    if (9 == i % 10) {
+      if (symlink("../dir0000/file-000000.txt", psz_path)) {
+        perror(psz_path);
+        return false;
+      }
+    } else {
+      FILE *p_file = fopen(psz_path, "wb");
+      if (!p_file) {
+        perror(psz_path);
+        return false;
+      }
+      fprintf(p_file, "%u\n", i);
+      fclose(p_file);
+    }
+  }
+  return true;
+}
+
+static void
+remove_tree(const char psz_dir[], unsigned int i_files)
+{
+  unsigned int i;
+
+  for (i = 0; i < i_files; i++) {
+    char psz_path[2048];
+    snprintf(psz_path, sizeof(psz_path), "%s/dir%04u/file-%06u.txt",
+             psz_dir, i / FILES_PER_DIR, i);
+    unlink(psz_path);
+    if (FILES_PER_DIR - 1 == i % FILES_PER_DIR || i + 1 == i_files) {
+      snprintf(psz_path, sizeof(psz_path), "%s/dir%04u", psz_dir,
+               i / FILES_PER_DIR);
+      rmdir(psz_path);
+    }
+  }
+  rmdir(psz_dir);
+}
+
+static bool
+build(const char psz_source[], const char psz_image[])
+{
+  iso9660_builder_t *p_builder =
+    iso9660_builder_new("CDROM", NULL, NULL, "LIBCDIO ISOSCAN",
+                        ISO9660_BUILD_ROCK);
+  bool b_ok;
+  int fd;
+
+  if (!p_builder) return false;
+  b_ok = iso9660_builder_scan(p_builder, psz_source, 1)
+    && iso9660_builder_get_blocks(p_builder);
+  fd = open(psz_image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(psz_image);
+    b_ok = false;
+  } else {
+    b_ok = b_ok && iso9660_builder_write(p_builder, fd);
+    close(fd);
+  }
+  iso9660_builder_free(p_builder);
+  return b_ok;
+}
+
+static int
+scan(const char psz_image[], unsigned int i_repeat)
+{
+  static const struct { const char *psz_name; unsigned int flags; }
+    decodes[] = {
+      { "names",         ISO9660_DECODE_NAME },
+      { "+ attributes",  ISO9660_DECODE_ATTRS },
+      { "+ symlinks",    ISO9660_DECODE_SYMLINK },
+      { "+ times",       ISO9660_DECODE_TIMES },
+      { "everything",    ISO9660_DECODE_ALL }
+    };
+  iso9660_t *p_iso = iso9660_open_ext(psz_image, ISO_EXTENSION_ALL);
+  unsigned int k, i;
+
+  if (!p_iso) {
+    fprintf(stderr, "Sorry, couldn't open %s as an ISO-9660 image\n",
+            psz_image);
+    return 1;
+  }
+
+  for (k = 0; k < sizeof(decodes) / sizeof(decodes[0]); k++) {
+    unsigned long int i_entries = 0;
+    double d_start, d_secs;
+
+    iso9660_ifs_set_decode(p_iso, decodes[k].flags);
+    /* The first walk also fills the directory cache. */
+    iso9660_ifs_walk(p_iso, count_entries, &i_entries, 1, 0);
+    i_entries = 0;
+    d_start = now();
+    for (i = 0; i < i_repeat; i++)
+      iso9660_ifs_walk(p_iso, count_entries, &i_entries, 1, 0);
+    d_secs = now() - d_start;
+    printf("%-14s %8.3f s  %10.0f entries/s\n", decodes[k].psz_name,
+           d_secs, d_secs > 0 ? i_entries / d_secs : 0);
+  }
+  iso9660_close(p_iso);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned int i_files = 20000;
+  unsigned int i_repeat = 100;
+  char psz_dir[] = "isoscan.tree.XXXXXX";
+  const char psz_image[] = "isoscan.iso";
+  int opt, rc;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+    switch (opt) {
+    case 'n': i_files = strtoul(optarg, NULL, 10); break;
+    case 'r': i_repeat = strtoul(optarg, NULL, 10); break;
+    default:
+      fprintf(stderr, "Usage: %s [-n FILES] [-r REPEAT] [IMAGE]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind < argc)
+    return scan(argv[optind], i_repeat);
+
+  if (!mkdtemp(psz_dir)) {
+    perror(psz_dir);
+    return 1;
+  }
+  printf("Building a Rock Ridge image of %u files...\n", i_files);
+  rc = (make_tree(psz_dir, i_files) && build(psz_dir, psz_image))
+    ? scan(psz_image, i_repeat) : 2;
+  remove_tree(psz_dir, i_files);
+  unlink(psz_image);
+  return rc;
+}
@@ -135,8 +135,18 @@ struct cdrom_drive_s {
 		       the flag masks to simulate a particular kind of
 		       failure.    */
 
+  /** Like read_audio, but also sets CDIO_CDDA_C2_SIZE bytes of C2
+      error pointers a sector at p_c2.  NULL, or returning -405, if
+      the drive can't report them. */
+  long (*read_audio_c2)(cdrom_drive_t *d, void *p, uint8_t *p_c2,
+			lsn_t begin, long sectors);
 };
 
+/** The bytes of C2 error pointers of a sector: a bit for each of its
+    bytes, the first byte's in the top bit of the first.  A bit set
+    means the drive could not correct that byte. */
+#define CDIO_CDDA_C2_SIZE (CDIO_CD_FRAMESIZE_RAW/8)
+
 
   /**
      Flags for simulating jitter used in testing.
@@ -153,7 +163,8 @@ struct cdrom_drive_s {
     CDDA_TEST_FRAG_SMALL     = (1<<3),
     CDDA_TEST_FRAG_LARGE     = (2<<3),
     CDDA_TEST_FRAG_MASSIVE   = (3<<3),
-    CDDA_TEST_UNDERRUN       = 64 
+    CDDA_TEST_UNDERRUN       = 64,
+    CDDA_TEST_C2_ERRORS      = 1024
   } paranoia_jitter_t;
   
 /** jitter testing. The first two bits are set to determine the
@@ -175,6 +186,11 @@ struct cdrom_drive_s {
 /**< under-run testing. The below bit is set for testing.  */
 #define CDDA_TEST_UNDERRUN         64 
 
+/**< C2 error testing. Garble bytes of some sectors read, as reading a
+     scratched disc would, and report them in the C2 error pointers of
+     cdio_cddap_read_c2(). */
+#define CDDA_TEST_C2_ERRORS      1024
+
 #if TESTING_IS_FINISHED
 
  /** scratch testing */
@@ -246,6 +262,16 @@ extern int     cdio_cddap_open(cdrom_drive_t *d);
 extern long    cdio_cddap_read(cdrom_drive_t *d, void *p_buffer,
 			       lsn_t beginsector, long sectors);
 
+/*! Read sectors as cdio_cddap_read() does, and their C2 error
+  pointers, CDIO_CDDA_C2_SIZE bytes a sector, into p_c2.
+
+  @return the number of sectors read, or a negative error; -405 if
+  d can't report C2 errors.
+*/
+extern long    cdio_cddap_read_c2(cdrom_drive_t *d, void *p_buffer,
+				  uint8_t *p_c2, lsn_t beginsector,
+				  long sectors);
+
 /*! Return the lsn for the start of track i_track */
 extern lsn_t   cdio_cddap_track_firstsector(cdrom_drive_t *d, 
 				      track_t i_track);
@@ -365,6 +391,7 @@ const char *strerror_tr[]={
 401: Invalid track number
 402: Track not audio data
 403: No audio tracks on disc
+405: Drive does not report C2 errors
 \endverbatim
 
 */
@@ -380,6 +407,7 @@ const char *strerror_tr[]={
 #define cdda_close              cdio_cddap_close
 #define cdda_open               cdio_cddap_open
 #define cdda_read               cdio_cddap_read
+#define cdda_read_c2            cdio_cddap_read_c2
 #define cdda_track_firstsector  cdio_cddap_track_firstsector 
 #define cdda_track_lastsector   cdio_cddap_track_lastsector 
 #define cdda_tracks             cdio_cddap_tracks 
@@ -34,10 +34,17 @@
 /** opaque types... */
 typedef struct _CdioList CdioList_t;
 typedef struct _CdioListNode CdioListNode_t;
+typedef struct _CdioVector CdioVector_t;
 
 typedef int (*_cdio_list_cmp_func_t) (void *p_data1, void *p_data2);
 typedef int (*_cdio_list_iterfunc_t) (void *p_data, void *p_user_data);
 
+/** Compare two elements of a vector, or a search key with an element,
+    as strcmp() does: negative if p_data1 goes before p_data2, 0 if
+    they are equal and positive otherwise. */
+typedef int (*_cdio_vector_cmp_func_t) (const void *p_data1, 
+                                        const void *p_data2);
+
 /** The below are given compatibility with old code. Please use
     the above type names, not these. */
 #define CdioList CdioList_t
@@ -82,6 +89,57 @@ void _cdio_list_node_free (CdioListNode_t *p_node, int i_free_data);
 
 void *_cdio_list_node_data (CdioListNode_t *p_node);
 
+/** vector methods
+
+    A CdioVector_t holds its elements in one growable array, so its
+    length and any element are found in constant time and appending
+    only allocates when the array has to grow. */
+
+CdioVector_t *_cdio_vector_new (void);
+
+/** Free p_vector and, if free_data is set, its elements. */
+void _cdio_vector_free (CdioVector_t *p_vector, int free_data);
+
+unsigned _cdio_vector_length (const CdioVector_t *p_vector);
+
+/** Make room for i_size elements altogether, so that appending up to that
+    many allocates nothing. false is returned if out of memory. */
+bool _cdio_vector_reserve (CdioVector_t *p_vector, unsigned i_size);
+
+/** Add p_data at the end. false is returned if out of memory. */
+bool _cdio_vector_append (CdioVector_t *p_vector, void *p_data);
+
+/** Add p_data before element i, or at the end if i is the length.
+    false is returned if out of memory. */
+bool _cdio_vector_insert (CdioVector_t *p_vector, unsigned i, void *p_data);
+
+/** Remove element i, freeing it if free_data is set. */
+void _cdio_vector_remove (CdioVector_t *p_vector, unsigned i, int free_data);
+
+/** Return element i, or NULL if there is no such element. */
+void *_cdio_vector_get (const CdioVector_t *p_vector, unsigned i);
+
+/** Return the array of elements, _cdio_vector_length() long. It is
+    valid until p_vector is next changed. */
+void **_cdio_vector_data (const CdioVector_t *p_vector);
+
+/** Sort the elements by cmp_func. Equal elements keep their order. */
+void _cdio_vector_sort (CdioVector_t *p_vector, 
+                        _cdio_vector_cmp_func_t cmp_func);
+
+/** Look for p_key in p_vector, which must be sorted by cmp_func;
+    cmp_func is called with p_key first. If pi_index is not NULL, the
+    index of the first element equal to p_key is stored there, or if
+    there is none, the index where p_key would be inserted to keep the
+    order. true is returned if an element equal to p_key was found. */
+bool _cdio_vector_bsearch (const CdioVector_t *p_vector, const void *p_key,
+                           _cdio_vector_cmp_func_t cmp_func,
+                           /*out*/ unsigned *pi_index);
+
+#define _CDIO_VECTOR_FOREACH(i, p_data, vector) \
+ for (i = 0; i < _cdio_vector_length (vector)                 \
+        ? (p_data = _cdio_vector_get (vector, i), 1) : 0; i++)
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -163,6 +163,13 @@ extern const char ISO_STANDARD_ID[sizeof("CD001")-1];
 
 #define ISO_STANDARD_ID      "CD001" 
 
+/*! Maximum number of extents of a multi-extent file (one recorded
+    with several directory records, each but the last flagged
+    ISO_MULTIEXTENT) that iso9660_stat_t keeps track of. Each extent is
+    at most 4 GiB - 1.
+*/
+#define ISO_MAX_MULTIEXTENT 8
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -496,6 +503,12 @@ typedef struct iso9660_svd_s  iso9660_svd_t;
 
 PRAGMA_END_PACKED
 
+/*! One extent of a multi-extent file. */
+typedef struct iso9660_extent_s {
+  lsn_t              lsn;             /**< start logical sector number */
+  uint32_t           size;            /**< bytes in the extent */
+} iso9660_extent_t;
+
 /*! \brief Unix stat-like version of iso9660_dir
 
    The iso9660_stat structure is not part of the ISO-9660
@@ -512,8 +525,18 @@ struct iso9660_stat_s { /* big endian!! */
   struct tm          tm;              /**< time on entry - FIXME merge with
                                          one of entries above, like ctime? */
   lsn_t              lsn;             /**< start logical sector number */
-  uint32_t           size;            /**< total size in bytes */
+  uint32_t           size;            /**< total size in bytes; for a
+                                         multi-extent file, that of the
+                                         first extent */
   uint32_t           secsize;         /**< number of sectors allocated */
+  uint64_t           total_size;      /**< size in bytes over all extents */
+  unsigned int       i_extents;       /**< number of extents, usually 1 */
+  iso9660_extent_t  *p_extents;       /**< the i_extents extents of a
+                                         multi-extent file, kept in the
+                                         same allocation as the entry;
+                                         NULL if lsn and size are the
+                                         only extent. Copy such entries
+                                         with iso9660_stat_dup(). */
   iso9660_xa_t       xa;              /**< XA attributes */
   enum { _STAT_FILE = 1, _STAT_DIR = 2 } type;
   bool               b_xa;
@@ -913,6 +936,37 @@ iso9660_stat_t *iso9660_fs_stat_translate (CdIo_t *p_cdio,
  */
 iso9660_stat_t *iso9660_ifs_stat (iso9660_t *p_iso, const char psz_path[]);
 
+/*!
+  Read up to i_size bytes of the file p_stat into buf, starting
+  i_offset bytes into the file. All extents of a multi-extent file
+  are followed, and whole runs of blocks are read with one request.
+
+  The number of bytes read is returned; it is less than i_size only
+  when the end of the file is reached. -1 is returned on error.
+ */
+long int iso9660_ifs_read_file (iso9660_t *p_iso, 
+                                const iso9660_stat_t *p_stat,
+                                uint64_t i_offset, void *buf, 
+                                long int i_size);
+
+/*!
+  Return a newly allocated copy of p_stat, with its file name and the
+  extents of a multi-extent file but without any Rock Ridge symbolic
+  link name. The copy is freed with free(). NULL is returned if memory
+  could not be allocated.
+ */
+iso9660_stat_t *iso9660_stat_dup (const iso9660_stat_t *p_stat);
+
+/*!
+  Write the contents of the file p_stat to the file descriptor fd at
+  its current position. Where the system allows, the data is copied
+  in the kernel without passing through user space.
+
+  true is returned on success, false on error.
+ */
+bool iso9660_ifs_copy_file (iso9660_t *p_iso, const iso9660_stat_t *p_stat,
+                            int fd);
+
 
 /*!  Return file status for path name psz_path. NULL is returned on
   error.  pathname version numbers in the ISO 9660 name are dropped,
@@ -936,6 +990,184 @@ CdioList_t * iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[],
 */
 CdioList_t * iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[]);
 
+/*!  Same as iso9660_fs_readdir() but the entries are returned in a
+  CdioVector_t, which is cheaper to build and to index than a list.
+  The caller must free the returned result, e.g. with
+  _cdio_vector_free (p_vector, true) after freeing any rr.psz_symlink.
+*/
+CdioVector_t * iso9660_fs_readdir_vector (CdIo_t *p_cdio, 
+                                          const char psz_path[]);
+
+/*!  Same as iso9660_ifs_readdir() but the entries are returned in a
+  CdioVector_t, which is cheaper to build and to index than a list.
+  The caller must free the returned result as for
+  iso9660_fs_readdir_vector().
+*/
+CdioVector_t * iso9660_ifs_readdir_vector (iso9660_t *p_iso, 
+                                           const char psz_path[]);
+
+/** An arena (bump) allocator. iso9660_stat_t's read into an arena are
+    not freed one at a time; everything is released at once when the
+    arena is reset or freed. This is an opaque structure. An arena
+    is not safe to use from more than one thread at a time. */
+typedef struct _iso9660_arena_s iso9660_arena_t;
+
+/*!
+  Create a new arena. i_chunk_size is the size of the first block
+  obtained from malloc(); 0 selects a reasonable default. NULL is
+  returned if memory could not be allocated.
+*/
+iso9660_arena_t *iso9660_arena_new (size_t i_chunk_size);
+
+/*!
+  Allocate i_size bytes from p_arena. The memory is not zeroed.
+*/
+void *iso9660_arena_alloc (iso9660_arena_t *p_arena, size_t i_size);
+
+/*!
+  Allocate i_size zeroed bytes from p_arena.
+*/
+void *iso9660_arena_calloc (iso9660_arena_t *p_arena, size_t i_size);
+
+/*!
+  Release everything allocated from p_arena in O(1). The memory is kept
+  for reuse by later allocations.
+*/
+void iso9660_arena_reset (iso9660_arena_t *p_arena);
+
+/*!
+  Free p_arena and everything allocated from it.
+*/
+void iso9660_arena_free (iso9660_arena_t *p_arena);
+
+/*!  Read the directory described by p_dir (which may come from an
+  earlier call) and return a NULL-terminated array of iso9660_stat_t
+  pointers for the files inside it. If p_dir is NULL, the root
+  directory is read. The number of entries is stored in *pi_entries
+  if pi_entries is not NULL.
+
+  Each entry is laid out in p_arena with its file name inline and
+  rr.psz_symlink, if set, also pointing into p_arena. The caller must
+  not free() the array or the entries; reset or free p_arena instead.
+  NULL is returned on error.
+*/
+iso9660_stat_t **iso9660_ifs_readdir_arena (iso9660_t *p_iso, 
+                                            const iso9660_stat_t *p_dir,
+                                            iso9660_arena_t *p_arena,
+                                            /*out*/ unsigned int *pi_entries);
+
+/*! What directory reads decode besides each entry's name, extents,
+  size and XA attributes, for iso9660_ifs_set_decode(). */
+typedef enum {
+  ISO9660_DECODE_NAME    = 0x00, /**< names, extents and sizes only */
+  ISO9660_DECODE_ATTRS   = 0x01, /**< Rock Ridge mode, links, uid and gid
+                                      (PX) */
+  ISO9660_DECODE_SYMLINK = 0x02, /**< Rock Ridge symbolic link names (SL) */
+  ISO9660_DECODE_TIMES   = 0x04, /**< tm and the Rock Ridge time stamps
+                                      (TF) */
+  ISO9660_DECODE_ALL     = 0x07
+} iso9660_decode_flag_t;
+
+/*!
+  Set what iso9660_ifs_readdir(), iso9660_ifs_readdir_arena(),
+  iso9660_ifs_stat(), iso9660_ifs_walk() and the like fill in for
+  p_iso. flags is a combination of iso9660_decode_flag_t values; the
+  fields of parts left out are zero. A new iso9660_t decodes
+  everything (ISO9660_DECODE_ALL). Callers that only need names and
+  extents save most of the decoding, and the allocation of symbolic
+  link names, with ISO9660_DECODE_NAME.
+*/
+void iso9660_ifs_set_decode (iso9660_t *p_iso, unsigned int flags);
+
+/*!
+  Return the iso9660_decode_flag_t values set for p_iso.
+*/
+unsigned int iso9660_ifs_get_decode (const iso9660_t *p_iso);
+
+/*! Flags for iso9660_ifs_walk(). */
+typedef enum {
+  ISO9660_WALK_ORDERED     = 0x01, /**< call back in depth-first order,
+                                        as a plain recursion would */
+  ISO9660_WALK_TRANSLATE   = 0x02, /**< build paths from translated names
+                                        unless Rock Ridge names exist */
+  ISO9660_WALK_IGNORE_ROCK = 0x04  /**< with ISO9660_WALK_TRANSLATE,
+                                        translate Rock Ridge names too */
+} iso9660_walk_flag_t;
+
+/*!
+  Callback for iso9660_ifs_walk(), called once per directory. psz_path
+  is the directory's path and ends in "/". pp_entries holds its
+  i_entries entries, including "." and "..", or is NULL if the
+  directory could not be read. The entries belong to the walk and
+  must not be freed. Return nonzero to stop the walk.
+*/
+typedef int (*iso9660_walk_callback_t) (const char psz_path[],
+                                        iso9660_stat_t **pp_entries,
+                                        unsigned int i_entries,
+                                        void *p_user_data);
+
+/*!
+  Walk all directories of p_iso, calling callback for each one.
+  Directories are read by up to i_threads threads (0 chooses a number
+  from the processors available) but callback is always run in the
+  calling thread. flags is a combination of iso9660_walk_flag_t values.
+
+  false is returned if the walk was stopped by the callback or a
+  directory could not be read.
+*/
+bool iso9660_ifs_walk (iso9660_t *p_iso, iso9660_walk_callback_t callback,
+                       void *p_user_data, unsigned int i_threads,
+                       unsigned int flags);
+
+/** Builds an ISO 9660 image from a directory tree. This is an opaque
+    structure. */
+typedef struct _iso9660_builder_s iso9660_builder_t;
+
+/*! Flags for iso9660_builder_new(). */
+typedef enum {
+  ISO9660_BUILD_ROCK   = 0x01, /**< record Rock Ridge names, modes,
+                                    times and symbolic links */
+  ISO9660_BUILD_JOLIET = 0x02  /**< add a Joliet (UCS-2) directory tree */
+} iso9660_build_flag_t;
+
+/*!
+  Create a builder for an image with the given volume, publisher,
+  preparer and application IDs; any but psz_volume_id may be NULL.
+  flags is a combination of iso9660_build_flag_t values.
+*/
+iso9660_builder_t *iso9660_builder_new (const char psz_volume_id[],
+                                        const char psz_publisher_id[],
+                                        const char psz_preparer_id[],
+                                        const char psz_application_id[],
+                                        unsigned int flags);
+
+/*!
+  Scan the tree under psz_source, which becomes the root directory of
+  the image, using up to i_threads threads (0 chooses a number from
+  the processors available). Entries that cannot be read or
+  represented are left out with a warning, and false is returned.
+*/
+bool iso9660_builder_scan (iso9660_builder_t *p_builder, 
+                           const char psz_source[], unsigned int i_threads);
+
+/*!
+  Return the size in blocks of the image that iso9660_builder_write()
+  will produce, or 0 if the scanned tree does not fit in an image.
+*/
+uint32_t iso9660_builder_get_blocks (iso9660_builder_t *p_builder);
+
+/*!
+  Write the image to fd, starting at its current position. File data
+  is copied directly from the source files. Return true if the whole
+  image was written.
+*/
+bool iso9660_builder_write (iso9660_builder_t *p_builder, int fd);
+
+/*!
+  Free p_builder and everything it holds.
+*/
+void iso9660_builder_free (iso9660_builder_t *p_builder);
+
 /*!
   Return the PVD's application ID.
   NULL is returned if there is some problem in getting this. 
@@ -56,6 +56,14 @@ typedef enum  {
 				      maxretries) */
   PARANOIA_MODE_FULL      =  0xff, /**< Maximum paranoia - all of the above 
 				        (except disable) */
+  PARANOIA_MODE_TESTCOPY  = 0x100, /**< With VERIFY, read twice in bursts
+				      and compare, verifying by overlap
+				      only where the reads differ. Not
+				      part of FULL */
+  PARANOIA_MODE_C2        = 0x200, /**< Read C2 error pointers, if the
+				      drive has them, and take what it
+				      read without errors as verified.
+				      Not part of FULL */
 } paranoia_mode_t;
   
 
@@ -83,6 +91,65 @@ typedef enum  {
   PARANOIA_CB_READERR         /**< Hard read error */
 } paranoia_cb_mode_t;
 
+/**
+  The kinds of memory a paranoia object keeps for reuse, for
+  paranoia_pool_stats().
+*/
+typedef enum  {
+  PARANOIA_POOL_BUFFERS,      /**< samples of reads */
+  PARANOIA_POOL_FLAGS,        /**< flags of the samples of reads */
+  PARANOIA_POOL_NODES         /**< blocks, fragments and list elements */
+} paranoia_pool_kind_t;
+
+/**
+  How a paranoia object has come by the memory of one kind it used.
+*/
+typedef struct cdio_paranoia_pool_stats_s {
+  unsigned long i_allocs;     /**< pieces got from malloc() */
+  unsigned long i_reuses;     /**< pieces used again */
+  unsigned long i_free;       /**< pieces kept for reuse just now */
+  size_t i_size;              /**< bytes in a piece */
+} cdio_paranoia_pool_stats_t;
+
+/**
+  Checksums of the audio of one track, summed as it is read: a CRC32
+  of its bytes as a WAV file has them, and the checksums AccurateRip
+  keeps for it. Set up with cdio_paranoia_checksum_init().
+*/
+typedef struct cdio_paranoia_checksum_s {
+  uint32_t i_crc32;           /**< CRC32, as zlib's crc32(), of all of it */
+  uint32_t i_ar_v1;           /**< AccurateRip v1 checksum */
+  uint32_t i_ar_v2;           /**< AccurateRip v2 checksum */
+  uint32_t i_samples;         /**< stereo samples summed so far */
+  /* The rest is private. */
+  uint32_t i_ar_hi;           /**< high halves of the AccurateRip products */
+  uint32_t i_ar_from;         /**< first sample AccurateRip counts, from 1 */
+  uint32_t i_ar_to;           /**< last sample AccurateRip counts */
+} cdio_paranoia_checksum_t;
+
+/**
+  What AccurateRip knows a disc by, from its table of contents.
+*/
+typedef struct cdio_paranoia_accuraterip_id_s {
+  track_t  i_tracks;          /**< audio tracks */
+  uint32_t i_id1;             /**< sum of the audio track offsets */
+  uint32_t i_id2;             /**< sum of the offsets by track number */
+  uint32_t i_cddb;            /**< CDDB (freedb) disc ID */
+} cdio_paranoia_accuraterip_id_t;
+
+/**
+  Where a paranoia object is reading and what it has learned of the
+  jitter and drift of the drive, to carry on from in another run with
+  cdio_paranoia_resume().
+*/
+typedef struct cdio_paranoia_state_s {
+  lsn_t i_cursor;             /**< the next sector to be returned */
+  long i_dyndrift;            /**< drift made up for, in samples */
+  long i_dynoverlap;          /**< overlap of reads, in samples */
+  long i_stage1[6];           /**< offsets seen by stage 1 (private) */
+  long i_stage2[6];           /**< offsets seen by stage 2 (private) */
+} cdio_paranoia_state_t;
+
   extern const char *paranoia_cb_mode2str[];
   
 #ifdef __cplusplus
@@ -167,12 +234,145 @@ extern "C" {
 					     int max_retries);
 
 
+  /*!
+    Read the next sectors of verified audio into a buffer of the
+    caller's.  The first sector is read as cdio_paranoia_read_limited()
+    reads it, going to the drive if need be; the rest only as far as
+    paranoia has already verified them.  So a call returns at least
+    one sector but often many, with one copy rather than a call each.
+    @param p paranoia object.
+    @param p_buffer where to put the sectors, room for i_sectors
+    sectors of CDIO_CD_FRAMESIZE_RAW bytes.
+    @param i_sectors the most sectors to read.
+    @param callback callback routine which gets called with the status
+    on each read.
+    @param max_retries number of times to try re-reading a block before
+    failing.
+    @return the number of sectors read, or 0 if i_sectors is 0 or the
+    first sector could not be read.
+    @see cdio_paranoia_read_limited.
+  */
+  extern long cdio_paranoia_read_range(cdrom_paranoia_t *p,
+				       int16_t *p_buffer, long i_sectors,
+				       void(*callback)(long int,
+						       paranoia_cb_mode_t),
+				       int max_retries);
+
 /*! a temporary hack */
   extern void cdio_paranoia_overlapset(cdrom_paranoia_t *p,long overlap);
 
   extern void cdio_paranoia_set_range(cdrom_paranoia_t *p, long int start, 
 				      long int end);
 
+  /*!
+    Turn pipelined reading on or off.  It is off to start with.
+
+    Pipelined, the next block of sectors is read on another thread
+    while the last one is verified, which can save a good part of the
+    time a slow drive takes.  The sectors read and the audio returned
+    are the same as without pipelining, but messages of the drive may
+    come a read earlier.  The drive must not be used from the callback
+    of cdio_paranoia_read().
+
+    @param p paranoia object.
+
+    @param b_pipeline true to turn pipelining on, false to turn it off.
+
+    @return false if pipelining was asked for but libcdio was built
+    without threads, true otherwise.
+  */
+  extern bool cdio_paranoia_set_pipeline(cdrom_paranoia_t *p,
+					 bool b_pipeline);
+
+  /*!
+    Get where p is reading and what it has learned of the drive, for
+    a rip cut short to carry on from later.  Take it between reads:
+    all the sectors before i_cursor have been returned.
+    @param p paranoia object.
+    @param p_state where to put it.
+    @see cdio_paranoia_resume.
+  */
+  extern void cdio_paranoia_get_state(const cdrom_paranoia_t *p,
+				      cdio_paranoia_state_t *p_state);
+
+  /*!
+    Carry on reading where cdio_paranoia_get_state() left off, maybe
+    in another run: seek to the sector after the last one returned and
+    take up the drift and jitter learned till then.  Paranoia verifies
+    the sectors from there on as it would have, without reading again
+    those before.
+    @param p paranoia object, set up as the one p_state came from.
+    @param p_state what cdio_paranoia_get_state() gave.
+    @return the sector read next, or -1 if it is not on the disc.
+  */
+  extern lsn_t cdio_paranoia_resume(cdrom_paranoia_t *p,
+				    const cdio_paranoia_state_t *p_state);
+
+  /*!
+    Get counts of how p has come by the memory of one kind, for
+    profiling.  The memory of the blocks read and verified is kept and
+    used again rather than freed, so once reading is under way
+    i_allocs should stay put while i_reuses grows.
+    @param p paranoia object.
+    @param kind which memory to count.
+    @param p_stats where to put the counts.
+  */
+  extern void cdio_paranoia_pool_stats(const cdrom_paranoia_t *p,
+				       paranoia_pool_kind_t kind,
+				       cdio_paranoia_pool_stats_t *p_stats);
+
+  /*!
+    Start summing the checksums of a track.
+    @param p_sum the checksums.
+    @param i_sectors the length of the track.
+    @param b_first_track true if the track is the first audio track of
+    the disc, whose first 5 sectors, but one sample, AccurateRip leaves
+    out.
+    @param b_last_track true if the track is the last audio track of
+    the disc, whose last 5 sectors AccurateRip leaves out.
+  */
+  extern void cdio_paranoia_checksum_init(cdio_paranoia_checksum_t *p_sum,
+					  long i_sectors, bool b_first_track,
+					  bool b_last_track);
+
+  /*!
+    Add the next samples of a track to its checksums, in the order of
+    this host as cdio_paranoia_read() returns them.  They may come a
+    sector or many at a time, or in other pieces of whole stereo
+    samples.
+    @param p_sum the checksums.
+    @param p_samples the samples.
+    @param i_words how many 16-bit samples there are, an even number:
+    CD_FRAMEWORDS for a sector.
+  */
+  extern void cdio_paranoia_checksum_add(cdio_paranoia_checksum_t *p_sum,
+					 const int16_t *p_samples,
+					 long i_words);
+
+  /*!
+    Update a CRC32 with some bytes.  It is the CRC32 of
+    cdio_paranoia_checksum_t and zlib's crc32(), summed as fast.
+    @param i_crc the CRC32 of the bytes before, 0 to start with.
+    @param p_buf the bytes.
+    @param i_bytes how many there are.
+    @return the CRC32 of all of them.
+  */
+  extern uint32_t cdio_paranoia_crc32(uint32_t i_crc, const void *p_buf,
+				      long i_bytes);
+
+  /*!
+    Work out what AccurateRip knows the disc in d by from its table of
+    contents.  Its database has the checksums of a disc at
+    http://www.accuraterip.com/accuraterip/a/b/c/dBAR-ttt-id1-id2-cddb.bin,
+    where c, b and a are the last three hex digits of id1 and ttt is
+    the number of audio tracks.
+    @param d the open drive.
+    @param p_id where to put the identification.
+    @return 0, or -1 if the disc has no audio tracks or is not open.
+  */
+  extern int cdio_paranoia_accuraterip_id(cdrom_drive_t *d,
+					  cdio_paranoia_accuraterip_id_t *p_id);
+
 #ifndef DO_NOT_WANT_PARANOIA_COMPATIBILITY
 /** For compatibility with good ol' paranoia */
 #define cdrom_paranoia        cdrom_paranoia_t
@@ -182,8 +382,17 @@ extern "C" {
 #define paranoia_seek         cdio_paranoia_seek
 #define paranoia_read         cdio_paranoia_read
 #define paranoia_read_limited cdio_paranoia_read_limited
+#define paranoia_read_range   cdio_paranoia_read_range
 #define paranoia_overlapset   cdio_paranoia_overlapset
 #define paranoia_set_range    cdio_paranoia_set_range
+#define paranoia_set_pipeline cdio_paranoia_set_pipeline
+#define paranoia_pool_stats   cdio_paranoia_pool_stats
+#define paranoia_get_state    cdio_paranoia_get_state
+#define paranoia_resume       cdio_paranoia_resume
+#define paranoia_checksum_init cdio_paranoia_checksum_init
+#define paranoia_checksum_add  cdio_paranoia_checksum_add
+#define paranoia_crc32         cdio_paranoia_crc32
+#define paranoia_accuraterip_id cdio_paranoia_accuraterip_id
 #endif /*DO_NOT_WANT_PARANOIA_COMPATIBILITY*/
 
 #ifdef __cplusplus
@@ -370,9 +370,23 @@ int get_rock_ridge_filename(iso9660_dir_t * de, /*out*/ char * retname,
   property is not allowed for a group or user but the corresponding
   group/user is set "S" indicates this. If none of these properties
   holds the "-" indicates this.
+
+  The string is in a buffer of the library's, one of 16 that each
+  thread cycles through, so it is good until the calling thread has
+  made 16 more such calls.
 */
 const char *iso9660_get_rock_attr_str(posix_mode_t st_mode);
 
+/*! Size of the buffer for iso9660_get_rock_attr_str_r(). */
+#define ISO9660_ROCK_ATTR_STR_SIZE sizeof("drwxrwxrwx")
+
+/*!
+  Like iso9660_get_rock_attr_str() but puts the string in result,
+  which it returns. Any number of threads may call this at once.
+*/
+char *iso9660_get_rock_attr_str_r(posix_mode_t st_mode, 
+                                  char result[ISO9660_ROCK_ATTR_STR_SIZE]);
+
 /** These variables are not used, but are defined to facilatate debugging
     by letting us use enumerations values (which also correspond to 
     \#define's inside a debugged program.
@@ -79,6 +79,9 @@ extern "C" {
      
      If there is an error, cast the result to driver_return_code_t for 
      the specific error code.
+
+     The position is shared by all files of the udf_t, so files can't
+     be read interleaved this way; use udf_file_open() for that.
   */
   /**
     Attempts to read up to count bytes from file descriptor fd into
@@ -90,6 +93,49 @@ extern "C" {
   ssize_t udf_read_block(const udf_dirent_t *p_udf_dirent, 
 			 void * buf, size_t count);
 
+  /**
+    Open the file given by p_udf_dirent for reading. The handle
+    carries its own file position, which starts at 0, and keeps what
+    it needs of p_udf_dirent, so that can be advanced with
+    udf_readdir() or freed while the file stays open. Any number of
+    files on one udf_t may be open at once. NULL is returned on error.
+
+    Caller must free result - use udf_file_close for that.
+  */
+  udf_file_t *udf_file_open(const udf_dirent_t *p_udf_dirent);
+
+  /**
+    Attempts to read up to count bytes at byte offset i_offset of
+    p_udf_file into buf, like pread(2). The position of p_udf_file is
+    neither used nor changed, so several threads may read through
+    the same handle, or through different handles on the same udf_t,
+    at once. When the image can't be read without seeking, those
+    reads are serialized.
+
+    Returns the number of bytes read, which is less than count only at
+    end of file, or a negative driver_return_code_t on error.
+  */
+  ssize_t udf_pread(const udf_file_t *p_udf_file, void *buf, size_t count,
+		    off_t i_offset);
+
+  /**
+    Like udf_pread() but reads at the position of p_udf_file and
+    advances it by the number of bytes read.
+  */
+  ssize_t udf_file_read(udf_file_t *p_udf_file, void *buf, size_t count);
+
+  /**
+    Set the position of p_udf_file to i_offset relative to whence
+    (SEEK_SET, SEEK_CUR or SEEK_END), like lseek(2). The new position
+    is returned, or a negative driver_return_code_t on error.
+  */
+  off_t udf_file_seek(udf_file_t *p_udf_file, off_t i_offset, int whence);
+
+  /**
+    free resources associated with p_udf_file.
+  */
+  bool udf_file_close(udf_file_t *p_udf_file);
+
   /**
     Advances p_udf_direct to the the next directory entry in the
     pointed to by p_udf_dir. It also returns this as the value.  NULL
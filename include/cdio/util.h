@@ -100,6 +100,17 @@ uint8_t cdio_to_bcd8(uint8_t n);
 uint8_t cdio_from_bcd8(uint8_t p);
 
 void cdio_follow_symlink (const char * src, char * dst);
+
+/*!
+  Update a CRC-32 (ISO 3309, the CRC of zip, gzip and zlib's crc32())
+  with some bytes.
+
+  @param i_crc the CRC-32 of the bytes before, 0 to start with.
+  @param p_buf the bytes.
+  @param i_bytes how many there are.
+  @return the CRC-32 of all of them.
+*/
+uint32_t cdio_crc32 (uint32_t i_crc, const void *p_buf, size_t i_bytes);
   
 #ifdef __cplusplus
 }
@@ -141,9 +141,24 @@ typedef struct iso9660_xa_s
   allowed to be listed or "searched".
   The second character of a pair (7, 9, 11) is "r" if the entry is allowed
   to be read. 
+
+  The string is in a buffer of the library's, one of 16 that each
+  thread cycles through, so it is good until the calling thread has
+  made 16 more such calls.
 */
 const char *
 iso9660_get_xa_attr_str (uint16_t xa_attr);
+
+/*! Size of the buffer for iso9660_get_xa_attr_str_r(). */
+#define ISO9660_XA_ATTR_STR_SIZE sizeof("d---1xrxrxr")
+
+/*!
+  Like iso9660_get_xa_attr_str() but puts the string in result, which
+  it returns. Any number of threads may call this at once.
+*/
+char *
+iso9660_get_xa_attr_str_r (uint16_t xa_attr, 
+                           char result[ISO9660_XA_ATTR_STR_SIZE]);
   
 /*! 
   Allocates and initalizes a new iso9600_xa_t variable and returns
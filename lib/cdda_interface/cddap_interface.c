@@ -32,6 +32,7 @@
 #include "common_interface.h"
 #include "low_interface.h"
 #include "utils.h"
+#include <cdio/mmc.h>
 
 /** The below variables are trickery to force the above enum symbol
     values to be recorded in debug symbol tables. They are used to
@@ -221,12 +222,48 @@ jitter_read (cdrom_drive_t *d, void *p, lsn_t begin, long i_sectors,
   return(i_sectors);
 }
 
+/* A number from 0 to i_range-1. */
+static long
+test_random(long i_range)
+{
+#ifdef HAVE_DRAND48
+  return (long)(drand48()*i_range);
+#else
+  return (long)(rand()/(RAND_MAX+1.0)*i_range);
+#endif
+}
+
+/* Garble a run of bytes in about one sector in eight read, differently
+   each time, and set their C2 error pointers, as a drive would
+   reading a scratch, if p_c2 is not NULL.  For CDDA_TEST_C2_ERRORS. */
+static void
+test_c2_errors(uint8_t *p, uint8_t *p_c2, long i_sectors)
+{
+  long i;
+
+  if (p_c2) memset(p_c2, 0, i_sectors*CDIO_CDDA_C2_SIZE);
+  for (i=0; i<i_sectors; i++) {
+    long j, n;
+
+    if (test_random(8)) continue;
+    j = i*CDIO_CD_FRAMESIZE_RAW + test_random(CDIO_CD_FRAMESIZE_RAW);
+    n = 1 + test_random(600);
+    if (n > (i+1)*CDIO_CD_FRAMESIZE_RAW - j)
+      n = (i+1)*CDIO_CD_FRAMESIZE_RAW - j;
+    for (; n>0; j++, n--) {
+      p[j] ^= 1 + test_random(255);
+      if (p_c2) p_c2[j/8] |= 0x80 >> (j%8);
+    }
+  }
+}
+
 /* read 'i_sector' adjacent audio sectors
- * into buffer '*p' beginning at sector 'begin'
+ * into buffer '*p' beginning at sector 'begin', with the under-run
+ * and jitter the test flags ask for, if any.
  */
 
 static long int
-cddap_read (cdrom_drive_t *d, void *p, lsn_t begin, long i_sectors)
+read_sectors (cdrom_drive_t *d, void *p, lsn_t begin, long i_sectors)
 {
   jitter_baddness_t jitter_badness = d->i_test_flags & 0x3;
 
@@ -246,6 +283,92 @@ cddap_read (cdrom_drive_t *d, void *p, lsn_t begin, long i_sectors)
   
 }
 
+/* read 'i_sector' adjacent audio sectors
+ * into buffer '*p' beginning at sector 'begin'
+ */
+
+static long int
+cddap_read (cdrom_drive_t *d, void *p, lsn_t begin, long i_sectors)
+{
+  i_sectors = read_sectors(d, p, begin, i_sectors);
+  if (i_sectors > 0 && (d->i_test_flags & CDDA_TEST_C2_ERRORS))
+    test_c2_errors(p, NULL, i_sectors);
+  return(i_sectors);
+}
+
+/* read 'i_sector' adjacent audio sectors into buffer '*p' beginning
+ * at sector 'begin', garbling some as CDDA_TEST_C2_ERRORS asks, and
+ * flag those bytes in 'p_c2'.
+ */
+
+static long int
+test_read_c2 (cdrom_drive_t *d, void *p, uint8_t *p_c2, lsn_t begin,
+	      long i_sectors)
+{
+  i_sectors = read_sectors(d, p, begin, i_sectors);
+  if (i_sectors > 0)
+    test_c2_errors(p, p_c2, i_sectors);
+  return(i_sectors);
+}
+
+/* read 'i_sector' adjacent audio sectors into buffer '*p' beginning
+ * at sector 'begin', and their C2 error pointers into 'p_c2'.  The
+ * drive sends each sector's pointers right after its samples.
+ */
+
+static long int
+cddap_read_c2 (cdrom_drive_t *d, void *p, uint8_t *p_c2, lsn_t begin,
+	       long i_sectors)
+{
+  const uint16_t i_blocksize = CDIO_CD_FRAMESIZE_RAW + CDIO_CDDA_C2_SIZE;
+  uint8_t *p_buf;
+  long i;
+
+  if (d->i_test_flags & CDDA_TEST_C2_ERRORS)
+    return test_read_c2(d, p, p_c2, begin, i_sectors);
+
+  i_sectors = ( i_sectors > d->nsectors && d->nsectors > 0 ) 
+    ? d->nsectors : i_sectors;
+
+  p_buf = malloc(i_blocksize*i_sectors);
+  if (!p_buf || DRIVER_OP_SUCCESS != 
+      mmc_read_cd(d->p_cdio, p_buf, begin, CDIO_MMC_READ_TYPE_CDDA, 
+		  false, false, 0, true, false, 
+		  1 /* C2 error pointers */, 0, i_blocksize, i_sectors)) {
+    /* Read them without, with every byte counted as an error.  Paranoia
+       will verify them as it would have without C2 error pointers. */
+    free(p_buf);
+    i_sectors = read_blocks(d, p, begin, i_sectors);
+    if (i_sectors > 0)
+      memset(p_c2, 0xff, i_sectors*CDIO_CDDA_C2_SIZE);
+    return(i_sectors);
+  }
+
+  for (i=0; i<i_sectors; i++) {
+    memcpy((char *)p + i*CDIO_CD_FRAMESIZE_RAW, p_buf + i*i_blocksize, 
+	   CDIO_CD_FRAMESIZE_RAW);
+    memcpy(p_c2 + i*CDIO_CDDA_C2_SIZE, 
+	   p_buf + i*i_blocksize + CDIO_CD_FRAMESIZE_RAW, CDIO_CDDA_C2_SIZE);
+  }
+  free(p_buf);
+  return(i_sectors);
+}
+
+/* read_audio_c2 of a drive that can't report C2 errors: only the
+ * simulated ones of CDDA_TEST_C2_ERRORS.
+ */
+
+static long int
+cddap_read_no_c2 (cdrom_drive_t *d, void *p, uint8_t *p_c2, lsn_t begin,
+		  long i_sectors)
+{
+  if (d->i_test_flags & CDDA_TEST_C2_ERRORS)
+    return test_read_c2(d, p, p_c2, begin, i_sectors);
+
+  cderror(d,"405: Drive does not report C2 errors\n");
+  return(-405);
+}
+
 static int 
 verify_read_command(cdrom_drive_t *d)
 {
@@ -386,6 +509,19 @@ cddap_init_drive (cdrom_drive_t *d)
   d->read_toc    = cddap_readtoc;
   d->read_audio  = cddap_read;
 
+  {
+    cdio_drive_read_cap_t  i_read_cap;
+    cdio_drive_write_cap_t i_write_cap;
+    cdio_drive_misc_cap_t  i_misc_cap;
+
+    cdio_get_drive_cap(d->p_cdio, &i_read_cap, &i_write_cap, &i_misc_cap);
+    if ( !(i_read_cap & (CDIO_DRIVE_CAP_ERROR|CDIO_DRIVE_CAP_UNKNOWN))
+	 && (i_read_cap & CDIO_DRIVE_CAP_READ_C2_ERRS) )
+      d->read_audio_c2 = cddap_read_c2;
+    else
+      d->read_audio_c2 = cddap_read_no_c2;
+  }
+
   ret = d->tracks = d->read_toc(d);
   if(d->tracks<1)
     return(ret);
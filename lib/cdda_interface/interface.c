@@ -133,6 +133,29 @@ cdio_cddap_speed_set(cdrom_drive_t *d, int speed)
   return d->set_speed ? d->set_speed(d, speed) : 0;
 }
 
+/* Put the samples of sectors read into the order this host wants, and
+   with them the bits of their bytes in the C2 error pointers p_c2, if
+   any. */
+static void
+swap_read(cdrom_drive_t *d, void *buffer, uint8_t *p_c2, long sectors)
+{
+  if ( d->bigendianp == -1 ) /* not determined yet */
+    d->bigendianp = data_bigendianp(d);
+
+  if ( d->b_swap_bytes && d->bigendianp != bigendianp() ) {
+    int i;
+    uint16_t *p=(uint16_t *)buffer;
+    long els=sectors*CDIO_CD_FRAMESIZE_RAW/2;
+	  
+    for(i=0;i<els;i++)
+      p[i]=UINT16_SWAP_LE_BE_C(p[i]);
+
+    if (p_c2)
+      for(i=0;i<sectors*CDIO_CDDA_C2_SIZE;i++)
+	p_c2[i]=((p_c2[i]&0xaa)>>1)|((p_c2[i]&0x55)<<1);
+  }
+}
+
 long 
 cdio_cddap_read(cdrom_drive_t *d, void *buffer, lsn_t beginsector, 
 		long sectors)
@@ -140,21 +163,27 @@ cdio_cddap_read(cdrom_drive_t *d, void *buffer, lsn_t beginsector,
   if (d->opened) {
     if (sectors>0) {
       sectors=d->read_audio(d, buffer, beginsector, sectors);
+      if (sectors > 0) swap_read(d, buffer, NULL, sectors);
+    }
+    return(sectors);
+  }
+  
+  cderror(d,"400: Device not open\n");
+  return(-400);
+}
 
-      if (sectors > 0) {
-	/* byteswap? */
-	if ( d->bigendianp == -1 ) /* not determined yet */
-	  d->bigendianp = data_bigendianp(d);
-
-	if ( d->b_swap_bytes && d->bigendianp != bigendianp() ) {
-	  int i;
-	  uint16_t *p=(uint16_t *)buffer;
-	  long els=sectors*CDIO_CD_FRAMESIZE_RAW/2;
-	  
-	  for(i=0;i<els;i++)
-	    p[i]=UINT16_SWAP_LE_BE_C(p[i]);
-	}
+long 
+cdio_cddap_read_c2(cdrom_drive_t *d, void *buffer, uint8_t *p_c2,
+		   lsn_t beginsector, long sectors)
+{
+  if (d->opened) {
+    if (sectors>0) {
+      if (!d->read_audio_c2) {
+	cderror(d,"405: Drive does not report C2 errors\n");
+	return(-405);
       }
+      sectors=d->read_audio_c2(d, buffer, p_c2, beginsector, sectors);
+      if (sectors > 0) swap_read(d, buffer, p_c2, sectors);
     }
     return(sectors);
   }
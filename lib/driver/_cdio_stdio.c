@@ -173,6 +173,44 @@ _stdio_read(void *user_data, void *buf, long int count)
   return read;
 }
 
+#ifdef HAVE_PREAD
+/*!
+  Like pread(2). Read count bytes at offset i_offset from the file
+  underneath the stdio stream without disturbing its position. The
+  image is only read, so bypassing the stdio buffer is harmless.
+ */
+static long
+_stdio_pread(void *user_data, void *buf, long int count, off_t i_offset)
+{
+  _UserData *const ud = user_data;
+  const int fd = fileno(ud->fd);
+  long i_read = 0;
+
+  while (i_read < count) {
+    ssize_t ret = pread(fd, (char *) buf + i_read, count - i_read, 
+                        i_offset + i_read);
+    if (ret < 0) {
+      if (EINTR == errno) continue;
+      cdio_error ("pread (): %s", strerror (errno));
+      break;
+    }
+    if (0 == ret) {
+      cdio_debug ("pread (): EOF encountered");
+      break;
+    }
+    i_read += ret;
+  }
+  return i_read;
+}
+#endif /*HAVE_PREAD*/
+
+static int
+_stdio_get_fd(void *user_data)
+{
+  _UserData *const ud = user_data;
+  return ud->fd ? fileno(ud->fd) : -1;
+}
+
 /*!
   Deallocate resources assocaited with obj. After this obj is unusable.
 */
@@ -186,7 +224,8 @@ CdioDataSource_t *
 cdio_stdio_new(const char pathname[])
 {
   CdioDataSource_t *new_obj = NULL;
-  cdio_stream_io_functions funcs = { NULL, NULL, NULL, NULL, NULL, NULL };
+  cdio_stream_io_functions funcs = { NULL, NULL, NULL, NULL, NULL, NULL, 
+                                     NULL, NULL };
   _UserData *ud = NULL;
   struct stat statbuf;
   
@@ -208,6 +247,10 @@ cdio_stdio_new(const char pathname[])
   funcs.read   = _stdio_read;
   funcs.close  = _stdio_close;
   funcs.free   = _stdio_free;
+  funcs.get_fd = _stdio_get_fd;
+#ifdef HAVE_PREAD
+  funcs.pread  = _stdio_pread;
+#endif
 
   new_obj = cdio_stream_new(ud, &funcs);
 
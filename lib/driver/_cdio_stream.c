@@ -154,6 +154,37 @@ cdio_stream_read(CdioDataSource_t* p_obj, void *ptr, long size, long nmemb)
   return read_bytes;
 }
 
+/**
+  Like pread(2): read size*nmemb bytes at byte i_offset without using
+  or changing the stream position.
+
+  @return the number of bytes read, or DRIVER_OP_UNSUPPORTED if the
+  underlying data source has no positional read.
+*/
+ssize_t
+cdio_stream_pread(CdioDataSource_t* p_obj, void *ptr, long size, long nmemb,
+                  off_t i_offset)
+{
+  if (!p_obj) return 0;
+  if (!p_obj->op.pread) return DRIVER_OP_UNSUPPORTED;
+  if (!_cdio_stream_open_if_necessary(p_obj)) return 0;
+  if (i_offset < 0) return DRIVER_OP_ERROR;
+  return (p_obj->op.pread)(p_obj->user_data, ptr, size*nmemb, i_offset);
+}
+
+/**
+  Return the file descriptor underneath the stream, or -1 if there
+  is none.
+*/
+int
+cdio_stream_get_fd(CdioDataSource_t* p_obj)
+{
+  if (!p_obj) return -1;
+  if (!p_obj->op.get_fd) return -1;
+  if (!_cdio_stream_open_if_necessary(p_obj)) return -1;
+  return (p_obj->op.get_fd)(p_obj->user_data);
+}
+
 /**
   Like 3 fseek and in fact may be the same.
   
@@ -43,6 +43,11 @@ extern "C" {
   typedef int(*cdio_data_close_t)(void *user_data);
   
   typedef void(*cdio_data_free_t)(void *user_data);
+
+  typedef long(*cdio_data_pread_t)(void *user_data, void *buf, long count,
+                                   off_t offset);
+
+  typedef int(*cdio_data_get_fd_t)(void *user_data);
   
   
   /* abstract data source */
@@ -54,6 +59,8 @@ extern "C" {
     cdio_data_read_t read;
     cdio_data_close_t close;
     cdio_data_free_t free;
+    cdio_data_pread_t pread; /* optional; NULL if not supported */
+    cdio_data_get_fd_t get_fd; /* optional; NULL if not backed by a file */
   } cdio_stream_io_functions;
   
   /**
@@ -90,6 +97,28 @@ extern "C" {
   */
   ssize_t cdio_stream_read(CdioDataSource_t* p_obj, void *ptr, long i_size, 
                            long nmemb);
+
+  /**
+    Read i_size * nmemb bytes starting at byte i_offset without using
+    or changing the stream position, like pread(2). Since no position
+    is shared, several threads may call this on the same stream at
+    once, provided the stream has already been opened (any read or
+    seek does that).
+
+    @return the number of bytes read, or DRIVER_OP_UNSUPPORTED if the
+    stream has no positional read. In the latter case use
+    cdio_stream_seek() and cdio_stream_read() instead.
+  */
+  ssize_t cdio_stream_pread(CdioDataSource_t* p_obj, void *ptr, long i_size, 
+                            long nmemb, off_t i_offset);
+
+  /**
+    Return the file descriptor of the file underneath the stream, for
+    use with pread(2) or copy_file_range(2), or -1 if the stream isn't
+    backed by one. The descriptor belongs to the stream: don't close
+    it or move its file position.
+  */
+  int cdio_stream_get_fd(CdioDataSource_t* p_obj);
   
   /** 
     Like fseek(3) and in fact may be the same.
@@ -49,6 +49,14 @@ struct _CdioListNode
   void *data;
 };
 
+struct _CdioVector
+{
+  unsigned length;
+  unsigned size;                /* elements allocated */
+
+  void **data;
+};
+
 /* impl */
 
 CdioList_t *
@@ -238,6 +246,247 @@ _cdio_list_node_data (CdioListNode_t *p_node)
   return NULL;
 }
 
+/* vector */
+
+CdioVector_t *
+_cdio_vector_new (void)
+{
+  return calloc (1, sizeof (CdioVector_t));
+}
+
+void
+_cdio_vector_free (CdioVector_t *p_vector, int free_data)
+{
+  if (!p_vector)
+    return;
+
+  if (free_data)
+    {
+      unsigned i;
+      for (i = 0; i < p_vector->length; i++)
+        free (p_vector->data[i]);
+    }
+
+  free (p_vector->data);
+  free (p_vector);
+}
+
+unsigned
+_cdio_vector_length (const CdioVector_t *p_vector)
+{
+  cdio_assert (p_vector != NULL);
+
+  return p_vector->length;
+}
+
+bool
+_cdio_vector_reserve (CdioVector_t *p_vector, unsigned i_size)
+{
+  void **data;
+
+  cdio_assert (p_vector != NULL);
+
+  if (i_size <= p_vector->size)
+    return true;
+
+  data = realloc (p_vector->data, i_size * sizeof (void *));
+  if (!data)
+    return false;
+
+  p_vector->data = data;
+  p_vector->size = i_size;
+  return true;
+}
+
+/* Make room for one more element, doubling the array when it is full
+   so that appending n elements costs O(n) altogether. */
+static bool
+_cdio_vector_grow (CdioVector_t *p_vector)
+{
+  if (p_vector->length < p_vector->size)
+    return true;
+
+  return _cdio_vector_reserve (p_vector, 
+                               p_vector->size ? 2 * p_vector->size : 16);
+}
+
+bool
+_cdio_vector_append (CdioVector_t *p_vector, void *p_data)
+{
+  cdio_assert (p_vector != NULL);
+
+  if (!_cdio_vector_grow (p_vector))
+    return false;
+
+  p_vector->data[p_vector->length++] = p_data;
+  return true;
+}
+
+bool
+_cdio_vector_insert (CdioVector_t *p_vector, unsigned i, void *p_data)
+{
+  cdio_assert (p_vector != NULL);
+  cdio_assert (i <= p_vector->length);
+
+  if (!_cdio_vector_grow (p_vector))
+    return false;
+
+  memmove (&p_vector->data[i + 1], &p_vector->data[i], 
+           (p_vector->length - i) * sizeof (void *));
+  p_vector->data[i] = p_data;
+  p_vector->length++;
+  return true;
+}
+
+void
+_cdio_vector_remove (CdioVector_t *p_vector, unsigned i, int free_data)
+{
+  cdio_assert (p_vector != NULL);
+  cdio_assert (i < p_vector->length);
+
+  if (free_data)
+    free (p_vector->data[i]);
+
+  p_vector->length--;
+  memmove (&p_vector->data[i], &p_vector->data[i + 1], 
+           (p_vector->length - i) * sizeof (void *));
+}
+
+void *
+_cdio_vector_get (const CdioVector_t *p_vector, unsigned i)
+{
+  cdio_assert (p_vector != NULL);
+
+  if (i >= p_vector->length)
+    return NULL;
+
+  return p_vector->data[i];
+}
+
+void **
+_cdio_vector_data (const CdioVector_t *p_vector)
+{
+  cdio_assert (p_vector != NULL);
+
+  return p_vector->data;
+}
+
+/* Runs shorter than this are sorted by insertion. */
+#define VECTOR_RUN 16
+
+/* Sort the elements of data from i_lo up to i_hi by insertion. */
+static void
+_cdio_vector_insertion_sort (void **data, unsigned i_lo, unsigned i_hi,
+                             _cdio_vector_cmp_func_t cmp_func)
+{
+  unsigned i;
+
+  for (i = i_lo + 1; i < i_hi; i++)
+    {
+      void *p_data = data[i];
+      unsigned j = i;
+
+      while (j > i_lo && cmp_func (data[j - 1], p_data) > 0)
+        {
+          data[j] = data[j - 1];
+          j--;
+        }
+      data[j] = p_data;
+    }
+}
+
+void
+_cdio_vector_sort (CdioVector_t *p_vector, _cdio_vector_cmp_func_t cmp_func)
+{
+  const unsigned n = _cdio_vector_length (p_vector);
+  void **from = p_vector->data;
+  void **to;
+  unsigned i_run;
+  unsigned i;
+
+  cdio_assert (cmp_func != 0);
+
+  for (i = 0; i < n; i += VECTOR_RUN)
+    _cdio_vector_insertion_sort (from, i, MIN (i + VECTOR_RUN, n), cmp_func);
+
+  if (n <= VECTOR_RUN)
+    return;
+
+  to = malloc (n * sizeof (void *));
+  if (!to)
+    {
+      /* Finish by insertion rather than fail; the runs are sorted
+         already, so this is still correct, only slower. */
+      _cdio_vector_insertion_sort (from, 0, n, cmp_func);
+      return;
+    }
+
+  /* Merge pairs of sorted runs back and forth between the two
+     arrays, taking from the left run on ties to keep the sort
+     stable. */
+  for (i_run = VECTOR_RUN; i_run < n; i_run *= 2)
+    {
+      void **tmp;
+
+      for (i = 0; i < n; i += 2 * i_run)
+        {
+          unsigned i_left = i;
+          const unsigned i_mid = MIN (i + i_run, n);
+          unsigned i_right = i_mid;
+          const unsigned i_end = MIN (i + 2 * i_run, n);
+          unsigned k = i;
+
+          while (i_left < i_mid && i_right < i_end)
+            to[k++] = cmp_func (from[i_right], from[i_left]) < 0
+              ? from[i_right++] : from[i_left++];
+          while (i_left < i_mid)
+            to[k++] = from[i_left++];
+          while (i_right < i_end)
+            to[k++] = from[i_right++];
+        }
+
+      tmp = from;
+      from = to;
+      to = tmp;
+    }
+
+  if (from != p_vector->data)
+    {
+      memcpy (p_vector->data, from, n * sizeof (void *));
+      free (from);
+    }
+  else
+    free (to);
+}
+
+bool
+_cdio_vector_bsearch (const CdioVector_t *p_vector, const void *p_key,
+                      _cdio_vector_cmp_func_t cmp_func, 
+                      /*out*/ unsigned *pi_index)
+{
+  unsigned i_lo = 0;
+  unsigned i_hi = _cdio_vector_length (p_vector);
+
+  cdio_assert (cmp_func != 0);
+
+  /* Find the first element not less than p_key. */
+  while (i_lo < i_hi)
+    {
+      const unsigned i_mid = i_lo + (i_hi - i_lo) / 2;
+
+      if (cmp_func (p_key, p_vector->data[i_mid]) > 0)
+        i_lo = i_mid + 1;
+      else
+        i_hi = i_mid;
+    }
+
+  if (pi_index)
+    *pi_index = i_lo;
+
+  return i_lo < p_vector->length 
+    && 0 == cmp_func (p_key, p_vector->data[i_lo]);
+}
+
 /* eof */
 
 
@@ -89,8 +89,8 @@ _register_mapping (_img_private_t *env, lsn_t start_lsn, uint32_t sec_count,
   _map->img_offset = img_offset;
   _map->blocksize  = blocksize;
 
-  if (!env->mapping) env->mapping = _cdio_list_new ();
-  _cdio_list_append (env->mapping, _map);
+  if (!env->mapping) env->mapping = _cdio_vector_new ();
+  _cdio_vector_append (env->mapping, _map);
 
   env->size = MAX (env->size, (start_lsn + sec_count));
 
@@ -167,6 +167,48 @@ _register_mapping (_img_private_t *env, lsn_t start_lsn, uint32_t sec_count,
 	      (long unsigned int) img_offset);
 }
 
+/* _cdio_vector_sort() order for mappings. */
+static int
+_mapping_cmp (const void *p_data1, const void *p_data2)
+{
+  const _mapping_t *_map1 = p_data1;
+  const _mapping_t *_map2 = p_data2;
+
+  if (_map1->start_lsn < _map2->start_lsn) return -1;
+  return (_map1->start_lsn > _map2->start_lsn) ? 1 : 0;
+}
+
+/* _cdio_vector_bsearch() order for an lsn_t key. The key never
+   compares equal, so the search stops at the first mapping starting
+   after it. */
+static int
+_mapping_key_cmp (const void *p_key, const void *p_data)
+{
+  return (*(const lsn_t *) p_key < ((const _mapping_t *) p_data)->start_lsn)
+    ? -1 : 1;
+}
+
+/* Return the mapping holding lsn, or NULL if lsn is in a pre gap. */
+static const _mapping_t *
+_find_mapping (const _img_private_t *p_env, lsn_t lsn)
+{
+  unsigned int i;
+
+  if (!p_env->mapping) return NULL;
+
+  _cdio_vector_bsearch (p_env->mapping, &lsn, _mapping_key_cmp, &i);
+
+  /* Step back over empty mappings, which can sort after the one
+     holding lsn. */
+  for ( ; i > 0; i--) {
+    const _mapping_t *_map = _cdio_vector_get (p_env->mapping, i - 1);
+    if (IN (lsn, _map->start_lsn, (_map->start_lsn + _map->sec_count - 1)))
+      return _map;
+    if (0 != _map->sec_count) break;
+  }
+  return NULL;
+}
+
 
 /* 
    Disk and track information for a Nero file are located at the end
@@ -776,6 +818,8 @@ parse_nrg (_img_private_t *p_env, const char *psz_nrg_name,
   p_env->gen.b_cdtext_init  = true;
   p_env->gen.b_cdtext_error = false;
   p_env->gen.toc_init       = true;
+  if (p_env->mapping)
+    _cdio_vector_sort (p_env->mapping, _mapping_cmp);
   free(footer_buf);
   return true;
 }
@@ -894,7 +938,7 @@ _read_audio_sectors_nrg (void *p_user_data, void *data, lsn_t lsn,
 			  unsigned int nblocks)
 {
   _img_private_t *p_env = p_user_data;
-  CdioListNode_t *node;
+  const _mapping_t *_map;
 
   if (lsn >= p_env->size)
     {
@@ -917,26 +961,22 @@ _read_audio_sectors_nrg (void *p_user_data, void *data, lsn_t lsn,
     return ret == 0;
   }
 
-  _CDIO_LIST_FOREACH (node, p_env->mapping) {
-    _mapping_t *_map = _cdio_list_node_data (node);
+  _map = _find_mapping (p_env, lsn);
+  if (_map) {
+    int ret;
+    long int img_offset = _map->img_offset;
     
-    if (IN (lsn, _map->start_lsn, (_map->start_lsn + _map->sec_count - 1))) {
-      int ret;
-      long int img_offset = _map->img_offset;
-      
-      img_offset += (lsn - _map->start_lsn) * CDIO_CD_FRAMESIZE_RAW;
-      
-      ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
-			      SEEK_SET); 
-      if (ret!=0) return ret;
-      ret = cdio_stream_read (p_env->gen.data_source, data, 
-			      CDIO_CD_FRAMESIZE_RAW, nblocks);
-      if (ret==0) return ret;
-      break;
-    }
+    img_offset += (lsn - _map->start_lsn) * CDIO_CD_FRAMESIZE_RAW;
+    
+    ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
+			    SEEK_SET); 
+    if (ret!=0) return ret;
+    ret = cdio_stream_read (p_env->gen.data_source, data, 
+			    CDIO_CD_FRAMESIZE_RAW, nblocks);
+    if (ret==0) return ret;
   }
 
-  if (!node) cdio_warn ("reading into pre gap (lsn %lu)", 
+  if (!_map) cdio_warn ("reading into pre gap (lsn %lu)", 
 			(long unsigned int) lsn);
 
   return 0;
@@ -949,7 +989,7 @@ _read_mode1_sector_nrg (void *p_user_data, void *data, lsn_t lsn,
   _img_private_t *p_env = p_user_data;
   char buf[CDIO_CD_FRAMESIZE_RAW] = { 0, };
 
-  CdioListNode_t *node;
+  const _mapping_t *_map;
 
   if (lsn >= p_env->size)
     {
@@ -958,31 +998,27 @@ _read_mode1_sector_nrg (void *p_user_data, void *data, lsn_t lsn,
       return -1;
     }
 
-  _CDIO_LIST_FOREACH (node, p_env->mapping) {
-    _mapping_t *_map = _cdio_list_node_data (node);
+  _map = _find_mapping (p_env, lsn);
+  if (_map) {
+    int ret;
+    long int img_offset = _map->img_offset;
     
-    if (IN (lsn, _map->start_lsn, (_map->start_lsn + _map->sec_count - 1))) {
-      int ret;
-      long int img_offset = _map->img_offset;
-      
-      img_offset += (lsn - _map->start_lsn) * _map->blocksize;
-      
-      ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
-			      SEEK_SET); 
-      if (ret!=0) return ret;
-
-      /* FIXME: Not completely sure the below is correct. */
-      ret = cdio_stream_read (p_env->gen.data_source, 
-			      (M2RAW_SECTOR_SIZE == _map->blocksize)
-			      ? (buf + CDIO_CD_SYNC_SIZE + CDIO_CD_HEADER_SIZE)
-			      : buf,
-			      _map->blocksize, 1); 
-      if (ret==0) return ret;
-      break;
-    }
+    img_offset += (lsn - _map->start_lsn) * _map->blocksize;
+    
+    ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
+			    SEEK_SET); 
+    if (ret!=0) return ret;
+
+    /* FIXME: Not completely sure the below is correct. */
+    ret = cdio_stream_read (p_env->gen.data_source, 
+			    (M2RAW_SECTOR_SIZE == _map->blocksize)
+			    ? (buf + CDIO_CD_SYNC_SIZE + CDIO_CD_HEADER_SIZE)
+			    : buf,
+			    _map->blocksize, 1); 
+    if (ret==0) return ret;
   }
 
-  if (!node)
+  if (!_map)
     cdio_warn ("reading into pre gap (lsn %lu)", (long unsigned int) lsn);
 
   memcpy (data, buf + CDIO_CD_SYNC_SIZE + CDIO_CD_HEADER_SIZE, 
@@ -1020,7 +1056,7 @@ _read_mode2_sector_nrg (void *p_user_data, void *data, lsn_t lsn,
   _img_private_t *p_env = p_user_data;
   char buf[CDIO_CD_FRAMESIZE_RAW] = { 0, };
 
-  CdioListNode_t *node;
+  const _mapping_t *_map;
 
   if (lsn >= p_env->size)
     {
@@ -1029,29 +1065,25 @@ _read_mode2_sector_nrg (void *p_user_data, void *data, lsn_t lsn,
       return -1;
     }
 
-  _CDIO_LIST_FOREACH (node, p_env->mapping) {
-    _mapping_t *_map = _cdio_list_node_data (node);
+  _map = _find_mapping (p_env, lsn);
+  if (_map) {
+    int ret;
+    long int img_offset = _map->img_offset;
     
-    if (IN (lsn, _map->start_lsn, (_map->start_lsn + _map->sec_count - 1))) {
-      int ret;
-      long int img_offset = _map->img_offset;
-      
-      img_offset += (lsn - _map->start_lsn) * _map->blocksize;
-      
-      ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
-			      SEEK_SET); 
-      if (ret!=0) return ret;
-      ret = cdio_stream_read (p_env->gen.data_source, 
-			      (M2RAW_SECTOR_SIZE == _map->blocksize)
-			      ? (buf + CDIO_CD_SYNC_SIZE + CDIO_CD_HEADER_SIZE)
-			      : buf,
-			      _map->blocksize, 1); 
-      if (ret==0) return ret;
-      break;
-    }
+    img_offset += (lsn - _map->start_lsn) * _map->blocksize;
+    
+    ret = cdio_stream_seek (p_env->gen.data_source, img_offset, 
+			    SEEK_SET); 
+    if (ret!=0) return ret;
+    ret = cdio_stream_read (p_env->gen.data_source, 
+			    (M2RAW_SECTOR_SIZE == _map->blocksize)
+			    ? (buf + CDIO_CD_SYNC_SIZE + CDIO_CD_HEADER_SIZE)
+			    : buf,
+			    _map->blocksize, 1); 
+    if (ret==0) return ret;
   }
 
-  if (!node)
+  if (!_map)
     cdio_warn ("reading into pre gap (lsn %lu)", (long unsigned int) lsn);
 
   if (b_form2)
@@ -1096,7 +1128,7 @@ _free_nrg (void *p_user_data)
 
   if (NULL == p_env) return;
   if (NULL != p_env->mapping)
-    _cdio_list_free (p_env->mapping, true); 
+    _cdio_vector_free (p_env->mapping, true); 
 
   /* The remaining part of the image is like the other image drivers,
      so free that in the same way. */
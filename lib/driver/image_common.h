@@ -57,7 +57,7 @@ typedef struct {
   /* This is a hack because I don't really understnad NERO better. */
   bool            is_cues;
 
-  CdioList_t    *mapping;        /* List of track information */
+  CdioVector_t  *mapping;        /* Track information sorted by start_lsn */
   uint32_t      size;
 #endif
 } _img_private_t;
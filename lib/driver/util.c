@@ -149,6 +149,57 @@ cdio_from_bcd8(uint8_t p)
   return (0xf & p)+(10*(p >> 4));
 }
 
+/* The reflected CRC-32 polynomial. */
+#define CRC32_POLY 0xedb88320UL
+
+/* The CRC of one byte, and, in crc32_table[k], of one byte followed
+   by k bytes of 0. The tables are built the first time they are
+   needed; building them twice at once is harmless. */
+static uint32_t crc32_table[8][256];
+static bool b_crc32_table = false;
+
+static void
+_cdio_crc32_init (void)
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+    crc32_table[0][i] = c;
+  }
+  for (i = 0; i < 256; i++)
+    for (k = 1; k < 8; k++)
+      crc32_table[k][i] = (crc32_table[k-1][i] >> 8)
+        ^ crc32_table[0][crc32_table[k-1][i] & 0xff];
+  b_crc32_table = true;
+}
+
+/* Eight bytes are looked up at a time, in the eight tables, then the
+   rest one at a time. */
+uint32_t
+cdio_crc32 (uint32_t i_crc, const void *p_buf, size_t i_bytes)
+{
+  const uint8_t *p = p_buf;
+  uint32_t crc = ~i_crc;
+
+  if (!b_crc32_table)
+    _cdio_crc32_init ();
+  for ( ; i_bytes >= 8; p += 8, i_bytes -= 8) {
+    const uint32_t a = crc ^ (p[0] | p[1] << 8 | p[2] << 16
+                              | (uint32_t) p[3] << 24);
+    const uint32_t b = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t) p[7] << 24;
+    crc = crc32_table[7][a & 0xff] ^ crc32_table[6][(a >> 8) & 0xff]
+      ^ crc32_table[5][(a >> 16) & 0xff] ^ crc32_table[4][a >> 24]
+      ^ crc32_table[3][b & 0xff] ^ crc32_table[2][(b >> 8) & 0xff]
+      ^ crc32_table[1][(b >> 16) & 0xff] ^ crc32_table[0][b >> 24];
+  }
+  while (i_bytes--)
+    crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+  return ~crc;
+}
+
 /*!
   Follow symlinks until we have the real device file
   (idea taken from libunieject). 
@@ -682,8 +682,7 @@ iso9660_dir_add_entry_su(void *dir,
   uint8_t *dir8 = dir;
   unsigned int offset = 0;
   uint32_t dsize = from_733(idr->size);
-  int length, su_offset;
-  struct tm temp_tm;
+  int length;
   cdio_assert (sizeof(iso9660_dir_t) == 33);
 
   if (!dsize && !idr->length)
@@ -698,7 +697,6 @@ iso9660_dir_add_entry_su(void *dir,
   length = sizeof(iso9660_dir_t);
   length += strlen(filename);
   length = _cdio_ceil2block (length, 2); /* pad to word boundary */
-  su_offset = length;
   length += su_size;
   length = _cdio_ceil2block (length, 2); /* pad to word boundary again */
 
@@ -730,10 +728,40 @@ iso9660_dir_add_entry_su(void *dir,
 
   cdio_assert (offset + length <= dsize);
 
-  idr = (iso9660_dir_t *) &dir8[offset];
-  
   cdio_assert (offset+length < dsize); 
   
+  _iso9660_dir_set_entry (&dir8[offset], filename, 
+                          strlen(filename) 
+                          ? strlen(filename) : 1, /* working hack! */
+                          extent, size, file_flags, su_data, su_size,
+                          entry_time);
+}
+
+/*!
+  Fill in the directory record at p_rec for a name of i_filename
+  bytes, which need not be NUL-terminated (Joliet names are UCS-2),
+  and return its length. This is iso9660_dir_add_entry_su() without
+  the search for the end of the directory, for callers that lay out
+  their directories themselves.
+*/
+unsigned int
+_iso9660_dir_set_entry (void *p_rec, const char filename[], 
+                        unsigned int i_filename, uint32_t extent,
+                        uint32_t size, uint8_t file_flags, 
+                        const void *su_data, unsigned int su_size,
+                        const time_t *entry_time)
+{
+  iso9660_dir_t *idr = p_rec;
+  unsigned int length, su_offset;
+  struct tm temp_tm;
+
+  length = sizeof(iso9660_dir_t);
+  length += i_filename;
+  length = _cdio_ceil2block (length, 2); /* pad to word boundary */
+  su_offset = length;
+  length += su_size;
+  length = _cdio_ceil2block (length, 2); /* pad to word boundary again */
+
   memset(idr, 0, length);
 
   idr->length = to_711(length);
@@ -747,11 +775,12 @@ iso9660_dir_add_entry_su(void *dir,
 
   idr->volume_sequence_number = to_723(1);
 
-  idr->filename_len = to_711(strlen(filename) 
-                             ? strlen(filename) : 1); /* working hack! */
+  idr->filename_len = to_711(i_filename);
 
-  memcpy(idr->filename, filename, from_711(idr->filename_len));
-  memcpy(&dir8[offset] + su_offset, su_data, su_size);
+  memcpy(idr->filename, filename, i_filename);
+  if (su_size)
+    memcpy(((uint8_t *) p_rec) + su_offset, su_data, su_size);
+  return length;
 }
 
 void
@@ -0,0 +1,221 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Bump ("arena") allocator for iso9660_stat_t's handed out during a
+   readdir or a filesystem walk. Everything allocated from an arena is
+   released at once by iso9660_arena_reset() or iso9660_arena_free(). */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
+
+#include <cdio/iso9660.h>
+#include <cdio/logging.h>
+
+#include "iso9660_private.h"
+
+/* Default size of the first chunk. Each subsequent chunk doubles in
+   size until ISO9660_ARENA_MAX_CHUNK is reached, so a walk over a
+   large tree costs a few dozen malloc()'s rather than one per entry. */
+#define ISO9660_ARENA_DEFAULT_CHUNK (64 * 1024)
+#define ISO9660_ARENA_MAX_CHUNK     (4 * 1024 * 1024)
+
+/* All allocations are rounded up to this so that the iso9660_stat_t's
+   we place in an arena are suitably aligned. */
+#define ISO9660_ARENA_ALIGN         sizeof(double)
+#define ARENA_ROUNDUP(n) \
+  (((n) + ISO9660_ARENA_ALIGN - 1) & ~(ISO9660_ARENA_ALIGN - 1))
+
+typedef struct iso9660_arena_chunk_s iso9660_arena_chunk_t;
+
+struct iso9660_arena_chunk_s {
+  iso9660_arena_chunk_t *p_next;
+  size_t                 i_size;  /* usable bytes following the header */
+  size_t                 i_used;
+};
+
+#define ARENA_CHUNK_HDR ARENA_ROUNDUP(sizeof(iso9660_arena_chunk_t))
+#define ARENA_CHUNK_DATA(p_chunk) (((uint8_t *) (p_chunk)) + ARENA_CHUNK_HDR)
+
+struct _iso9660_arena_s {
+  iso9660_arena_chunk_t *p_first;   /* first chunk; kept across a reset */
+  iso9660_arena_chunk_t *p_current; /* chunk we are bumping in */
+  size_t   i_chunk_size;            /* size of the next chunk to get */
+  size_t   i_first_size;            /* size the arena was created with */
+  uint8_t *p_scratch;               /* reusable directory-extent buffer */
+  size_t   i_scratch;
+};
+
+static iso9660_arena_chunk_t *
+_arena_chunk_new (size_t i_size)
+{
+  iso9660_arena_chunk_t *p_chunk = malloc(ARENA_CHUNK_HDR + i_size);
+  if (!p_chunk) {
+    cdio_warn("Couldn't malloc(%lu)",
+              (long unsigned int) (ARENA_CHUNK_HDR + i_size));
+    return NULL;
+  }
+  p_chunk->p_next = NULL;
+  p_chunk->i_size = i_size;
+  p_chunk->i_used = 0;
+  return p_chunk;
+}
+
+/*!
+  Create a new arena. i_chunk_size is the size of the first block
+  requested from malloc(); 0 selects a reasonable default.
+*/
+iso9660_arena_t *
+iso9660_arena_new (size_t i_chunk_size)
+{
+  iso9660_arena_t *p_arena = calloc(1, sizeof(iso9660_arena_t));
+  if (!p_arena) return NULL;
+
+  if (0 == i_chunk_size) i_chunk_size = ISO9660_ARENA_DEFAULT_CHUNK;
+  i_chunk_size = ARENA_ROUNDUP(i_chunk_size);
+
+  p_arena->p_first = _arena_chunk_new(i_chunk_size);
+  if (!p_arena->p_first) {
+    free(p_arena);
+    return NULL;
+  }
+  p_arena->p_current    = p_arena->p_first;
+  p_arena->i_first_size = i_chunk_size;
+  p_arena->i_chunk_size = i_chunk_size;
+  return p_arena;
+}
+
+/*!
+  Allocate i_size bytes from p_arena. The memory is not zeroed and is
+  only released when the arena is reset or freed.
+*/
+void *
+iso9660_arena_alloc (iso9660_arena_t *p_arena, size_t i_size)
+{
+  iso9660_arena_chunk_t *p_chunk;
+  void *p;
+
+  if (!p_arena) return NULL;
+  i_size  = ARENA_ROUNDUP(i_size);
+  p_chunk = p_arena->p_current;
+
+  if (p_chunk->i_used + i_size > p_chunk->i_size) {
+    /* After a reset, chunks from the previous session are still
+       linked after p_current; reuse them if they are big enough. */
+    iso9660_arena_chunk_t *p_next = p_chunk->p_next;
+    if (p_next && i_size <= p_next->i_size) {
+      p_next->i_used = 0;
+      p_chunk = p_next;
+    } else {
+      size_t i_new = p_arena->i_chunk_size;
+      iso9660_arena_chunk_t *p_new;
+
+      if (i_new < ISO9660_ARENA_MAX_CHUNK) {
+        i_new *= 2;
+        p_arena->i_chunk_size = i_new;
+      }
+      if (i_new < i_size) i_new = i_size;
+      p_new = _arena_chunk_new(i_new);
+      if (!p_new) return NULL;
+      p_new->p_next   = p_chunk->p_next;
+      p_chunk->p_next = p_new;
+      p_chunk = p_new;
+    }
+    p_arena->p_current = p_chunk;
+  }
+
+  p = ARENA_CHUNK_DATA(p_chunk) + p_chunk->i_used;
+  p_chunk->i_used += i_size;
+  return p;
+}
+
+/*!
+  Like iso9660_arena_alloc(), but the memory returned is zeroed.
+*/
+void *
+iso9660_arena_calloc (iso9660_arena_t *p_arena, size_t i_size)
+{
+  void *p = iso9660_arena_alloc(p_arena, i_size);
+  if (p) memset(p, 0, i_size);
+  return p;
+}
+
+/*!
+  Release everything allocated from p_arena. Memory obtained from
+  malloc() is kept for reuse, so this is O(1).
+*/
+void
+iso9660_arena_reset (iso9660_arena_t *p_arena)
+{
+  if (!p_arena) return;
+  p_arena->p_first->i_used = 0;
+  p_arena->p_current = p_arena->p_first;
+}
+
+/*!
+  Free p_arena and everything allocated from it.
+*/
+void
+iso9660_arena_free (iso9660_arena_t *p_arena)
+{
+  iso9660_arena_chunk_t *p_chunk;
+
+  if (!p_arena) return;
+  p_chunk = p_arena->p_first;
+  while (p_chunk) {
+    iso9660_arena_chunk_t *p_next = p_chunk->p_next;
+    free(p_chunk);
+    p_chunk = p_next;
+  }
+  free(p_arena->p_scratch);
+  free(p_arena);
+}
+
+/* Return a buffer of at least i_size bytes that stays valid until
+   the next call. It is used to hold a directory extent while its
+   entries are decoded into the arena. */
+uint8_t *
+_iso9660_arena_scratch (iso9660_arena_t *p_arena, size_t i_size)
+{
+  if (i_size > p_arena->i_scratch) {
+    uint8_t *p_new = malloc(i_size);
+    if (!p_new) {
+      cdio_warn("Couldn't malloc(%lu)", (long unsigned int) i_size);
+      return NULL;
+    }
+    free(p_arena->p_scratch);
+    p_arena->p_scratch = p_new;
+    p_arena->i_scratch = i_size;
+  }
+  return p_arena->p_scratch;
+}
+
+
+/*
+ * Local variables:
+ *  c-file-style: "gnu"
+ *  tab-width: 8
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,1521 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Build an ISO 9660 image, optionally with Rock Ridge and Joliet
+   extensions, from a directory tree.
+
+   This happens in three steps. The source tree is scanned by a small
+   pool of threads; whichever thread reads a directory also names and
+   sorts its entries. A single planning pass then gives every path
+   table, directory and file its place in the image. Finally the
+   volume descriptors, path tables and directories are written with
+   the primitives of iso9660.c and the file data is copied straight
+   from the source files into the image, with copy_file_range() where
+   the system has it, so that nothing is staged in between.
+
+   Rock Ridge entries are kept inside the directory records as the
+   reader in rock.c does not follow continuation areas: names longer
+   than ISO9660_BUILD_RR_ROOM allows are truncated and symbolic links
+   that do not fit are left out. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+# include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+# include <errno.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include <ctype.h>
+#include <dirent.h>
+
+#include <cdio/bytesex.h>
+#include <cdio/iso9660.h>
+#include <cdio/logging.h>
+#include <cdio/rock.h>
+#include <cdio/util.h>
+
+#include "iso9660_private.h"
+#include "cdio_assert.h"
+
+/* Upper bound on the number of threads used when the caller lets us
+   choose. Scanning is dominated by waiting for directory and inode
+   reads, which only a few threads at a time can usefully overlap. */
+#define ISO9660_BUILD_MAX_AUTO_THREADS 8
+
+/* Size of the buffer used to copy file data when copy_file_range()
+   can't be used. */
+#define ISO9660_BUILD_COPY_BUFSIZE (1024 * 1024)
+
+/* Interchange level 2 names: at most 30 characters of name and
+   extension together, plus ".;1" for files; 31 for directories. We
+   keep at most ISO9660_BUILD_EXT_MAX characters of an extension. */
+#define ISO9660_BUILD_NAME_MAX 30
+#define ISO9660_BUILD_EXT_MAX   8
+
+/* Joliet names are at most 64 UCS-2 characters. When a name must be
+   shortened, extensions up to ISO9660_BUILD_JOLIET_EXT_MAX characters
+   are kept. */
+#define ISO9660_BUILD_JOLIET_MAX     64
+#define ISO9660_BUILD_JOLIET_EXT_MAX 16
+
+/* Largest extent of a multi-extent file. Every extent but the last
+   must fill whole blocks, and its size must fit in 32 bits. */
+#define ISO9660_BUILD_EXTENT_MAX \
+  ((uint32_t) (0xFFFFFFFFu & ~(ISO_BLOCKSIZE - 1)))
+
+/* Sizes of the Rock Ridge entries we write. */
+#define RR_HDR_SIZE 4
+#define RR_SP_SIZE  (RR_HDR_SIZE + 3)
+#define RR_PX_SIZE  (RR_HDR_SIZE + 4 * 8)
+#define RR_TF_SIZE  (RR_HDR_SIZE + 1 + 3 * 7)
+#define RR_NM_SIZE(n) (RR_HDR_SIZE + 1 + (n))
+
+#define RR_ER_ID  "RRIP_1991A"
+#define RR_ER_DES "THE ROCK RIDGE INTERCHANGE PROTOCOL PROVIDES SUPPORT " \
+                  "FOR POSIX FILE SYSTEM SEMANTICS"
+#define RR_ER_SIZE (RR_HDR_SIZE + 4 + sizeof(RR_ER_ID) - 1 \
+                    + sizeof(RR_ER_DES) - 1)
+
+/* A directory record holds at most 255 bytes. With the longest ISO
+   9660 name (33 bytes) and PX and TF, this much is left for NM and SL. */
+#define ISO9660_BUILD_RR_ROOM \
+  (255 - 66 - RR_PX_SIZE - RR_TF_SIZE)
+
+#ifdef HAVE_PTHREAD
+# define BUILD_LOCK(p)      pthread_mutex_lock(&(p)->mutex)
+# define BUILD_UNLOCK(p)    pthread_mutex_unlock(&(p)->mutex)
+# define BUILD_WAIT(p)      pthread_cond_wait(&(p)->work_cond, &(p)->mutex)
+# define BUILD_BROADCAST(p) pthread_cond_broadcast(&(p)->work_cond)
+#else
+# define BUILD_LOCK(p)
+# define BUILD_UNLOCK(p)
+# define BUILD_WAIT(p)
+# define BUILD_BROADCAST(p)
+#endif
+
+typedef struct build_node_s build_node_t;
+
+/* One file, directory or symbolic link of the source tree. */
+struct build_node_s {
+  char          *psz_path;      /* path of the source */
+  const char    *psz_name;      /* last component of psz_path */
+  build_node_t  *p_parent;      /* NULL for the root */
+
+  mode_t         i_mode;
+  uint32_t       i_nlink;
+  uint32_t       i_uid;
+  uint32_t       i_gid;
+  time_t         mtime;
+  time_t         atime;
+  time_t         ctime;
+  uint64_t       i_size;        /* bytes of file data */
+  char          *psz_symlink;   /* target of a symbolic link */
+
+  char           iso_name[ISO9660_BUILD_NAME_MAX + 4]; /* "NAME.EXT;1" */
+  unsigned int   i_rr_name;     /* bytes of psz_name that go in NM */
+  bool           b_rr_symlink;  /* target fits in SL */
+  char          *p_joliet;      /* UCS-2BE name, not terminated */
+  unsigned int   i_joliet;      /* its length in bytes */
+
+  build_node_t **pp_children;   /* in ISO 9660 order */
+  unsigned int   i_children;
+  build_node_t **pp_joliet;     /* in Joliet order, without symlinks */
+  unsigned int   i_joliet_children;
+
+  lsn_t          lsn;           /* first block of data or directory */
+  uint32_t       i_dir_size;    /* bytes in the ISO 9660 directory */
+  lsn_t          joliet_lsn;
+  uint32_t       i_joliet_size; /* bytes in the Joliet directory */
+  uint16_t       i_dirnum;      /* path table number, from 1 */
+  uint16_t       i_joliet_dirnum;
+
+  build_node_t  *p_work_next;   /* stack of directories to scan */
+};
+
+struct _iso9660_builder_s {
+  char          *psz_volume_id;
+  char          *psz_publisher_id;
+  char          *psz_preparer_id;
+  char          *psz_application_id;
+  unsigned int   flags;
+  time_t         build_time;
+
+  build_node_t  *p_root;
+
+  /* Scanning */
+  build_node_t  *p_work;        /* directories nobody has claimed */
+  unsigned int   i_pending;     /* directories pushed but not scanned */
+  unsigned int   i_dirs;
+  bool           b_error;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex;
+  pthread_cond_t  work_cond;
+#endif
+
+  /* Planning */
+  bool           b_planned;
+  build_node_t **pp_dirs;       /* directories in path table order */
+  build_node_t **pp_joliet_dirs;
+  build_node_t **pp_files;      /* files with data, in LSN order */
+  unsigned int   i_files;
+  uint32_t       i_pt_size;     /* bytes in each path table */
+  uint32_t       i_joliet_pt_size;
+  lsn_t          pt_l_lsn;
+  lsn_t          pt_m_lsn;
+  lsn_t          joliet_pt_l_lsn;
+  lsn_t          joliet_pt_m_lsn;
+  uint32_t       i_blocks;      /* 0 if the tree does not fit */
+};
+
+/* Where the image is going and how much of it has been written. */
+typedef struct {
+  int       fd;
+  uint64_t  i_pos;
+} build_out_t;
+
+static const uint8_t zero_block[ISO_BLOCKSIZE];
+
+#define BUILD_IS_FILE(p_node)    S_ISREG((p_node)->i_mode)
+#define BUILD_IS_DIR(p_node)     S_ISDIR((p_node)->i_mode)
+#define BUILD_IS_SYMLINK(p_node) S_ISLNK((p_node)->i_mode)
+
+static void
+_build_node_free (build_node_t *p_node)
+{
+  unsigned int i;
+
+  if (!p_node) return;
+  for (i = 0; i < p_node->i_children; i++)
+    _build_node_free(p_node->pp_children[i]);
+  free(p_node->pp_children);
+  free(p_node->pp_joliet);
+  free(p_node->p_joliet);
+  free(p_node->psz_symlink);
+  free(p_node->psz_path);
+  free(p_node);
+}
+
+/* Create a node for psz_path, which has been lstat()'ed into p_st.
+   psz_path now belongs to the node. */
+static build_node_t *
+_build_node_new (build_node_t *p_parent, char *psz_path,
+                 const struct stat *p_st)
+{
+  build_node_t *p_node = calloc(1, sizeof(build_node_t));
+  const char *psz_slash;
+
+  if (!p_node) {
+    cdio_warn("Couldn't calloc(1, %lu)",
+              (long unsigned int) sizeof(build_node_t));
+    free(psz_path);
+    return NULL;
+  }
+
+  psz_slash = strrchr(psz_path, '/');
+  p_node->psz_path = psz_path;
+  p_node->psz_name = psz_slash ? psz_slash + 1 : psz_path;
+  p_node->p_parent = p_parent;
+  p_node->i_mode   = p_st->st_mode;
+  p_node->i_nlink  = p_st->st_nlink;
+  p_node->i_uid    = p_st->st_uid;
+  p_node->i_gid    = p_st->st_gid;
+  p_node->mtime    = p_st->st_mtime;
+  p_node->atime    = p_st->st_atime;
+  p_node->ctime    = p_st->st_ctime;
+  if (S_ISREG(p_st->st_mode))
+    p_node->i_size = p_st->st_size;
+
+  if (S_ISLNK(p_st->st_mode)) {
+    size_t i_max = p_st->st_size ? p_st->st_size + 1 : 256;
+    ssize_t i_len;
+
+    p_node->psz_symlink = malloc(i_max);
+    i_len = p_node->psz_symlink
+      ? readlink(psz_path, p_node->psz_symlink, i_max - 1) : -1;
+    if (i_len < 0) {
+      cdio_warn("Can't read symbolic link %s: %s", psz_path,
+                strerror(errno));
+      _build_node_free(p_node);
+      return NULL;
+    }
+    p_node->psz_symlink[i_len] = '\0';
+  }
+  return p_node;
+}
+
+/* ISO 9660 names */
+
+static char
+_build_dchar (char c)
+{
+  c = toupper((unsigned char) c);
+  return iso9660_is_dchar((unsigned char) c) ? c : '_';
+}
+
+/* Set the ISO 9660 name of p_node from its source name. A nonzero
+   i_serial is worked into the name to tell it from others that come
+   out the same. */
+static void
+_build_iso_name (build_node_t *p_node, unsigned int i_serial)
+{
+  const char *psz_src = p_node->psz_name;
+  const char *psz_dot = NULL;
+  char psz_serial[12] = "";
+  char *p = p_node->iso_name;
+  size_t i_name, i_ext = 0, i_max, i_digits, i;
+
+  if (!BUILD_IS_DIR(p_node)) {
+    psz_dot = strrchr(psz_src, '.');
+    if (psz_dot == psz_src) psz_dot = NULL;
+  }
+  i_name = psz_dot ? (size_t) (psz_dot - psz_src) : strlen(psz_src);
+  if (psz_dot) {
+    i_ext = strlen(psz_dot + 1);
+    if (i_ext > ISO9660_BUILD_EXT_MAX) i_ext = ISO9660_BUILD_EXT_MAX;
+  }
+
+  i_max = BUILD_IS_DIR(p_node)
+    ? ISO9660_BUILD_NAME_MAX + 1 : ISO9660_BUILD_NAME_MAX - i_ext;
+  if (i_serial)
+    snprintf(psz_serial, sizeof(psz_serial), "%u", i_serial);
+  i_digits = strlen(psz_serial);
+  if (i_name + i_digits > i_max) i_name = i_max - i_digits;
+
+  for (i = 0; i < i_name; i++)
+    *p++ = _build_dchar(psz_src[i]);
+  memcpy(p, psz_serial, i_digits);
+  p += i_digits;
+  if (!BUILD_IS_DIR(p_node)) {
+    *p++ = '.';
+    for (i = 0; i < i_ext; i++)
+      *p++ = _build_dchar(psz_dot[1+i]);
+    *p++ = ';';
+    *p++ = '1';
+  }
+  *p = '\0';
+}
+
+/* Split an ISO 9660 name into its name and extension, each padded
+   with spaces, as used for ordering (ECMA-119 9.3). */
+static void
+_build_iso_split (const char *psz, char name[ISO9660_BUILD_NAME_MAX + 2],
+                  char ext[ISO9660_BUILD_NAME_MAX + 2])
+{
+  unsigned int i = 0;
+
+  memset(name, ' ', ISO9660_BUILD_NAME_MAX + 2);
+  memset(ext,  ' ', ISO9660_BUILD_NAME_MAX + 2);
+  while (*psz && '.' != *psz && ';' != *psz)
+    name[i++] = *psz++;
+  if ('.' == *psz) {
+    psz++;
+    i = 0;
+    while (*psz && ';' != *psz)
+      ext[i++] = *psz++;
+  }
+}
+
+static int
+_build_cmp_iso (const void *p1, const void *p2)
+{
+  const build_node_t *p_node1 = *(build_node_t * const *) p1;
+  const build_node_t *p_node2 = *(build_node_t * const *) p2;
+  char name1[ISO9660_BUILD_NAME_MAX + 2], ext1[ISO9660_BUILD_NAME_MAX + 2];
+  char name2[ISO9660_BUILD_NAME_MAX + 2], ext2[ISO9660_BUILD_NAME_MAX + 2];
+  int i_cmp;
+
+  _build_iso_split(p_node1->iso_name, name1, ext1);
+  _build_iso_split(p_node2->iso_name, name2, ext2);
+  i_cmp = memcmp(name1, name2, sizeof(name1));
+  if (0 == i_cmp) i_cmp = memcmp(ext1, ext2, sizeof(ext1));
+  return i_cmp;
+}
+
+/* Joliet names */
+
+/* Decode the UTF-8 string psz into at most i_max UCS-2 characters.
+   Bytes that are not part of a valid sequence are taken to be
+   Latin-1, characters outside the BMP and those Joliet forbids
+   become '_'. */
+static unsigned int
+_build_ucs2_decode (const char *psz, uint16_t *p_out, unsigned int i_max)
+{
+  const unsigned char *s = (const unsigned char *) psz;
+  unsigned int i_out = 0;
+
+#define CONT(c) (0x80 == ((c) & 0xc0))
+  while (*s && i_out < i_max) {
+    uint32_t c = *s;
+    unsigned int i_len = 1;
+
+    if (c >= 0xc2 && c <= 0xdf && CONT(s[1])) {
+      c = ((c & 0x1f) << 6) | (s[1] & 0x3f);
+      i_len = 2;
+    } else if (c >= 0xe0 && c <= 0xef && CONT(s[1]) && CONT(s[2])) {
+      c = ((c & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+      i_len = 3;
+      if (c < 0x800 || (c >= 0xd800 && c <= 0xdfff)) c = '_';
+    } else if (c >= 0xf0 && c <= 0xf4
+               && CONT(s[1]) && CONT(s[2]) && CONT(s[3])) {
+      c = '_';
+      i_len = 4;
+    }
+#undef CONT
+    if (c < 0x20 || (c < 0x80 && strchr("*/:;?\\", (int) c)))
+      c = '_';
+    p_out[i_out++] = c;
+    s += i_len;
+  }
+  return i_out;
+}
+
+/* Set the Joliet name of p_node; i_serial is as for
+   _build_iso_name(). */
+static bool
+_build_joliet_name (build_node_t *p_node, unsigned int i_serial)
+{
+  uint16_t a_ucs[256];
+  char psz_serial[12] = "";
+  unsigned int i_chars, i_base, i_ext = 0, i_digits, i;
+  char *p;
+
+  i_chars = _build_ucs2_decode(p_node->psz_name, a_ucs,
+                               sizeof(a_ucs) / sizeof(a_ucs[0]));
+  if (!BUILD_IS_DIR(p_node))
+    for (i = i_chars; i > 1; i--)
+      if ('.' == a_ucs[i-1]) {
+        if (i_chars - (i - 1) <= ISO9660_BUILD_JOLIET_EXT_MAX)
+          i_ext = i_chars - (i - 1);
+        break;
+      }
+  i_base = i_chars - i_ext;
+
+  if (i_serial)
+    snprintf(psz_serial, sizeof(psz_serial), "%u", i_serial);
+  i_digits = strlen(psz_serial);
+  if (i_base + i_digits + i_ext > ISO9660_BUILD_JOLIET_MAX)
+    i_base = ISO9660_BUILD_JOLIET_MAX - i_digits - i_ext;
+
+  p = realloc(p_node->p_joliet, 2 * (i_base + i_digits + i_ext));
+  if (!p) {
+    cdio_warn("Couldn't realloc(%u)", 2 * (i_base + i_digits + i_ext));
+    return false;
+  }
+  p_node->p_joliet = p;
+  p_node->i_joliet = 2 * (i_base + i_digits + i_ext);
+
+  for (i = 0; i < i_base; i++, p += 2)
+    p[0] = a_ucs[i] >> 8, p[1] = a_ucs[i] & 0xff;
+  for (i = 0; i < i_digits; i++, p += 2)
+    p[0] = 0, p[1] = psz_serial[i];
+  for (i = i_chars - i_ext; i < i_chars; i++, p += 2)
+    p[0] = a_ucs[i] >> 8, p[1] = a_ucs[i] & 0xff;
+  return true;
+}
+
+static int
+_build_cmp_joliet (const void *p1, const void *p2)
+{
+  const build_node_t *p_node1 = *(build_node_t * const *) p1;
+  const build_node_t *p_node2 = *(build_node_t * const *) p2;
+  unsigned int i_len = p_node1->i_joliet < p_node2->i_joliet
+    ? p_node1->i_joliet : p_node2->i_joliet;
+  int i_cmp = memcmp(p_node1->p_joliet, p_node2->p_joliet, i_len);
+
+  if (i_cmp) return i_cmp;
+  return (int) p_node1->i_joliet - (int) p_node2->i_joliet;
+}
+
+/* Sort pp_nodes with cmp and rename entries, with increasing serial
+   numbers, until no two compare equal. */
+static void
+_build_sort_unique (build_node_t **pp_nodes, unsigned int i_nodes,
+                    int (*cmp) (const void *, const void *),
+                    bool (*rename) (build_node_t *, unsigned int))
+{
+  unsigned int i_serial = 0;
+  bool b_changed = true;
+
+  qsort(pp_nodes, i_nodes, sizeof(build_node_t *), cmp);
+  while (b_changed) {
+    unsigned int i;
+
+    b_changed = false;
+    for (i = 1; i < i_nodes; i++)
+      if (0 == cmp(&pp_nodes[i-1], &pp_nodes[i])) {
+        rename(pp_nodes[i], ++i_serial);
+        b_changed = true;
+      }
+    if (b_changed)
+      qsort(pp_nodes, i_nodes, sizeof(build_node_t *), cmp);
+  }
+}
+
+static bool
+_build_iso_rename (build_node_t *p_node, unsigned int i_serial)
+{
+  _build_iso_name(p_node, i_serial);
+  return true;
+}
+
+/* Rock Ridge */
+
+/* Size of the SL entry for psz_target. */
+static unsigned int
+_build_rock_sl (const char *psz_target, uint8_t *p_su)
+{
+  unsigned int i_size = RR_HDR_SIZE + 1;
+  const char *p = psz_target;
+
+  if ('/' == *p) {
+    if (p_su) p_su[i_size] = ISO_ROCK_SL_ROOT, p_su[i_size+1] = 0;
+    i_size += 2;
+  }
+  while (*p) {
+    const char *psz_end;
+    size_t i_len;
+
+    while ('/' == *p) p++;
+    if (!*p) break;
+    psz_end = strchr(p, '/');
+    i_len = psz_end ? (size_t) (psz_end - p) : strlen(p);
+    if (i_len > 255) return 256;
+    if (p_su) {
+      if (1 == i_len && '.' == p[0]) {
+        p_su[i_size] = ISO_ROCK_SL_CURRENT, p_su[i_size+1] = 0;
+      } else if (2 == i_len && '.' == p[0] && '.' == p[1]) {
+        p_su[i_size] = ISO_ROCK_SL_PARENT, p_su[i_size+1] = 0;
+      } else {
+        p_su[i_size] = 0, p_su[i_size+1] = i_len;
+        memcpy(&p_su[i_size+2], p, i_len);
+      }
+    }
+    if ((1 == i_len && '.' == p[0])
+        || (2 == i_len && '.' == p[0] && '.' == p[1]))
+      i_size += 2;
+    else
+      i_size += 2 + i_len;
+    p += i_len;
+  }
+  if (p_su) {
+    p_su[0] = 'S', p_su[1] = 'L', p_su[2] = i_size, p_su[3] = 1;
+    p_su[4] = 0;
+  }
+  return i_size;
+}
+
+/* Decide how much of p_node's name and symbolic link go into its
+   Rock Ridge entries. */
+static void
+_build_rock_fit (build_node_t *p_node)
+{
+  unsigned int i_room = ISO9660_BUILD_RR_ROOM;
+  unsigned int i_name = strlen(p_node->psz_name);
+
+  if (p_node->psz_symlink) {
+    unsigned int i_sl = _build_rock_sl(p_node->psz_symlink, NULL);
+    if (i_sl <= 255 && RR_NM_SIZE(i_name) + i_sl <= i_room) {
+      p_node->b_rr_symlink = true;
+      i_room -= i_sl;
+    } else {
+      cdio_warn("%s: symbolic link target too long for Rock Ridge; "
+                "not recorded", p_node->psz_path);
+    }
+  }
+  if (RR_NM_SIZE(i_name) > i_room) {
+    i_name = i_room - RR_NM_SIZE(0);
+    /* Don't cut a UTF-8 sequence in two. */
+    while (i_name > 0 && 0x80 == (p_node->psz_name[i_name] & 0xc0))
+      i_name--;
+    cdio_warn("%s: name too long for Rock Ridge; truncated to %u bytes",
+              p_node->psz_path, i_name);
+  }
+  p_node->i_rr_name = i_name;
+}
+
+static uint32_t
+_build_rock_mode (mode_t i_mode)
+{
+  uint32_t i_rock = i_mode & 07777;
+
+  if (S_ISDIR(i_mode))
+    i_rock |= ISO_ROCK_ISDIR;
+  else if (S_ISLNK(i_mode))
+    i_rock |= ISO_ROCK_ISLNK;
+  else
+    i_rock |= ISO_ROCK_ISREG;
+  return i_rock;
+}
+
+static void
+_build_rock_time (time_t t, uint8_t *p)
+{
+  struct tm tm;
+
+  gmtime_r(&t, &tm);
+  iso9660_set_dtime(&tm, (iso9660_dtime_t *) p);
+}
+
+/* Write the Rock Ridge entries for p_node to p_su, if not NULL, and
+   return their size. b_name adds NM and SL, as for the entry in its
+   parent directory; b_root adds SP and ER, as for the root's ".". */
+static unsigned int
+_build_rock_su (const build_node_t *p_node, bool b_name, bool b_root,
+                uint8_t *p_su)
+{
+  unsigned int i_size = 0;
+
+  if (b_root) {
+    if (p_su) {
+      uint8_t *p = p_su + i_size;
+      p[0] = 'S', p[1] = 'P', p[2] = RR_SP_SIZE, p[3] = 1;
+      p[4] = 0xbe, p[5] = 0xef, p[6] = 0;
+    }
+    i_size += RR_SP_SIZE;
+  }
+
+  if (p_su) {
+    iso_extension_record_t *p_rr = (void *) (p_su + i_size);
+    p_rr->signature[0] = 'P', p_rr->signature[1] = 'X';
+    p_rr->len = RR_PX_SIZE;
+    p_rr->version = 1;
+    p_rr->u.PX.st_mode   = to_733(_build_rock_mode(p_node->i_mode));
+    p_rr->u.PX.st_nlinks = to_733(p_node->i_nlink);
+    p_rr->u.PX.st_uid    = to_733(p_node->i_uid);
+    p_rr->u.PX.st_gid    = to_733(p_node->i_gid);
+  }
+  i_size += RR_PX_SIZE;
+
+  if (p_su) {
+    uint8_t *p = p_su + i_size;
+    p[0] = 'T', p[1] = 'F', p[2] = RR_TF_SIZE, p[3] = 1;
+    p[4] = ISO_ROCK_TF_MODIFY | ISO_ROCK_TF_ACCESS | ISO_ROCK_TF_ATTRIBUTES;
+    _build_rock_time(p_node->mtime, p + 5);
+    _build_rock_time(p_node->atime, p + 5 + 7);
+    _build_rock_time(p_node->ctime, p + 5 + 14);
+  }
+  i_size += RR_TF_SIZE;
+
+  if (b_name) {
+    if (p_su) {
+      uint8_t *p = p_su + i_size;
+      p[0] = 'N', p[1] = 'M', p[2] = RR_NM_SIZE(p_node->i_rr_name);
+      p[3] = 1, p[4] = 0;
+      memcpy(p + 5, p_node->psz_name, p_node->i_rr_name);
+    }
+    i_size += RR_NM_SIZE(p_node->i_rr_name);
+
+    if (p_node->b_rr_symlink)
+      i_size += _build_rock_sl(p_node->psz_symlink,
+                               p_su ? p_su + i_size : NULL);
+  }
+
+  if (b_root) {
+    if (p_su) {
+      uint8_t *p = p_su + i_size;
+      p[0] = 'E', p[1] = 'R', p[2] = RR_ER_SIZE, p[3] = 1;
+      p[4] = sizeof(RR_ER_ID) - 1;
+      p[5] = sizeof(RR_ER_DES) - 1;
+      p[6] = 0;
+      p[7] = 1;
+      memcpy(p + 8, RR_ER_ID, sizeof(RR_ER_ID) - 1);
+      memcpy(p + 8 + sizeof(RR_ER_ID) - 1, RR_ER_DES,
+             sizeof(RR_ER_DES) - 1);
+    }
+    i_size += RR_ER_SIZE;
+  }
+  return i_size;
+}
+
+/* Scanning */
+
+/* Name and sort the entries of p_dir, which has just been read. */
+static bool
+_build_name_children (iso9660_builder_t *p_builder, build_node_t *p_dir)
+{
+  unsigned int i;
+
+  for (i = 0; i < p_dir->i_children; i++) {
+    build_node_t *p_node = p_dir->pp_children[i];
+    _build_iso_name(p_node, 0);
+    if (p_builder->flags & ISO9660_BUILD_ROCK)
+      _build_rock_fit(p_node);
+  }
+  _build_sort_unique(p_dir->pp_children, p_dir->i_children,
+                     _build_cmp_iso, _build_iso_rename);
+
+  if (!(p_builder->flags & ISO9660_BUILD_JOLIET) || !p_dir->i_children)
+    return true;
+
+  p_dir->pp_joliet = malloc(p_dir->i_children * sizeof(build_node_t *));
+  if (!p_dir->pp_joliet) {
+    cdio_warn("Couldn't malloc(%lu)", (long unsigned int)
+              (p_dir->i_children * sizeof(build_node_t *)));
+    return false;
+  }
+  for (i = 0; i < p_dir->i_children; i++) {
+    build_node_t *p_node = p_dir->pp_children[i];
+    if (BUILD_IS_SYMLINK(p_node)) continue;
+    if (!_build_joliet_name(p_node, 0)) return false;
+    p_dir->pp_joliet[p_dir->i_joliet_children++] = p_node;
+  }
+  _build_sort_unique(p_dir->pp_joliet, p_dir->i_joliet_children,
+                     _build_cmp_joliet, _build_joliet_name);
+  return true;
+}
+
+/* Read the directory p_dir from the source tree. Called without the
+   lock held. Return false if some entry had to be left out. */
+static bool
+_build_scan_dir (iso9660_builder_t *p_builder, build_node_t *p_dir)
+{
+  DIR *p_dirp = opendir(p_dir->psz_path[0] ? p_dir->psz_path : "/");
+  struct dirent *p_ent;
+  unsigned int i_max = 0;
+  bool b_ok = true;
+
+  if (!p_dirp) {
+    cdio_warn("Can't open directory %s: %s", p_dir->psz_path,
+              strerror(errno));
+    return false;
+  }
+
+  while ((p_ent = readdir(p_dirp))) {
+    size_t i_path;
+    char *psz_path;
+    struct stat st;
+    build_node_t *p_node;
+
+    if (!strcmp(p_ent->d_name, ".") || !strcmp(p_ent->d_name, ".."))
+      continue;
+
+    i_path = strlen(p_dir->psz_path) + strlen(p_ent->d_name) + 2;
+    psz_path = malloc(i_path);
+    if (!psz_path) {
+      cdio_warn("Couldn't malloc(%lu)", (long unsigned int) i_path);
+      b_ok = false;
+      continue;
+    }
+    snprintf(psz_path, i_path, "%s/%s", p_dir->psz_path, p_ent->d_name);
+
+    if (lstat(psz_path, &st)) {
+      cdio_warn("Can't stat %s: %s", psz_path, strerror(errno));
+      free(psz_path);
+      b_ok = false;
+      continue;
+    }
+    if (S_ISLNK(st.st_mode) && !(p_builder->flags & ISO9660_BUILD_ROCK)) {
+      cdio_info("%s: symbolic links need Rock Ridge; skipped", psz_path);
+      free(psz_path);
+      continue;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)
+        && !S_ISLNK(st.st_mode)) {
+      cdio_warn("%s: not a file, directory or symbolic link; skipped",
+                psz_path);
+      free(psz_path);
+      b_ok = false;
+      continue;
+    }
+    if (S_ISREG(st.st_mode) && (uint64_t) st.st_size
+        > (uint64_t) ISO_MAX_MULTIEXTENT * ISO9660_BUILD_EXTENT_MAX) {
+      cdio_warn("%s: too large for ISO 9660; skipped", psz_path);
+      free(psz_path);
+      b_ok = false;
+      continue;
+    }
+
+    p_node = _build_node_new(p_dir, psz_path, &st);
+    if (!p_node) {
+      b_ok = false;
+      continue;
+    }
+    if (p_dir->i_children == i_max) {
+      unsigned int i_new = i_max ? 2 * i_max : 16;
+      build_node_t **pp_new = realloc(p_dir->pp_children,
+                                      i_new * sizeof(build_node_t *));
+      if (!pp_new) {
+        cdio_warn("Couldn't realloc(%lu)",
+                  (long unsigned int) (i_new * sizeof(build_node_t *)));
+        _build_node_free(p_node);
+        b_ok = false;
+        break;
+      }
+      p_dir->pp_children = pp_new;
+      i_max = i_new;
+    }
+    p_dir->pp_children[p_dir->i_children++] = p_node;
+  }
+  closedir(p_dirp);
+
+  return _build_name_children(p_builder, p_dir) && b_ok;
+}
+
+/* Scan directories until there are none left. Run by each worker
+   thread and by the calling thread. */
+static void *
+_build_scan_worker (void *p_data)
+{
+  iso9660_builder_t *p_builder = p_data;
+
+  BUILD_LOCK(p_builder);
+  while (true) {
+    build_node_t *p_dir;
+    unsigned int i, i_subdirs = 0;
+    bool b_ok;
+
+    while (!p_builder->p_work && p_builder->i_pending)
+      BUILD_WAIT(p_builder);
+    if (!p_builder->p_work) break;
+
+    p_dir = p_builder->p_work;
+    p_builder->p_work = p_dir->p_work_next;
+
+    BUILD_UNLOCK(p_builder);
+    b_ok = _build_scan_dir(p_builder, p_dir);
+    BUILD_LOCK(p_builder);
+
+    if (!b_ok) p_builder->b_error = true;
+    for (i = p_dir->i_children; i > 0; i--) {
+      build_node_t *p_node = p_dir->pp_children[i-1];
+      if (!BUILD_IS_DIR(p_node)) continue;
+      p_node->p_work_next = p_builder->p_work;
+      p_builder->p_work = p_node;
+      i_subdirs++;
+    }
+    p_builder->i_dirs    += i_subdirs;
+    p_builder->i_pending += i_subdirs;
+    p_builder->i_pending--;
+    if (i_subdirs || !p_builder->i_pending) BUILD_BROADCAST(p_builder);
+  }
+  BUILD_UNLOCK(p_builder);
+  return NULL;
+}
+
+static void
+_build_forget (iso9660_builder_t *p_builder)
+{
+  _build_node_free(p_builder->p_root);
+  p_builder->p_root = NULL;
+  free(p_builder->pp_dirs);
+  free(p_builder->pp_joliet_dirs);
+  free(p_builder->pp_files);
+  p_builder->pp_dirs = p_builder->pp_joliet_dirs = p_builder->pp_files
+    = NULL;
+  p_builder->i_dirs = p_builder->i_files = 0;
+  p_builder->b_planned = false;
+  p_builder->i_blocks = 0;
+}
+
+/*!
+  Create a builder for an image with the given volume, publisher,
+  preparer and application IDs; any but psz_volume_id may be NULL.
+  flags is a combination of iso9660_build_flag_t values.
+*/
+iso9660_builder_t *
+iso9660_builder_new (const char psz_volume_id[],
+                     const char psz_publisher_id[],
+                     const char psz_preparer_id[],
+                     const char psz_application_id[],
+                     unsigned int flags)
+{
+  iso9660_builder_t *p_builder;
+
+  if (!psz_volume_id) return NULL;
+
+  p_builder = calloc(1, sizeof(iso9660_builder_t));
+  if (!p_builder) return NULL;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&p_builder->mutex, NULL);
+  pthread_cond_init(&p_builder->work_cond, NULL);
+#endif
+
+  p_builder->psz_volume_id      = strdup(psz_volume_id);
+  p_builder->psz_publisher_id   = strdup(psz_publisher_id ?
+                                         psz_publisher_id : "");
+  p_builder->psz_preparer_id    = strdup(psz_preparer_id ?
+                                         psz_preparer_id : "");
+  p_builder->psz_application_id = strdup(psz_application_id ?
+                                         psz_application_id : "");
+  p_builder->flags      = flags;
+  p_builder->build_time = time(NULL);
+
+  if (!p_builder->psz_volume_id || !p_builder->psz_publisher_id
+      || !p_builder->psz_preparer_id || !p_builder->psz_application_id) {
+    iso9660_builder_free(p_builder);
+    return NULL;
+  }
+  return p_builder;
+}
+
+/*!
+  Scan the tree under psz_source, which becomes the root directory of
+  the image, using up to i_threads threads (0 chooses a number from
+  the processors available). Entries that cannot be read or
+  represented are left out with a warning, and false is returned.
+*/
+bool
+iso9660_builder_scan (iso9660_builder_t *p_builder, const char psz_source[],
+                      unsigned int i_threads)
+{
+  struct stat st;
+  char *psz_path;
+#ifdef HAVE_PTHREAD
+  pthread_t *p_threads = NULL;
+  unsigned int i_started = 0;
+  unsigned int i;
+#endif
+
+  if (!p_builder || !psz_source) return false;
+  _build_forget(p_builder);
+
+  if (stat(psz_source, &st) || !S_ISDIR(st.st_mode)) {
+    cdio_warn("%s is not a directory", psz_source);
+    return false;
+  }
+  psz_path = strdup(psz_source);
+  if (!psz_path) return false;
+  /* Child paths are built as "parent/name". */
+  while (strlen(psz_path) > 1 && '/' == psz_path[strlen(psz_path) - 1])
+    psz_path[strlen(psz_path) - 1] = '\0';
+  p_builder->p_root = _build_node_new(NULL, psz_path, &st);
+  if (!p_builder->p_root) return false;
+  if (!strcmp(p_builder->p_root->psz_path, "/"))
+    p_builder->p_root->psz_path[0] = '\0';  /* so we get "/name" */
+
+  if (0 == i_threads) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long int i_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    i_threads = (i_cpus > 0) ? (unsigned int) i_cpus : 1;
+#else
+    i_threads = 1;
+#endif
+    if (i_threads > ISO9660_BUILD_MAX_AUTO_THREADS)
+      i_threads = ISO9660_BUILD_MAX_AUTO_THREADS;
+  }
+
+  p_builder->b_error   = false;
+  p_builder->p_work    = p_builder->p_root;
+  p_builder->i_pending = 1;
+  p_builder->i_dirs    = 1;
+
+#ifdef HAVE_PTHREAD
+  if (i_threads > 1) {
+    p_threads = calloc(i_threads - 1, sizeof(pthread_t));
+    if (p_threads)
+      for (i = 0; i < i_threads - 1; i++) {
+        if (pthread_create(&p_threads[i], NULL, _build_scan_worker,
+                           p_builder))
+          break;
+        i_started++;
+      }
+  }
+#endif
+
+  _build_scan_worker(p_builder);
+
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < i_started; i++)
+    pthread_join(p_threads[i], NULL);
+  free(p_threads);
+#endif
+
+  return !p_builder->b_error;
+}
+
+/* Planning */
+
+static unsigned int
+_build_extents (const build_node_t *p_node)
+{
+  if (!BUILD_IS_FILE(p_node) || 0 == p_node->i_size) return 1;
+  return (p_node->i_size + ISO9660_BUILD_EXTENT_MAX - 1)
+    / ISO9660_BUILD_EXTENT_MAX;
+}
+
+/* Place a record of i_length bytes at *pi_offset, or at the next block
+   if it would cross into it, and advance *pi_offset past it. This is
+   the rule iso9660_dir_add_entry_su() follows. */
+static uint32_t
+_build_dir_place (uint32_t *pi_offset, unsigned int i_length)
+{
+  uint32_t i_rec = *pi_offset;
+
+  if (i_rec / ISO_BLOCKSIZE != (i_rec + i_length - 1) / ISO_BLOCKSIZE)
+    i_rec = _cdio_ceil2block(i_rec, ISO_BLOCKSIZE);
+  *pi_offset = i_rec + i_length;
+  return i_rec;
+}
+
+/* Lay out the ISO 9660 or Joliet directory of p_dir and return its
+   size in bytes. If p_dir8 is not NULL, it holds that many zeroed
+   bytes and the directory is written to it. */
+static uint32_t
+_build_dir_records (const iso9660_builder_t *p_builder,
+                    const build_node_t *p_dir, bool b_joliet,
+                    uint8_t *p_dir8)
+{
+  const bool b_rock = !b_joliet && (p_builder->flags & ISO9660_BUILD_ROCK);
+  const build_node_t *p_parent = p_dir->p_parent ? p_dir->p_parent : p_dir;
+  build_node_t * const *pp_children =
+    b_joliet ? p_dir->pp_joliet : p_dir->pp_children;
+  const unsigned int i_children =
+    b_joliet ? p_dir->i_joliet_children : p_dir->i_children;
+  uint8_t su[255];
+  uint32_t i_offset = 0;
+  unsigned int i_su, i;
+
+  /* "." and ".." */
+  i_su = b_rock ? _build_rock_su(p_dir, false, !p_dir->p_parent, NULL) : 0;
+  i_offset += iso9660_dir_calc_record_size(1, i_su);
+  i_su = b_rock ? _build_rock_su(p_parent, false, false, NULL) : 0;
+  i_offset += iso9660_dir_calc_record_size(1, i_su);
+
+  for (i = 0; i < i_children; i++) {
+    const build_node_t *p_node = pp_children[i];
+    const char *p_name = b_joliet ? p_node->p_joliet : p_node->iso_name;
+    const unsigned int i_name =
+      b_joliet ? p_node->i_joliet : strlen(p_node->iso_name);
+    const unsigned int i_extents = _build_extents(p_node);
+    unsigned int i_length, k;
+
+    i_su = b_rock ? _build_rock_su(p_node, true, false,
+                                   p_dir8 ? su : NULL) : 0;
+    i_length = iso9660_dir_calc_record_size(i_name, i_su);
+
+    for (k = 0; k < i_extents; k++) {
+      uint32_t i_rec = _build_dir_place(&i_offset, i_length);
+      lsn_t lsn;
+      uint32_t i_size;
+      uint8_t i_flags;
+
+      if (!p_dir8) continue;
+      if (BUILD_IS_DIR(p_node)) {
+        lsn     = b_joliet ? p_node->joliet_lsn : p_node->lsn;
+        i_size  = b_joliet ? p_node->i_joliet_size : p_node->i_dir_size;
+        i_flags = ISO_DIRECTORY;
+      } else {
+        uint64_t i_done = (uint64_t) k * ISO9660_BUILD_EXTENT_MAX;
+        lsn     = p_node->lsn + k * (ISO9660_BUILD_EXTENT_MAX / ISO_BLOCKSIZE);
+        i_size  = (p_node->i_size - i_done > ISO9660_BUILD_EXTENT_MAX)
+          ? ISO9660_BUILD_EXTENT_MAX : (uint32_t) (p_node->i_size - i_done);
+        i_flags = (k + 1 < i_extents) ? ISO_MULTIEXTENT : 0;
+      }
+      _iso9660_dir_set_entry(p_dir8 + i_rec, p_name, i_name, lsn, i_size,
+                             i_flags, su, i_su, &p_node->mtime);
+    }
+  }
+  return _cdio_ceil2block(i_offset, ISO_BLOCKSIZE);
+}
+
+/* Put the directories below p_root in path table order, that is
+   breadth first with the subdirectories of each directory in the
+   order they appear in it, into pp_dirs and number them. */
+static void
+_build_number_dirs (build_node_t *p_root, build_node_t **pp_dirs,
+                    bool b_joliet)
+{
+  unsigned int i_dirs = 1, i;
+
+  pp_dirs[0] = p_root;
+  for (i = 0; i < i_dirs; i++) {
+    build_node_t *p_dir = pp_dirs[i];
+    build_node_t * const *pp_children =
+      b_joliet ? p_dir->pp_joliet : p_dir->pp_children;
+    unsigned int i_children =
+      b_joliet ? p_dir->i_joliet_children : p_dir->i_children;
+    unsigned int j;
+
+    if (b_joliet)
+      p_dir->i_joliet_dirnum = i + 1;
+    else
+      p_dir->i_dirnum = i + 1;
+    for (j = 0; j < i_children; j++)
+      if (BUILD_IS_DIR(pp_children[j]))
+        pp_dirs[i_dirs++] = pp_children[j];
+  }
+}
+
+static uint32_t
+_build_pathtable_size (build_node_t **pp_dirs, unsigned int i_dirs,
+                       bool b_joliet)
+{
+  uint32_t i_size = 0;
+  unsigned int i;
+
+  for (i = 0; i < i_dirs; i++) {
+    unsigned int i_name = !pp_dirs[i]->p_parent ? 1
+      : b_joliet ? pp_dirs[i]->i_joliet : strlen(pp_dirs[i]->iso_name);
+    i_size += sizeof(iso_path_table_t) + i_name + (i_name & 1);
+  }
+  return i_size;
+}
+
+static bool
+_build_plan (iso9660_builder_t *p_builder)
+{
+  const bool b_joliet = p_builder->flags & ISO9660_BUILD_JOLIET;
+  const unsigned int i_dirs = p_builder->i_dirs;
+  uint64_t i_next;
+  unsigned int i, j;
+
+  if (!p_builder->p_root) return false;
+  if (i_dirs > 0xffff) {
+    cdio_warn("%u directories are too many for a path table", i_dirs);
+    return false;
+  }
+
+  p_builder->pp_dirs = malloc(i_dirs * sizeof(build_node_t *));
+  if (!p_builder->pp_dirs) return false;
+  _build_number_dirs(p_builder->p_root, p_builder->pp_dirs, false);
+  p_builder->i_pt_size =
+    _build_pathtable_size(p_builder->pp_dirs, i_dirs, false);
+  if (b_joliet) {
+    p_builder->pp_joliet_dirs = malloc(i_dirs * sizeof(build_node_t *));
+    if (!p_builder->pp_joliet_dirs) return false;
+    _build_number_dirs(p_builder->p_root, p_builder->pp_joliet_dirs, true);
+    p_builder->i_joliet_pt_size =
+      _build_pathtable_size(p_builder->pp_joliet_dirs, i_dirs, true);
+  }
+
+  /* System area, volume descriptors and the terminator. */
+  i_next = ISO_PVD_SECTOR + 1 + (b_joliet ? 1 : 0) + 1;
+
+  p_builder->pt_l_lsn = i_next;
+  i_next += _cdio_len2blocks(p_builder->i_pt_size, ISO_BLOCKSIZE);
+  p_builder->pt_m_lsn = i_next;
+  i_next += _cdio_len2blocks(p_builder->i_pt_size, ISO_BLOCKSIZE);
+  if (b_joliet) {
+    p_builder->joliet_pt_l_lsn = i_next;
+    i_next += _cdio_len2blocks(p_builder->i_joliet_pt_size, ISO_BLOCKSIZE);
+    p_builder->joliet_pt_m_lsn = i_next;
+    i_next += _cdio_len2blocks(p_builder->i_joliet_pt_size, ISO_BLOCKSIZE);
+  }
+
+  for (i = 0; i < i_dirs; i++) {
+    build_node_t *p_dir = p_builder->pp_dirs[i];
+    p_dir->lsn = i_next;
+    p_dir->i_dir_size = _build_dir_records(p_builder, p_dir, false, NULL);
+    i_next += p_dir->i_dir_size / ISO_BLOCKSIZE;
+  }
+  for (i = 0; b_joliet && i < i_dirs; i++) {
+    build_node_t *p_dir = p_builder->pp_joliet_dirs[i];
+    p_dir->joliet_lsn = i_next;
+    p_dir->i_joliet_size = _build_dir_records(p_builder, p_dir, true, NULL);
+    i_next += p_dir->i_joliet_size / ISO_BLOCKSIZE;
+  }
+
+  /* File data, in the order of the ISO 9660 directories. Empty files
+     and symbolic links point where their data would have started. */
+  p_builder->i_files = 0;
+  for (i = 0; i < i_dirs; i++) {
+    const build_node_t *p_dir = p_builder->pp_dirs[i];
+    for (j = 0; j < p_dir->i_children; j++)
+      if (BUILD_IS_FILE(p_dir->pp_children[j])
+          && p_dir->pp_children[j]->i_size)
+        p_builder->i_files++;
+  }
+  p_builder->pp_files = malloc((p_builder->i_files + 1)
+                               * sizeof(build_node_t *));
+  if (!p_builder->pp_files) return false;
+  p_builder->i_files = 0;
+  for (i = 0; i < i_dirs; i++) {
+    const build_node_t *p_dir = p_builder->pp_dirs[i];
+    for (j = 0; j < p_dir->i_children; j++) {
+      build_node_t *p_node = p_dir->pp_children[j];
+      if (BUILD_IS_DIR(p_node)) continue;
+      p_node->lsn = (lsn_t) i_next;
+      if (BUILD_IS_FILE(p_node) && p_node->i_size) {
+        i_next += _cdio_len2blocks(p_node->i_size, ISO_BLOCKSIZE);
+        p_builder->pp_files[p_builder->i_files++] = p_node;
+      }
+    }
+  }
+
+  if (i_next > 0x7fffffff) {
+    cdio_warn("The tree needs %lu blocks; that is too big for an image",
+              (long unsigned int) i_next);
+    return false;
+  }
+  p_builder->i_blocks = i_next;
+  return true;
+}
+
+/*!
+  Return the size in blocks of the image that iso9660_builder_write()
+  will produce, or 0 if the scanned tree does not fit in an image.
+*/
+uint32_t
+iso9660_builder_get_blocks (iso9660_builder_t *p_builder)
+{
+  if (!p_builder) return 0;
+  if (!p_builder->b_planned) {
+    p_builder->b_planned = true;
+    if (!_build_plan(p_builder)) p_builder->i_blocks = 0;
+  }
+  return p_builder->i_blocks;
+}
+
+/* Writing */
+
+static bool
+_build_write (build_out_t *p_out, const void *p_buf, size_t i_size)
+{
+  const uint8_t *p = p_buf;
+
+  while (i_size > 0) {
+    ssize_t i_written = write(p_out->fd, p, i_size);
+    if (i_written < 0) {
+      if (EINTR == errno) continue;
+      cdio_warn("write(): %s", strerror(errno));
+      return false;
+    }
+    p            += i_written;
+    i_size       -= i_written;
+    p_out->i_pos += i_written;
+  }
+  return true;
+}
+
+static bool
+_build_write_zeros (build_out_t *p_out, uint64_t i_size)
+{
+  while (i_size > 0) {
+    size_t i_chunk = i_size > ISO_BLOCKSIZE ? ISO_BLOCKSIZE : i_size;
+    if (!_build_write(p_out, zero_block, i_chunk)) return false;
+    i_size -= i_chunk;
+  }
+  return true;
+}
+
+/* Store the space-padded a-characters of an i_size byte descriptor
+   field again as UCS-2, as the Joliet descriptor wants them. */
+static void
+_build_joliet_field (char *p_field, size_t i_size)
+{
+  char buf[ISO_MAX_APPLICATION_ID];
+  size_t i;
+
+  memcpy(buf, p_field, i_size);
+  for (i = 0; i < i_size / 2; i++) {
+    p_field[2*i]   = 0;
+    p_field[2*i+1] = buf[i];
+  }
+}
+
+static bool
+_build_write_descriptors (const iso9660_builder_t *p_builder,
+                          build_out_t *p_out)
+{
+  const build_node_t *p_root = p_builder->p_root;
+  uint8_t pvd[ISO_BLOCKSIZE];
+  uint8_t root_dir[ISO_BLOCKSIZE];
+
+  memset(root_dir, 0, sizeof(root_dir));
+  _iso9660_dir_set_entry(root_dir, "\0", 1, p_root->lsn,
+                         p_root->i_dir_size, ISO_DIRECTORY, NULL, 0,
+                         &p_root->mtime);
+  iso9660_set_pvd(pvd, p_builder->psz_volume_id,
+                  p_builder->psz_publisher_id, p_builder->psz_preparer_id,
+                  p_builder->psz_application_id, p_builder->i_blocks,
+                  root_dir, p_builder->pt_l_lsn, p_builder->pt_m_lsn,
+                  p_builder->i_pt_size, &p_builder->build_time);
+  /* iso9660_set_pvd() marks the volume as CD-XA, which has readers
+     look for XA attributes in every directory record. We write none. */
+  memset(pvd + ISO_XA_MARKER_OFFSET, 0, strlen(ISO_XA_MARKER_STRING));
+  if (!_build_write(p_out, pvd, sizeof(pvd))) return false;
+
+  if (p_builder->flags & ISO9660_BUILD_JOLIET) {
+    iso9660_svd_t svd;
+
+    cdio_assert (sizeof(svd) == ISO_BLOCKSIZE);
+    memcpy(&svd, pvd, sizeof(svd));
+    svd.type = to_711(ISO_VD_SUPPLEMENTARY);
+    memcpy(svd.escape_sequences, "%/E", 3); /* UCS-2 level 3 */
+    _build_joliet_field(svd.system_id, sizeof(svd.system_id));
+    _build_joliet_field(svd.volume_id, sizeof(svd.volume_id));
+    _build_joliet_field(svd.volume_set_id, sizeof(svd.volume_set_id));
+    _build_joliet_field(svd.publisher_id, sizeof(svd.publisher_id));
+    _build_joliet_field(svd.preparer_id, sizeof(svd.preparer_id));
+    _build_joliet_field(svd.application_id, sizeof(svd.application_id));
+    svd.path_table_size   = to_733(p_builder->i_joliet_pt_size);
+    svd.type_l_path_table = to_731(p_builder->joliet_pt_l_lsn);
+    svd.type_m_path_table = to_732(p_builder->joliet_pt_m_lsn);
+    _iso9660_dir_set_entry(&svd.root_directory_record, "\0", 1,
+                           p_root->joliet_lsn, p_root->i_joliet_size,
+                           ISO_DIRECTORY, NULL, 0, &p_root->mtime);
+    if (!_build_write(p_out, &svd, sizeof(svd))) return false;
+  }
+
+  iso9660_set_evd(pvd);
+  return _build_write(p_out, pvd, sizeof(pvd));
+}
+
+static bool
+_build_write_pathtable (const iso9660_builder_t *p_builder,
+                        build_out_t *p_out, bool b_joliet, bool b_msb,
+                        uint8_t *p_pt)
+{
+  build_node_t * const *pp_dirs =
+    b_joliet ? p_builder->pp_joliet_dirs : p_builder->pp_dirs;
+  const uint32_t i_size =
+    b_joliet ? p_builder->i_joliet_pt_size : p_builder->i_pt_size;
+  uint32_t i_offset = 0;
+  unsigned int i;
+
+  memset(p_pt, 0, _cdio_ceil2block(i_size, ISO_BLOCKSIZE));
+  for (i = 0; i < p_builder->i_dirs; i++) {
+    const build_node_t *p_dir = pp_dirs[i];
+    const build_node_t *p_parent = p_dir->p_parent ? p_dir->p_parent : p_dir;
+    iso_path_table_t *p_entry = (void *) (p_pt + i_offset);
+    const char *p_name;
+    unsigned int i_name;
+    lsn_t lsn;
+    uint16_t i_parent;
+
+    if (!p_dir->p_parent) {
+      p_name = "\0";
+      i_name = 1;
+    } else if (b_joliet) {
+      p_name = p_dir->p_joliet;
+      i_name = p_dir->i_joliet;
+    } else {
+      p_name = p_dir->iso_name;
+      i_name = strlen(p_dir->iso_name);
+    }
+    lsn      = b_joliet ? p_dir->joliet_lsn : p_dir->lsn;
+    i_parent = b_joliet ? p_parent->i_joliet_dirnum : p_parent->i_dirnum;
+
+    p_entry->name_len = to_711(i_name);
+    p_entry->extent   = b_msb ? to_732(lsn) : to_731(lsn);
+    p_entry->parent   = b_msb ? to_722(i_parent) : to_721(i_parent);
+    memcpy(p_entry->name, p_name, i_name);
+    i_offset += sizeof(iso_path_table_t) + i_name + (i_name & 1);
+  }
+  cdio_assert (i_offset == i_size);
+  return _build_write(p_out, p_pt, _cdio_ceil2block(i_size, ISO_BLOCKSIZE));
+}
+
+static bool
+_build_write_dir (const iso9660_builder_t *p_builder, build_out_t *p_out,
+                  const build_node_t *p_dir, bool b_joliet,
+                  uint8_t **pp_buf, size_t *pi_buf)
+{
+  const bool b_rock = !b_joliet && (p_builder->flags & ISO9660_BUILD_ROCK);
+  const build_node_t *p_parent = p_dir->p_parent ? p_dir->p_parent : p_dir;
+  const lsn_t lsn = b_joliet ? p_dir->joliet_lsn : p_dir->lsn;
+  const uint32_t i_size = b_joliet ? p_dir->i_joliet_size : p_dir->i_dir_size;
+  uint8_t su_self[255], su_parent[255];
+  unsigned int i_su_self = 0, i_su_parent = 0;
+
+  cdio_assert (p_out->i_pos == (uint64_t) lsn * ISO_BLOCKSIZE);
+
+  if (i_size > *pi_buf) {
+    uint8_t *p_new = realloc(*pp_buf, i_size);
+    if (!p_new) {
+      cdio_warn("Couldn't realloc(%lu)", (long unsigned int) i_size);
+      return false;
+    }
+    *pp_buf = p_new;
+    *pi_buf = i_size;
+  }
+
+  if (b_rock) {
+    i_su_self   = _build_rock_su(p_dir, false, !p_dir->p_parent, su_self);
+    i_su_parent = _build_rock_su(p_parent, false, false, su_parent);
+  }
+  iso9660_dir_init_new_su(*pp_buf, lsn, i_size, su_self, i_su_self,
+                          b_joliet ? p_parent->joliet_lsn : p_parent->lsn,
+                          b_joliet ? p_parent->i_joliet_size
+                          : p_parent->i_dir_size,
+                          su_parent, i_su_parent, &p_dir->mtime);
+  _build_dir_records(p_builder, p_dir, b_joliet, *pp_buf);
+  return _build_write(p_out, *pp_buf, i_size);
+}
+
+/* Copy the data of p_node into the image and pad it to a whole
+   block. */
+static bool
+_build_copy_file (build_out_t *p_out, const build_node_t *p_node,
+                  uint8_t *p_buf)
+{
+  uint64_t i_left = p_node->i_size;
+  int fd_in;
+
+  cdio_assert (p_out->i_pos == (uint64_t) p_node->lsn * ISO_BLOCKSIZE);
+
+  fd_in = open(p_node->psz_path, O_RDONLY);
+  if (fd_in < 0) {
+    cdio_warn("Can't open %s: %s", p_node->psz_path, strerror(errno));
+    return false;
+  }
+
+#ifdef HAVE_COPY_FILE_RANGE
+  /* Let the kernel move the data; on failure (another file system,
+     a pipe, an old kernel) fall back to read() and write() from
+     wherever it stopped. */
+  while (i_left > 0) {
+    size_t i_chunk = i_left > (1 << 30) ? (1 << 30) : (size_t) i_left;
+    ssize_t i_copied = copy_file_range(fd_in, NULL, p_out->fd, NULL,
+                                       i_chunk, 0);
+    if (i_copied > 0) {
+      i_left       -= i_copied;
+      p_out->i_pos += i_copied;
+    } else if (i_copied < 0 && EINTR == errno) {
+      continue;
+    } else {
+      break;
+    }
+  }
+#endif /*HAVE_COPY_FILE_RANGE*/
+
+  while (i_left > 0) {
+    size_t i_chunk = i_left > ISO9660_BUILD_COPY_BUFSIZE
+      ? ISO9660_BUILD_COPY_BUFSIZE : (size_t) i_left;
+    ssize_t i_read = read(fd_in, p_buf, i_chunk);
+
+    if (i_read < 0 && EINTR == errno) continue;
+    if (i_read <= 0) break;
+    if (!_build_write(p_out, p_buf, i_read)) {
+      close(fd_in);
+      return false;
+    }
+    i_left -= i_read;
+  }
+  close(fd_in);
+
+  if (i_left > 0)
+    cdio_warn("%s: %lu bytes shorter than when scanned; padded with zeros",
+              p_node->psz_path, (long unsigned int) i_left);
+  return _build_write_zeros(p_out, i_left)
+    && _build_write_zeros(p_out,
+                          _cdio_ceil2block(p_node->i_size, ISO_BLOCKSIZE)
+                          - p_node->i_size);
+}
+
+/*!
+  Write the image to fd, starting at its current position. File data
+  is copied directly from the source files. Return true if the whole
+  image was written.
+*/
+bool
+iso9660_builder_write (iso9660_builder_t *p_builder, int fd)
+{
+  const bool b_joliet = p_builder && (p_builder->flags & ISO9660_BUILD_JOLIET);
+  build_out_t out;
+  uint8_t *p_buf = NULL;
+  size_t i_buf = 0;
+  bool b_ok;
+  unsigned int i;
+
+  if (!iso9660_builder_get_blocks(p_builder)) return false;
+
+  out.fd    = fd;
+  out.i_pos = 0;
+
+  /* The path tables are the largest thing we lay out in memory,
+     short of big directories, and the copy buffer is reused for them. */
+  i_buf = ISO9660_BUILD_COPY_BUFSIZE;
+  if (i_buf < _cdio_ceil2block(p_builder->i_pt_size, ISO_BLOCKSIZE))
+    i_buf = _cdio_ceil2block(p_builder->i_pt_size, ISO_BLOCKSIZE);
+  if (i_buf < _cdio_ceil2block(p_builder->i_joliet_pt_size, ISO_BLOCKSIZE))
+    i_buf = _cdio_ceil2block(p_builder->i_joliet_pt_size, ISO_BLOCKSIZE);
+  p_buf = malloc(i_buf);
+  if (!p_buf) {
+    cdio_warn("Couldn't malloc(%lu)", (long unsigned int) i_buf);
+    return false;
+  }
+
+  b_ok = _build_write_zeros(&out, ISO_PVD_SECTOR * ISO_BLOCKSIZE)
+    && _build_write_descriptors(p_builder, &out)
+    && _build_write_pathtable(p_builder, &out, false, false, p_buf)
+    && _build_write_pathtable(p_builder, &out, false, true, p_buf);
+  if (b_ok && b_joliet)
+    b_ok = _build_write_pathtable(p_builder, &out, true, false, p_buf)
+      && _build_write_pathtable(p_builder, &out, true, true, p_buf);
+
+  for (i = 0; b_ok && i < p_builder->i_dirs; i++)
+    b_ok = _build_write_dir(p_builder, &out, p_builder->pp_dirs[i], false,
+                            &p_buf, &i_buf);
+  for (i = 0; b_ok && b_joliet && i < p_builder->i_dirs; i++)
+    b_ok = _build_write_dir(p_builder, &out, p_builder->pp_joliet_dirs[i],
+                            true, &p_buf, &i_buf);
+
+  for (i = 0; b_ok && i < p_builder->i_files; i++)
+    b_ok = _build_copy_file(&out, p_builder->pp_files[i], p_buf);
+
+  free(p_buf);
+  if (b_ok)
+    cdio_assert (out.i_pos == (uint64_t) p_builder->i_blocks * ISO_BLOCKSIZE);
+  return b_ok;
+}
+
+/*!
+  Free p_builder and everything it holds.
+*/
+void
+iso9660_builder_free (iso9660_builder_t *p_builder)
+{
+  if (!p_builder) return;
+  _build_forget(p_builder);
+#ifdef HAVE_PTHREAD
+  pthread_cond_destroy(&p_builder->work_cond);
+  pthread_mutex_destroy(&p_builder->mutex);
+#endif
+  free(p_builder->psz_volume_id);
+  free(p_builder->psz_publisher_id);
+  free(p_builder->psz_preparer_id);
+  free(p_builder->psz_application_id);
+  free(p_builder);
+}
+
+
+/*
+ * Local variables:
+ *  c-file-style: "gnu"
+ *  tab-width: 8
+ *  indent-tabs-mode: nil
+ * End:
+ */
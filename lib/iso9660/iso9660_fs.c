@@ -32,10 +32,22 @@
 # include <errno.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
 #ifdef HAVE_LANGINFO_CODESET
 #include <langinfo.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include <cdio/cdio.h>
 #include <cdio/bytesex.h>
 #include <cdio/iso9660.h>
@@ -46,11 +58,43 @@
 #include "cdio_assert.h"
 #include "_cdio_stdio.h"
 #include "cdio_private.h"
+#include "iso9660_private.h"
 
 #include <stdio.h>
 
 static const char _rcsid[] = "$Id: iso9660_fs.c,v 1.47 2008/04/18 16:02:09 karl Exp $";
 
+/* Directory extents read through an iso9660_t are kept in a small
+   LRU cache. Path lookups re-read every directory above the one
+   wanted, and so do parallel walkers that meet the same extent twice;
+   this way those reads are served from memory. */
+#define ISO9660_DIR_CACHE_SIZE    (4 * 1024 * 1024)
+#define ISO9660_DIR_CACHE_BUCKETS 256
+
+/* Name lookup table for one directory extent, see
+   _iso9660_dir_index_new(). */
+typedef struct iso9660_dir_index_s iso9660_dir_index_t;
+
+typedef struct iso9660_dir_cache_entry_s iso9660_dir_cache_entry_t;
+
+struct iso9660_dir_cache_entry_s {
+  lsn_t    lsn;
+  long int i_blocks;
+  iso9660_dir_index_t *p_index;          /* built on first lookup */
+  size_t   i_index_size;
+  iso9660_dir_cache_entry_t *p_hash_next;
+  iso9660_dir_cache_entry_t *p_lru_prev; /* toward most recently used */
+  iso9660_dir_cache_entry_t *p_lru_next; /* toward least recently used */
+  uint8_t  data[EMPTY_ARRAY_SIZE];
+};
+
+typedef struct {
+  iso9660_dir_cache_entry_t *buckets[ISO9660_DIR_CACHE_BUCKETS];
+  iso9660_dir_cache_entry_t *p_lru_first;
+  iso9660_dir_cache_entry_t *p_lru_last;
+  size_t i_bytes;
+} iso9660_dir_cache_t;
+
 /* Implementation of iso9660_t type */
 struct _iso9660_s {
   CdioDataSource_t *stream; /* Stream pointer */
@@ -84,12 +128,37 @@ struct _iso9660_s {
 			       filesystem inside that it may be
 			       different.
 			     */
+  iso9660_dir_cache_t dir_cache;
+  unsigned int i_decode;    /* iso9660_decode_flag_t's: what directory
+			       reads decode beyond names and extents. */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex;    /* Guards dir_cache and, when the stream
+			       can't do positional reads, the stream
+			       position. */
+#endif
 };
 
 static long int iso9660_seek_read_framesize (const iso9660_t *p_iso, 
 					     void *ptr, lsn_t start, 
 					     long int size, 
 					     uint16_t i_framesize);
+static long int _iso9660_pread (const iso9660_t *p_iso, void *ptr,
+				long int i_len, off_t i_offset);
+
+static void _iso9660_dir_index_free (iso9660_dir_index_t *p_index);
+
+static void
+_iso9660_dir_cache_free (iso9660_dir_cache_t *p_cache)
+{
+  iso9660_dir_cache_entry_t *p_entry = p_cache->p_lru_first;
+  while (p_entry) {
+    iso9660_dir_cache_entry_t *p_next = p_entry->p_lru_next;
+    _iso9660_dir_index_free(p_entry->p_index);
+    free(p_entry);
+    p_entry = p_next;
+  }
+  memset(p_cache, 0, sizeof(iso9660_dir_cache_t));
+}
 
 /* Adjust the p_iso's i_datastart, i_byte_offset and i_framesize 
    based on whether we find a frame header or not.
@@ -169,6 +238,10 @@ iso9660_open_ext_private (const char *psz_path,
 
   if (!p_iso) return NULL;
   
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&p_iso->mutex, NULL);
+#endif
+
   p_iso->stream = cdio_stdio_new( psz_path );
   if (NULL == p_iso->stream) 
     goto error;
@@ -189,11 +262,16 @@ iso9660_open_ext_private (const char *psz_path,
     ? nope : yep;
   
   p_iso->iso_extension_mask = iso_extension_mask;
+  p_iso->i_decode = ISO9660_DECODE_ALL;
   return p_iso;
 
  error:
   if (p_iso && p_iso->stream) {
     cdio_stdio_destroy(p_iso->stream);
+    _iso9660_dir_cache_free(&p_iso->dir_cache);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&p_iso->mutex);
+#endif
     free(p_iso);
   }
   return NULL;
@@ -254,6 +332,10 @@ iso9660_close (iso9660_t *p_iso)
 {
   if (NULL != p_iso) {
     cdio_stdio_destroy(p_iso->stream);
+    _iso9660_dir_cache_free(&p_iso->dir_cache);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_destroy(&p_iso->mutex);
+#endif
     free(p_iso);
   }
   return true;
@@ -536,73 +618,189 @@ iso9660_ifs_read_superblock (iso9660_t *p_iso,
   return true;
 }
 
+/* The fuzzy superblock search reads the image this many bytes at a
+   time, and first searches this many frames either side of
+   ISO_PVD_SECTOR, then FUZZY_GROWTH times as many, and so on up to
+   i_fuzz, so that an image whose PVD is about where it should be
+   doesn't have the whole window read. */
+#define FUZZY_READ_SIZE (4 * 1024 * 1024)
+#define FUZZY_RADIUS    32
+#define FUZZY_GROWTH    32
+
+static const uint16_t fuzzy_framesizes[] = { 
+  ISO_BLOCKSIZE, CDIO_CD_FRAMESIZE_RAW, M2RAW_SECTOR_SIZE 
+};
+#define FUZZY_FRAMESIZES \
+  (sizeof(fuzzy_framesizes) / sizeof(fuzzy_framesizes[0]))
+
+/* Where a frame of the k'th frame size starts its data. */
+#define FUZZY_DATASTART(k) ((0 == (k)) ? 0 : CDIO_CD_SYNC_SIZE)
+
+/* A place ISO_STANDARD_ID was found, taken as being in a frame of the
+   i_frame'th frame size. i_order is when a frame-at-a-time search
+   outward from ISO_PVD_SECTOR would have come to it. */
+typedef struct {
+  off_t        i_pos;
+  unsigned int i_frame;
+  unsigned int i_order;
+} fuzzy_hit_t;
+
+static int
+_fuzzy_hit_cmp (const void *p1, const void *p2)
+{
+  const fuzzy_hit_t *p_hit1 = p1, *p_hit2 = p2;
+  if (p_hit1->i_order != p_hit2->i_order)
+    return p_hit1->i_order < p_hit2->i_order ? -1 : 1;
+  return 0;
+}
+
+/* Find every ISO_STANDARD_ID in the frames from i_min to i_max - 1
+   frames either side of ISO_PVD_SECTOR, reading that part of the
+   image a big chunk at a time. Only the first in each frame counts,
+   as that is what looking at the frame would see. The hits are
+   returned in the order they should be tried in, and *pi_hits is set
+   to how many there are. NULL is returned if there are none. */
+static fuzzy_hit_t *
+_fuzzy_find_ids (const iso9660_t *p_iso, unsigned int i_min, 
+		 unsigned int i_max, /*out*/ unsigned int *pi_hits)
+{
+  const size_t i_id_len = strlen(ISO_STANDARD_ID);
+  const lsn_t lsn_lo = (i_max > ISO_PVD_SECTOR) ? 0 
+    : ISO_PVD_SECTOR - i_max + 1;
+  const lsn_t lsn_hi = ISO_PVD_SECTOR + i_max;
+  lsn_t last_lsn[FUZZY_FRAMESIZES];
+  fuzzy_hit_t *p_hits = NULL;
+  unsigned int i_hits = 0, i_alloced = 0, k;
+  off_t i_start = -1, i_end = 0;
+  uint8_t *p_buf;
+
+  /* The bytes those frames cover, for any of the frame sizes. */
+  for (k = 0; k < FUZZY_FRAMESIZES; k++) {
+    const off_t i_lo = (off_t) lsn_lo * fuzzy_framesizes[k] 
+      + FUZZY_DATASTART(k);
+    const off_t i_hi = (off_t) lsn_hi * fuzzy_framesizes[k] 
+      + FUZZY_DATASTART(k);
+    if (i_start < 0 || i_lo < i_start) i_start = i_lo;
+    if (i_hi > i_end) i_end = i_hi;
+    last_lsn[k] = -1;
+  }
+
+  p_buf = malloc(FUZZY_READ_SIZE);
+  if (!p_buf) return NULL;
+
+  /* Chunks overlap by one less than the ID, so each ID is wholly in
+     exactly one chunk. */
+  while (i_start < i_end) {
+    long int i_want = FUZZY_READ_SIZE;
+    if (i_end - i_start + (off_t) i_id_len - 1 < i_want)
+      i_want = i_end - i_start + i_id_len - 1;
+    long int i_read = _iso9660_pread(p_iso, p_buf, i_want, i_start);
+    const uint8_t *p = p_buf;
+    const uint8_t *p_last;
+
+    if (i_read < (long int) i_id_len) break;
+    p_last = p_buf + i_read - i_id_len;
+
+    /* memchr() is about as fast as scanning memory gets. */
+    while (p <= p_last 
+	   && (p = memchr(p, ISO_STANDARD_ID[0], p_last - p + 1))) {
+      const off_t i_pos = i_start + (p - p_buf);
+
+      if (0 != memcmp(p + 1, ISO_STANDARD_ID + 1, i_id_len - 1)) {
+	p++;
+	continue;
+      }
+      for (k = 0; k < FUZZY_FRAMESIZES; k++) {
+	lsn_t lsn;
+	unsigned int i;
+
+	/* The descriptor type byte comes before the ID. */
+	if (i_pos <= FUZZY_DATASTART(k)) continue;
+	lsn = (i_pos - FUZZY_DATASTART(k)) / fuzzy_framesizes[k];
+	if (lsn == last_lsn[k]) continue;
+	last_lsn[k] = lsn;
+	i = (lsn < ISO_PVD_SECTOR) ? ISO_PVD_SECTOR - lsn 
+	  : lsn - ISO_PVD_SECTOR;
+	if (i < i_min || i >= i_max) continue;
+
+	if (i_hits == i_alloced) {
+	  fuzzy_hit_t *p_more;
+	  i_alloced = i_alloced ? 2 * i_alloced : 16;
+	  p_more = realloc(p_hits, i_alloced * sizeof(fuzzy_hit_t));
+	  if (!p_more) {
+	    free(p_hits);
+	    free(p_buf);
+	    return NULL;
+	  }
+	  p_hits = p_more;
+	}
+	p_hits[i_hits].i_pos   = i_pos;
+	p_hits[i_hits].i_frame = k;
+	p_hits[i_hits].i_order = 
+	  (2 * i + (lsn < ISO_PVD_SECTOR)) * FUZZY_FRAMESIZES + k;
+	i_hits++;
+      }
+      p++;
+    }
+    if (i_read < i_want) break;
+    i_start += i_read - (i_id_len - 1);
+  }
+  free(p_buf);
+
+  if (p_hits)
+    qsort(p_hits, i_hits, sizeof(fuzzy_hit_t), _fuzzy_hit_cmp);
+  *pi_hits = i_hits;
+  return p_hits;
+}
+
 /*!
   Read the Super block of an ISO 9660 image but determine framesize
   and datastart and a possible additional offset. Generally here we are
   not reading an ISO 9660 image but a CD-Image which contains an ISO 9660
   filesystem.
+
+  ISO_STANDARD_ID ("CD001") is looked for in up to i_fuzz frames either
+  side of ISO_PVD_SECTOR, taking the frames to be ISO_BLOCKSIZE,
+  CDIO_CD_FRAMESIZE_RAW or M2RAW_SECTOR_SIZE bytes. Rather than reading
+  each frame for each frame size, the image is read in large chunks
+  and scanned once; the places found are then checked to be a PVD
+  nearest first.
 */
 bool 
 iso9660_ifs_fuzzy_read_superblock (iso9660_t *p_iso, 
 				   iso_extension_mask_t iso_extension_mask,
 				   uint16_t i_fuzz)
 {
-  /* Got some work to do to find ISO_STANDARD_ID ("CD001") */
-  unsigned int i;
-  
-  for (i=0; i<i_fuzz; i++) {
-    unsigned int j;
-    char *pvd = NULL;
-
-    for (j = 0; j <= 1; j++ ) {
-      lsn_t lsn;
-      uint16_t k;
-      const uint16_t framesizes[] = { ISO_BLOCKSIZE, CDIO_CD_FRAMESIZE_RAW, 
-				      M2RAW_SECTOR_SIZE } ;
-
-      /* We don't need to loop over a zero offset twice*/
-      if (0==i && j)
-	continue;
-      
-      lsn = (j) ? ISO_PVD_SECTOR - i : ISO_PVD_SECTOR + i;
-      
-      for (k=0; k < 3; k++) {
-	char *p, *q;
-	char frame[CDIO_CD_FRAMESIZE_RAW] = {'\0',};
-	p_iso->i_framesize = framesizes[k];
-	p_iso->i_datastart = (ISO_BLOCKSIZE == framesizes[k]) ? 
-			      0 : CDIO_CD_SYNC_SIZE;
-	p_iso->i_fuzzy_offset = 0;
-	if (0 == iso9660_seek_read_framesize (p_iso, frame, lsn, 1, 
-					      p_iso->i_framesize)) {
-	  return false;
-	}
-
-	q = memchr(frame, 'C', p_iso->i_framesize);
-	for ( p=q; p && p < frame + p_iso->i_framesize ; p=q+1 ) {
-	  q = memchr(p, 'C', p_iso->i_framesize - (p - frame));
-	  if ( !q || (pvd = strstr(q, ISO_STANDARD_ID)) )
-	    break;
-	}
-	
-	if (pvd) {
-	  /* Yay! Found something */
-	  p_iso->i_fuzzy_offset = (pvd - frame - 1) - 
-	    ((ISO_PVD_SECTOR-lsn)*p_iso->i_framesize) ;
-	  /* But is it *really* a PVD? */
-	  if ( iso9660_ifs_read_pvd_loglevel(p_iso, &(p_iso->pvd), 
-					     CDIO_LOG_DEBUG) ) {
-	    adjust_fuzzy_pvd(p_iso);
-	    return true;
-	  }
-	  
-	}
+  unsigned int i_min = 0;
+
+  while (i_min < i_fuzz) {
+    unsigned int i_max = i_min ? i_min * FUZZY_GROWTH : FUZZY_RADIUS;
+    unsigned int i_hits = 0, i;
+    fuzzy_hit_t *p_hits;
+
+    if (i_max > i_fuzz) i_max = i_fuzz;
+    p_hits = _fuzzy_find_ids(p_iso, i_min, i_max, &i_hits);
+
+    for (i = 0; i < i_hits; i++) {
+      const unsigned int k = p_hits[i].i_frame;
+
+      p_iso->i_framesize = fuzzy_framesizes[k];
+      p_iso->i_datastart = FUZZY_DATASTART(k);
+      p_iso->i_fuzzy_offset = p_hits[i].i_pos - 1 - p_iso->i_datastart
+	- ISO_PVD_SECTOR * p_iso->i_framesize;
+      /* But is it *really* a PVD? */
+      if ( iso9660_ifs_read_pvd_loglevel(p_iso, &(p_iso->pvd), 
+					 CDIO_LOG_DEBUG) ) {
+	free(p_hits);
+	adjust_fuzzy_pvd(p_iso);
+	return true;
       }
     }
+    free(p_hits);
+    i_min = i_max;
   }
   return false;
 }
-
   
 /*!
   Read the Primary Volume Descriptor for of CD.
@@ -698,6 +896,15 @@ iso9660_fs_read_superblock (CdIo_t *p_cdio,
   return true;
 }
 
+/* Byte position of block lsn in the image. Computed in off_t since
+   images, and multi-extent files in them, may be larger than 4 GiB. */
+static off_t
+_iso9660_lsn_offset (const iso9660_t *p_iso, lsn_t lsn)
+{
+  return (off_t) lsn * p_iso->i_framesize + p_iso->i_fuzzy_offset 
+    + p_iso->i_datastart;
+}
+
 /*!
   Seek to a position and then read n blocks. Size read is returned.
 */
@@ -706,16 +913,41 @@ iso9660_seek_read_framesize (const iso9660_t *p_iso, void *ptr,
 			     lsn_t start, long int size, 
 			     uint16_t i_framesize)
 {
-  long int ret;
-  long int i_byte_offset;
+  off_t i_byte_offset;
   
   if (!p_iso) return 0;
-  i_byte_offset = (start * p_iso->i_framesize) + p_iso->i_fuzzy_offset 
-    + p_iso->i_datastart;
+  i_byte_offset = _iso9660_lsn_offset(p_iso, start);
+  return _iso9660_pread (p_iso, ptr, (long int) i_framesize * size, 
+			 i_byte_offset);
+}
+
+/*!
+  Read i_len bytes at byte i_offset of the image. The number of bytes
+  read is returned.
+*/
+static long int 
+_iso9660_pread (const iso9660_t *p_iso, void *ptr, long int i_len, 
+		off_t i_offset)
+{
+  long int ret;
+
+  /* A positional read leaves the stream alone, so several threads can
+     read through the same iso9660_t. */
+  ret = cdio_stream_pread (p_iso->stream, ptr, i_len, 1, i_offset);
+  if (DRIVER_OP_UNSUPPORTED != ret) return ret;
 
-  ret = cdio_stream_seek (p_iso->stream, i_byte_offset, SEEK_SET);
-  if (ret!=0) return 0;
-  return cdio_stream_read (p_iso->stream, ptr, i_framesize, size);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock((pthread_mutex_t *) &p_iso->mutex);
+#endif
+  ret = cdio_stream_seek (p_iso->stream, i_offset, SEEK_SET);
+  if (0 == ret)
+    ret = cdio_stream_read (p_iso->stream, ptr, i_len, 1);
+  else 
+    ret = 0;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock((pthread_mutex_t *) &p_iso->mutex);
+#endif
+  return ret;
 }
 
 /*!
@@ -728,95 +960,402 @@ iso9660_iso_seek_read (const iso9660_t *p_iso, void *ptr, lsn_t start,
   return iso9660_seek_read_framesize(p_iso, ptr, start, size, ISO_BLOCKSIZE);
 }
 
+/* Extent i of p_stat. */
+static iso9660_extent_t
+_iso9660_stat_extent (const iso9660_stat_t *p_stat, unsigned int i)
+{
+  iso9660_extent_t extent;
+
+  if (p_stat->p_extents) return p_stat->p_extents[i];
+  extent.lsn  = p_stat->lsn;
+  extent.size = p_stat->size;
+  return extent;
+}
 
+/*!
+  Read up to i_size bytes of the file p_stat into buf, starting
+  i_offset bytes into the file. The number of bytes read is returned,
+  or -1 on error.
+*/
+long int
+iso9660_ifs_read_file (iso9660_t *p_iso, const iso9660_stat_t *p_stat,
+		       uint64_t i_offset, void *buf, long int i_size)
+{
+  uint8_t *p_buf = buf;
+  uint64_t i_extent_start = 0; /* file offset of the current extent */
+  long int i_done = 0;
+  unsigned int i;
 
-static iso9660_stat_t *
-_iso9660_dir_to_statbuf (iso9660_dir_t *p_iso9660_dir, bool_3way_t b_xa, 
-			 uint8_t i_joliet_level)
+  if (!p_iso || !p_stat || !buf || i_size < 0) return -1;
+
+  for (i = 0; i < p_stat->i_extents && i_done < i_size; i++) {
+    const iso9660_extent_t extent = _iso9660_stat_extent(p_stat, i);
+    const uint64_t i_extent_end = i_extent_start + extent.size;
+
+    while (i_offset < i_extent_end && i_done < i_size) {
+      const uint64_t i_rel  = i_offset - i_extent_start;
+      const lsn_t    lsn    = extent.lsn + i_rel / ISO_BLOCKSIZE;
+      const unsigned int i_skip = i_rel % ISO_BLOCKSIZE;
+      uint64_t i_left = i_extent_end - i_offset;
+      long int i_copy;
+
+      if (i_left > (uint64_t) (i_size - i_done)) i_left = i_size - i_done;
+
+      if (0 == i_skip && i_left >= ISO_BLOCKSIZE) {
+	/* Whole blocks go straight into the caller's buffer, all in
+	   one request unless the image holds raw frames, where the
+	   blocks aren't contiguous. */
+	long int i_blocks = (ISO_BLOCKSIZE == p_iso->i_framesize) 
+	  ? (long int) (i_left / ISO_BLOCKSIZE) : 1;
+	i_copy = i_blocks * ISO_BLOCKSIZE;
+	if (iso9660_iso_seek_read (p_iso, p_buf + i_done, lsn, i_blocks) 
+	    != i_copy) {
+	  cdio_warn("error reading %ld blocks at LSN %lu", i_blocks,
+		    (long unsigned int) lsn);
+	  return -1;
+	}
+      } else {
+	uint8_t block[ISO_BLOCKSIZE];
+	i_copy = ISO_BLOCKSIZE - i_skip;
+	if (i_copy > i_left) i_copy = i_left;
+	if (iso9660_iso_seek_read (p_iso, block, lsn, 1) != ISO_BLOCKSIZE) {
+	  cdio_warn("error reading block at LSN %lu", 
+		    (long unsigned int) lsn);
+	  return -1;
+	}
+	memcpy(p_buf + i_done, block + i_skip, i_copy);
+      }
+      i_done   += i_copy;
+      i_offset += i_copy;
+    }
+    i_extent_start = i_extent_end;
+  }
+  return i_done;
+}
+
+/* Size of the buffer used by iso9660_ifs_copy_file() when it can't
+   have the kernel do the copying. */
+#define ISO9660_COPY_BUFSIZE (1024 * 1024)
+
+/*!
+  Write the contents of the file p_stat to the file descriptor fd at
+  its current position. true is returned on success.
+*/
+bool
+iso9660_ifs_copy_file (iso9660_t *p_iso, const iso9660_stat_t *p_stat,
+		       int fd)
+{
+  uint64_t i_pos = 0;  /* bytes of the file copied so far */
+  uint8_t *p_buf;
+
+  if (!p_iso || !p_stat || fd < 0) return false;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  /* With a plain image file underneath, let the kernel copy the
+     extents. This fails for some pairs of files (e.g. across file
+     systems on older kernels); then we fall back to read and write. */
+  if (ISO_BLOCKSIZE == p_iso->i_framesize) {
+    int fd_in = cdio_stream_get_fd (p_iso->stream);
+    unsigned int i;
+
+    for (i = 0; fd_in >= 0 && i < p_stat->i_extents; i++) {
+      const iso9660_extent_t extent = _iso9660_stat_extent(p_stat, i);
+      uint64_t i_left = extent.size;
+      loff_t i_in = _iso9660_lsn_offset(p_iso, extent.lsn);
+
+      while (i_left > 0) {
+	ssize_t i_copied = copy_file_range(fd_in, &i_in, fd, NULL, 
+					   i_left, 0);
+	if (i_copied > 0) {
+	  i_left -= i_copied;
+	  i_pos  += i_copied;
+	} else if (i_copied < 0 && EINTR == errno) {
+	  continue;
+	} else {
+	  fd_in = -1;
+	  break;
+	}
+      }
+    }
+    if (i_pos == p_stat->total_size) return true;
+  }
+#endif /*HAVE_COPY_FILE_RANGE*/
+
+  p_buf = malloc(ISO9660_COPY_BUFSIZE);
+  if (!p_buf) {
+    cdio_warn("Couldn't malloc(%lu)", 
+	      (long unsigned int) ISO9660_COPY_BUFSIZE);
+    return false;
+  }
+
+  while (i_pos < p_stat->total_size) {
+    long int i_read = iso9660_ifs_read_file(p_iso, p_stat, i_pos, p_buf, 
+					    ISO9660_COPY_BUFSIZE);
+    long int i_written = 0;
+
+    if (i_read <= 0) break;
+    while (i_written < i_read) {
+      ssize_t ret = write(fd, p_buf + i_written, i_read - i_written);
+      if (ret < 0) {
+	if (EINTR == errno) continue;
+	cdio_warn("write(): %s", strerror(errno));
+	free(p_buf);
+	return false;
+      }
+      i_written += ret;
+    }
+    i_pos += i_read;
+  }
+
+  free(p_buf);
+  return i_pos == p_stat->total_size;
+}
+
+
+
+static void
+_dir_cache_unlink_lru (iso9660_dir_cache_t *p_cache, 
+		       iso9660_dir_cache_entry_t *p_entry)
+{
+  if (p_entry->p_lru_prev) 
+    p_entry->p_lru_prev->p_lru_next = p_entry->p_lru_next;
+  else
+    p_cache->p_lru_first = p_entry->p_lru_next;
+  if (p_entry->p_lru_next) 
+    p_entry->p_lru_next->p_lru_prev = p_entry->p_lru_prev;
+  else
+    p_cache->p_lru_last = p_entry->p_lru_prev;
+  p_entry->p_lru_prev = p_entry->p_lru_next = NULL;
+}
+
+static void
+_dir_cache_push_lru (iso9660_dir_cache_t *p_cache, 
+		     iso9660_dir_cache_entry_t *p_entry)
+{
+  p_entry->p_lru_prev = NULL;
+  p_entry->p_lru_next = p_cache->p_lru_first;
+  if (p_cache->p_lru_first) 
+    p_cache->p_lru_first->p_lru_prev = p_entry;
+  else
+    p_cache->p_lru_last = p_entry;
+  p_cache->p_lru_first = p_entry;
+}
+
+static void
+_dir_cache_evict (iso9660_dir_cache_t *p_cache)
+{
+  iso9660_dir_cache_entry_t *p_entry = p_cache->p_lru_last;
+  iso9660_dir_cache_entry_t **pp;
+
+  if (!p_entry) return;
+  _dir_cache_unlink_lru(p_cache, p_entry);
+  for (pp = &p_cache->buckets[p_entry->lsn % ISO9660_DIR_CACHE_BUCKETS];
+       *pp; pp = &(*pp)->p_hash_next)
+    if (*pp == p_entry) {
+      *pp = p_entry->p_hash_next;
+      break;
+    }
+  p_cache->i_bytes -= p_entry->i_blocks * ISO_BLOCKSIZE 
+    + p_entry->i_index_size;
+  _iso9660_dir_index_free(p_entry->p_index);
+  free(p_entry);
+}
+
+/* Evict the least recently used entries until the cache fits in
+   ISO9660_DIR_CACHE_SIZE, but for the most recently used one, which
+   the caller is using. The lock must be held. */
+static void
+_dir_cache_trim (iso9660_dir_cache_t *p_cache)
+{
+  while (p_cache->p_lru_last != p_cache->p_lru_first
+	 && p_cache->i_bytes > ISO9660_DIR_CACHE_SIZE)
+    _dir_cache_evict(p_cache);
+}
+
+/* Return the cached extent at lsn, making it the most recently used,
+   or NULL if it isn't cached. The lock must be held. */
+static iso9660_dir_cache_entry_t *
+_dir_cache_find (iso9660_dir_cache_t *p_cache, lsn_t lsn, long int i_blocks)
+{
+  iso9660_dir_cache_entry_t *p_entry;
+
+  for (p_entry = p_cache->buckets[lsn % ISO9660_DIR_CACHE_BUCKETS]; p_entry;
+       p_entry = p_entry->p_hash_next)
+    if (p_entry->lsn == lsn && p_entry->i_blocks == i_blocks) {
+      _dir_cache_unlink_lru(p_cache, p_entry);
+      _dir_cache_push_lru(p_cache, p_entry);
+      return p_entry;
+    }
+  return NULL;
+}
+
+/* Add p_new, read without the lock held, to the cache and return it.
+   If another thread got there first p_new is freed and the entry
+   already cached is returned instead. The lock must be held. */
+static iso9660_dir_cache_entry_t *
+_dir_cache_insert (iso9660_dir_cache_t *p_cache, 
+		   iso9660_dir_cache_entry_t *p_new)
+{
+  iso9660_dir_cache_entry_t *p_entry = 
+    _dir_cache_find(p_cache, p_new->lsn, p_new->i_blocks);
+  const size_t i_bytes = p_new->i_blocks * ISO_BLOCKSIZE;
+
+  if (p_entry) {
+    free(p_new);
+    return p_entry;
+  }
+  p_new->p_hash_next = p_cache->buckets[p_new->lsn % ISO9660_DIR_CACHE_BUCKETS];
+  p_cache->buckets[p_new->lsn % ISO9660_DIR_CACHE_BUCKETS] = p_new;
+  _dir_cache_push_lru(p_cache, p_new);
+  p_cache->i_bytes += i_bytes;
+  _dir_cache_trim(p_cache);
+  return p_new;
+}
+
+/* Read the i_blocks-long directory extent at lsn into a new, not yet
+   cached, cache entry. NULL is returned on error. */
+static iso9660_dir_cache_entry_t *
+_dir_cache_entry_read (iso9660_t *p_iso, lsn_t lsn, long int i_blocks)
+{
+  const size_t i_bytes = i_blocks * ISO_BLOCKSIZE;
+  iso9660_dir_cache_entry_t *p_entry = 
+    calloc(1, sizeof(iso9660_dir_cache_entry_t) + i_bytes);
+
+  if (!p_entry) {
+    cdio_warn("Couldn't calloc(1, %lu)", 
+	      (long unsigned int) (sizeof(iso9660_dir_cache_entry_t) 
+				   + i_bytes));
+    return NULL;
+  }
+  p_entry->lsn      = lsn;
+  p_entry->i_blocks = i_blocks;
+  if (iso9660_iso_seek_read (p_iso, p_entry->data, lsn, i_blocks) 
+      != i_bytes) {
+    free(p_entry);
+    return NULL;
+  }
+  return p_entry;
+}
+
+/* Read the i_blocks-long directory extent at lsn into ptr, going
+   through the directory cache of p_iso. The number of bytes read is
+   returned. */
+static long int
+_iso9660_read_dir_extent (iso9660_t *p_iso, void *ptr, lsn_t lsn, 
+			  long int i_blocks)
+{
+  iso9660_dir_cache_t *p_cache = &p_iso->dir_cache;
+  iso9660_dir_cache_entry_t *p_entry;
+  const size_t i_bytes = i_blocks * ISO_BLOCKSIZE;
+
+  if (i_bytes > ISO9660_DIR_CACHE_SIZE / 4) 
+    return iso9660_iso_seek_read (p_iso, ptr, lsn, i_blocks);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&p_iso->mutex);
+#endif
+  p_entry = _dir_cache_find(p_cache, lsn, i_blocks);
+  if (!p_entry) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&p_iso->mutex);
+#endif
+    p_entry = _dir_cache_entry_read(p_iso, lsn, i_blocks);
+    if (!p_entry) 
+      return iso9660_iso_seek_read (p_iso, ptr, lsn, i_blocks);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&p_iso->mutex);
+#endif
+    p_entry = _dir_cache_insert(p_cache, p_entry);
+  }
+  memcpy(ptr, p_entry->data, i_bytes);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&p_iso->mutex);
+#endif
+  return i_bytes;
+}
+
+/* Room needed for a decoded file name. ISO 9660 and Joliet names are
+   limited by the 8-bit filename_len field; Rock Ridge names are
+   truncated at 254 characters by get_rock_ridge_filename(). */
+#define ISO9660_DECODED_NAME_SIZE 258
+
+/* Decode p_iso9660_dir into the fixed part of p_stat and put its file
+   name in psz_name, which must hold ISO9660_DECODED_NAME_SIZE bytes.
+   A Rock Ridge symbolic link name is allocated from p_arena, or from
+   the heap if p_arena is NULL. i_decode says which of the optional
+   parts (iso9660_decode_flag_t) to fill in; the others stay zero.
+
+   false is returned if the record is bad.
+*/
+static bool
+_iso9660_dir_decode (iso9660_dir_t *p_iso9660_dir, bool_3way_t b_xa, 
+		     uint8_t i_joliet_level, unsigned int i_decode,
+		     iso9660_arena_t *p_arena,
+		     /*out*/ iso9660_stat_t *p_stat, /*out*/ char *psz_name)
 {
   uint8_t dir_len= iso9660_get_dir_len(p_iso9660_dir);
   iso711_t i_fname;
-  unsigned int stat_len;
-  iso9660_stat_t *p_stat;
 
-  if (!dir_len) return NULL;
+  if (!dir_len) return false;
 
   i_fname  = from_711(p_iso9660_dir->filename_len);
 
-  /* .. string in statbuf is one longer than in p_iso9660_dir's listing '\1' */
-  stat_len      = sizeof(iso9660_stat_t)+i_fname+2;
-
-  p_stat          = calloc(1, stat_len);
-  if (!p_stat)
-    {
-    cdio_warn("Couldn't calloc(1, %d)", stat_len);
-    return NULL;
-    }
+  memset(p_stat, 0, sizeof(iso9660_stat_t));
+  memset(psz_name, 0, ISO9660_DECODED_NAME_SIZE);
   p_stat->type    = (p_iso9660_dir->file_flags & ISO_DIRECTORY) 
     ? _STAT_DIR : _STAT_FILE;
   p_stat->lsn     = from_733 (p_iso9660_dir->extent);
   p_stat->size    = from_733 (p_iso9660_dir->size);
   p_stat->secsize = _cdio_len2blocks (p_stat->size, ISO_BLOCKSIZE);
+  p_stat->total_size = p_stat->size;
+  p_stat->i_extents  = 1;
   p_stat->rr.b3_rock = dunno; /*FIXME should do based on mask */
   p_stat->b_xa    = false; 
 
   {
-    char rr_fname[256] = "";
-
     int  i_rr_fname = 
 #ifdef HAVE_ROCK
-      get_rock_ridge_filename(p_iso9660_dir, rr_fname, p_stat);
+      _iso9660_get_rock_ridge_filename(p_iso9660_dir, psz_name, p_stat,
+                                       i_decode, p_arena);
 #else
       0;
 #endif
     
-    if (i_rr_fname > 0) {
-      if (i_rr_fname > i_fname) {
-	/* realloc gives valgrind errors */
-	iso9660_stat_t *p_stat_new = 
-	  calloc(1, sizeof(iso9660_stat_t)+i_rr_fname+2);
-        if (!p_stat_new)
-          {
-          cdio_warn("Couldn't calloc(1, %d)", sizeof(iso9660_stat_t)+i_rr_fname+2);
-          return NULL;
-          }
-	memcpy(p_stat_new, p_stat, stat_len);
-	free(p_stat);
-	p_stat = p_stat_new;
-      }
-      strncpy(p_stat->filename, rr_fname, i_rr_fname+1);
-    } else {
+    if (i_rr_fname <= 0) {
+      memset(psz_name, 0, ISO9660_DECODED_NAME_SIZE);
       if ('\0' == p_iso9660_dir->filename[0] && 1 == i_fname)
-	strncpy (p_stat->filename, ".", sizeof("."));
+	strncpy (psz_name, ".", sizeof("."));
       else if ('\1' == p_iso9660_dir->filename[0] && 1 == i_fname)
-	strncpy (p_stat->filename, "..", sizeof(".."));
+	strncpy (psz_name, "..", sizeof(".."));
 #ifdef HAVE_JOLIET
       else if (i_joliet_level) {
 	int i_inlen = i_fname;
 	cdio_utf8_t *p_psz_out = NULL;
 	if (cdio_charset_to_utf8(p_iso9660_dir->filename, i_inlen,
                              &p_psz_out, "UCS-2BE")) {
-          strncpy(p_stat->filename, p_psz_out, i_fname);
+          strncpy(psz_name, p_psz_out, i_fname);
           free(p_psz_out);
         }
         else {
-          return NULL;
+          return false;
         }
       }
 #endif /*HAVE_JOLIET*/
       else {
-	strncpy (p_stat->filename, p_iso9660_dir->filename, i_fname);
+	strncpy (psz_name, p_iso9660_dir->filename, i_fname);
       }
     }
   }
   
 
-  iso9660_get_dtime(&(p_iso9660_dir->recording_time), true, &(p_stat->tm));
+  /* This goes through mktime(), which costs more than all the rest. */
+  if (i_decode & ISO9660_DECODE_TIMES)
+    iso9660_get_dtime(&(p_iso9660_dir->recording_time), true, 
+		      &(p_stat->tm));
 
   if (dir_len < sizeof (iso9660_dir_t)) {
-    free(p_stat->rr.psz_symlink);
-    free(p_stat);
-    return NULL;
+    if (!p_arena) free(p_stat->rr.psz_symlink);
+    return false;
   }
   
 
@@ -829,10 +1368,10 @@ _iso9660_dir_to_statbuf (iso9660_dir_t *p_iso9660_dir, bool_3way_t b_xa,
       su_length--;
     
     if (su_length < 0 || su_length < sizeof (iso9660_xa_t))
-      return p_stat;
+      return true;
     
     if (nope == b_xa) {
-      return p_stat;
+      return true;
     } else {
       iso9660_xa_t *xa_data = 
 	(void *) (((char *) p_iso9660_dir)  
@@ -852,14 +1391,445 @@ _iso9660_dir_to_statbuf (iso9660_dir_t *p_iso9660_dir, bool_3way_t b_xa,
 		      su_length,
 		      xa_data->signature[0], xa_data->signature[1],
 		      xa_data->signature[0], xa_data->signature[1]);
-	  return p_stat;
+	  return true;
 	}
       p_stat->b_xa = true;
       p_stat->xa   = *xa_data;
     }
   }
+  return true;
+}
+
+/* Where the extents of a multi-extent entry with an i_name byte file
+   name are kept: after the name and its NUL, in the same allocation,
+   so that the entry is freed as before. Only entries whose first
+   directory record is flagged ISO_MULTIEXTENT get room for them. */
+static size_t
+_iso9660_stat_extents_offset (size_t i_name)
+{
+  const size_t i_align = sizeof(uint64_t);
+  return (sizeof(iso9660_stat_t) + i_name + 1 + i_align - 1) 
+    / i_align * i_align;
+}
+
+/* Room for an entry with an i_name byte file name decoded from
+   p_iso9660_dir. */
+static size_t
+_iso9660_stat_len (const iso9660_dir_t *p_iso9660_dir, size_t i_name)
+{
+  if (p_iso9660_dir->file_flags & ISO_MULTIEXTENT)
+    return _iso9660_stat_extents_offset(i_name) 
+      + ISO_MAX_MULTIEXTENT * sizeof(iso9660_extent_t);
+  return sizeof(iso9660_stat_t) + i_name + 1;
+}
+
+/* Point the extents of p_stat, allocated with _iso9660_stat_len(), at
+   their room, if it has any, and start them with its first extent. */
+static void
+_iso9660_stat_init_extents (iso9660_stat_t *p_stat, 
+			    const iso9660_dir_t *p_iso9660_dir, size_t i_name)
+{
+  if (p_iso9660_dir->file_flags & ISO_MULTIEXTENT) {
+    p_stat->p_extents = (iso9660_extent_t *) 
+      ((char *) p_stat + _iso9660_stat_extents_offset(i_name));
+    p_stat->p_extents[0].lsn  = p_stat->lsn;
+    p_stat->p_extents[0].size = p_stat->size;
+  }
+}
+
+/*!
+  Return a newly allocated copy of p_stat, with its file name and the
+  extents of a multi-extent file but without any Rock Ridge symbolic
+  link name. NULL is returned if memory could not be allocated.
+*/
+iso9660_stat_t *
+iso9660_stat_dup (const iso9660_stat_t *p_stat)
+{
+  const size_t i_name = strlen(p_stat->filename);
+  const size_t i_len = p_stat->p_extents
+    ? _iso9660_stat_extents_offset(i_name) 
+      + p_stat->i_extents * sizeof(iso9660_extent_t)
+    : sizeof(iso9660_stat_t) + i_name + 1;
+  iso9660_stat_t *p_copy = calloc(1, i_len);
+
+  if (!p_copy) {
+    cdio_warn("Couldn't calloc(1, %lu)", (long unsigned int) i_len);
+    return NULL;
+  }
+  memcpy(p_copy, p_stat, sizeof(iso9660_stat_t) + i_name + 1);
+  p_copy->rr.psz_symlink  = NULL;
+  p_copy->rr.i_symlink     = 0;
+  p_copy->rr.i_symlink_max = 0;
+  if (p_stat->p_extents) {
+    p_copy->p_extents = (iso9660_extent_t *) 
+      ((char *) p_copy + _iso9660_stat_extents_offset(i_name));
+    memcpy(p_copy->p_extents, p_stat->p_extents, 
+	   p_stat->i_extents * sizeof(iso9660_extent_t));
+  }
+  return p_copy;
+}
+
+static iso9660_stat_t *
+_iso9660_dir_to_statbuf (iso9660_dir_t *p_iso9660_dir, bool_3way_t b_xa, 
+			 uint8_t i_joliet_level, unsigned int i_decode)
+{
+  iso9660_stat_t stat;
+  char psz_name[ISO9660_DECODED_NAME_SIZE];
+  unsigned int i_name;
+  unsigned int stat_len;
+  iso9660_stat_t *p_stat;
+
+  if (!_iso9660_dir_decode(p_iso9660_dir, b_xa, i_joliet_level, i_decode,
+			   NULL, &stat, psz_name))
+    return NULL;
+
+  /* .. string in statbuf is one longer than in p_iso9660_dir's listing '\1' */
+  i_name = strlen(psz_name);
+  if (i_name < from_711(p_iso9660_dir->filename_len))
+    i_name = from_711(p_iso9660_dir->filename_len);
+  stat_len = _iso9660_stat_len(p_iso9660_dir, i_name+1);
+
+  p_stat = calloc(1, stat_len);
+  if (!p_stat)
+    {
+    cdio_warn("Couldn't calloc(1, %d)", stat_len);
+    free(stat.rr.psz_symlink);
+    return NULL;
+    }
+  memcpy(p_stat, &stat, sizeof(iso9660_stat_t));
+  strcpy(p_stat->filename, psz_name);
+  _iso9660_stat_init_extents(p_stat, p_iso9660_dir, i_name+1);
+  return p_stat;
+}
+
+/* Same as _iso9660_dir_to_statbuf() but everything, including the
+   file name and any symbolic link name, is allocated from p_arena.
+   The result must not be passed to free().
+*/
+static iso9660_stat_t *
+_iso9660_dir_to_statbuf_arena (iso9660_dir_t *p_iso9660_dir, 
+			       bool_3way_t b_xa, uint8_t i_joliet_level,
+			       unsigned int i_decode, iso9660_arena_t *p_arena)
+{
+  iso9660_stat_t stat;
+  char psz_name[ISO9660_DECODED_NAME_SIZE];
+  unsigned int i_name;
+  iso9660_stat_t *p_stat;
+
+  if (!_iso9660_dir_decode(p_iso9660_dir, b_xa, i_joliet_level, i_decode,
+			   p_arena, &stat, psz_name))
+    return NULL;
+
+  i_name = strlen(psz_name);
+  p_stat = iso9660_arena_alloc(p_arena, 
+			       _iso9660_stat_len(p_iso9660_dir, i_name));
+  if (!p_stat) return NULL;
+  memcpy(p_stat, &stat, sizeof(iso9660_stat_t));
+  memcpy(p_stat->filename, psz_name, i_name+1);
+  _iso9660_stat_init_extents(p_stat, p_iso9660_dir, i_name);
+  return p_stat;
+}
+
+/* A file larger than 4 GiB is recorded as several consecutive
+   directory records with the same name, each but the last one flagged
+   ISO_MULTIEXTENT. *pp_multi is the entry whose later extents are
+   still to come, or NULL. If p_iso9660_dir, decoded as p_stat,
+   continues *pp_multi, its extent is added there and true is
+   returned: the caller should drop p_stat. Otherwise p_stat is a
+   separate entry and false is returned. */
+static bool
+_iso9660_stat_merge_extent (iso9660_stat_t **pp_multi, 
+			    const iso9660_dir_t *p_iso9660_dir,
+			    iso9660_stat_t *p_stat)
+{
+  iso9660_stat_t *p_multi = *pp_multi;
+  const bool b_more = 0 != (p_iso9660_dir->file_flags & ISO_MULTIEXTENT);
+
+  if (p_multi && !strcmp(p_multi->filename, p_stat->filename)) {
+    if (p_multi->i_extents < ISO_MAX_MULTIEXTENT) {
+      p_multi->p_extents[p_multi->i_extents].lsn  = p_stat->lsn;
+      p_multi->p_extents[p_multi->i_extents].size = p_stat->size;
+      p_multi->i_extents++;
+      p_multi->total_size += p_stat->size;
+      *pp_multi = b_more ? p_multi : NULL;
+      return true;
+    }
+    cdio_warn("%s has more than %d extents; ignoring the rest",
+	      p_multi->filename, ISO_MAX_MULTIEXTENT);
+    *pp_multi = b_more ? p_multi : NULL;
+    return true;
+  }
+
+  *pp_multi = b_more ? p_stat : NULL;
+  return false;
+}
+
+/* A directory name index maps each name a path component may match
+   to the offset of its directory record in the extent. Besides the
+   decoded name, a plain ISO 9660 entry (no Joliet, no Rock Ridge
+   name) is also entered under its translated name: version number
+   dropped and lowercased. When two entries have the same key the
+   first in directory order wins, just as with a linear scan. 
+
+   The whole index lives in a single arena, so building it costs a
+   handful of allocations and a lookup costs none. */
+typedef struct {
+  uint32_t    i_hash;
+  uint32_t    i_offset;   /* of the directory record in the extent */
+  const char *psz_name;
+} iso9660_dir_key_t;
+
+struct iso9660_dir_index_s {
+  iso9660_arena_t   *p_arena;  /* everything below is allocated here */
+  unsigned int       i_size;   /* of the directory extent */
+  unsigned int       i_keys;
+  uint32_t           i_mask;   /* size of p_table minus one */
+  iso9660_dir_key_t *p_keys;
+  uint32_t          *p_table;  /* key number + 1, or 0 if unused */
+};
+
+/* FNV-1a */
+static uint32_t
+_iso9660_name_hash (const char *psz_name)
+{
+  uint32_t i_hash = 2166136261U;
+  for ( ; *psz_name; psz_name++) {
+    i_hash ^= (uint8_t) *psz_name;
+    i_hash *= 16777619U;
+  }
+  return i_hash;
+}
+
+static void
+_iso9660_dir_index_add (iso9660_dir_index_t *p_index, const char *psz_name,
+			uint32_t i_offset)
+{
+  const uint32_t i_hash = _iso9660_name_hash(psz_name);
+  uint32_t i_slot = i_hash & p_index->i_mask;
+  iso9660_dir_key_t *p_key;
+
+  for ( ; p_index->p_table[i_slot]; i_slot = (i_slot + 1) & p_index->i_mask) {
+    p_key = &p_index->p_keys[p_index->p_table[i_slot] - 1];
+    if (p_key->i_hash == i_hash && !strcmp(p_key->psz_name, psz_name))
+      return;
+  }
+
+  p_key = &p_index->p_keys[p_index->i_keys++];
+  p_key->i_hash   = i_hash;
+  p_key->i_offset = i_offset;
+  p_key->psz_name = psz_name;
+  p_index->p_table[i_slot] = p_index->i_keys;
+}
+
+static void
+_iso9660_dir_index_free (iso9660_dir_index_t *p_index)
+{
+  if (p_index) iso9660_arena_free(p_index->p_arena);
+}
+
+/* Build the name index of the directory extent p_extent, i_size bytes
+   long. The size of memory used is stored in *pi_mem if pi_mem is not
+   NULL. NULL is returned if the extent is bad or memory runs out. */
+static iso9660_dir_index_t *
+_iso9660_dir_index_new (const uint8_t *p_extent, unsigned int i_size,
+			bool_3way_t b_xa, uint8_t i_joliet_level, 
+			/*out*/ size_t *pi_mem)
+{
+  iso9660_arena_t *p_arena;
+  iso9660_dir_index_t *p_index;
+  unsigned int i_records = 0;
+  unsigned int i_table = 4;
+  unsigned int offset;
+
+  for (offset = 0; offset < i_size; ) {
+    const iso9660_dir_t *p_iso9660_dir = (const void *) &p_extent[offset];
+    if (!iso9660_get_dir_len(p_iso9660_dir)) {
+      offset++;
+      continue;
+    }
+    i_records++;
+    offset += iso9660_get_dir_len(p_iso9660_dir);
+  }
+  if (offset != i_size) return NULL;
+
+  /* Each record gives at most two keys; keep the table at most half
+     full. */
+  while (i_table < 4 * i_records) i_table *= 2;
+
+  /* Decoded names are never much longer than the records they come
+     from, so twice the extent size is usually all we need. */
+  p_arena = iso9660_arena_new(2 * i_size + i_table * sizeof(uint32_t)
+			      + 2 * i_records * sizeof(iso9660_dir_key_t)
+			      + sizeof(iso9660_dir_index_t));
+  if (!p_arena) return NULL;
+
+  p_index = iso9660_arena_calloc(p_arena, sizeof(iso9660_dir_index_t));
+  if (!p_index) goto error;
+  p_index->p_arena = p_arena;
+  p_index->i_size  = i_size;
+  p_index->i_mask  = i_table - 1;
+  p_index->p_keys  = iso9660_arena_alloc(p_arena, (2 * i_records + 1)
+					 * sizeof(iso9660_dir_key_t));
+  p_index->p_table = iso9660_arena_calloc(p_arena, 
+					  i_table * sizeof(uint32_t));
+  if (!p_index->p_keys || !p_index->p_table) goto error;
+
+  for (offset = 0; offset < i_size; ) {
+    iso9660_dir_t *p_iso9660_dir = (void *) &p_extent[offset];
+    iso9660_stat_t stat;
+    char psz_name[ISO9660_DECODED_NAME_SIZE];
+    char *psz_key;
+    size_t i_name;
+
+    if (!iso9660_get_dir_len(p_iso9660_dir)) {
+      offset++;
+      continue;
+    }
+
+    /* Only the names are wanted here. */
+    if (_iso9660_dir_decode(p_iso9660_dir, b_xa, i_joliet_level, 
+			    ISO9660_DECODE_NAME, p_arena, &stat, psz_name)) {
+      i_name = strlen(psz_name);
+      psz_key = iso9660_arena_alloc(p_arena, i_name + 1);
+      if (!psz_key) goto error;
+      memcpy(psz_key, psz_name, i_name + 1);
+      _iso9660_dir_index_add(p_index, psz_key, offset);
+
+      if (0 == i_joliet_level && yep != stat.rr.b3_rock && i_name) {
+	char psz_trans[ISO9660_DECODED_NAME_SIZE];
+	iso9660_name_translate_ext(psz_name, psz_trans, i_joliet_level);
+	if (strcmp(psz_trans, psz_name)) {
+	  i_name = strlen(psz_trans);
+	  psz_key = iso9660_arena_alloc(p_arena, i_name + 1);
+	  if (!psz_key) goto error;
+	  memcpy(psz_key, psz_trans, i_name + 1);
+	  _iso9660_dir_index_add(p_index, psz_key, offset);
+	}
+      }
+    }
+    offset += iso9660_get_dir_len(p_iso9660_dir);
+  }
+
+  if (pi_mem) 
+    *pi_mem = 2 * i_size + i_table * sizeof(uint32_t)
+      + 2 * i_records * sizeof(iso9660_dir_key_t);
+  return p_index;
+
+ error:
+  iso9660_arena_free(p_arena);
+  return NULL;
+}
+
+/* Find psz_name in the directory extent p_extent through p_index and
+   return a newly allocated iso9660_stat_t for it, or NULL if there
+   is no such entry. */
+static iso9660_stat_t *
+_iso9660_dir_index_stat (const iso9660_dir_index_t *p_index, 
+			 const uint8_t *p_extent, const char psz_name[],
+			 bool_3way_t b_xa, uint8_t i_joliet_level,
+			 unsigned int i_decode)
+{
+  const uint32_t i_hash = _iso9660_name_hash(psz_name);
+  uint32_t i_slot = i_hash & p_index->i_mask;
+
+  for ( ; p_index->p_table[i_slot]; i_slot = (i_slot + 1) & p_index->i_mask) {
+    const iso9660_dir_key_t *p_key = 
+      &p_index->p_keys[p_index->p_table[i_slot] - 1];
+    if (p_key->i_hash == i_hash && !strcmp(p_key->psz_name, psz_name)) {
+      unsigned int offset = p_key->i_offset;
+      iso9660_dir_t *p_iso9660_dir = (void *) &p_extent[offset];
+      iso9660_stat_t *p_stat = 
+	_iso9660_dir_to_statbuf (p_iso9660_dir, b_xa, i_joliet_level, i_decode);
+      iso9660_stat_t *p_multi = NULL;
+
+      if (!p_stat) return NULL;
+      _iso9660_stat_merge_extent(&p_multi, p_iso9660_dir, p_stat);
+
+      /* Pick up the remaining extents of a multi-extent file. */
+      while (p_multi) {
+	iso9660_stat_t *p_next;
+	offset += iso9660_get_dir_len(p_iso9660_dir);
+	while (offset < p_index->i_size && !p_extent[offset]) offset++;
+	if (offset >= p_index->i_size) break;
+	p_iso9660_dir = (void *) &p_extent[offset];
+	p_next = _iso9660_dir_to_statbuf (p_iso9660_dir, b_xa, i_joliet_level,
+					  i_decode);
+	if (!p_next) break;
+	if (!_iso9660_stat_merge_extent(&p_multi, p_iso9660_dir, p_next))
+	  p_multi = NULL;
+	free(p_next->rr.psz_symlink);
+	free(p_next);
+      }
+      return p_stat;
+    }
+  }
+  return NULL;
+}
+
+/* Look up psz_name in the directory p_dir of p_iso. The name index is
+   built when a cached directory is first searched and kept with the
+   cached extent afterwards, so walking down a path reads and decodes
+   each directory at most once. A newly allocated iso9660_stat_t is
+   returned, or NULL if there is no such entry or on error. */
+static iso9660_stat_t *
+_iso9660_dir_lookup (iso9660_t *p_iso, const iso9660_stat_t *p_dir,
+		     const char psz_name[])
+{
+  iso9660_dir_cache_t *p_cache = &p_iso->dir_cache;
+  iso9660_dir_cache_entry_t *p_entry;
+  iso9660_stat_t *p_stat = NULL;
+  const size_t i_bytes = p_dir->secsize * ISO_BLOCKSIZE;
+
+  if (i_bytes > ISO9660_DIR_CACHE_SIZE / 4) {
+    /* Too big to keep around: index it just for this lookup. */
+    iso9660_dir_index_t *p_index;
+    p_entry = _dir_cache_entry_read(p_iso, p_dir->lsn, p_dir->secsize);
+    if (!p_entry) return NULL;
+    p_index = _iso9660_dir_index_new(p_entry->data, i_bytes, p_iso->b_xa,
+				     p_iso->i_joliet_level, NULL);
+    if (p_index) 
+      p_stat = _iso9660_dir_index_stat(p_index, p_entry->data, psz_name,
+				       p_iso->b_xa, p_iso->i_joliet_level,
+				       p_iso->i_decode);
+    _iso9660_dir_index_free(p_index);
+    free(p_entry);
+    return p_stat;
+  }
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&p_iso->mutex);
+#endif
+  p_entry = _dir_cache_find(p_cache, p_dir->lsn, p_dir->secsize);
+  if (!p_entry) {
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&p_iso->mutex);
+#endif
+    p_entry = _dir_cache_entry_read(p_iso, p_dir->lsn, p_dir->secsize);
+    if (!p_entry) return NULL;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&p_iso->mutex);
+#endif
+    p_entry = _dir_cache_insert(p_cache, p_entry);
+  }
+  if (!p_entry->p_index) {
+    p_entry->p_index = _iso9660_dir_index_new(p_entry->data, i_bytes,
+					      p_iso->b_xa,
+					      p_iso->i_joliet_level, 
+					      &p_entry->i_index_size);
+    if (p_entry->p_index) {
+      /* The index counts against the cache size as well. */
+      p_cache->i_bytes += p_entry->i_index_size;
+      _dir_cache_trim(p_cache);
+    }
+  }
+  if (p_entry->p_index)
+    p_stat = _iso9660_dir_index_stat(p_entry->p_index, p_entry->data, 
+				     psz_name, p_iso->b_xa, 
+				     p_iso->i_joliet_level, p_iso->i_decode);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&p_iso->mutex);
+#endif
   return p_stat;
-    
 }
 
 /*!
@@ -933,7 +1903,8 @@ _fs_stat_root (CdIo_t *p_cdio)
 #endif
     
     p_stat = _iso9660_dir_to_statbuf (p_iso9660_dir, b_xa, 
-				      p_env->i_joliet_level);
+				      p_env->i_joliet_level, 
+				      ISO9660_DECODE_ALL);
     return p_stat;
   }
   
@@ -954,7 +1925,7 @@ _ifs_stat_root (iso9660_t *p_iso)
 #endif
   
   p_stat = _iso9660_dir_to_statbuf (p_iso9660_dir, p_iso->b_xa,
-				    p_iso->i_joliet_level);
+				    p_iso->i_joliet_level, p_iso->i_decode);
   return p_stat;
 }
 
@@ -962,16 +1933,18 @@ static iso9660_stat_t *
 _fs_stat_traverse (const CdIo_t *p_cdio, const iso9660_stat_t *_root, 
 		   char **splitpath)
 {
-  unsigned offset = 0;
   uint8_t *_dirbuf = NULL;
-  iso9660_stat_t *p_stat;
+  iso9660_dir_index_t *p_index;
+  iso9660_stat_t *p_stat = NULL;
   generic_img_private_t *p_env = (generic_img_private_t *) p_cdio->env;
 
   if (!splitpath[0])
     {
-      unsigned int len=sizeof(iso9660_stat_t) + strlen(_root->filename)+1;
-      p_stat = calloc(1, len);
-      memcpy(p_stat, _root, len);
+      /* The caller frees _root, so the copy needs its own extents. */
+      p_stat = iso9660_stat_dup(_root);
+      if (!p_stat) return NULL;
+      p_stat->rr.i_symlink     = _root->rr.i_symlink;
+      p_stat->rr.i_symlink_max = _root->rr.i_symlink_max;
       p_stat->rr.psz_symlink = calloc(1, p_stat->rr.i_symlink_max);
       memcpy(p_stat->rr.psz_symlink, _root->rr.psz_symlink, 
 	     p_stat->rr.i_symlink_max);
@@ -998,87 +1971,46 @@ _fs_stat_traverse (const CdIo_t *p_cdio, const iso9660_stat_t *_root,
     }
 
   if (cdio_read_data_sectors (p_cdio, _dirbuf, _root->lsn, ISO_BLOCKSIZE, 
-			      _root->secsize))
-      return NULL;
-  
-  while (offset < (_root->secsize * ISO_BLOCKSIZE))
-    {
-      iso9660_dir_t *p_iso9660_dir = (void *) &_dirbuf[offset];
-      iso9660_stat_t *p_stat;
-      int cmp;
-
-      if (!iso9660_get_dir_len(p_iso9660_dir))
-	{
-	  offset++;
-	  continue;
-	}
-      
-      p_stat = _iso9660_dir_to_statbuf (p_iso9660_dir, dunno, 
-					p_env->i_joliet_level);
-
-      cmp = strcmp(splitpath[0], p_stat->filename);
+			      _root->secsize)) {
+    free (_dirbuf);
+    return NULL;
+  }
 
-      if ( 0 != cmp && 0 == p_env->i_joliet_level 
-	   && yep != p_stat->rr.b3_rock ) {
-	char *trans_fname = NULL;
-	unsigned int i_trans_fname=strlen(p_stat->filename);
-	int trans_len;
-	
-	if (i_trans_fname) {
-	  trans_fname = calloc(1, i_trans_fname+1);
-	  if (!trans_fname) {
-	    cdio_warn("can't allocate %lu bytes", 
-		      (long unsigned int) strlen(p_stat->filename));
-	    return NULL;
-	  }
-	  trans_len = iso9660_name_translate_ext(p_stat->filename, trans_fname,
-						 p_env->i_joliet_level);
-	  cmp = strcmp(splitpath[0], trans_fname);
-	  free(trans_fname);
-	}
-      }
-      
-      if (!cmp) {
-	iso9660_stat_t *ret_stat 
-	  = _fs_stat_traverse (p_cdio, p_stat, &splitpath[1]);
-	free(p_stat->rr.psz_symlink);
-	free(p_stat);
-	free (_dirbuf);
-	return ret_stat;
-      }
+  /* The index is thrown away again, but using it saves building an
+     iso9660_stat_t for every entry we pass over. */
+  p_index = _iso9660_dir_index_new(_dirbuf, _root->secsize * ISO_BLOCKSIZE,
+				   dunno, p_env->i_joliet_level, NULL);
+  if (p_index)
+    p_stat = _iso9660_dir_index_stat(p_index, _dirbuf, splitpath[0], dunno,
+				     p_env->i_joliet_level, 
+				     ISO9660_DECODE_ALL);
+  _iso9660_dir_index_free(p_index);
+  free (_dirbuf);
 
-      free(p_stat->rr.psz_symlink);
-      free(p_stat);
-	  
-      offset += iso9660_get_dir_len(p_iso9660_dir);
-    }
+  if (!p_stat) return NULL;   /* not found */
 
-  cdio_assert (offset == (_root->secsize * ISO_BLOCKSIZE));
-  
-  /* not found */
-  free (_dirbuf);
-  return NULL;
+  {
+    iso9660_stat_t *ret_stat 
+      = _fs_stat_traverse (p_cdio, p_stat, &splitpath[1]);
+    free(p_stat->rr.psz_symlink);
+    free(p_stat);
+    return ret_stat;
+  }
 }
 
 static iso9660_stat_t *
 _fs_iso_stat_traverse (iso9660_t *p_iso, const iso9660_stat_t *_root, 
 		       char **splitpath)
 {
-  unsigned offset = 0;
-  uint8_t *_dirbuf = NULL;
-  int ret;
+  iso9660_stat_t *p_stat;
 
   if (!splitpath[0])
     {
-      iso9660_stat_t *p_stat;
-      unsigned int len=sizeof(iso9660_stat_t) + strlen(_root->filename)+1;
-      p_stat = calloc(1, len);
-      if (!p_stat)
-        {
-        cdio_warn("Couldn't calloc(1, %d)", len);
-        return NULL;
-        }
-      memcpy(p_stat, _root, len);
+      /* The caller frees _root, so the copy needs its own extents. */
+      p_stat = iso9660_stat_dup(_root);
+      if (!p_stat) return NULL;
+      p_stat->rr.i_symlink     = _root->rr.i_symlink;
+      p_stat->rr.i_symlink_max = _root->rr.i_symlink_max;
       p_stat->rr.psz_symlink = calloc(1, p_stat->rr.i_symlink_max);
       memcpy(p_stat->rr.psz_symlink, _root->rr.psz_symlink, 
 	     p_stat->rr.i_symlink_max);
@@ -1097,73 +2029,16 @@ _fs_iso_stat_traverse (iso9660_t *p_iso, const iso9660_stat_t *_root,
 		 (unsigned long int) ISO_BLOCKSIZE * _root->secsize);
     }
   
-  _dirbuf = calloc(1, _root->secsize * ISO_BLOCKSIZE);
-  if (!_dirbuf)
-    {
-    cdio_warn("Couldn't calloc(1, %d)", _root->secsize * ISO_BLOCKSIZE);
-    return NULL;
-    }
-
-  ret = iso9660_iso_seek_read (p_iso, _dirbuf, _root->lsn, _root->secsize);
-  if (ret!=ISO_BLOCKSIZE*_root->secsize) return NULL;
-  
-  while (offset < (_root->secsize * ISO_BLOCKSIZE))
-    {
-      iso9660_dir_t *p_iso9660_dir = (void *) &_dirbuf[offset];
-      iso9660_stat_t *p_stat;
-      int cmp;
-
-      if (!iso9660_get_dir_len(p_iso9660_dir))
-	{
-	  offset++;
-	  continue;
-	}
-      
-      p_stat = _iso9660_dir_to_statbuf (p_iso9660_dir, p_iso->b_xa, 
-					p_iso->i_joliet_level);
-
-      cmp = strcmp(splitpath[0], p_stat->filename);
-
-      if ( 0 != cmp && 0 == p_iso->i_joliet_level 
-	   && yep != p_stat->rr.b3_rock ) {
-	char *trans_fname = NULL;
-	unsigned int i_trans_fname=strlen(p_stat->filename);
-	int trans_len;
-	
-	if (i_trans_fname) {
-	  trans_fname = calloc(1, i_trans_fname+1);
-	  if (!trans_fname) {
-	    cdio_warn("can't allocate %lu bytes", 
-		      (long unsigned int) strlen(p_stat->filename));
-	    return NULL;
-	  }
-	  trans_len = iso9660_name_translate_ext(p_stat->filename, trans_fname, 
-						 p_iso->i_joliet_level);
-	  cmp = strcmp(splitpath[0], trans_fname);
-	  free(trans_fname);
-	}
-      }
-      
-      if (!cmp) {
-	iso9660_stat_t *ret_stat 
-	  = _fs_iso_stat_traverse (p_iso, p_stat, &splitpath[1]);
-	free(p_stat->rr.psz_symlink);
-	free(p_stat);
-	free (_dirbuf);
-	return ret_stat;
-      }
-
-      free(p_stat->rr.psz_symlink);
-      free(p_stat);
-	  
-      offset += iso9660_get_dir_len(p_iso9660_dir);
-    }
+  p_stat = _iso9660_dir_lookup (p_iso, _root, splitpath[0]);
+  if (!p_stat) return NULL;   /* not found */
 
-  cdio_assert (offset == (_root->secsize * ISO_BLOCKSIZE));
-  
-  /* not found */
-  free (_dirbuf);
-  return NULL;
+  {
+    iso9660_stat_t *ret_stat 
+      = _fs_iso_stat_traverse (p_iso, p_stat, &splitpath[1]);
+    free(p_stat->rr.psz_symlink);
+    free(p_stat);
+    return ret_stat;
+  }
 }
 
 /*!
@@ -1273,13 +2148,11 @@ iso9660_ifs_stat (iso9660_t *p_iso, const char psz_path[])
 }
 
 /*! 
-  Read psz_path (a directory) and return a list of iso9660_stat_t
+  Read psz_path (a directory) and return a vector of iso9660_stat_t
   of the files inside that. The caller must free the returned result.
-
-  b_mode2 is historical. It is not used.
 */
-CdioList_t * 
-iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[], bool b_mode2)
+CdioVector_t * 
+iso9660_fs_readdir_vector (CdIo_t *p_cdio, const char psz_path[])
 {
   generic_img_private_t *p_env;
   iso9660_stat_t *p_stat;
@@ -1301,7 +2174,8 @@ iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[], bool b_mode2)
   {
     unsigned offset = 0;
     uint8_t *_dirbuf = NULL;
-    CdioList_t *retval = _cdio_list_new ();
+    iso9660_stat_t *p_multi = NULL;
+    CdioVector_t *retval = _cdio_vector_new ();
 
     if (p_stat->size != ISO_BLOCKSIZE * p_stat->secsize)
       {
@@ -1333,8 +2207,16 @@ iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[], bool b_mode2)
 	  }
 
 	p_iso9660_stat = _iso9660_dir_to_statbuf(p_iso9660_dir, dunno,
-						 p_env->i_joliet_level);
-	_cdio_list_append (retval, p_iso9660_stat);
+						 p_env->i_joliet_level,
+						 ISO9660_DECODE_ALL);
+	if (p_iso9660_stat) {
+	  if (_iso9660_stat_merge_extent(&p_multi, p_iso9660_dir, 
+					 p_iso9660_stat)) {
+	    free(p_iso9660_stat->rr.psz_symlink);
+	    free(p_iso9660_stat);
+	  } else
+	    _cdio_vector_append (retval, p_iso9660_stat);
+	}
 
 	offset += iso9660_get_dir_len(p_iso9660_dir);
       }
@@ -1348,11 +2230,11 @@ iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[], bool b_mode2)
 }
 
 /*! 
-  Read psz_path (a directory) and return a list of iso9660_stat_t
+  Read psz_path (a directory) and return a vector of iso9660_stat_t
   of the files inside that. The caller must free the returned result.
 */
-CdioList_t * 
-iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
+CdioVector_t * 
+iso9660_ifs_readdir_vector (iso9660_t *p_iso, const char psz_path[])
 {
   iso9660_stat_t *p_stat;
 
@@ -1372,7 +2254,8 @@ iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
     long int ret;
     unsigned offset = 0;
     uint8_t *_dirbuf = NULL;
-    CdioList_t *retval = _cdio_list_new ();
+    iso9660_stat_t *p_multi = NULL;
+    CdioVector_t *retval = _cdio_vector_new ();
 
     if (p_stat->size != ISO_BLOCKSIZE * p_stat->secsize)
       {
@@ -1388,7 +2271,8 @@ iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
         return NULL;
       }
 
-    ret = iso9660_iso_seek_read (p_iso, _dirbuf, p_stat->lsn, p_stat->secsize);
+    ret = _iso9660_read_dir_extent (p_iso, _dirbuf, p_stat->lsn, 
+				    p_stat->secsize);
     if (ret != ISO_BLOCKSIZE*p_stat->secsize) return NULL;
     
     while (offset < (p_stat->secsize * ISO_BLOCKSIZE))
@@ -1403,10 +2287,17 @@ iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
 	  }
 
 	p_iso9660_stat = _iso9660_dir_to_statbuf(p_iso9660_dir, p_iso->b_xa,
-						 p_iso->i_joliet_level);
-
-	if (p_iso9660_stat) 
-	  _cdio_list_append (retval, p_iso9660_stat);
+						 p_iso->i_joliet_level,
+						 p_iso->i_decode);
+
+	if (p_iso9660_stat) {
+	  if (_iso9660_stat_merge_extent(&p_multi, p_iso9660_dir, 
+					 p_iso9660_stat)) {
+	    free(p_iso9660_stat->rr.psz_symlink);
+	    free(p_iso9660_stat);
+	  } else
+	    _cdio_vector_append (retval, p_iso9660_stat);
+	}
 
 	offset += iso9660_get_dir_len(p_iso9660_dir);
       }
@@ -1415,7 +2306,7 @@ iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
 
     if (offset != (p_stat->secsize * ISO_BLOCKSIZE)) {
       free (p_stat);
-      _cdio_list_free (retval, true);
+      _cdio_vector_free (retval, true);
       return NULL;
     }
 
@@ -1424,7 +2315,154 @@ iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
   }
 }
 
-typedef CdioList_t * (iso9660_readdir_t) 
+/* Move the elements of p_vector, which is freed, into a new list. */
+static CdioList_t *
+_iso9660_vector_to_list (CdioVector_t *p_vector)
+{
+  CdioList_t *p_list;
+  unsigned int i;
+  void *p_data;
+
+  if (!p_vector) return NULL;
+
+  p_list = _cdio_list_new ();
+  _CDIO_VECTOR_FOREACH (i, p_data, p_vector)
+    _cdio_list_append (p_list, p_data);
+  _cdio_vector_free (p_vector, false);
+  return p_list;
+}
+
+/*! 
+  Read psz_path (a directory) and return a list of iso9660_stat_t
+  of the files inside that. The caller must free the returned result.
+
+  b_mode2 is historical. It is not used.
+*/
+CdioList_t * 
+iso9660_fs_readdir (CdIo_t *p_cdio, const char psz_path[], bool b_mode2)
+{
+  return _iso9660_vector_to_list (iso9660_fs_readdir_vector (p_cdio, 
+                                                             psz_path));
+}
+
+/*! 
+  Read psz_path (a directory) and return a list of iso9660_stat_t
+  of the files inside that. The caller must free the returned result.
+*/
+CdioList_t * 
+iso9660_ifs_readdir (iso9660_t *p_iso, const char psz_path[])
+{
+  return _iso9660_vector_to_list (iso9660_ifs_readdir_vector (p_iso, 
+                                                              psz_path));
+}
+
+/*! 
+  Read the directory described by p_dir and return a NULL-terminated
+  array of iso9660_stat_t pointers for the files inside it. If p_dir
+  is NULL the root directory is read.
+
+  The array and everything it points to is allocated from p_arena and
+  is released by iso9660_arena_reset() or iso9660_arena_free(); none of
+  it may be passed to free(). If pi_entries is not NULL, the number of
+  entries is stored there.
+
+  NULL is returned on error.
+*/
+iso9660_stat_t **
+iso9660_ifs_readdir_arena (iso9660_t *p_iso, const iso9660_stat_t *p_dir,
+			   iso9660_arena_t *p_arena, 
+			   /*out*/ unsigned int *pi_entries)
+{
+  iso9660_stat_t root;
+  iso9660_stat_t **pp_entries;
+  iso9660_stat_t *p_multi = NULL;
+  unsigned int i_entries = 0;
+  unsigned int i_dirsize;
+  unsigned int offset;
+  uint8_t *_dirbuf;
+  long int ret;
+
+  if (!p_iso)   return NULL;
+  if (!p_arena) return NULL;
+
+  if (!p_dir) {
+    char psz_name[ISO9660_DECODED_NAME_SIZE];
+    iso9660_dir_t *p_iso9660_dir;
+#ifdef HAVE_JOLIET
+    p_iso9660_dir = p_iso->i_joliet_level 
+      ? &(p_iso->svd.root_directory_record)
+      : &(p_iso->pvd.root_directory_record) ;
+#else 
+    p_iso9660_dir = &(p_iso->pvd.root_directory_record) ;
+#endif
+    if (!_iso9660_dir_decode(p_iso9660_dir, p_iso->b_xa, 
+			     p_iso->i_joliet_level, p_iso->i_decode, p_arena,
+			     &root, psz_name))
+      return NULL;
+    p_dir = &root;
+  }
+
+  if (p_dir->type != _STAT_DIR) return NULL;
+
+  if (p_dir->size != ISO_BLOCKSIZE * p_dir->secsize)
+    {
+      cdio_warn ("bad size for ISO9660 directory (%ud) should be (%lu)!",
+		 (unsigned int) p_dir->size, 
+		 (unsigned long int) ISO_BLOCKSIZE * p_dir->secsize);
+    }
+
+  i_dirsize = p_dir->secsize * ISO_BLOCKSIZE;
+  _dirbuf = _iso9660_arena_scratch(p_arena, i_dirsize);
+  if (!_dirbuf) return NULL;
+
+  ret = _iso9660_read_dir_extent (p_iso, _dirbuf, p_dir->lsn, p_dir->secsize);
+  if (ret != i_dirsize) return NULL;
+
+  /* Count the entries first so the result array can be sized exactly. */
+  for (offset = 0; offset < i_dirsize; ) {
+    iso9660_dir_t *p_iso9660_dir = (void *) &_dirbuf[offset];
+    if (!iso9660_get_dir_len(p_iso9660_dir)) {
+      offset++;
+      continue;
+    }
+    i_entries++;
+    offset += iso9660_get_dir_len(p_iso9660_dir);
+  }
+
+  if (offset != i_dirsize) return NULL;
+
+  pp_entries = iso9660_arena_alloc(p_arena, 
+				   (i_entries+1) * sizeof(iso9660_stat_t *));
+  if (!pp_entries) return NULL;
+
+  i_entries = 0;
+  for (offset = 0; offset < i_dirsize; ) {
+    iso9660_dir_t *p_iso9660_dir = (void *) &_dirbuf[offset];
+    iso9660_stat_t *p_iso9660_stat;
+
+    if (!iso9660_get_dir_len(p_iso9660_dir)) {
+      offset++;
+      continue;
+    }
+
+    p_iso9660_stat = _iso9660_dir_to_statbuf_arena(p_iso9660_dir, 
+						   p_iso->b_xa,
+						   p_iso->i_joliet_level,
+						   p_iso->i_decode, p_arena);
+    if (p_iso9660_stat 
+	&& !_iso9660_stat_merge_extent(&p_multi, p_iso9660_dir, 
+				       p_iso9660_stat))
+      pp_entries[i_entries++] = p_iso9660_stat;
+
+    offset += iso9660_get_dir_len(p_iso9660_dir);
+  }
+  pp_entries[i_entries] = NULL;
+
+  if (pi_entries) *pi_entries = i_entries;
+  return pp_entries;
+}
+
+typedef CdioVector_t * (iso9660_readdir_t) 
   (void *p_image,  const char * psz_path);
 
 static iso9660_stat_t *
@@ -1432,17 +2470,18 @@ find_lsn_recurse (void *p_image, iso9660_readdir_t iso9660_readdir,
 		  const char psz_path[], lsn_t lsn,
 		  /*out*/ char **ppsz_full_filename)
 {
-  CdioList_t *entlist = iso9660_readdir (p_image, psz_path);
-  CdioList_t *dirlist =  _cdio_list_new ();
-  CdioListNode_t *entnode;
+  CdioVector_t *entlist = iso9660_readdir (p_image, psz_path);
+  CdioVector_t *dirlist =  _cdio_vector_new ();
+  iso9660_stat_t *statbuf;
+  char *psz_path_prefix;
+  unsigned int i;
     
   cdio_assert (entlist != NULL);
 
   /* iterate over each entry in the directory */
   
-  _CDIO_LIST_FOREACH (entnode, entlist)
+  _CDIO_VECTOR_FOREACH (i, statbuf, entlist)
     {
-      iso9660_stat_t *statbuf = _cdio_list_node_data (entnode);
       const char *psz_filename  = (char *) statbuf->filename;
       const unsigned int len = strlen(psz_path) + strlen(psz_filename)+2;
       
@@ -1453,32 +2492,30 @@ find_lsn_recurse (void *p_image, iso9660_readdir_t iso9660_readdir,
       if (statbuf->type == _STAT_DIR
           && strcmp ((char *) statbuf->filename, ".") 
           && strcmp ((char *) statbuf->filename, "..")) {
-        _cdio_list_append (dirlist, strdup(*ppsz_full_filename));
+        _cdio_vector_append (dirlist, strdup(*ppsz_full_filename));
       }
 
       if (statbuf->lsn == lsn) {
-	unsigned int len=sizeof(iso9660_stat_t)+strlen(statbuf->filename)+1;
-	iso9660_stat_t *ret_stat = calloc(1, len);
+	iso9660_stat_t *ret_stat = iso9660_stat_dup(statbuf);
 	if (!ret_stat)
-	  {
-          cdio_warn("Couldn't calloc(1, %d)", len);
           return NULL;
-	  }
-	memcpy(ret_stat, statbuf, len);
-        _cdio_list_free (entlist, true);
-        _cdio_list_free (dirlist, true);
+	/* The symbolic link name, if any, goes with the copy. */
+	ret_stat->rr.psz_symlink  = statbuf->rr.psz_symlink;
+	ret_stat->rr.i_symlink     = statbuf->rr.i_symlink;
+	ret_stat->rr.i_symlink_max = statbuf->rr.i_symlink_max;
+        _cdio_vector_free (entlist, true);
+        _cdio_vector_free (dirlist, true);
         return ret_stat;
       }
       
     }
 
-  _cdio_list_free (entlist, true);
+  _cdio_vector_free (entlist, true);
 
   /* now recurse/descend over directories encountered */
 
-  _CDIO_LIST_FOREACH (entnode, dirlist)
+  _CDIO_VECTOR_FOREACH (i, psz_path_prefix, dirlist)
     {
-      char *psz_path_prefix = _cdio_list_node_data (entnode);
       iso9660_stat_t *ret_stat;
       free(*ppsz_full_filename);
       *ppsz_full_filename = NULL;
@@ -1487,7 +2524,7 @@ find_lsn_recurse (void *p_image, iso9660_readdir_t iso9660_readdir,
 				   ppsz_full_filename);
 
       if (NULL != ret_stat) {
-        _cdio_list_free (dirlist, true);
+        _cdio_vector_free (dirlist, true);
         return ret_stat;
       }
     }
@@ -1496,7 +2533,7 @@ find_lsn_recurse (void *p_image, iso9660_readdir_t iso9660_readdir,
     free(*ppsz_full_filename);
     *ppsz_full_filename = NULL;
   }
-  _cdio_list_free (dirlist, true);
+  _cdio_vector_free (dirlist, true);
   return NULL;
 }
 
@@ -1510,7 +2547,8 @@ iso9660_stat_t *
 iso9660_fs_find_lsn(CdIo_t *p_cdio, lsn_t i_lsn)
 {
   char *psz_full_filename = NULL;
-  return find_lsn_recurse (p_cdio, (iso9660_readdir_t *) iso9660_fs_readdir, 
+  return find_lsn_recurse (p_cdio,
+			   (iso9660_readdir_t *) iso9660_fs_readdir_vector,
 			   "/", i_lsn, &psz_full_filename);
 }
 
@@ -1524,7 +2562,8 @@ iso9660_stat_t *
 iso9660_fs_find_lsn_with_path(CdIo_t *p_cdio, lsn_t i_lsn,
 			      /*out*/ char **ppsz_full_filename)
 {
-  return find_lsn_recurse (p_cdio, (iso9660_readdir_t *) iso9660_fs_readdir, 
+  return find_lsn_recurse (p_cdio,
+			   (iso9660_readdir_t *) iso9660_fs_readdir_vector,
 			   "/", i_lsn, ppsz_full_filename);
 }
 
@@ -1538,7 +2577,8 @@ iso9660_stat_t *
 iso9660_ifs_find_lsn(iso9660_t *p_iso, lsn_t i_lsn)
 {
   char *psz_full_filename = NULL;
-  return find_lsn_recurse (p_iso, (iso9660_readdir_t *) iso9660_ifs_readdir, 
+  return find_lsn_recurse (p_iso,
+			   (iso9660_readdir_t *) iso9660_ifs_readdir_vector,
 			   "/", i_lsn, &psz_full_filename);
 }
 
@@ -1552,10 +2592,30 @@ iso9660_stat_t *
 iso9660_ifs_find_lsn_with_path(iso9660_t *p_iso, lsn_t i_lsn,
 			       /*out*/ char **ppsz_full_filename)
 {
-  return find_lsn_recurse (p_iso, (iso9660_readdir_t *) iso9660_ifs_readdir, 
+  return find_lsn_recurse (p_iso,
+			   (iso9660_readdir_t *) iso9660_ifs_readdir_vector,
 			   "/", i_lsn, ppsz_full_filename);
 }
 
+/*!
+  Set what directory reads decode for p_iso; see iso9660_decode_flag_t.
+*/
+void
+iso9660_ifs_set_decode (iso9660_t *p_iso, unsigned int flags)
+{
+  if (p_iso) p_iso->i_decode = flags & ISO9660_DECODE_ALL;
+}
+
+/*!
+  Return the iso9660_decode_flag_t values set for p_iso.
+*/
+unsigned int
+iso9660_ifs_get_decode (const iso9660_t *p_iso)
+{
+  if (!p_iso) return 0;
+  return p_iso->i_decode;
+}
+
 /*!
   Return true if ISO 9660 image has extended attrributes (XA).
 */
@@ -31,9 +31,18 @@
 #endif
 
 #include <cdio/types.h>
+#include <cdio/iso9660.h>
 
 #define ISO_VERSION             1
 
+/* Static buffers handed back to callers are declared THREAD_LOCAL, so
+   that threads don't overwrite each other's. */
+#ifdef HAVE_TLS
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
+
 PRAGMA_BEGIN_PACKED
 
 typedef struct iso_volume_descriptor_s {
@@ -71,6 +80,30 @@ typedef struct iso_path_table_s {
 
 PRAGMA_END_PACKED
 
+/*! Return a buffer of at least i_size bytes owned by p_arena. The
+  buffer is reused (and possibly moved) on the next call. */
+uint8_t *_iso9660_arena_scratch (iso9660_arena_t *p_arena, size_t i_size);
+
+/*! Same as get_rock_ridge_filename() but only the parts in i_decode
+  (iso9660_decode_flag_t's) besides the name are filled in, and a
+  symbolic link name, if any, is allocated from p_arena rather than
+  from the heap. p_arena may be NULL. */
+int _iso9660_get_rock_ridge_filename (iso9660_dir_t * p_iso9660_dir, 
+                                      /*out*/ char * psz_name, 
+                                      /*in/out*/ iso9660_stat_t *p_stat,
+                                      unsigned int i_decode,
+                                      iso9660_arena_t *p_arena);
+
+/*! Fill in the directory record at p_rec for the i_filename-byte name
+  filename and return the record's length. */
+unsigned int _iso9660_dir_set_entry (void *p_rec, const char filename[], 
+                                     unsigned int i_filename, 
+                                     uint32_t extent, uint32_t size, 
+                                     uint8_t file_flags, 
+                                     const void *su_data, 
+                                     unsigned int su_size,
+                                     const time_t *entry_time);
+
 #endif /* __CDIO_ISO9660_PRIVATE_H__ */
 
 
@@ -0,0 +1,556 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Recursive walk over the directories of an ISO 9660 image.
+
+   Directory extents are read and decoded by a small pool of worker
+   threads while the calling thread hands finished directories to the
+   user's callback. All callbacks run in the calling thread, so the
+   callback needs no locking of its own. Without POSIX threads the
+   same code runs entirely in the calling thread. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDIO_H
+# include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include <cdio/iso9660.h>
+#include <cdio/logging.h>
+
+/* Upper bound on the number of threads used when the caller lets us
+   choose. Reading directories is mostly I/O bound and a handful of
+   outstanding reads is enough to keep a drive or a disk busy. */
+#define ISO9660_WALK_MAX_AUTO_THREADS 8
+
+/* How many directories per thread may be read ahead of the callback.
+   This bounds the memory a walk holds on to in ordered mode, where
+   the callback may be far behind the readers. */
+#define ISO9660_WALK_READAHEAD 32
+
+#ifdef HAVE_PTHREAD
+# define WALK_LOCK(p_walk)      pthread_mutex_lock(&(p_walk)->mutex)
+# define WALK_UNLOCK(p_walk)    pthread_mutex_unlock(&(p_walk)->mutex)
+# define WALK_WAIT(p_walk, c)   pthread_cond_wait(&(p_walk)->c, \
+                                                  &(p_walk)->mutex)
+# define WALK_BROADCAST(p_walk, c) pthread_cond_broadcast(&(p_walk)->c)
+#else
+# define WALK_LOCK(p_walk)
+# define WALK_UNLOCK(p_walk)
+# define WALK_WAIT(p_walk, c)
+# define WALK_BROADCAST(p_walk, c)
+#endif
+
+typedef struct walk_node_s walk_node_t;
+
+/* One directory of the image. A node is created when its parent has
+   been read, gets its entries when it is read, and is freed once the
+   callback has seen it. */
+struct walk_node_s {
+  char             *psz_path;   /* "/" or "/dir/.../name/" */
+  iso9660_stat_t   *p_stat;     /* NULL for the root directory */
+  iso9660_arena_t  *p_arena;    /* holds pp_entries once read */
+  iso9660_stat_t  **pp_entries; /* NULL if the directory is unreadable */
+  unsigned int      i_entries;
+  bool              b_claimed;  /* somebody is reading it */
+  bool              b_read;     /* ...and has finished doing so */
+  bool              b_short;    /* no room was found for its children */
+
+  walk_node_t     **pp_children; /* subdirectories, in directory order */
+  unsigned int      i_children;
+
+  walk_node_t      *p_work_prev; /* stack of nodes nobody has claimed */
+  walk_node_t      *p_work_next;
+  walk_node_t      *p_next;      /* delivery stack or done queue */
+  walk_node_t      *p_all_prev;  /* every live node, for cleanup */
+  walk_node_t      *p_all_next;
+};
+
+typedef struct {
+  iso9660_t    *p_iso;
+  unsigned int  flags;
+  uint8_t       i_joliet_level;
+
+  walk_node_t  *p_work;        /* top of the unclaimed-node stack */
+  walk_node_t  *p_done_first;  /* unordered mode: read, undelivered */
+  walk_node_t  *p_done_last;
+  walk_node_t  *p_all;
+  unsigned int  i_outstanding; /* nodes created but not yet delivered */
+  unsigned int  i_read_ahead;  /* nodes read but not yet delivered */
+  unsigned int  i_read_ahead_max;
+  bool          b_stop;
+  bool          b_error;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t mutex;
+  pthread_cond_t  work_cond;   /* work was pushed, or room to read ahead */
+  pthread_cond_t  done_cond;   /* a node was read */
+#endif
+} iso9660_walk_t;
+
+/* The following routines expect the walker lock to be held. */
+
+static void
+_walk_push_work (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  p_node->p_work_prev = NULL;
+  p_node->p_work_next = p_walk->p_work;
+  if (p_walk->p_work) p_walk->p_work->p_work_prev = p_node;
+  p_walk->p_work = p_node;
+}
+
+static void
+_walk_unlink_work (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  if (p_node->p_work_prev)
+    p_node->p_work_prev->p_work_next = p_node->p_work_next;
+  else
+    p_walk->p_work = p_node->p_work_next;
+  if (p_node->p_work_next)
+    p_node->p_work_next->p_work_prev = p_node->p_work_prev;
+  p_node->p_work_prev = p_node->p_work_next = NULL;
+}
+
+static walk_node_t *
+_walk_node_new (iso9660_walk_t *p_walk, const char psz_path[],
+                const iso9660_stat_t *p_stat)
+{
+  walk_node_t *p_node = calloc(1, sizeof(walk_node_t));
+  if (!p_node) return NULL;
+
+  p_node->psz_path = strdup(psz_path);
+  if (!p_node->psz_path) {
+    free(p_node);
+    return NULL;
+  }
+  if (p_stat) {
+    /* Only the extent is needed to read the directory later on; the
+       name and any symbolic link stay with the parent's entries. */
+    p_node->p_stat = malloc(sizeof(iso9660_stat_t));
+    if (!p_node->p_stat) {
+      free(p_node->psz_path);
+      free(p_node);
+      return NULL;
+    }
+    memcpy(p_node->p_stat, p_stat, sizeof(iso9660_stat_t));
+    p_node->p_stat->rr.psz_symlink = NULL;
+    p_node->p_stat->rr.i_symlink   = 0;
+    p_node->p_stat->p_extents      = NULL;
+  }
+
+  p_node->p_all_next = p_walk->p_all;
+  if (p_walk->p_all) p_walk->p_all->p_all_prev = p_node;
+  p_walk->p_all = p_node;
+  p_walk->i_outstanding++;
+  return p_node;
+}
+
+static void
+_walk_node_free (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  if (p_node->p_all_prev)
+    p_node->p_all_prev->p_all_next = p_node->p_all_next;
+  else
+    p_walk->p_all = p_node->p_all_next;
+  if (p_node->p_all_next)
+    p_node->p_all_next->p_all_prev = p_node->p_all_prev;
+
+  iso9660_arena_free(p_node->p_arena);
+  free(p_node->pp_children);
+  free(p_node->p_stat);
+  free(p_node->psz_path);
+  free(p_node);
+}
+
+/* Build the path of the subdirectory p_stat of psz_parent into
+   psz_path, which has room for i_size bytes. */
+static void
+_walk_child_path (const iso9660_walk_t *p_walk, const char psz_parent[],
+                  const iso9660_stat_t *p_stat, char *psz_path, size_t i_size)
+{
+  const char *psz_name = p_stat->filename;
+  char *psz_translated = NULL;
+
+  if ((p_walk->flags & ISO9660_WALK_TRANSLATE)
+      && (yep != p_stat->rr.b3_rock
+          || (p_walk->flags & ISO9660_WALK_IGNORE_ROCK))) {
+    psz_translated = malloc(strlen(psz_name) + 1);
+    if (psz_translated) {
+      iso9660_name_translate_ext(psz_name, psz_translated,
+                                 p_walk->i_joliet_level);
+      psz_name = psz_translated;
+    }
+  }
+
+  snprintf(psz_path, i_size, "%s%s/", psz_parent, psz_name);
+  free(psz_translated);
+}
+
+/* Read the directory of p_node and make room for its subdirectories
+   in p_node->pp_children. Called without the lock held; p_node has
+   been claimed so nobody else touches it. */
+static void
+_walk_read_node (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  unsigned int i;
+  unsigned int i_dirs = 0;
+
+  p_node->p_arena = iso9660_arena_new(0);
+  if (p_node->p_arena)
+    p_node->pp_entries = iso9660_ifs_readdir_arena(p_walk->p_iso,
+                                                   p_node->p_stat,
+                                                   p_node->p_arena,
+                                                   &p_node->i_entries);
+  if (!p_node->pp_entries) {
+    p_node->i_entries = 0;
+    return;
+  }
+
+  for (i = 0; i < p_node->i_entries; i++) {
+    const iso9660_stat_t *p_stat = p_node->pp_entries[i];
+    if (p_stat->type == _STAT_DIR
+        && strcmp(p_stat->filename, ".")
+        && strcmp(p_stat->filename, ".."))
+      i_dirs++;
+  }
+  if (0 == i_dirs) return;
+
+  p_node->pp_children = calloc(i_dirs, sizeof(walk_node_t *));
+  if (!p_node->pp_children) {
+    cdio_warn("Couldn't calloc(%u, %lu)", i_dirs,
+              (long unsigned int) sizeof(walk_node_t *));
+    p_node->b_short = true;
+  }
+}
+
+/* Create and publish the child nodes of p_node, whose entries have
+   just been read. Called with the lock held. Children are pushed in
+   reverse so the first subdirectory ends up on top of the stack and
+   readers follow the order in which the callback wants them. */
+static void
+_walk_add_children (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  unsigned int i;
+  size_t i_parent;
+  char *psz_path;
+
+  if (p_node->b_short) p_walk->b_error = true;
+  if (!p_node->pp_children) return;
+
+  i_parent = strlen(p_node->psz_path);
+  for (i = 0; i < p_node->i_entries; i++) {
+    const iso9660_stat_t *p_stat = p_node->pp_entries[i];
+    walk_node_t *p_child;
+    size_t i_size;
+
+    if (p_stat->type != _STAT_DIR
+        || !strcmp(p_stat->filename, ".")
+        || !strcmp(p_stat->filename, ".."))
+      continue;
+
+    i_size = i_parent + strlen(p_stat->filename) + 2;
+    psz_path = malloc(i_size);
+    if (!psz_path) {
+      cdio_warn("Couldn't malloc(%lu)", (long unsigned int) i_size);
+      p_walk->b_error = true;
+      continue;
+    }
+    _walk_child_path(p_walk, p_node->psz_path, p_stat, psz_path, i_size);
+    p_child = _walk_node_new(p_walk, psz_path, p_stat);
+    free(psz_path);
+    if (!p_child) {
+      p_walk->b_error = true;
+      continue;
+    }
+    p_node->pp_children[p_node->i_children++] = p_child;
+  }
+
+  for (i = p_node->i_children; i > 0; i--)
+    _walk_push_work(p_walk, p_node->pp_children[i-1]);
+  if (p_node->i_children) WALK_BROADCAST(p_walk, work_cond);
+}
+
+/* Claimed p_node has been read: publish it. Lock must be held. */
+static void
+_walk_node_read (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  _walk_add_children(p_walk, p_node);
+  p_node->b_read = true;
+  p_walk->i_read_ahead++;
+  if (!(p_walk->flags & ISO9660_WALK_ORDERED)) {
+    p_node->p_next = NULL;
+    if (p_walk->p_done_last)
+      p_walk->p_done_last->p_next = p_node;
+    else
+      p_walk->p_done_first = p_node;
+    p_walk->p_done_last = p_node;
+  }
+  WALK_BROADCAST(p_walk, done_cond);
+}
+
+/* Hand p_node to the callback and release it. Called with the lock
+   held, which is dropped around the callback. */
+static void
+_walk_deliver (iso9660_walk_t *p_walk, walk_node_t *p_node,
+               iso9660_walk_callback_t callback, void *p_user_data)
+{
+  int rc;
+
+  p_walk->i_read_ahead--;
+  WALK_BROADCAST(p_walk, work_cond);
+
+  if (!p_node->pp_entries) p_walk->b_error = true;
+  WALK_UNLOCK(p_walk);
+  rc = callback(p_node->psz_path, p_node->pp_entries, p_node->i_entries,
+                p_user_data);
+  WALK_LOCK(p_walk);
+
+  if (rc) {
+    p_walk->b_stop = true;
+    WALK_BROADCAST(p_walk, work_cond);
+  }
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+_walk_worker (void *p_data)
+{
+  iso9660_walk_t *p_walk = p_data;
+
+  WALK_LOCK(p_walk);
+  while (true) {
+    walk_node_t *p_node;
+
+    while (!p_walk->b_stop
+           && (!p_walk->p_work
+               || p_walk->i_read_ahead >= p_walk->i_read_ahead_max))
+      WALK_WAIT(p_walk, work_cond);
+    if (p_walk->b_stop) break;
+
+    p_node = p_walk->p_work;
+    _walk_unlink_work(p_walk, p_node);
+    p_node->b_claimed = true;
+
+    WALK_UNLOCK(p_walk);
+    _walk_read_node(p_walk, p_node);
+    WALK_LOCK(p_walk);
+
+    _walk_node_read(p_walk, p_node);
+  }
+  WALK_UNLOCK(p_walk);
+  return NULL;
+}
+#endif
+
+/* Make sure p_node has been read, reading it in this thread if no
+   worker has got to it yet. Lock must be held. */
+static void
+_walk_fetch (iso9660_walk_t *p_walk, walk_node_t *p_node)
+{
+  if (!p_node->b_claimed) {
+    _walk_unlink_work(p_walk, p_node);
+    p_node->b_claimed = true;
+    WALK_UNLOCK(p_walk);
+    _walk_read_node(p_walk, p_node);
+    WALK_LOCK(p_walk);
+    _walk_node_read(p_walk, p_node);
+  }
+  while (!p_node->b_read)
+    WALK_WAIT(p_walk, done_cond);
+}
+
+/* Deliver directories in the order a depth-first recursion would:
+   a directory, then each of its subdirectories with all that lies
+   beneath it, in directory order. */
+static void
+_walk_ordered (iso9660_walk_t *p_walk, walk_node_t *p_root,
+               iso9660_walk_callback_t callback, void *p_user_data)
+{
+  walk_node_t *p_deliver = p_root;
+
+  p_root->p_next = NULL;
+  while (p_deliver && !p_walk->b_stop) {
+    walk_node_t *p_node = p_deliver;
+    unsigned int i;
+
+    _walk_fetch(p_walk, p_node);
+    p_deliver = p_node->p_next;
+    _walk_deliver(p_walk, p_node, callback, p_user_data);
+
+    for (i = p_node->i_children; i > 0; i--) {
+      p_node->pp_children[i-1]->p_next = p_deliver;
+      p_deliver = p_node->pp_children[i-1];
+    }
+    p_walk->i_outstanding--;
+    _walk_node_free(p_walk, p_node);
+  }
+}
+
+/* Deliver directories as soon as they have been read. */
+static void
+_walk_unordered (iso9660_walk_t *p_walk,
+                 iso9660_walk_callback_t callback, void *p_user_data)
+{
+  while (p_walk->i_outstanding && !p_walk->b_stop) {
+    walk_node_t *p_node = p_walk->p_done_first;
+
+    if (p_node) {
+      p_walk->p_done_first = p_node->p_next;
+      if (!p_walk->p_done_first) p_walk->p_done_last = NULL;
+      _walk_deliver(p_walk, p_node, callback, p_user_data);
+      p_walk->i_outstanding--;
+      _walk_node_free(p_walk, p_node);
+    } else if (p_walk->p_work) {
+      _walk_fetch(p_walk, p_walk->p_work);
+    } else {
+      WALK_WAIT(p_walk, done_cond);
+    }
+  }
+}
+
+/*!
+  Walk the directory tree of p_iso. callback is called once for each
+  directory with its path and its entries, including "." and "..".
+  The entries belong to the walk and are only valid during the
+  callback; pp_entries is NULL if the directory could not be read.
+
+  Directories are read by up to i_threads threads; 0 picks a number
+  based on the processors available and 1 reads everything in the
+  calling thread. The callback is always run in the calling thread.
+
+  With ISO9660_WALK_ORDERED in flags the callback sees directories in
+  the order a simple recursion gives; otherwise in whatever order
+  they are read. ISO9660_WALK_TRANSLATE builds paths from translated
+  ISO 9660 names unless a Rock Ridge name is present (and
+  ISO9660_WALK_IGNORE_ROCK is not given).
+
+  A nonzero return from callback stops the walk. false is returned if
+  the walk was stopped or some directory could not be read.
+*/
+bool
+iso9660_ifs_walk (iso9660_t *p_iso, iso9660_walk_callback_t callback,
+                  void *p_user_data, unsigned int i_threads,
+                  unsigned int flags)
+{
+  iso9660_walk_t walk;
+  walk_node_t *p_root;
+#ifdef HAVE_PTHREAD
+  pthread_t *p_threads = NULL;
+  unsigned int i_started = 0;
+  unsigned int i;
+#endif
+
+  if (!p_iso || !callback) return false;
+
+  memset(&walk, 0, sizeof(walk));
+  walk.p_iso          = p_iso;
+  walk.flags          = flags;
+  walk.i_joliet_level = iso9660_ifs_get_joliet_level(p_iso);
+
+  if (0 == i_threads) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long int i_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    i_threads = (i_cpus > 0) ? (unsigned int) i_cpus : 1;
+#else
+    i_threads = 1;
+#endif
+    if (i_threads > ISO9660_WALK_MAX_AUTO_THREADS)
+      i_threads = ISO9660_WALK_MAX_AUTO_THREADS;
+  }
+  walk.i_read_ahead_max = ISO9660_WALK_READAHEAD * i_threads;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&walk.mutex, NULL);
+  pthread_cond_init(&walk.work_cond, NULL);
+  pthread_cond_init(&walk.done_cond, NULL);
+#endif
+
+  WALK_LOCK(&walk);
+  p_root = _walk_node_new(&walk, "/", NULL);
+  if (!p_root) {
+    WALK_UNLOCK(&walk);
+    return false;
+  }
+  _walk_push_work(&walk, p_root);
+
+#ifdef HAVE_PTHREAD
+  if (i_threads > 1) {
+    p_threads = calloc(i_threads - 1, sizeof(pthread_t));
+    if (p_threads)
+      for (i = 0; i < i_threads - 1; i++) {
+        if (pthread_create(&p_threads[i], NULL, _walk_worker, &walk))
+          break;
+        i_started++;
+      }
+  }
+#endif
+
+  if (flags & ISO9660_WALK_ORDERED)
+    _walk_ordered(&walk, p_root, callback, p_user_data);
+  else
+    _walk_unordered(&walk, callback, p_user_data);
+
+  /* Wake up the workers so they notice we are done. */
+  walk.b_stop = true;
+  WALK_BROADCAST(&walk, work_cond);
+  WALK_UNLOCK(&walk);
+
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < i_started; i++)
+    pthread_join(p_threads[i], NULL);
+  free(p_threads);
+#endif
+
+  /* Anything left over was never delivered because of a stop. */
+  if (walk.p_all) walk.b_error = true;
+  while (walk.p_all)
+    _walk_node_free(&walk, walk.p_all);
+
+#ifdef HAVE_PTHREAD
+  pthread_cond_destroy(&walk.done_cond);
+  pthread_cond_destroy(&walk.work_cond);
+  pthread_mutex_destroy(&walk.mutex);
+#endif
+
+  return !walk.b_error;
+}
+
+
+/*
+ * Local variables:
+ *  c-file-style: "gnu"
+ *  tab-width: 8
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -40,6 +40,8 @@
 #include <cdio/logging.h>
 #include <cdio/bytesex.h>
 
+#include "iso9660_private.h"
+
 #define CDIO_MKDEV(ma,mi)	((ma)<<16 | (mi))
 
 enum iso_rock_enums iso_rock_enums;
@@ -50,13 +52,19 @@ iso_rock_tf_flag_t iso_rock_tf_flag;
 /* Our own realloc routine tailored for the iso9660_stat_t symlink
    field.  I can't figure out how to make realloc() work without
    valgrind complaint.
+
+   If p_arena is not NULL, the symlink buffer comes from that arena;
+   an outgrown buffer is then simply abandoned to the arena.
 */
 static bool
-realloc_symlink(/*in/out*/ iso9660_stat_t *p_stat, uint8_t i_grow) 
+realloc_symlink(/*in/out*/ iso9660_stat_t *p_stat, uint8_t i_grow,
+                iso9660_arena_t *p_arena) 
 {
   if (!p_stat->rr.i_symlink) {
     const uint16_t i_max = 2*i_grow+1;
-    p_stat->rr.psz_symlink = (char *) calloc(1, i_max);
+    p_stat->rr.psz_symlink = (p_arena) 
+      ? (char *) iso9660_arena_calloc(p_arena, i_max)
+      : (char *) calloc(1, i_max);
     p_stat->rr.i_symlink_max = i_max;
     return (NULL != p_stat->rr.psz_symlink);
   } else {
@@ -64,11 +72,13 @@ realloc_symlink(/*in/out*/ iso9660_stat_t *p_stat, uint8_t i_grow)
     if ( i_needed <= p_stat->rr.i_symlink_max)
       return true;
     else {
-      char * psz_newsymlink = (char *) calloc(1, 2*i_needed);
+      char * psz_newsymlink = (p_arena)
+        ? (char *) iso9660_arena_calloc(p_arena, 2*i_needed)
+        : (char *) calloc(1, 2*i_needed);
       if (!psz_newsymlink) return false;
       p_stat->rr.i_symlink_max = 2*i_needed;
       memcpy(psz_newsymlink, p_stat->rr.psz_symlink, p_stat->rr.i_symlink);
-      free(p_stat->rr.psz_symlink);
+      if (!p_arena) free(p_stat->rr.psz_symlink);
       p_stat->rr.psz_symlink = psz_newsymlink;
       return true;
     }
@@ -148,6 +158,17 @@ int
 get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir, 
 			/*out*/ char * psz_name, 
 			/*in/out*/ iso9660_stat_t *p_stat)
+{
+  return _iso9660_get_rock_ridge_filename(p_iso9660_dir, psz_name, p_stat,
+                                          ISO9660_DECODE_ALL, NULL);
+}
+
+int 
+_iso9660_get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir, 
+                                 /*out*/ char * psz_name, 
+                                 /*in/out*/ iso9660_stat_t *p_stat,
+                                 unsigned int i_decode,
+                                 iso9660_arena_t *p_arena)
 {
   int len;
   unsigned char *chr;
@@ -221,13 +242,15 @@ get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir,
 	break;
       case SIG('P','X'):
 	/* POSIX file attributes */
+	p_stat->rr.b3_rock    = yep;
+	if (!(i_decode & ISO9660_DECODE_ATTRS)) break;
 	p_stat->rr.st_mode   = from_733(rr->u.PX.st_mode);
 	p_stat->rr.st_nlinks = from_733(rr->u.PX.st_nlinks);
 	p_stat->rr.st_uid    = from_733(rr->u.PX.st_uid);
 	p_stat->rr.st_gid    = from_733(rr->u.PX.st_gid);
-	p_stat->rr.b3_rock    = yep;
 	break;
       case SIG('S','L'):
+	if (!(i_decode & ISO9660_DECODE_SYMLINK)) break;
 	{
 	  /* Symbolic link */
 	  uint8_t slen;
@@ -240,22 +263,22 @@ get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir,
 	    rootflag = 0;
 	    switch(p_sl->flags &~1){
 	    case 0:
-	      realloc_symlink(p_stat, p_sl->len);
+	      realloc_symlink(p_stat, p_sl->len, p_arena);
 	      memcpy(&(p_stat->rr.psz_symlink[p_stat->rr.i_symlink]),
 		     p_sl->text, p_sl->len);
 	      p_stat->rr.i_symlink += p_sl->len;
 	      break;
 	    case 4:
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, p_arena);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '.';
 	      /* continue into next case. */
 	    case 2:
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, p_arena);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '.';
 	      break;
 	    case 8:
 	      rootflag = 1;
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, p_arena);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '/';
 	      break;
 	    default:
@@ -275,13 +298,13 @@ get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir,
 	     * If this component record isn't continued, then append a '/'.
 	     */
 	    if (!rootflag && (p_oldsl->flags & 1) == 0) {
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, p_arena);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '/';
 	    }
 	  }
 	}
 	symlink_len = p_stat->rr.i_symlink;
-	realloc_symlink(p_stat, 1);
+	realloc_symlink(p_stat, 1, p_arena);
 	p_stat->rr.psz_symlink[symlink_len]='\0';
 	break;
       case SIG('R','E'):
@@ -289,6 +312,8 @@ get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir,
 	return -1;
       case SIG('T','F'): 
 	/* Time stamp(s) for a file */
+	p_stat->rr.b3_rock = yep;
+	if (!(i_decode & ISO9660_DECODE_TIMES)) break;
 	{
 	  int cnt = 0;
 	  add_time(ISO_ROCK_TF_CREATE,     create);
@@ -298,7 +323,6 @@ get_rock_ridge_filename(iso9660_dir_t * p_iso9660_dir,
 	  add_time(ISO_ROCK_TF_BACKUP,     backup);
 	  add_time(ISO_ROCK_TF_EXPIRATION, expiration);
 	  add_time(ISO_ROCK_TF_EFFECTIVE,  effective);
-	  p_stat->rr.b3_rock = yep;
 	  break;
 	}
       default:
@@ -411,22 +435,22 @@ parse_rock_ridge_stat_internal(iso9660_dir_t *p_iso9660_dir,
 	    rootflag = 0;
 	    switch(p_sl->flags &~1){
 	    case 0:
-	      realloc_symlink(p_stat, p_sl->len);
+	      realloc_symlink(p_stat, p_sl->len, NULL);
 	      memcpy(&(p_stat->rr.psz_symlink[p_stat->rr.i_symlink]),
 		     p_sl->text, p_sl->len);
 	      p_stat->rr.i_symlink += p_sl->len;
 	      break;
 	    case 4:
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, NULL);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '.';
 	      /* continue into next case. */
 	    case 2:
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, NULL);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '.';
 	      break;
 	    case 8:
 	      rootflag = 1;
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, NULL);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '/';
 	      p_stat->rr.i_symlink++;
 	      break;
@@ -447,13 +471,13 @@ parse_rock_ridge_stat_internal(iso9660_dir_t *p_iso9660_dir,
 	     * If this component record isn't continued, then append a '/'.
 	     */
 	    if (!rootflag && (p_oldsl->flags & 1) == 0) {
-	      realloc_symlink(p_stat, 1);
+	      realloc_symlink(p_stat, 1, NULL);
 	      p_stat->rr.psz_symlink[p_stat->rr.i_symlink++] = '/';
 	    }
 	  }
 	}
 	symlink_len = p_stat->rr.i_symlink;
-	realloc_symlink(p_stat, 1);
+	realloc_symlink(p_stat, 1, NULL);
 	p_stat->rr.psz_symlink[symlink_len]='\0';
 	break;
       case SIG('R','E'):
@@ -509,20 +533,19 @@ parse_rock_ridge_stat(iso9660_dir_t *p_iso9660_dir,
 }
 
 #define BUF_COUNT 16
-#define BUF_SIZE sizeof("drwxrwxrwx")
+#define BUF_SIZE ISO9660_ROCK_ATTR_STR_SIZE
 
-/* Return a pointer to a internal free buffer */
+/* Return a pointer to a internal free buffer. Each thread has its own
+   BUF_COUNT of them. */
 static char *
 _getbuf (void)
 {
-  static char _buf[BUF_COUNT][BUF_SIZE];
-  static int _i = -1;
+  static THREAD_LOCAL char _buf[BUF_COUNT][BUF_SIZE];
+  static THREAD_LOCAL int _i = -1;
   
   _i++;
   _i %= BUF_COUNT;
 
-  memset (_buf[_i], 0, BUF_SIZE);
-
   return _buf[_i];
 }
 
@@ -560,11 +583,14 @@ _getbuf (void)
   property is not allowed for a group or user but the corresponding
   group/user is set "S" indicates this. If none of these properties
   holds the "-" indicates this.
+
+  The string is put in result, which is returned. Nothing else is
+  touched, so any number of threads may call this at once.
 */
-const char *
-iso9660_get_rock_attr_str(posix_mode_t st_mode)
+char *
+iso9660_get_rock_attr_str_r(posix_mode_t st_mode, 
+			    char result[ISO9660_ROCK_ATTR_STR_SIZE])
 {
-  char *result = _getbuf();
 
   if (S_ISBLK(st_mode))
     result[ 0] = 'b';
@@ -602,11 +628,21 @@ iso9660_get_rock_attr_str(posix_mode_t st_mode)
   result[ 8] = (st_mode & ISO_ROCK_IWOTH) ? 'w' : '-';
   result[ 9] = (st_mode & ISO_ROCK_IXOTH) ? 'x' : '-';
 
-  result[11] = '\0';
+  result[10] = '\0';
 
   return result;
 }
 
+/*!
+  Like iso9660_get_rock_attr_str_r() but the string is in a buffer of
+  the library's, one of 16 that each thread cycles through.
+*/
+const char *
+iso9660_get_rock_attr_str(posix_mode_t st_mode)
+{
+  return iso9660_get_rock_attr_str_r(st_mode, _getbuf());
+}
+
 /*!
   Returns POSIX mode bitstring for a given file.
 */
@@ -44,6 +44,7 @@ const char ISO_XA_MARKER_STRING[] = {'C', 'D', '-', 'X', 'A', '0', '0', '1'};
 
 /* Private headers */
 #include "cdio_assert.h"
+#include "iso9660_private.h"
 
 /** The below variable is trickery to force enum symbol values to be
     recorded in debug symbol tables. It is used to allow one to refer
@@ -53,20 +54,19 @@ const char ISO_XA_MARKER_STRING[] = {'C', 'D', '-', 'X', 'A', '0', '0', '1'};
 xa_misc_enum_t debugger_xa_misc_enum;
 
 #define BUF_COUNT 16
-#define BUF_SIZE 80
+#define BUF_SIZE ISO9660_XA_ATTR_STR_SIZE
 
-/* Return a pointer to a internal free buffer */
+/* Return a pointer to a internal free buffer. Each thread has its own
+   BUF_COUNT of them. */
 static char *
 _getbuf (void)
 {
-  static char _buf[BUF_COUNT][BUF_SIZE];
-  static int _num = -1;
+  static THREAD_LOCAL char _buf[BUF_COUNT][BUF_SIZE];
+  static THREAD_LOCAL int _num = -1;
   
   _num++;
   _num %= BUF_COUNT;
 
-  memset (_buf[_num], 0, BUF_SIZE);
-
   return _buf[_num];
 }
 
@@ -97,12 +97,15 @@ _getbuf (void)
   allowed to be listed or "searched".
   The second character of a pair (7, 9, 11) is "r" if the entry is allowed
   to be read. 
+
+  The string is put in result, which is returned. Nothing else is
+  touched, so any number of threads may call this at once.
 */
 
-const char *
-iso9660_get_xa_attr_str (uint16_t xa_attr)
+char *
+iso9660_get_xa_attr_str_r (uint16_t xa_attr, 
+			   char result[ISO9660_XA_ATTR_STR_SIZE])
 {
-  char *result = _getbuf();
 
   xa_attr = uint16_from_be (xa_attr);
 
@@ -127,6 +130,16 @@ iso9660_get_xa_attr_str (uint16_t xa_attr)
   return result;
 }
 
+/*!
+  Like iso9660_get_xa_attr_str_r() but the string is in a buffer of
+  the library's, one of 16 that each thread cycles through.
+*/
+const char *
+iso9660_get_xa_attr_str (uint16_t xa_attr)
+{
+  return iso9660_get_xa_attr_str_r (xa_attr, _getbuf());
+}
+
 iso9660_xa_t *
 iso9660_xa_init (iso9660_xa_t *_xa, uint16_t uid, uint16_t gid, uint16_t attr, 
 	      uint8_t filenum)
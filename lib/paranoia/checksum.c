@@ -0,0 +1,407 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/***
+ * Checksums of ripped audio.
+ *
+ * A CRC32 and the AccurateRip checksums of a track are summed as its
+ * samples are read, so a rip can be checked without reading the files
+ * written back.  The AccurateRip identification of a disc comes from
+ * its table of contents.
+ *
+ * As with the matching kernels, the scalar kernels below are the
+ * reference the others must agree with, and the fastest the processor
+ * supports is picked at run time.  The scalar CRC32 is libcdio's
+ * cdio_crc32(), which the standalone programs use too.
+ ***/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <cdio/cdio.h>
+#include <cdio/util.h>
+#include "p_block.h"
+#include "checksum.h"
+
+#if defined(__SSE2__)
+# define CHECKSUM_HAVE_SSE2
+# include <emmintrin.h>
+#endif
+#if defined(CHECKSUM_HAVE_SSE2) && defined(HAVE_PCLMUL_TARGET)
+# define CHECKSUM_HAVE_PCLMUL
+# include <smmintrin.h>
+# include <wmmintrin.h>
+#endif
+
+/* AccurateRip leaves out the first 5 sectors but one sample of the
+   first track of a disc and the last 5 sectors of the last, which
+   drives with different offsets may not read the same. */
+#define AR_SKIP_SAMPLES (5 * CD_FRAMEWORDS / 2)
+
+/* The lead-out and lead-in between the audio session of an enhanced
+   CD and its data session, which AccurateRip takes off the start of
+   the data track to get the end of the audio. */
+#define AR_SESSION_GAP 11400
+
+/**** scalar kernels *****************************************************/
+
+static uint32_t
+crc32_scalar(uint32_t crc, const uint8_t *p, long n)
+{
+  return cdio_crc32(crc, p, n);
+}
+
+static void
+accuraterip_scalar(const int16_t *p, long n, uint32_t i_mult,
+		   uint32_t *p_lo, uint32_t *p_hi)
+{
+  uint32_t lo = *p_lo, hi = *p_hi;
+  long i;
+  for (i=0; i<n; i++) {
+    /* the left sample in the low half, as in a WAV file */
+    const uint32_t w = (uint16_t) p[2*i] | (uint32_t) (uint16_t) p[2*i+1] << 16;
+    const uint64_t product = (uint64_t) w * (i_mult + i);
+    lo += (uint32_t) product;
+    hi += (uint32_t) (product >> 32);
+  }
+  *p_lo = lo;
+  *p_hi = hi;
+}
+
+static const checksum_kernels_t checksum_scalar = {
+  crc32_scalar, accuraterip_scalar
+};
+
+/**** SSE2 AccurateRip: 4 samples a step *********************************/
+
+#ifdef CHECKSUM_HAVE_SSE2
+
+static void
+accuraterip_sse2(const int16_t *p, long n, uint32_t i_mult,
+		 uint32_t *p_lo, uint32_t *p_hi)
+{
+  __m128i mult = _mm_set_epi32(i_mult+3, i_mult+2, i_mult+1, i_mult);
+  /* The 32-bit lanes 0 and 2 sum the low halves of the products, 1
+     and 3 the high halves, each modulo 2^32 as AccurateRip has it. */
+  __m128i sum = _mm_setzero_si128();
+  uint32_t lanes[4];
+  long i;
+
+  for (i=0; i+4<=n; i+=4) {
+    const __m128i w = _mm_loadu_si128((const __m128i *) (p+2*i));
+    sum = _mm_add_epi32(sum, _mm_mul_epu32(w, mult));
+    sum = _mm_add_epi32(sum, _mm_mul_epu32(_mm_srli_epi64(w, 32),
+					   _mm_srli_epi64(mult, 32)));
+    mult = _mm_add_epi32(mult, _mm_set1_epi32(4));
+  }
+  _mm_storeu_si128((__m128i *) lanes, sum);
+  *p_lo += lanes[0] + lanes[2];
+  *p_hi += lanes[1] + lanes[3];
+  accuraterip_scalar(p+2*i, n-i, i_mult+i, p_lo, p_hi);
+}
+
+static const checksum_kernels_t checksum_sse2 = {
+  crc32_scalar, accuraterip_sse2
+};
+
+#endif /* CHECKSUM_HAVE_SSE2 */
+
+/**** PCLMUL CRC32: 64 bytes a step **************************************/
+
+#ifdef CHECKSUM_HAVE_PCLMUL
+
+#define CHECKSUM_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+
+/* The CRC register (not complemented) after the n bytes at p, n a
+   multiple of 16 and at least 64.  Four 128-bit lanes are folded
+   forward 512 bits at a time by carry-less multiplication, then into
+   one, which is reduced to 32 bits; see Gopal et al., "Fast CRC
+   Computation for Generic Polynomials Using PCLMULQDQ Instruction",
+   Intel, 2009. The constants are for the reflected polynomial. */
+static CHECKSUM_TARGET_PCLMUL uint32_t
+crc32_fold_pclmul(uint32_t crc, const uint8_t *p, long n)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i *) (p + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *) (p + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *) (p + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *) (p + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  p += 64;
+  n -= 64;
+
+  for (; n>=64; p+=64, n-=64) {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		       _mm_loadu_si128((const __m128i *) (p + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+		       _mm_loadu_si128((const __m128i *) (p + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+		       _mm_loadu_si128((const __m128i *) (p + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+		       _mm_loadu_si128((const __m128i *) (p + 0x30)));
+  }
+
+  /* Fold the four lanes into one, then the rest 16 bytes at a time. */
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  for (; n>=16; p+=16, n-=16) {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+		       _mm_loadu_si128((const __m128i *) p));
+  }
+
+  /* 128 bits to 64, then Barrett reduction to 32. */
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t
+crc32_pclmul(uint32_t crc, const uint8_t *p, long n)
+{
+  if (n >= 64) {
+    const long n_fold = n & ~15L;
+    crc = ~crc32_fold_pclmul(~crc, p, n_fold);
+    p += n_fold;
+    n -= n_fold;
+  }
+  return cdio_crc32(crc, p, n);
+}
+
+static const checksum_kernels_t checksum_pclmul = {
+  crc32_pclmul, accuraterip_sse2
+};
+
+#endif /* CHECKSUM_HAVE_PCLMUL */
+
+/**** selection **********************************************************/
+
+const checksum_kernels_t *checksum_kernels = &checksum_scalar;
+
+/* The kernels of impl, or NULL if this build or processor lacks them. */
+static const checksum_kernels_t *
+checksum_get(checksum_impl_t impl)
+{
+  switch (impl) {
+  case CHECKSUM_SCALAR:
+    return &checksum_scalar;
+#ifdef CHECKSUM_HAVE_SSE2
+  case CHECKSUM_SSE2:
+    return &checksum_sse2;
+#endif
+#ifdef CHECKSUM_HAVE_PCLMUL
+  case CHECKSUM_PCLMUL:
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")
+      ? &checksum_pclmul : NULL;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+void
+i_checksum_init(void)
+{
+  int impl;
+
+  for (impl=CHECKSUM_IMPLS-1; impl>CHECKSUM_SCALAR; impl--)
+    if (checksum_get(impl)) break;
+  checksum_kernels = checksum_get(impl);
+}
+
+bool
+i_checksum_use(checksum_impl_t impl)
+{
+  const checksum_kernels_t *kernels = checksum_get(impl);
+  if (!kernels) return false;
+  checksum_kernels = kernels;
+  return true;
+}
+
+const char *
+i_checksum_name(checksum_impl_t impl)
+{
+  static const char *names[CHECKSUM_IMPLS] =
+    { "scalar", "SSE2", "PCLMUL" };
+  return (impl < CHECKSUM_IMPLS) ? names[impl] : "unknown";
+}
+
+/**** checksums of a track ***********************************************/
+
+void
+cdio_paranoia_checksum_init(cdio_paranoia_checksum_t *p_sum,
+			    long i_sectors, bool b_first_track,
+			    bool b_last_track)
+{
+  const uint32_t i_samples = i_sectors * (CD_FRAMEWORDS / 2);
+
+  i_checksum_init();
+  memset(p_sum, 0, sizeof(cdio_paranoia_checksum_t));
+  p_sum->i_ar_from = b_first_track ? AR_SKIP_SAMPLES : 1;
+  p_sum->i_ar_to = !b_last_track ? i_samples
+    : (i_samples > AR_SKIP_SAMPLES) ? i_samples - AR_SKIP_SAMPLES : 0;
+}
+
+void
+cdio_paranoia_checksum_add(cdio_paranoia_checksum_t *p_sum,
+			   const int16_t *p_samples, long i_words)
+{
+  /* The multipliers of these samples, counting from 1 at the start of
+     the track, and those of them AccurateRip counts. */
+  const uint32_t i_first = p_sum->i_samples + 1;
+  const uint32_t i_last = p_sum->i_samples + i_words/2;
+  const uint32_t i_from = max(i_first, p_sum->i_ar_from);
+  const uint32_t i_to = min(i_last, p_sum->i_ar_to);
+  uint32_t i_lo = p_sum->i_ar_v1;
+
+  if (i_words <= 0) return;
+
+  if (i_from <= i_to)
+    checksum_kernels->accuraterip(p_samples + 2*(i_from-i_first),
+				  i_to-i_from+1, i_from,
+				  &i_lo, &p_sum->i_ar_hi);
+  p_sum->i_ar_v1 = i_lo;
+  p_sum->i_ar_v2 = i_lo + p_sum->i_ar_hi;
+
+#ifdef WORDS_BIGENDIAN
+  /* The CRC is of the samples as a WAV file has them, little-endian. */
+  {
+    int16_t swapped[1024];
+    long i, j;
+    for (i=0; i<i_words; i+=j) {
+      for (j=0; j<1024 && i+j<i_words; j++)
+	swapped[j] = UINT16_SWAP_LE_BE_C(p_samples[i+j]);
+      p_sum->i_crc32 = checksum_kernels->crc32(p_sum->i_crc32,
+					       (const uint8_t *) swapped,
+					       j*2);
+    }
+  }
+#else
+  p_sum->i_crc32 = checksum_kernels->crc32(p_sum->i_crc32,
+					   (const uint8_t *) p_samples,
+					   i_words*2);
+#endif
+  p_sum->i_samples = i_last;
+}
+
+uint32_t
+cdio_paranoia_crc32(uint32_t i_crc, const void *p_buf, long i_bytes)
+{
+  static bool b_init = false;
+  if (!b_init) {
+    i_checksum_init();
+    b_init = true;
+  }
+  return checksum_kernels->crc32(i_crc, p_buf, i_bytes);
+}
+
+/**** disc identification ************************************************/
+
+/* The sum of the decimal digits of n. */
+static int
+digit_sum(long n)
+{
+  int sum = 0;
+  for (; n>0; n/=10)
+    sum += n % 10;
+  return sum;
+}
+
+int
+cdio_paranoia_accuraterip_id(cdrom_drive_t *d,
+			     cdio_paranoia_accuraterip_id_t *p_id)
+{
+  const track_t i_first_track = cdio_get_first_track_num(d->p_cdio);
+  lsn_t i_leadout = d->disc_toc[d->tracks].dwStartSector;
+  int i_last_audio;
+  int i;
+  long n = 0;
+
+  memset(p_id, 0, sizeof(cdio_paranoia_accuraterip_id_t));
+  if (!d->opened || d->tracks < 1)
+    return -1;
+
+  /* The CDDB ID counts every track, to the end of the disc, in
+     seconds from the start of the lead-in. */
+  for (i=0; i<d->tracks; i++)
+    n += digit_sum((d->disc_toc[i].dwStartSector + CDIO_PREGAP_SECTORS)
+		   / CDIO_CD_FRAMES_PER_SEC);
+  p_id->i_cddb = (uint32_t) (n % 0xff) << 24
+    | (uint32_t) ((i_leadout + CDIO_PREGAP_SECTORS) / CDIO_CD_FRAMES_PER_SEC
+		  - (d->disc_toc[0].dwStartSector + CDIO_PREGAP_SECTORS)
+		  / CDIO_CD_FRAMES_PER_SEC) << 8
+    | d->tracks;
+
+  /* AccurateRip only counts the audio; a data track after it is the
+     second session of an enhanced CD. */
+  for (i_last_audio=d->tracks-1; i_last_audio>=0; i_last_audio--)
+    if (cdio_cddap_track_audiop(d, i_first_track+i_last_audio) == 1) break;
+  if (i_last_audio < 0)
+    return -1;
+  if (i_last_audio < d->tracks-1)
+    i_leadout = d->disc_toc[i_last_audio+1].dwStartSector - AR_SESSION_GAP;
+
+  for (i=0; i<=i_last_audio; i++) {
+    const lsn_t i_lsn = d->disc_toc[i].dwStartSector;
+    if (cdio_cddap_track_audiop(d, i_first_track+i) != 1) continue;
+    p_id->i_tracks++;
+    p_id->i_id1 += i_lsn;
+    p_id->i_id2 += (i_lsn ? i_lsn : 1) * (uint32_t) (i_first_track+i);
+  }
+  p_id->i_id1 += i_leadout;
+  p_id->i_id2 += (i_leadout ? i_leadout : 1)
+    * (uint32_t) (i_first_track+i_last_audio+1);
+  return 0;
+}
@@ -0,0 +1,60 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Summing CRC32 and AccurateRip checksums of audio, several bytes or
+   samples at a time. */
+
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+#include <cdio/types.h>
+
+/* The implementations of the checksum kernels. */
+typedef enum {
+  CHECKSUM_SCALAR,   /* CRC32 by cdio_crc32(), AccurateRip a sample at a
+			time; always available */
+  CHECKSUM_SSE2,     /* as SCALAR, with AccurateRip 4 samples at a time */
+  CHECKSUM_PCLMUL,   /* as SSE2, with CRC32 folded 64 bytes at a time */
+  CHECKSUM_IMPLS
+} checksum_impl_t;
+
+typedef struct {
+  /* The CRC32 crc of the bytes before these n bytes at p, updated
+     with them; crc is 0 to start with, as with zlib's crc32(). */
+  uint32_t (*crc32)(uint32_t crc, const uint8_t *p, long n);
+  /* Add the AccurateRip products of the n stereo samples at p with
+     the multipliers i_mult, i_mult+1, ...: the low 32 bits of each
+     to *p_lo and the high ones to *p_hi. */
+  void (*accuraterip)(const int16_t *p, long n, uint32_t i_mult,
+		      uint32_t *p_lo, uint32_t *p_hi);
+} checksum_kernels_t;
+
+/* The kernels in use, scalar ones until i_checksum_init() picks
+   others. */
+extern const checksum_kernels_t *checksum_kernels;
+
+/* Pick the fastest kernels the processor running us supports. It is
+   cheap to call again. */
+extern void i_checksum_init(void);
+
+/* Use the kernels of impl, if this build and processor have them;
+   returns false otherwise. For tests and benchmarks. */
+extern bool i_checksum_use(checksum_impl_t impl);
+
+extern const char *i_checksum_name(checksum_impl_t impl);
+
+#endif /*_CHECKSUM_H_*/
@@ -26,6 +26,7 @@
 #include "p_block.h"
 #include <cdio/paranoia.h>
 #include "gap.h"
+#include "match.h"
 #include <string.h>
 
 /**** Gap analysis code ***************************************************/
@@ -47,26 +48,16 @@ long int
 i_paranoia_overlap_r(int16_t *buffA,int16_t *buffB,
 			  long offsetA, long offsetB)
 {
-  long beginA=offsetA;
-  long beginB=offsetB;
-
   /* Start at the given offsets and work our way backwards until we hit
    * the beginning of one of the vectors.
    */
-  for( ; beginA>=0 && beginB>=0; beginA--,beginB-- )
-    if (buffA[beginA] != buffB[beginB]) break;
+  long matched = match_kernels->backward(buffA+offsetA, buffB+offsetB,
+					 min(offsetA, offsetB)+1);
 
-  /* These values will either point to the first mismatching sample, or
-   * -1 if we hit the beginning of a vector.  So increment to point to the
-   * last matching sample.
-   *
-   * ??? Why?  This would appear to return one less sample than actually
-   * matched.  E.g., no matching samples returns -1!  Is this a bug?
+  /* ??? This returns one less sample than actually matched.  E.g., no
+   * matching samples returns -1!  Is this a bug?
    */
-  beginA++;
-  beginB++;
-  
-  return(offsetA-beginA);
+  return(matched-1);
 }
 
 
@@ -88,20 +79,14 @@ i_paranoia_overlap_f(int16_t *buffA,int16_t *buffB,
 		     long offsetA, long offsetB,
 		     long sizeA,long sizeB)
 {
-  long endA=offsetA;
-  long endB=offsetB;
-  
   /* Start at the given offsets and work our way forward until we hit
    * the end of one of the vectors.
+   *
+   * ??? Note that the count is not one less here.  Why the asymmetry
+   * with i_paranoia_overlap_r?
    */
-  for(;endA<sizeA && endB<sizeB;endA++,endB++)
-    if(buffA[endA]!=buffB[endB])break;
-  
-  /* ??? Note that we don't do any post-loop tweaking of endA.  Why the
-   * asymmetry with i_paranoia_overlap_r?
-   */
-
-  return(endA-offsetA);
+  return match_kernels->forward(buffA+offsetA, buffB+offsetB,
+				min(sizeA-offsetA, sizeB-offsetB));
 }
 
 
@@ -20,18 +20,22 @@
 
 /* sorted vector abstraction for paranoia */
 
-/* Old isort got a bit complex.  This re-constrains complexity to
-   give a go at speed through a more alpha-6-like mechanism. */
-
-
-/* "Sort" is a bit of a misnomer in this implementation.  It's actually
- * basically a hash table of sample values (with a linked-list collision
- * resolution), which lets you quickly determine where in a vector a
- * particular sample value occurs.
+/* "Sort" is a bit of a misnomer in this implementation.  It's
+ * basically a hash table of sample values, which lets you quickly
+ * determine where in a vector a particular sample value occurs.
  *
- * Collisions aren't due to hash collisions, as the table has one bucket
- * for each possible sample value.  Instead, the "collisions" represent
- * multiple occurrences of a given value.
+ * It used to have a linked-list head for each of the 65536 possible
+ * sample values and a link for each sample of the vector, some 2.4MB
+ * for the vectors paranoia indexes, which searches wandered through
+ * one cache miss at a time.  The lists are still there, but are kept
+ * a block of the vector at a time, which lets a link be the two-byte
+ * offset of the next sample of the list within the block.  Within a
+ * block the samples are hashed into buckets of about four samples
+ * each, so the list heads of a block take a fraction of the space of
+ * its links,
+ * and a list is short but for the samples of a common value.  A run
+ * of equal samples, like silence, is linked up in order without going
+ * through the heads at all.
  */
 
 
@@ -48,6 +52,38 @@
 #include "p_block.h"
 #include "isort.h"
 
+/* How many samples sort_getmatch() looks at directly before it goes
+ * through the lists, which finds the start of a long run of matches
+ * without walking the samples before it. */
+#define SORT_PEEK 4
+
+/* ===========================================================================
+ * sort_hash() (internal)
+ *
+ * This function returns the bucket of a sample of the given value.
+ * The sample values cluster around 0, so their low bits tell the
+ * common ones apart.
+ */
+
+static inline unsigned int
+sort_hash(unsigned int hashbits, int value)
+{
+  return (unsigned int)value & ((1u << hashbits) - 1);
+}
+
+/* ===========================================================================
+ * sort_heads() (internal)
+ *
+ * This function returns the list heads of the buckets of the given
+ * block of the vector.
+ */
+
+static inline sort_link_t *
+sort_heads(sort_info_t *i, long block)
+{
+  return i->head + (block << i->hashbits);
+}
+
 
 /* ===========================================================================
  * sort_alloc()
@@ -60,16 +96,22 @@ sort_info_t *
 sort_alloc(long size)
 {
   sort_info_t *ret=calloc(1, sizeof(sort_info_t));
+  long blocksize=min(size, SORT_BLOCK_SIZE);
 
   ret->vector=NULL;
   ret->sortbegin=-1;
   ret->size=-1;
   ret->maxsize=size;
 
-  ret->head=calloc(65536,sizeof(sort_link_t *));
-  ret->bucketusage=calloc(1, 65536*sizeof(long));
-  ret->revindex=calloc(size,sizeof(sort_link_t));
-  ret->lastbucket=0;
+  /* About four samples a bucket.
+   */
+  ret->hashbits=2;
+  while ((4L << ret->hashbits) < blocksize)
+    ret->hashbits++;
+  ret->blocks=max(1, (size+SORT_BLOCK_SIZE-1)/SORT_BLOCK_SIZE);
+
+  ret->head=calloc(ret->blocks << ret->hashbits, sizeof(sort_link_t));
+  ret->index=calloc(max(size, 1), sizeof(sort_link_t));
 
   return(ret);
 }
@@ -85,27 +127,10 @@ sort_alloc(long size)
 void 
 sort_unsortall(sort_info_t *i)
 {
-  /* If there were few enough different samples encountered (and hence few
-   * enough buckets used), we can just zero out those buckets.  If there
-   * were many (2000 is picked somewhat arbitrarily), it's faster simply to
-   * zero out all buckets with a memset() rather than walking the data
-   * structure and zeroing them out one by one.
+  /* sort_sort() rebuilds the whole index, so there is nothing to
+   * clear here.
    */
-  if (i->lastbucket>2000) { /* a guess */
-    memset(i->head,0,65536*sizeof(sort_link_t *));
-  } else {
-    long b;
-    for (b=0; b<i->lastbucket; b++)
-      i->head[i->bucketusage[b]]=NULL;
-  }
-
-  i->lastbucket=0;
   i->sortbegin=-1;
-
-  /* Curiously, this function preserves the vector association created
-   * by sort_setup(), but it is used only internally by sort_setup, so
-   * preserving this association is unnecessary.
-   */
 }
 
 
@@ -118,9 +143,8 @@ sort_unsortall(sort_info_t *i)
 void 
 sort_free(sort_info_t *i)
 {
-  free(i->revindex);
+  free(i->index);
   free(i->head);
-  free(i->bucketusage);
   free(i);
 }
 
@@ -136,47 +160,64 @@ sort_free(sort_info_t *i)
 static void 
 sort_sort(sort_info_t *i,long sortlo,long sorthi)
 {
-  long j;
+  const unsigned int hashbits=i->hashbits;
+  const int16_t *vector=i->vector;
+  int16_t lowest=0, highest=0;
+  long block;
 
-  /* We walk backward through the range to index because we insert new
-   * samples at the head of each bucket's list.  At the end, they'll be
-   * sorted from first to last occurrence.
-   */
-  for (j=sorthi-1; j>=sortlo; j--) {
-    /* i->vector[j] = the signed 16-bit sample to index.
-     * hv           = pointer to the head of the sorted list of occurences
-     *                of this sample
-     * l            = the node to associate with this sample
-     *
-     * We add 32768 to convert the signed 16-bit integer to an unsigned
-     * range from 0 to 65535.
-     *
-     * Note that l is located within i->revindex at a position
-     * corresponding to the sample's position in the vector.  This allows
-     * ipos() to determine the sample position from a returned sort_link.
+  for (block=0; block<i->blocks; block++) {
+    /* Locals, as the stores to the lists could alias the fields of i.
      */
-    sort_link_t **hv = i->head+i->vector[j]+32768;
-    sort_link_t *l   = i->revindex+j;
-
-    /* If this is the first time we've encountered this sample, add its
-     * bucket to the list of buckets used.  This list is used only for
-     * resetting the index quickly.
+    const long base=block*SORT_BLOCK_SIZE;
+    const long lo=max(sortlo, base);
+    const long hi=min(sorthi, base+SORT_BLOCK_SIZE);
+    sort_link_t *head=sort_heads(i, block);
+    sort_link_t *index=i->index;
+    unsigned int bucket;
+    int16_t value;
+    long j;
+
+    memset(head, 0xff, (1L << hashbits)*sizeof(sort_link_t));
+    if (lo>=hi)
+      continue;
+
+    /* Put the samples at the head of their lists from the last one
+     * back, so that the lists are in ascending order.  The head of the
+     * list of a run of equal samples is only set once the start of the
+     * run is found.
      */
-    if(*hv==NULL){
-      i->bucketusage[i->lastbucket] = i->vector[j]+32768;
-      i->lastbucket++;
+    value=vector[hi-1];
+    lowest=min(lowest, value);
+    highest=max(highest, value);
+    bucket=sort_hash(hashbits, value);
+    index[hi-1]=SORT_END;
+    for (j=hi-2; j>=lo; j--) {
+      if (vector[j]==value)
+	index[j]=(sort_link_t)(j+1-base);
+      else {
+	head[bucket]=(sort_link_t)(j+1-base);
+	value=vector[j];
+	lowest=min(lowest, value);
+	highest=max(highest, value);
+	bucket=sort_hash(hashbits, value);
+	index[j]=head[bucket];
+      }
     }
-
-    /* Point the new node at the old head, then assign the new node as
-     * the new head.
-     */
-    l->next=*hv;    
-    *hv=l;
+    head[bucket]=(sort_link_t)(lo-base);
   }
 
-  /* Mark the index as initialized.
+  /* The values of the vector may all be too close together to share a
+   * bucket, and then a sample of the bucket needs no comparing.
+   */
+  i->lowest=lowest;
+  i->highest=highest;
+  i->exact=(highest-lowest < (1L << hashbits));
+
+  /* Mark the index as initialized, and remember what it covers.
    */
   i->sortbegin=0;
+  i->sortlo=sortlo;
+  i->sorthi=sorthi;
 }
 
 
@@ -217,6 +258,38 @@ sort_setup(sort_info_t *i, int16_t *vector, long int *abspos,
   i->hi = max(0, min(sorthi - *abspos, size));
 }
 
+/* ===========================================================================
+ * sort_scan() (internal)
+ *
+ * This function walks the list of the block of the vector at (base)
+ * from the sample at offset (link) within the block, and then the
+ * lists of the following blocks which the value being searched for
+ * hashes to, for the first sample equal to that value.  It returns
+ * NULL if there is none before the end of the range being searched.
+ */
+
+static sort_link_t *
+sort_scan(sort_info_t *i, long base, sort_link_t link)
+{
+  const unsigned int bucket=sort_hash(i->hashbits, i->val);
+
+  for (;;) {
+    for (; link!=SORT_END; link=i->index[base+link]) {
+      if (base+link>=i->hi)
+	return(NULL);
+      if (i->exact || i->vector[base+link]==i->val) {
+	i->base=base;
+	return(i->index+base+link);
+      }
+    }
+
+    base+=SORT_BLOCK_SIZE;
+    if (base>=i->hi)
+      return(NULL);
+    link=sort_heads(i, base/SORT_BLOCK_SIZE)[bucket];
+  }
+}
+
 /* ===========================================================================
  * sort_getmatch()
  *
@@ -232,7 +305,8 @@ sort_setup(sort_info_t *i, int16_t *vector, long int *abspos,
 sort_link_t *
 sort_getmatch(sort_info_t *i, long post, long overlap, int value)
 {
-  sort_link_t *ret;
+  long base, pos, end;
+  sort_link_t link;
 
   /* If the vector hasn't been indexed yet, index it now.
    */
@@ -242,61 +316,53 @@ sort_getmatch(sort_info_t *i, long post, long overlap, int value)
 
   /* We'll only return samples within (overlap) samples of (post).
    * Clamp the boundaries to search to the boundaries of the array,
-   * convert the signed sample to an unsigned offset, and store the
-   * state so that future calls to sort_nextmatch do the right thing.
+   * and store the state so that future calls to sort_nextmatch do the
+   * right thing.
    *
    * Reusing lo and hi this way is awful.
    */
   post=max(0,min(i->size,post));
-  i->val=value+32768;
+  i->val=value;
   i->lo=max(0,post-overlap);       /* absolute position */
   i->hi=min(i->size,post+overlap); /* absolute position */
 
-  /* Walk through the linked list of samples with this value, until
-   * we find the first one within the bounds specified.  If there
-   * aren't any, return NULL.
+  if (i->lo>=i->hi || value<i->lowest || value>i->highest)
+    return(NULL);
+
+  /* Look at the first few indexed samples of the range directly: in
+   * a run of matches the list would have to be walked from the start
+   * of the run.
    */
-  ret=i->head[i->val];
+  base=i->lo-i->lo%SORT_BLOCK_SIZE;
+  pos=max(i->lo, i->sortlo);
+  end=min(min(i->hi, i->sorthi), min(pos+SORT_PEEK, base+SORT_BLOCK_SIZE));
+  for (; pos<end; pos++)
+    if (i->vector[pos]==value) {
+      i->base=base;
+      return(i->index+pos);
+    }
 
-  while (ret) {
-    /* ipos() calculates the offset (in terms of the original vector)
-     * of this hit.
-     */
+  /* Otherwise walk the list of the first block from its head, past
+   * the samples looked at, and on from there.
+   */
+  end=max(end, i->lo);
+  link=sort_heads(i, base/SORT_BLOCK_SIZE)[sort_hash(i->hashbits, value)];
+  while (link!=SORT_END && base+link<end)
+    link=i->index[base+link];
 
-    if (ipos(i,ret)<i->lo) {
-      ret=ret->next;
-    } else {
-      if (ipos(i,ret)>=i->hi)
-	ret=NULL;
-      break;
-    }
-  }
-  /*i->head[i->val]=ret;*/
-  return(ret);
+  return(sort_scan(i, base, link));
 }
 
 
 /* ===========================================================================
- * sort_nextmatch()
+ * sort_scannext()
  *
- * This function returns a sort_link_t pointer which refers to the next sample
- * matching the criteria previously passed to sort_getmatch().  See
- * sort_getmatch() for details.
- *
- * This function returns NULL if no further matches were found.
+ * This function returns the next match after (prev) when it is not
+ * the next sample of the list of (prev), for sort_nextmatch().
  */
 
 sort_link_t *
-sort_nextmatch(sort_info_t *i, sort_link_t *prev)
+sort_scannext(sort_info_t *i, sort_link_t *prev)
 {
-  sort_link_t *ret=prev->next;
-
-  /* If there aren't any more hits, or we've passed the boundary requested
-   * of sort_getmatch(), we're done.
-   */
-  if (!ret || ipos(i,ret)>=i->hi)
-    return(NULL); 
-
-  return(ret);
+  return(sort_scan(i, i->base, *prev));
 }
-
@@ -21,9 +21,21 @@
 #ifndef _ISORT_H_
 #define _ISORT_H_
 
-typedef struct sort_link{
-  struct sort_link *next;
-} sort_link_t;
+/* The index is a list of the samples of each value hash in each block
+ * of the vector, in ascending order.  The link of a sample, at the
+ * same offset in the index as the sample is in the vector, is the
+ * offset of the next one within the block, so it takes two bytes.  A
+ * sort_link_t pointer is a pointer into this vector.
+ */
+typedef uint16_t sort_link_t;
+
+/* The samples in a block: as many as a link can tell apart from
+ * SORT_END. */
+#define SORT_BLOCK_SIZE 65535
+
+/* The link of the last sample of a list, and the head of a list
+ * without samples. */
+#define SORT_END 0xffff
 
 typedef struct sort_info {
   int16_t *vector;               /* vector (storage doesn't belong to us) */
@@ -34,15 +46,19 @@ typedef struct sort_info {
   long  maxsize;                 /* maximum vector size */
 
   long sortbegin;                /* range of contiguous sorted area */
+  long sortlo,sorthi;            /* range of the vector indexed */
   long lo,hi;                    /* current post, overlap range */
   int  val;                      /* ...and val */
+  long base;                     /* block of the last match */
 
   /* sort structs */
-  sort_link_t **head;           /* sort buckets (65536) */
-
-  long *bucketusage;          /*  of used buckets (65536) */
-  long lastbucket;
-  sort_link_t *revindex;
+  unsigned int hashbits;         /* log2 of the buckets in a block */
+  int  lowest,highest;           /* range of the values indexed */
+  int  exact;                    /* one of those values to a bucket */
+  long blocks;                   /* blocks in maxsize samples */
+  sort_link_t *head;             /* list heads of the buckets of each
+				    block */
+  sort_link_t *index;            /* links (maxsize) */
 
 } sort_info_t;
 
@@ -101,6 +117,14 @@ extern void sort_free(sort_info_t *i);
 extern sort_link_t *sort_getmatch(sort_info_t *i, long post, long overlap,
 				  int value);
 
+/* =========================================================================
+ * sort_scannext()
+ *
+ * The out-of-line part of sort_nextmatch(), which walks on from
+ * (prev) through the lists for the next match.
+ */
+extern sort_link_t *sort_scannext(sort_info_t *i, sort_link_t *prev);
+
 /*! ========================================================================
  * sort_nextmatch()
  *
@@ -109,8 +133,24 @@ extern sort_link_t *sort_getmatch(sort_info_t *i, long post, long overlap,
  * sort_getmatch().  See sort_getmatch() for details.
  *
  * This function returns NULL if no further matches were found.
+ *
+ * The next sample of the list of prev is most often the match (in a
+ * run of matches it is the sample after prev), or past the range
+ * searched, so that much is done inline.
  */
-extern sort_link_t *sort_nextmatch(sort_info_t *i, sort_link_t *prev);
+static inline sort_link_t *
+sort_nextmatch(sort_info_t *i, sort_link_t *prev)
+{
+  const long pos=i->base+*prev;
+
+  if (*prev!=SORT_END) {
+    if (pos>=i->hi)
+      return(NULL);
+    if (i->exact || i->vector[pos]==i->val)
+      return(i->index+pos);
+  }
+  return(sort_scannext(i, prev));
+}
 
 /* ===========================================================================
  * is()
@@ -155,7 +195,7 @@ extern sort_link_t *sort_nextmatch(sort_info_t *i, sort_link_t *prev);
  *   q - p = p + n - p, and
  *   q - p = n, not the difference of the two addresses.
  */
-#define ipos(i,l) (l-i->revindex)
+#define ipos(i,l) (l-i->index)
 
 #endif /* _ISORT_H_ */
 
@@ -0,0 +1,571 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/***
+ * Matching runs of samples.
+ *
+ * Most of the time paranoia spends verifying goes into extending runs
+ * of matching samples from a seed forward and backward. The kernels
+ * below do that several samples at a time with SSE2, AVX2 or NEON;
+ * the scalar ones are the reference the others must agree with. The
+ * fastest the processor supports is picked at run time.
+ ***/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "p_block.h"
+#include "match.h"
+
+#if defined(__SSE2__)
+# define MATCH_HAVE_SSE2
+# include <emmintrin.h>
+#endif
+#if defined(MATCH_HAVE_SSE2) && defined(HAVE_AVX2_TARGET)
+# define MATCH_HAVE_AVX2
+# include <immintrin.h>
+#endif
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+# define MATCH_HAVE_NEON
+# include <arm_neon.h>
+#endif
+
+/* Whether the read flags fa and fb end a matching run: don't match
+   through known missing data or across the edges of two reads. */
+#define MATCH_STOP(fa, fb) \
+  ((((fa)|(fb)) & FLAGS_UNREAD) || ((fa) & (fb) & FLAGS_EDGE))
+
+/**** scalar kernels *****************************************************/
+
+static long
+match_forward_scalar(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i<n; i++)
+    if (a[i] != b[i]) break;
+  return i;
+}
+
+static long
+match_backward_scalar(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i<n; i++)
+    if (a[-i] != b[-i]) break;
+  return i;
+}
+
+static long
+match_forward_flags_scalar(const int16_t *a, const int16_t *b,
+			   const unsigned char *fa, const unsigned char *fb,
+			   long n)
+{
+  long i;
+  for (i=0; i<n; i++)
+    if (a[i] != b[i] || MATCH_STOP(fa[i], fb[i])) break;
+  return i;
+}
+
+static long
+match_backward_flags_scalar(const int16_t *a, const int16_t *b,
+			    const unsigned char *fa, const unsigned char *fb,
+			    long n)
+{
+  long i;
+  for (i=0; i<n; i++)
+    if (a[-i] != b[-i] || MATCH_STOP(fa[-i], fb[-i])) break;
+  return i;
+}
+
+static const match_kernels_t match_scalar = {
+  match_forward_scalar, match_backward_scalar,
+  match_forward_flags_scalar, match_backward_flags_scalar
+};
+
+#if defined(MATCH_HAVE_SSE2) || defined(MATCH_HAVE_NEON)
+
+/* Index of the lowest and of the highest bit set in mask, which is not
+   0. */
+static inline unsigned int
+match_low_bit(uint64_t mask)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(mask);
+#else
+  unsigned int i = 0;
+  while (!(mask & 1)) { mask >>= 1; i++; }
+  return i;
+#endif
+}
+
+static inline unsigned int
+match_high_bit(uint64_t mask)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(mask);
+#else
+  unsigned int i = 63;
+  while (!(mask >> 63)) { mask <<= 1; i--; }
+  return i;
+#endif
+}
+
+#endif
+
+/**** SSE2 kernels: 8 samples a step *************************************/
+
+#ifdef MATCH_HAVE_SSE2
+
+/* Bytes of flags that end a run, as MATCH_STOP, are 0 in the result. */
+static inline __m128i
+match_flags_ok_sse2(__m128i fa, __m128i fb)
+{
+  const __m128i stop =
+    _mm_or_si128(_mm_and_si128(_mm_or_si128(fa, fb),
+			       _mm_set1_epi8(FLAGS_UNREAD)),
+		 _mm_and_si128(_mm_and_si128(fa, fb),
+			       _mm_set1_epi8(FLAGS_EDGE)));
+  return _mm_cmpeq_epi8(stop, _mm_setzero_si128());
+}
+
+/* One bit for each of the 8 samples at a and b that are equal. */
+static inline unsigned int
+match_eq_sse2(const int16_t *a, const int16_t *b)
+{
+  const __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) a),
+				     _mm_loadu_si128((const __m128i *) b));
+  return _mm_movemask_epi8(_mm_packs_epi16(eq, eq)) & 0xff;
+}
+
+/* The same also clearing the bits of samples whose flags end a run. */
+static inline unsigned int
+match_eq_flags_sse2(const int16_t *a, const int16_t *b,
+		    const unsigned char *fa, const unsigned char *fb)
+{
+  const __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *) a),
+				     _mm_loadu_si128((const __m128i *) b));
+  const __m128i ok =
+    match_flags_ok_sse2(_mm_loadl_epi64((const __m128i *) fa),
+			_mm_loadl_epi64((const __m128i *) fb));
+  return _mm_movemask_epi8(_mm_and_si128(_mm_packs_epi16(eq, eq), ok))
+    & 0xff;
+}
+
+static long
+match_forward_sse2(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const unsigned int mask = match_eq_sse2(a+i, b+i);
+    if (mask != 0xff) return i + match_low_bit(~mask & 0xff);
+  }
+  return i + match_forward_scalar(a+i, b+i, n-i);
+}
+
+static long
+match_backward_sse2(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const unsigned int mask = match_eq_sse2(a-i-7, b-i-7);
+    if (mask != 0xff) return i + 7 - match_high_bit(~mask & 0xff);
+  }
+  return i + match_backward_scalar(a-i, b-i, n-i);
+}
+
+static long
+match_forward_flags_sse2(const int16_t *a, const int16_t *b,
+			 const unsigned char *fa, const unsigned char *fb,
+			 long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const unsigned int mask = match_eq_flags_sse2(a+i, b+i, fa+i, fb+i);
+    if (mask != 0xff) return i + match_low_bit(~mask & 0xff);
+  }
+  return i + match_forward_flags_scalar(a+i, b+i, fa+i, fb+i, n-i);
+}
+
+static long
+match_backward_flags_sse2(const int16_t *a, const int16_t *b,
+			  const unsigned char *fa, const unsigned char *fb,
+			  long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const unsigned int mask =
+      match_eq_flags_sse2(a-i-7, b-i-7, fa-i-7, fb-i-7);
+    if (mask != 0xff) return i + 7 - match_high_bit(~mask & 0xff);
+  }
+  return i + match_backward_flags_scalar(a-i, b-i, fa-i, fb-i, n-i);
+}
+
+static const match_kernels_t match_sse2 = {
+  match_forward_sse2, match_backward_sse2,
+  match_forward_flags_sse2, match_backward_flags_sse2
+};
+
+#endif /* MATCH_HAVE_SSE2 */
+
+/**** AVX2 kernels: 16 samples a step ************************************/
+
+#ifdef MATCH_HAVE_AVX2
+
+#define MATCH_TARGET_AVX2 __attribute__((target("avx2")))
+
+/* One bit for each of the 16 samples at a and b that are equal. */
+static inline MATCH_TARGET_AVX2 __m128i
+match_eq_avx2(const int16_t *a, const int16_t *b)
+{
+  const __m256i eq =
+    _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *) a),
+		       _mm256_loadu_si256((const __m256i *) b));
+  return _mm_packs_epi16(_mm256_castsi256_si128(eq),
+			 _mm256_extracti128_si256(eq, 1));
+}
+
+static MATCH_TARGET_AVX2 long
+match_forward_avx2(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+16<=n; i+=16) {
+    const unsigned int mask = _mm_movemask_epi8(match_eq_avx2(a+i, b+i));
+    if (mask != 0xffff) return i + match_low_bit(~mask & 0xffff);
+  }
+  return i + match_forward_sse2(a+i, b+i, n-i);
+}
+
+static MATCH_TARGET_AVX2 long
+match_backward_avx2(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+16<=n; i+=16) {
+    const unsigned int mask =
+      _mm_movemask_epi8(match_eq_avx2(a-i-15, b-i-15));
+    if (mask != 0xffff) return i + 15 - match_high_bit(~mask & 0xffff);
+  }
+  return i + match_backward_sse2(a-i, b-i, n-i);
+}
+
+static MATCH_TARGET_AVX2 long
+match_forward_flags_avx2(const int16_t *a, const int16_t *b,
+			 const unsigned char *fa, const unsigned char *fb,
+			 long n)
+{
+  long i;
+  for (i=0; i+16<=n; i+=16) {
+    const __m128i ok =
+      match_flags_ok_sse2(_mm_loadu_si128((const __m128i *) (fa+i)),
+			  _mm_loadu_si128((const __m128i *) (fb+i)));
+    const unsigned int mask =
+      _mm_movemask_epi8(_mm_and_si128(match_eq_avx2(a+i, b+i), ok));
+    if (mask != 0xffff) return i + match_low_bit(~mask & 0xffff);
+  }
+  return i + match_forward_flags_sse2(a+i, b+i, fa+i, fb+i, n-i);
+}
+
+static MATCH_TARGET_AVX2 long
+match_backward_flags_avx2(const int16_t *a, const int16_t *b,
+			  const unsigned char *fa, const unsigned char *fb,
+			  long n)
+{
+  long i;
+  for (i=0; i+16<=n; i+=16) {
+    const __m128i ok =
+      match_flags_ok_sse2(_mm_loadu_si128((const __m128i *) (fa-i-15)),
+			  _mm_loadu_si128((const __m128i *) (fb-i-15)));
+    const unsigned int mask =
+      _mm_movemask_epi8(_mm_and_si128(match_eq_avx2(a-i-15, b-i-15), ok));
+    if (mask != 0xffff) return i + 15 - match_high_bit(~mask & 0xffff);
+  }
+  return i + match_backward_flags_sse2(a-i, b-i, fa-i, fb-i, n-i);
+}
+
+static const match_kernels_t match_avx2 = {
+  match_forward_avx2, match_backward_avx2,
+  match_forward_flags_avx2, match_backward_flags_avx2
+};
+
+#endif /* MATCH_HAVE_AVX2 */
+
+/**** NEON kernels: 8 samples a step *************************************/
+
+#ifdef MATCH_HAVE_NEON
+
+/* One byte of all ones for each of the 8 samples at a and b that are
+   equal, lowest sample in the lowest byte. */
+static inline uint8x8_t
+match_eq_neon(const int16_t *a, const int16_t *b)
+{
+  return vmovn_u16(vceqq_s16(vld1q_s16(a), vld1q_s16(b)));
+}
+
+static inline uint8x8_t
+match_flags_ok_neon(const unsigned char *fa, const unsigned char *fb)
+{
+  const uint8x8_t f_a = vld1_u8(fa);
+  const uint8x8_t f_b = vld1_u8(fb);
+  const uint8x8_t stop =
+    vorr_u8(vand_u8(vorr_u8(f_a, f_b), vdup_n_u8(FLAGS_UNREAD)),
+	    vand_u8(vand_u8(f_a, f_b), vdup_n_u8(FLAGS_EDGE)));
+  return vceq_u8(stop, vdup_n_u8(0));
+}
+
+static inline uint64_t
+match_mask_neon(uint8x8_t v)
+{
+  return vget_lane_u64(vreinterpret_u64_u8(v), 0);
+}
+
+static long
+match_forward_neon(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const uint64_t mask = match_mask_neon(match_eq_neon(a+i, b+i));
+    if (~mask) return i + match_low_bit(~mask) / 8;
+  }
+  return i + match_forward_scalar(a+i, b+i, n-i);
+}
+
+static long
+match_backward_neon(const int16_t *a, const int16_t *b, long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const uint64_t mask = match_mask_neon(match_eq_neon(a-i-7, b-i-7));
+    if (~mask) return i + 7 - match_high_bit(~mask) / 8;
+  }
+  return i + match_backward_scalar(a-i, b-i, n-i);
+}
+
+static long
+match_forward_flags_neon(const int16_t *a, const int16_t *b,
+			 const unsigned char *fa, const unsigned char *fb,
+			 long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const uint64_t mask =
+      match_mask_neon(vand_u8(match_eq_neon(a+i, b+i),
+			      match_flags_ok_neon(fa+i, fb+i)));
+    if (~mask) return i + match_low_bit(~mask) / 8;
+  }
+  return i + match_forward_flags_scalar(a+i, b+i, fa+i, fb+i, n-i);
+}
+
+static long
+match_backward_flags_neon(const int16_t *a, const int16_t *b,
+			  const unsigned char *fa, const unsigned char *fb,
+			  long n)
+{
+  long i;
+  for (i=0; i+8<=n; i+=8) {
+    const uint64_t mask =
+      match_mask_neon(vand_u8(match_eq_neon(a-i-7, b-i-7),
+			      match_flags_ok_neon(fa-i-7, fb-i-7)));
+    if (~mask) return i + 7 - match_high_bit(~mask) / 8;
+  }
+  return i + match_backward_flags_scalar(a-i, b-i, fa-i, fb-i, n-i);
+}
+
+static const match_kernels_t match_neon = {
+  match_forward_neon, match_backward_neon,
+  match_forward_flags_neon, match_backward_flags_neon
+};
+
+#endif /* MATCH_HAVE_NEON */
+
+/**** selection **********************************************************/
+
+const match_kernels_t *match_kernels = &match_scalar;
+
+/* The kernels of impl, or NULL if this build or processor lacks them. */
+static const match_kernels_t *
+match_get(match_impl_t impl)
+{
+  switch (impl) {
+  case MATCH_SCALAR:
+    return &match_scalar;
+#ifdef MATCH_HAVE_SSE2
+  case MATCH_SSE2:
+    return &match_sse2;
+#endif
+#ifdef MATCH_HAVE_AVX2
+  case MATCH_AVX2:
+    return __builtin_cpu_supports("avx2") ? &match_avx2 : NULL;
+#endif
+#ifdef MATCH_HAVE_NEON
+  case MATCH_NEON:
+    return &match_neon;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+void
+i_match_init(void)
+{
+  int impl;
+
+  /* Try the widest kernels first. A build only has the kernels of
+     one kind of processor. */
+  for (impl=MATCH_IMPLS-1; impl>MATCH_SCALAR; impl--)
+    if (match_get(impl)) break;
+  match_kernels = match_get(impl);
+}
+
+bool
+i_match_use(match_impl_t impl)
+{
+  const match_kernels_t *kernels = match_get(impl);
+  if (!kernels) return false;
+  match_kernels = kernels;
+  return true;
+}
+
+const char *
+i_match_name(match_impl_t impl)
+{
+  static const char *names[MATCH_IMPLS] = { "scalar", "SSE2", "AVX2", "NEON" };
+  return (impl < MATCH_IMPLS) ? names[impl] : "unknown";
+}
+
+/**** matching runs ******************************************************/
+
+/* ===========================================================================
+ * i_paranoia_overlap() (internal)
+ *
+ * This function is called when buffA[offsetA] == buffB[offsetB].  This
+ * function searches backward and forward to see how many consecutive
+ * samples also match.
+ *
+ * This function is called by do_const_sync() when we're not doing any
+ * verification.  Its more complicated sibling is i_paranoia_overlap2.
+ *
+ * This function returns the number of consecutive matching samples.
+ * If (ret_begin) or (ret_end) are not NULL, it fills them with the
+ * offsets of the first and last matching samples in A.
+ */
+long
+i_paranoia_overlap(int16_t *buffA,int16_t *buffB,
+		   long offsetA, long offsetB,
+		   long sizeA,long sizeB,
+		   long *ret_begin, long *ret_end)
+{
+  long beginA=offsetA,endA=offsetA;
+
+  /* Scan backward to extend the matching run in that direction. */
+  beginA -= match_kernels->backward(buffA+offsetA, buffB+offsetB,
+				    min(offsetA, offsetB)+1);
+  beginA++;
+
+  /* Scan forward to extend the matching run in that direction. */
+  endA += match_kernels->forward(buffA+offsetA, buffB+offsetB,
+				 min(sizeA-offsetA, sizeB-offsetB));
+
+  /* Return the result of our search. */
+  if (ret_begin) *ret_begin = beginA;
+  if (ret_end) *ret_end = endA;
+  return (endA-beginA);
+}
+
+
+/* ===========================================================================
+ * i_paranoia_overlap2() (internal)
+ *
+ * This function is called when buffA[offsetA] == buffB[offsetB].  This
+ * function searches backward and forward to see how many consecutive
+ * samples also match.
+ *
+ * This function is called by do_const_sync() when we're verifying the
+ * data coming off the CD.  Its less complicated sibling is
+ * i_paranoia_overlap, which is a good place to look to see the simplest
+ * outline of how this function works.
+ *
+ * This function returns the number of consecutive matching samples.
+ * If (ret_begin) or (ret_end) are not NULL, it fills them with the
+ * offsets of the first and last matching samples in A.
+ */
+long
+i_paranoia_overlap2(int16_t *buffA,int16_t *buffB,
+		    unsigned char *flagsA, unsigned char *flagsB,
+		    long offsetA, long offsetB,
+		    long sizeA,long sizeB,
+		    long *ret_begin, long *ret_end)
+{
+  const long n=min(offsetA, offsetB)+1;
+  long beginA=offsetA, endA=offsetA;
+  long beginB=offsetB, endB=offsetB;
+  long matched;
+
+  /* Scan backward to extend the matching run in that direction. */
+  matched = match_kernels->backward_flags(buffA+offsetA, buffB+offsetB,
+					  flagsA+offsetA, flagsB+offsetB, n);
+  beginA -= matched;
+  beginB -= matched;
+
+  /* don't allow matching across matching sector boundaries */
+  /* The scan stops at a mismatch, at known missing data or where both
+   * samples were at the edges of a low-level read; only in the last
+   * case is the sample it stopped at part of the run.
+   * ???: What implications does this have?
+   * ???: Why do we include the first sample for which this is true?
+   */
+  if (matched<n && buffA[beginA]==buffB[beginB]
+      && (flagsA[beginA]&flagsB[beginB]&FLAGS_EDGE)) {
+    beginA--;
+    beginB--;
+  }
+  beginA++;
+  beginB++;
+
+  /* Scan forward to extend the matching run in that direction. */
+  for (; endA<sizeA && endB<sizeB; endA++,endB++) {
+    if (endA>beginA) {
+      /* Past beginA every flag that ends a run ends it before the
+       * flagged sample, so the kernel can take it from here. */
+      matched = match_kernels->forward_flags(buffA+endA, buffB+endB,
+					     flagsA+endA, flagsB+endB,
+					     min(sizeA-endA, sizeB-endB));
+      endA += matched;
+      endB += matched;
+      break;
+    }
+
+    if (buffA[endA] != buffB[endB]) break;
+
+    /* don't allow matching across matching sector boundaries */
+    /* Stop if both samples were at the edges of a low-level read.
+     * ???: What implications does this have?
+     * ???: Why do we not stop if endA == beginA?
+     */
+    if ((flagsA[endA]&flagsB[endB]&FLAGS_EDGE) && endA!=beginA){
+      break;
+    }
+
+    /* don't allow matching through known missing data */
+    if ((flagsA[endA]&FLAGS_UNREAD) || (flagsB[endB]&FLAGS_UNREAD))
+      break;
+  }
+
+  /* Return the result of our search. */
+  if (ret_begin) *ret_begin = beginA;
+  if (ret_end) *ret_end = endA;
+  return (endA-beginA);
+}
@@ -0,0 +1,78 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Extending runs of matching samples, several samples at a time. */
+
+#ifndef _MATCH_H_
+#define _MATCH_H_
+
+#include <cdio/types.h>
+
+/* The implementations of the matching kernels. */
+typedef enum {
+  MATCH_SCALAR,   /* one sample at a time; always available */
+  MATCH_SSE2,     /* 8 samples at a time */
+  MATCH_AVX2,     /* 16 samples at a time */
+  MATCH_NEON,     /* 8 samples at a time */
+  MATCH_IMPLS
+} match_impl_t;
+
+typedef struct {
+  /* Number of samples, at most n, for which a[i] == b[i], counting
+     from i = 0 up. */
+  long (*forward)(const int16_t *a, const int16_t *b, long n);
+  /* The same counting from i = 0 down: a[0], a[-1], ... */
+  long (*backward)(const int16_t *a, const int16_t *b, long n);
+  /* As forward and backward but also stopping at the first sample
+     flagged FLAGS_UNREAD in fa or fb, or FLAGS_EDGE in both. */
+  long (*forward_flags)(const int16_t *a, const int16_t *b,
+			const unsigned char *fa, const unsigned char *fb,
+			long n);
+  long (*backward_flags)(const int16_t *a, const int16_t *b,
+			 const unsigned char *fa, const unsigned char *fb,
+			 long n);
+} match_kernels_t;
+
+/* The kernels in use, scalar ones until i_match_init() picks others. */
+extern const match_kernels_t *match_kernels;
+
+/* Pick the fastest kernels the processor running us supports. It is
+   called by paranoia_init() and is cheap to call again. */
+extern void i_match_init(void);
+
+/* Use the kernels of impl, if this build and processor have them;
+   returns false otherwise. For tests and benchmarks. */
+extern bool i_match_use(match_impl_t impl);
+
+extern const char *i_match_name(match_impl_t impl);
+
+/* i_paranoia_overlap and i_paranoia_overlap2 start from
+   buffA[offsetA] == buffB[offsetB] and return how many consecutive
+   samples around it match, storing the offsets in A of the first and
+   one past the last of them in *ret_begin and *ret_end if those are
+   not NULL. i_paranoia_overlap2 also stops at the read flags. */
+extern long i_paranoia_overlap(int16_t *buffA,int16_t *buffB,
+			       long offsetA, long offsetB,
+			       long sizeA,long sizeB,
+			       long *ret_begin, long *ret_end);
+extern long i_paranoia_overlap2(int16_t *buffA,int16_t *buffB,
+				unsigned char *flagsA, unsigned char *flagsB,
+				long offsetA, long offsetB,
+				long sizeA,long sizeB,
+				long *ret_begin, long *ret_end);
+
+#endif /*_MATCH_H_*/
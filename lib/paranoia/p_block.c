@@ -31,9 +31,59 @@
 #endif
 #include <limits.h>
 #include "p_block.h"
+#include "match.h"
 #include <cdio/cdda.h>
 #include <cdio/paranoia.h>
 
+/**** Pools ***************************************************************/
+
+void 
+pool_init(paranoia_pool_t *pool, size_t size)
+{
+  memset(pool,0,sizeof(paranoia_pool_t));
+  /* Every piece holds the pointer to the next while it is kept. */
+  pool->size=max(size,sizeof(void *));
+  pool->stats.i_size=pool->size;
+}
+
+void *
+pool_get(paranoia_pool_t *pool)
+{
+  void *piece=pool->free;
+
+  if(piece){
+    pool->free=*(void **)piece;
+    pool->stats.i_free--;
+    pool->stats.i_reuses++;
+    memset(piece,0,pool->size);
+    return(piece);
+  }
+
+  pool->stats.i_allocs++;
+  return(calloc(1,pool->size));
+}
+
+void 
+pool_put(paranoia_pool_t *pool, void *piece)
+{
+  *(void **)piece=pool->free;
+  pool->free=piece;
+  pool->stats.i_free++;
+}
+
+void 
+pool_drain(paranoia_pool_t *pool)
+{
+  while(pool->free){
+    void *next=*(void **)pool->free;
+    free(pool->free);
+    pool->free=next;
+  }
+  pool->stats.i_free=0;
+}
+
+/**** Linked lists ********************************************************/
+
 linked_list_t *new_list(void *(*newp)(void),void (*freep)(void *))
 {
   linked_list_t *ret=calloc(1,sizeof(linked_list_t));
@@ -45,7 +95,8 @@ linked_list_t *new_list(void *(*newp)(void),void (*freep)(void *))
 linked_element *add_elem(linked_list_t *l,void *elem)
 {
 
-  linked_element *ret=calloc(1,sizeof(linked_element));
+  linked_element *ret=l->pool ? pool_get(l->pool)
+    : calloc(1,sizeof(linked_element));
   ret->stamp=l->current++;
   ret->ptr=elem;
   ret->list=l;
@@ -86,7 +137,10 @@ free_elem(linked_element *e,int free_ptr)
     e->next->prev=e->prev;
 
   l->active--;
-  free(e);
+  if(l->pool)
+    pool_put(l->pool,e);
+  else
+    free(e);
 } 
 
 void 
@@ -107,6 +161,7 @@ linked_list_t *copy_list(linked_list_t *list)
   linked_list_t *new=new_list(list->new_poly,list->free_poly);
   linked_element *i=list->tail;
 
+  new->pool=list->pool;
   while(i){
     add_elem(new,i->ptr);
     i=i->prev;
@@ -123,23 +178,40 @@ i_cblock_constructor(cdrom_paranoia_t *p)
   return(ret);
 }
 
+/* c_blocks of a cdrom_paranoia_t go back to its pools; the samples
+   only if they were not reallocated since they came from the pool,
+   and the flags, which never are, always.  c_alloc() blocks are
+   freed. */
 void 
 i_cblock_destructor(c_block_t *c)
 {
   if(c){
-    if(c->vector)free(c->vector);
-    if(c->flags)free(c->flags);
+    cdrom_paranoia_t *p=c->p;
+
+    if(!p){
+      if(c->vector)free(c->vector);
+      if(c->flags)free(c->flags);
+      free(c);
+      return;
+    }
+
+    if(c->vector){
+      if(c->alloc*sizeof(int16_t)==p->buffers.size)
+	pool_put(&p->buffers,c->vector);
+      else
+	free(c->vector);
+    }
+    if(c->flags)pool_put(&p->flags,c->flags);
     c->e=NULL;
-    free(c);
+    pool_put(&p->nodes,c);
   }
 }
 
 c_block_t *
 new_c_block(cdrom_paranoia_t *p)
 {
-  linked_element *e=new_elem(p->cache);
-  c_block_t *c=e->ptr;
-  c->e=e;
+  c_block_t *c=pool_get(&p->nodes);
+  c->e=add_elem(p->cache,c);
   c->p=p;
   return(c);
 }
@@ -168,17 +240,16 @@ i_vfragment_constructor(void)
 static void 
 i_v_fragment_destructor(v_fragment_t *v)
 {
-  free(v);
+  pool_put(&v->p->nodes,v);
 }
 
 v_fragment_t *
 new_v_fragment(cdrom_paranoia_t *p, c_block_t *one,
 	       long int begin, long int end, int last)
 {
-  linked_element *e=new_elem(p->fragments);
-  v_fragment_t *b=e->ptr;
+  v_fragment_t *b=pool_get(&p->nodes);
   
-  b->e=e;
+  b->e=add_elem(p->fragments,b);
   b->p=p;
 
   b->one=one;
@@ -295,6 +366,7 @@ c_alloc(int16_t *vector, long begin, long size)
   c->vector=vector;
   c->begin=begin;
   c->size=size;
+  c->alloc=size;
   return(c);
 }
 
@@ -302,6 +374,19 @@ void c_set(c_block_t *v,long begin){
   v->begin=begin;
 }
 
+/* Make room in v for size samples in all.  The root grows by a read
+   at a time while its start is cut away, so room is made to spare,
+   to not reallocate it every time. */
+static void 
+i_c_reserve(c_block_t *v,long size)
+{
+  if(size>v->alloc){
+    long alloc=max(size,2*v->alloc);
+    v->vector=realloc(v->vector,sizeof(int16_t)*alloc);
+    v->alloc=alloc;
+  }
+}
+
 /* pos here is vector position from zero */
 void 
 c_insert(c_block_t *v,long pos,int16_t *b,long size)
@@ -309,11 +394,7 @@ c_insert(c_block_t *v,long pos,int16_t *b,long size)
   int vs=cs(v);
   if(pos<0 || pos>vs)return;
 
-  if(v->vector) {
-    v->vector = realloc(v->vector,sizeof(int16_t)*(size+vs));
-  } else {
-    v->vector = calloc(1, sizeof(int16_t)*size);
-  }
+  i_c_reserve(v,size+vs);
   
   if(pos<vs)memmove(v->vector+pos+size,v->vector+pos,
 		       (vs-pos)*sizeof(int16_t));
@@ -354,11 +435,7 @@ c_append(c_block_t *v, int16_t *vector, long size)
   int vs=cs(v);
 
   /* update the vector */
-  if(v->vector)
-    v->vector=realloc(v->vector,sizeof(int16_t)*(size+vs));
-  else {
-    v->vector=calloc(1, sizeof(int16_t)*size);
-  }
+  i_c_reserve(v,size+vs);
   memcpy(v->vector+vs,vector,sizeof(int16_t)*size);
 
   v->size+=size;
@@ -430,6 +507,8 @@ paranoia_init(cdrom_drive_t *d)
 {
   cdrom_paranoia_t *p=calloc(1,sizeof(cdrom_paranoia_t));
 
+  i_match_init();
+
   p->cache=new_list((void *)&i_cblock_constructor,
 		    (void *)&i_cblock_destructor);
 
@@ -437,6 +516,16 @@ paranoia_init(cdrom_drive_t *d)
 			(void *)&i_v_fragment_destructor);
 
   p->readahead=150;
+
+  /* A read is never longer than readahead sectors (i_plan_read()), so
+     every read fits a piece of the buffer pools. */
+  pool_init(&p->buffers,p->readahead*CDIO_CD_FRAMESIZE_RAW);
+  pool_init(&p->flags,p->readahead*CD_FRAMEWORDS);
+  pool_init(&p->nodes,max(sizeof(linked_element),
+			  max(sizeof(c_block_t),sizeof(v_fragment_t))));
+  p->cache->pool=&p->nodes;
+  p->fragments->pool=&p->nodes;
+
   p->sortcache=sort_alloc(p->readahead*CD_FRAMEWORDS);
   p->d=d;
   p->dynoverlap=MAX_SECTOR_OVERLAP*CD_FRAMEWORDS;
@@ -457,3 +546,20 @@ void paranoia_set_range(cdrom_paranoia_t *p, long start, long end)
   p->current_firstsector = start;
   p->current_lastsector = end;
 }
+
+void 
+paranoia_pool_stats(const cdrom_paranoia_t *p, paranoia_pool_kind_t kind,
+		    cdio_paranoia_pool_stats_t *p_stats)
+{
+  switch(kind){
+  case PARANOIA_POOL_BUFFERS:
+    *p_stats=p->buffers.stats;
+    break;
+  case PARANOIA_POOL_FLAGS:
+    *p_stats=p->flags.stats;
+    break;
+  default:
+    *p_stats=p->nodes.stats;
+    break;
+  }
+}
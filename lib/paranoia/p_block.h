@@ -38,6 +38,33 @@
 
 #include "isort.h"
 
+/** 
+    Flags indicating the status of a read samples.
+
+    Imagine the below enumeration values are #defines to be used in a
+    bitmask rather than distinct values of an enum.
+*/
+typedef enum  {
+  FLAGS_EDGE    =0x1, /**< first/last N words of frame */
+  FLAGS_UNREAD  =0x2, /**< unread, hence missing and unmatchable */
+  FLAGS_VERIFIED=0x4  /**< block read and verified */
+} paranoia_read_flags_t;
+
+/* Memory of one size that a cdrom_paranoia_t asks for over and over:
+   the samples and flags of its reads and the nodes of its lists.
+   Pieces given back are kept, each holding a pointer to the next, and
+   handed out again until pool_drain(). */
+typedef struct paranoia_pool_s {
+  size_t size;                     /* bytes in a piece */
+  void *free;                      /* pieces kept for reuse */
+  cdio_paranoia_pool_stats_t stats;
+} paranoia_pool_t;
+
+extern void pool_init(paranoia_pool_t *pool, size_t size);
+extern void *pool_get(paranoia_pool_t *pool); /* zeroed, like calloc */
+extern void pool_put(paranoia_pool_t *pool, void *piece);
+extern void pool_drain(paranoia_pool_t *pool);
+
 typedef struct {
   /* linked list */
   struct linked_element *head;
@@ -48,6 +75,8 @@ typedef struct {
   long current;
   long active;
 
+  paranoia_pool_t *pool;   /* of elements, or NULL to use malloc */
+
 } linked_list_t;
 
 typedef struct linked_element{
@@ -74,6 +103,7 @@ typedef struct c_block {
   int16_t *vector;
   long begin;
   long size;
+  long alloc;   /* samples vector has room for */
 
   /* auxiliary support structures */
   unsigned char *flags; /* 1    known boundaries in read data
@@ -88,6 +118,7 @@ typedef struct c_block {
 
   /* end of session cases */
   long lastsector;
+  bool b_c2;    /* read with C2 error pointers, its errors FLAGS_UNREAD */
   cdrom_paranoia_t *p;
   struct linked_element *e;
 
@@ -175,8 +206,28 @@ struct cdrom_paranoia_s {
   long dynoverlap;
   long dyndrift;
 
+  /* with PARANOIA_MODE_TESTCOPY, reads are made as with full paranoia
+     till the root gets to testcopy_end, and the root should have got
+     to testcopy_last; see i_test_copy() (words) */
+  long testcopy_end;
+  long testcopy_last;
+
+  /* with PARANOIA_MODE_C2, whether the drive turned out not to report
+     C2 errors */
+  bool b_no_c2;
+
   /* statistics for verification */
 
+  /* memory kept for reuse; see paranoia_pool_stats() */
+  paranoia_pool_t buffers;   /* samples of a read of readahead sectors */
+  paranoia_pool_t flags;     /* flags of the same */
+  paranoia_pool_t nodes;     /* c_blocks, v_fragments, list elements */
+
+  /* pipelined reading; see paranoia_set_pipeline() */
+  bool b_pipeline;
+  struct read_job_s *pipeline;  /* the next read, worked out ahead */
+  int pipeline_hits;            /* how many such came true in a row */
+
 };
 
 extern c_block_t *c_alloc(int16_t *vector,long begin,long size);
@@ -95,16 +95,21 @@
 #endif
 #include <unistd.h>
 #include <stdio.h>
+#include <limits.h>
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
 #include <math.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <cdio/cdda.h>
 #include "../cdda_interface/smallft.h"
 #include "p_block.h"
 #include <cdio/paranoia.h>
 #include "overlap.h"
 #include "gap.h"
+#include "match.h"
 #include "isort.h"
 
 const char *paranoia_cb_mode2str[] = {
@@ -165,139 +170,14 @@ rv(root_block *root){
 
 #define rc(r) (r->vector)
 
-/** 
-    Flags indicating the status of a read samples.
-
-    Imagine the below enumeration values are #defines to be used in a
-    bitmask rather than distinct values of an enum.
-
-    The variable part of the declaration is trickery to force the enum
-    symbol values to be recorded in debug symbol tables. They are used
-    to allow one refer to the enumeration value names in a debugger
-    and in debugger expressions.
-*/
-enum  {
-  FLAGS_EDGE    =0x1, /**< first/last N words of frame */
-  FLAGS_UNREAD  =0x2, /**< unread, hence missing and unmatchable */
-  FLAGS_VERIFIED=0x4  /**< block read and verified */
-} paranoia_read_flags;
+/* The read flags are paranoia_read_flags_t, in p_block.h. This
+   variable forces their names into the debug symbol tables so that
+   they can be used in debugger expressions. */
+paranoia_read_flags_t paranoia_read_flags;
 
 
 /**** matching and analysis code *****************************************/
 
-/* ===========================================================================
- * i_paranoia_overlap() (internal)
- *
- * This function is called when buffA[offsetA] == buffB[offsetB].  This
- * function searches backward and forward to see how many consecutive
- * samples also match.
- *
- * This function is called by do_const_sync() when we're not doing any
- * verification.  Its more complicated sibling is i_paranoia_overlap2.
- *
- * This function returns the number of consecutive matching samples.
- * If (ret_begin) or (ret_end) are not NULL, it fills them with the
- * offsets of the first and last matching samples in A.
- */
-static inline long 
-i_paranoia_overlap(int16_t *buffA,int16_t *buffB,
-		   long offsetA, long offsetB,
-		   long sizeA,long sizeB,
-		   long *ret_begin, long *ret_end)
-{
-  long beginA=offsetA,endA=offsetA;
-  long beginB=offsetB,endB=offsetB;
-
-  /* Scan backward to extend the matching run in that direction. */
-  for(; beginA>=0 && beginB>=0; beginA--,beginB--)
-    if (buffA[beginA] != buffB[beginB]) break;
-  beginA++;
-  beginB++;
-
-  /* Scan forward to extend the matching run in that direction. */
-  for(; endA<sizeA && endB<sizeB; endA++,endB++)
-    if (buffA[endA] != buffB[endB]) break;
-
-  /* Return the result of our search. */
-  if (ret_begin) *ret_begin = beginA;
-  if (ret_end) *ret_end = endA;
-  return (endA-beginA);
-}
-
-
-/* ===========================================================================
- * i_paranoia_overlap2() (internal)
- *
- * This function is called when buffA[offsetA] == buffB[offsetB].  This
- * function searches backward and forward to see how many consecutive
- * samples also match.
- *
- * This function is called by do_const_sync() when we're verifying the
- * data coming off the CD.  Its less complicated sibling is
- * i_paranoia_overlap, which is a good place to look to see the simplest
- * outline of how this function works.
- *
- * This function returns the number of consecutive matching samples.
- * If (ret_begin) or (ret_end) are not NULL, it fills them with the
- * offsets of the first and last matching samples in A.
- */
-static inline long 
-i_paranoia_overlap2(int16_t *buffA,int16_t *buffB,
-		    unsigned char *flagsA, unsigned char *flagsB,
-		    long offsetA, long offsetB,
-		    long sizeA,long sizeB,
-		    long *ret_begin, long *ret_end)
-{
-  long beginA=offsetA, endA=offsetA;
-  long beginB=offsetB, endB=offsetB;
-  
-  /* Scan backward to extend the matching run in that direction. */
-  for (; beginA>=0 && beginB>=0; beginA--,beginB--) {
-    if (buffA[beginA] != buffB[beginB]) break;
-
-    /* don't allow matching across matching sector boundaries */
-    /* Stop if both samples were at the edges of a low-level read.
-     * ???: What implications does this have?
-     * ???: Why do we include the first sample for which this is true?
-     */
-    if ((flagsA[beginA]&flagsB[beginB]&FLAGS_EDGE)) {
-      beginA--;
-      beginB--;
-      break;
-    }
-
-    /* don't allow matching through known missing data */
-    if ((flagsA[beginA]&FLAGS_UNREAD) || (flagsB[beginB]&FLAGS_UNREAD))
-      break;
-  }
-  beginA++;
-  beginB++;
-  
-  /* Scan forward to extend the matching run in that direction. */
-  for (; endA<sizeA && endB<sizeB; endA++,endB++) {
-    if (buffA[endA] != buffB[endB]) break;
-
-    /* don't allow matching across matching sector boundaries */
-    /* Stop if both samples were at the edges of a low-level read.
-     * ???: What implications does this have?
-     * ???: Why do we not stop if endA == beginA?
-     */
-    if ((flagsA[endA]&flagsB[endB]&FLAGS_EDGE) && endA!=beginA){
-      break;
-    }
-
-    /* don't allow matching through known missing data */
-    if ((flagsA[endA]&FLAGS_UNREAD) || (flagsB[endB]&FLAGS_UNREAD))
-      break;
-  }
-
-  /* Return the result of our search. */
-  if (ret_begin) *ret_begin = beginA;
-  if (ret_end) *ret_end = endA;
-  return (endA-beginA);
-}
-
-
 /* ===========================================================================
  * do_const_sync() (internal)
  *
@@ -2398,8 +2278,8 @@ verify_skip_case(cdrom_paranoia_t *p,
       gend=min(gend+OVERLAP_ADJ,cend);
 
       if (rv(root)==NULL){
-	int16_t *buff=malloc(cs(graft));
-	memcpy(buff,cv(graft),cs(graft));
+	int16_t *buff=malloc(cs(graft)*sizeof(int16_t));
+	memcpy(buff,cv(graft),cs(graft)*sizeof(int16_t));
 	rc(root)=c_alloc(buff,cb(graft),cs(graft));
       } else {
 	c_append(rc(root),cv(graft)+post-cbegin,
@@ -2436,133 +2316,92 @@ verify_skip_case(cdrom_paranoia_t *p,
   }
 }    
 
-/**** toplevel ****************************************/
-
-void 
-paranoia_free(cdrom_paranoia_t *p)
-{
-  paranoia_resetall(p);
-  sort_free(p->sortcache);
-  free_list(p->cache, 1);
-  free_list(p->fragments, 1);
-  free(p);
-}
-
-/*! 
-  Set the kind of repair you want to on for reading. 
-  The modes are listed above
-  
-  @param p       paranoia type
-  @mode  mode    paranoia mode flags built from values in 
-  paranoia_mode_t, e.g. 
-  PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP
-*/
-void 
-paranoia_modeset(cdrom_paranoia_t *p, int mode_flags)
-{
-  p->enable=mode_flags;
-}
-
-/*!
-  reposition reading offset. 
-  
-  @param p       paranoia type
-  @param seek    byte offset to seek to
-  @param whence  like corresponding parameter in libc's lseek, e.g. 
-  SEEK_SET or SEEK_END.
-*/
-lsn_t
-paranoia_seek(cdrom_paranoia_t *p, off_t seek, int whence)
-{
-  long sector;
-  long ret;
-  switch(whence){
-  case SEEK_SET:
-    sector=seek;
-    break;
-  case SEEK_END:
-    sector=cdda_disc_lastsector(p->d)+seek;
-    break;
-  default:
-    sector=p->cursor+seek;
-    break;
-  }
-  
-  if (cdda_sector_gettrack(p->d,sector)==-1)return(-1);
-
-  i_cblock_destructor(p->root.vector);
-  p->root.vector=NULL;
-  p->root.lastsector=0;
-  p->root.returnedlimit=0;
-
-  ret=p->cursor;
-  p->cursor=sector;
-
-  i_paranoia_firstlast(p);
-  
-  /* Evil hack to fix pregap patch for NEC drives! To be rooted out in a10 */
-  p->current_firstsector=sector;
-
-  return(ret);
-}
-
-
-
 /* ===========================================================================
- * read_c_block() (internal)
- *
- * This funtion reads many (p->readahead) sectors, encompassing at least
- * the requested words.
- *
- * It returns a c_block which encapsulates these sectors' data and sector
- * number.  The sectors come come from multiple low-level read requests.
- *
- * This function reads many sectors in order to exhaust any caching on the
- * drive itself, as caching would simply return the same incorrect data
- * over and over.  Paranoia depends on truly re-reading portions of the
- * disc to make sure the reads are accurate and correct any inaccuracies.
- *
- * Which precise sectors are read varies ("jiggles") between calls to
- * read_c_block, to prevent consistent errors across multiple reads
- * from being misinterpreted as correct data.
+ * Reading sectors
  *
- * The size of each low-level read is determined by the underlying driver
- * (p->d->nsectors), which allows the driver to specify how many sectors
- * can be read in a single request.  Historically, the Linux kernel could
- * only read 8 sectors at a time, with likely dropped samples between each
- * read request.  Other operating systems may have different limitations.
+ * i_read_c_block() first works out where to read (a read_plan_t), then
+ * carries the read out (a read_job_t) and makes a c_block of it.
  *
- * This function is called by paranoia_read_limited(), which breaks the
- * c_block of read data into runs of samples that are likely to be
- * contiguous, verifies them and stores them in verified fragments, and
- * eventually merges the fragments into the verified root.
+ * Where to read depends on where the verified root ends, which is
+ * known only once the block read before has been verified.  But as
+ * long as all goes well, verifying a block extends the root exactly to
+ * the end of the read before it, so once a block is read the plan for
+ * the next read can be worked out ahead of time.  With pipelining on
+ * (paranoia_set_pipeline()), that read is then made on another thread
+ * while the block just read is verified, as long as the plans worked
+ * out ahead the last two times proved right.  When the next read is due, its
+ * plan is worked out as always, and the read made ahead is taken only
+ * if it was made from the same plan; otherwise it is thrown away and
+ * the read made again.  Either way the drive is asked for the same
+ * sectors in the same requests as without pipelining, so the output is
+ * the same.
  *
- * This function returns the last c_block read or NULL on error.
+ * The drive must not be used by two threads at once, and callers may
+ * use it between reads (cdda_messages(), for instance), so a read made
+ * ahead is always waited for before cdio_paranoia_read_limited()
+ * returns.  What overlaps is the read and the verification within a
+ * call.
  */
 
-static c_block_t *
-i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
-	       void(*callback)(long, paranoia_cb_mode_t))
+/* Which sectors to read, and how. */
+typedef struct {
+  long readat;       /* first sector to read */
+  long totaltoread;  /* sectors to read */
+  long sectatonce;   /* sectors a request */
+  long firstatonce;  /* sectors of the first request, if not sectatonce */
+  long firstsector;  /* the readable area */
+  long lastsector;
+  bool b_flags;      /* whether to keep flags for the samples */
+  bool b_c2;         /* whether to flag C2 errors in them */
+} read_plan_t;
+
+/* A read of a plan, and what came of it.  The plan of a read worked
+   out ahead of time is kept in one even if the read is not made. */
+typedef struct read_job_s {
+  read_plan_t plan;
+  cdrom_drive_t *d;
+
+  int16_t *buffer;
+  unsigned char *flags;
+  uint8_t *c2;        /* C2 error pointers of a request */
+  long sofar;         /* sectors read or given up on */
+  long firstread;     /* first sector read, or -1 */
+  long lastread;      /* sector after the last request */
+  bool b_any;         /* whether any sectors were read */
+  bool b_lastsector;  /* whether the read reached plan.lastsector */
+  bool b_c2;          /* whether all of it came with C2 error pointers */
+  bool b_no_c2;       /* whether the drive turned out to have none */
+
+  /* The callbacks of a read made on another thread, to be made on the
+     caller's when the read is taken. */
+  bool b_record;
+  long *cb_pos;
+  paranoia_cb_mode_t *cb_mode;
+  int i_cb;
+
+  bool b_started;     /* whether the read was made at all */
+#ifdef HAVE_PTHREAD
+  bool b_running;
+  pthread_t thread;
+#endif
+} read_job_t;
+
+/* Work out the plan of the next read, for a root extending to rootend
+   (in words), or none if rootend is -1, and the given read cursor,
+   previous read and jitter. */
+static void
+i_plan_read(cdrom_paranoia_t *p,long cursor,long rootend,long lastread,
+	    int jitter,read_plan_t *plan)
 {
-
 /* why do it this way?  We need to read lots of sectors to kludge
    around stupid read ahead buffers on cheap drives, as well as avoid
    expensive back-seeking. We also want to 'jiggle' the start address
    to try to break borderline drives more noticeably (and make broken
    drives with unaddressable sectors behave more often). */
-      
-  long readat,firstread;
-  long totaltoread=p->readahead;
-  long sectatonce=p->d->nsectors;
+
+  long readat;
   long driftcomp=(float)p->dyndrift/CD_FRAMEWORDS+.5;
-  c_block_t *new=NULL;
-  root_block *root=&p->root;
-  int16_t *buffer=NULL;
-  unsigned char *flags=NULL;
-  long sofar;
   long dynoverlap=(p->dynoverlap+CD_FRAMEWORDS-1)/CD_FRAMEWORDS; 
-  long anyflag=0;
-
 
   /* Calculate the first sector to read.  This calculation takes
    * into account the need to jitter the starting point of the read
@@ -2580,13 +2419,13 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
     
     /* we want to jitter the read alignment boundary */
     long target;
-    if (rv(root)==NULL || rb(root)>beginword)
-      target=p->cursor-dynoverlap; 
+    if (rootend==-1)
+      target=cursor-dynoverlap; 
     else
-      target=re(root)/(CD_FRAMEWORDS)-dynoverlap;
+      target=rootend/(CD_FRAMEWORDS)-dynoverlap;
 	
-    if (target+MIN_SECTOR_BACKUP>p->lastread && target<=p->lastread)
-      target=p->lastread-MIN_SECTOR_BACKUP;
+    if (target+MIN_SECTOR_BACKUP>lastread && target<=lastread)
+      target=lastread-MIN_SECTOR_BACKUP;
 
     /* we want to jitter the read alignment boundary, as some
        drives, beginning from a specific point, will tend to
@@ -2594,40 +2433,93 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
        our vectors are being made up of multiple reads, we want
        the overlap boundaries to move.... */
     
-    readat=(target&(~((long)JIGGLE_MODULO-1)))+p->jitter;
+    readat=(target&(~((long)JIGGLE_MODULO-1)))+jitter;
     if (readat>target)readat-=JIGGLE_MODULO;
-    p->jitter++;
-    if (p->jitter>=JIGGLE_MODULO)
-      p->jitter=0;
      
   } else {
-    readat=p->cursor; 
+    readat=cursor; 
   }
   
-  readat+=driftcomp;
+  plan->readat=readat+driftcomp;
+  plan->totaltoread=p->readahead;
+  plan->sectatonce=p->d->nsectors;
+  plan->firstatonce=0;
+  plan->firstsector=p->current_firstsector;
+  plan->lastsector=p->current_lastsector;
+  plan->b_flags=(p->enable&(PARANOIA_MODE_VERIFY|PARANOIA_MODE_OVERLAP))!=0;
+  plan->b_c2=plan->b_flags && p->enable&PARANOIA_MODE_C2 && !p->b_no_c2;
+}
 
-  /* Create a new, empty c_block and add it to the head of the
-   * list of c_blocks in memory.  It will be empty until the end of
-   * this subroutine.
-   */
-  if (p->enable&(PARANOIA_MODE_OVERLAP|PARANOIA_MODE_VERIFY)) {
-    flags=calloc(totaltoread*CD_FRAMEWORDS, 1);
-    new=new_c_block(p);
-    recover_cache(p);
-  } else {
-    /* in the case of root it's just the buffer */
-    paranoia_resetall(p);	
-    new=new_c_block(p);
+/* Reads are never longer than p->readahead sectors, so their samples
+   and flags come from p's pools. */
+static read_job_t *
+i_read_job_new(cdrom_paranoia_t *p,const read_plan_t *plan)
+{
+  read_job_t *job=calloc(1,sizeof(read_job_t));
+
+  job->plan=*plan;
+  job->d=p->d;
+  job->firstread=-1;
+  job->buffer=pool_get(&p->buffers);
+  if (plan->b_flags)
+    job->flags=pool_get(&p->flags);
+  if (plan->b_c2){
+    job->c2=malloc(plan->sectatonce*CDIO_CDDA_C2_SIZE);
+    job->b_c2=true;
   }
+  return(job);
+}
 
-  buffer=calloc(totaltoread*CDIO_CD_FRAMESIZE_RAW, 1);
-  sofar=0;
-  firstread=-1;
+static void
+i_read_job_free(cdrom_paranoia_t *p,read_job_t *job)
+{
+  if (job->buffer)pool_put(&p->buffers,job->buffer);
+  if (job->flags)pool_put(&p->flags,job->flags);
+  free(job->c2);
+  free(job->cb_pos);
+  free(job->cb_mode);
+  free(job);
+}
 
-#if TRACE_PARANOIA
-  fprintf(stderr, "Reading [%ld-%ld] from media\n",
-	  readat*CD_FRAMEWORDS, (readat+totaltoread)*CD_FRAMEWORDS);
-#endif
+/* Make a callback of a read, or record it to be made later. */
+static void
+i_read_callback(read_job_t *job,long inpos,paranoia_cb_mode_t mode,
+		void(*callback)(long, paranoia_cb_mode_t))
+{
+  if (job->b_record) {
+    job->cb_pos[job->i_cb]=inpos;
+    job->cb_mode[job->i_cb]=mode;
+    job->i_cb++;
+  } else if (callback)
+    (*callback)(inpos,mode);
+}
+
+/* Flag the words of sectors with bytes the drive reports C2 errors in
+   FLAGS_UNREAD: they are as good as unread. */
+static void
+i_flag_c2_errors(unsigned char *flags,const uint8_t *c2,long sectors)
+{
+  long i;
+  int k;
+
+  for(i=0;i<sectors*CDIO_CDDA_C2_SIZE;i++)
+    if (c2[i])
+      for(k=0;k<8;k++)
+	if (c2[i]&(0x80>>k))
+	  flags[(i*8+k)/2]|=FLAGS_UNREAD;
+}
+
+/* Carry out the read of a job. */
+static void
+i_read_sectors(read_job_t *job,void(*callback)(long, paranoia_cb_mode_t))
+{
+  const read_plan_t *plan=&job->plan;
+  long readat=plan->readat;
+  long totaltoread=plan->totaltoread;
+  long sectatonce=plan->sectatonce;
+  int16_t *buffer=job->buffer;
+  unsigned char *flags=job->flags;
+  long sofar=0;
 
   /* Issue each of the low-level reads until we've read enough sectors
    * to exhaust the drive's cache.
@@ -2651,24 +2543,38 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
     long adjread=readat;      /* first sector to read for this request */
     long thisread;            /* how many sectors were read this request */
 
+    if (sofar==0 && plan->firstatonce>0)
+      secread=plan->firstatonce;
+
     /* don't under/overflow the audio session */
-    if (adjread<p->current_firstsector){
-      secread-=p->current_firstsector-adjread;
-      adjread=p->current_firstsector;
+    if (adjread<plan->firstsector){
+      secread-=plan->firstsector-adjread;
+      adjread=plan->firstsector;
     }
-    if (adjread+secread-1>p->current_lastsector)
-      secread=p->current_lastsector-adjread+1;
+    if (adjread+secread-1>plan->lastsector)
+      secread=plan->lastsector-adjread+1;
     
     if (sofar+secread>totaltoread)secread=totaltoread-sofar;
     
     if (secread>0){
       
-      if (firstread<0) firstread = adjread;
+      if (job->firstread<0) job->firstread = adjread;
 
       /* Issue the low-level read to the driver.
        */
 
-      thisread = cdda_read(p->d, buffer+sofar*CD_FRAMEWORDS, adjread, secread);
+      if (job->b_c2){
+	thisread = cdda_read_c2(job->d, buffer+sofar*CD_FRAMEWORDS, job->c2,
+				adjread, secread);
+	if (thisread==-405){
+	  /* no C2 error pointers from this drive; read as without */
+	  job->b_c2=false;
+	  job->b_no_c2=true;
+	}else if (thisread>0)
+	  i_flag_c2_errors(flags+sofar*CD_FRAMEWORDS,job->c2,thisread);
+      }
+      if (!job->b_c2)
+	thisread = cdda_read(job->d, buffer+sofar*CD_FRAMEWORDS, adjread, secread);
 
 #if TRACE_PARANOIA & 1
       fprintf(stderr, "- Read [%ld-%ld] (0x%04X...0x%04X)%s",
@@ -2700,15 +2606,15 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
 	/* Uhhh... right.  Make something up. But don't make us seek
            backward! */
 
-	if (callback)
-	  (*callback)((adjread+thisread)*CD_FRAMEWORDS, PARANOIA_CB_READERR);  
+	i_read_callback(job,(adjread+thisread)*CD_FRAMEWORDS,
+			PARANOIA_CB_READERR,callback);
 	memset(buffer+(sofar+thisread)*CD_FRAMEWORDS,0,
 	       CDIO_CD_FRAMESIZE_RAW*(secread-thisread));
 	if (flags)
           memset(flags+(sofar+thisread)*CD_FRAMEWORDS, FLAGS_UNREAD,
 	         CD_FRAMEWORDS*(secread-thisread));
       }
-      if (thisread!=0)anyflag=1;
+      if (thisread!=0)job->b_any=true;
 
 
       /* Because samples are likely to be dropped between read requests,
@@ -2738,17 +2644,18 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
        *
        * ???: Again, why not move it ahead by the number actually read?
        */
-      p->lastread=adjread+secread;
+      job->lastread=adjread+secread;
       
-      if (adjread+secread-1==p->current_lastsector)
-	new->lastsector=-1;
+      if (adjread+secread-1==plan->lastsector)
+	job->b_lastsector=true;
       
-      if (callback)(*callback)((adjread+secread-1)*CD_FRAMEWORDS,PARANOIA_CB_READ);
+      i_read_callback(job,(adjread+secread-1)*CD_FRAMEWORDS,
+		      PARANOIA_CB_READ,callback);
       
       sofar+=secread;
       readat=adjread+secread; 
     } else /* secread <= 0 */
-      if (readat<p->current_firstsector)
+      if (readat<plan->firstsector)
 	readat+=sectatonce; /* due to being before the readable area */
       else
 	break; /* due to being past the readable area */
@@ -2760,16 +2667,289 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
 
   } /* end while */
 
+  job->sofar=sofar;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+i_read_thread(void *arg)
+{
+  i_read_sectors((read_job_t *)arg,NULL);
+  return(NULL);
+}
+#endif
+
+/* Note the plan of the next read as worked out ahead of time, and
+   start reading it on another thread if the last two plans worked out
+   ahead proved right.  A wrong plan costs a whole read on the
+   drive, which verifying a block seldom takes as long as, so when
+   reads keep shifting (jitter, drift) it is better not to read ahead
+   at all. */
+static void
+i_pipeline_start(cdrom_paranoia_t *p,const read_plan_t *plan)
+{
+  read_job_t *job;
+
+#ifdef HAVE_PTHREAD
+  if (p->pipeline_hits>1) {
+    job=i_read_job_new(p,plan);
+
+    /* At most a READERR and a READ callback a request, and at least a
+       sector a request. */
+    job->b_record=true;
+    job->cb_pos=calloc(2*plan->totaltoread+2,sizeof(long));
+    job->cb_mode=calloc(2*plan->totaltoread+2,sizeof(paranoia_cb_mode_t));
+
+    if (0==pthread_create(&job->thread,NULL,i_read_thread,job))
+      job->b_running=job->b_started=true;
+    p->pipeline=job;
+    return;
+  }
+#endif
+
+  job=calloc(1,sizeof(read_job_t));
+  job->plan=*plan;
+  p->pipeline=job;
+}
+
+/* Wait for the read made ahead, if there is one in flight. */
+static void
+i_pipeline_wait(cdrom_paranoia_t *p)
+{
+#ifdef HAVE_PTHREAD
+  if (p->pipeline && p->pipeline->b_running) {
+    pthread_join(p->pipeline->thread,NULL);
+    p->pipeline->b_running=false;
+  }
+#endif
+}
+
+/* Throw away the read made ahead, if there is one. */
+static void
+i_pipeline_drop(cdrom_paranoia_t *p)
+{
+  if (p->pipeline) {
+    i_pipeline_wait(p);
+    i_read_job_free(p,p->pipeline);
+    p->pipeline=NULL;
+  }
+}
+
+/* Take the read made ahead if it was of the given plan, making its
+   callbacks; otherwise throw it away and return NULL. */
+static read_job_t *
+i_pipeline_take(cdrom_paranoia_t *p,const read_plan_t *plan,
+		void(*callback)(long, paranoia_cb_mode_t))
+{
+  read_job_t *job=p->pipeline;
+  int i;
+
+  if (!job)
+    return(NULL);
+
+  if (job->plan.readat==plan->readat
+      && job->plan.totaltoread==plan->totaltoread
+      && job->plan.sectatonce==plan->sectatonce
+      && job->plan.firstatonce==plan->firstatonce
+      && job->plan.firstsector==plan->firstsector
+      && job->plan.lastsector==plan->lastsector
+      && job->plan.b_flags==plan->b_flags
+      && job->plan.b_c2==plan->b_c2)
+    p->pipeline_hits++;
+  else
+    p->pipeline_hits=0;
 
-  /* If we managed to read any sectors at all (anyflag), fill in the
-   * previously allocated c_block with the read data.  Otherwise, free
-   * our buffers, dispose of the c_block, and return NULL.
+  if (0==p->pipeline_hits || !job->b_started) {
+    i_pipeline_drop(p);
+    return(NULL);
+  }
+
+  i_pipeline_wait(p);
+  p->pipeline=NULL;
+  if (callback)
+    for (i=0;i<job->i_cb;i++)
+      (*callback)(job->cb_pos[i],job->cb_mode[i]);
+  return(job);
+}
+
+/**** toplevel ****************************************/
+
+void 
+paranoia_free(cdrom_paranoia_t *p)
+{
+  i_pipeline_drop(p);
+  paranoia_resetall(p);
+  sort_free(p->sortcache);
+  free_list(p->cache, 1);
+  free_list(p->fragments, 1);
+  pool_drain(&p->buffers);
+  pool_drain(&p->flags);
+  pool_drain(&p->nodes);
+  free(p);
+}
+
+/*! 
+  Set the kind of repair you want to on for reading. 
+  The modes are listed above
+  
+  @param p       paranoia type
+  @mode  mode    paranoia mode flags built from values in 
+  paranoia_mode_t, e.g. 
+  PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP
+*/
+void 
+paranoia_modeset(cdrom_paranoia_t *p, int mode_flags)
+{
+  p->enable=mode_flags;
+}
+
+/*!
+  reposition reading offset. 
+  
+  @param p       paranoia type
+  @param seek    byte offset to seek to
+  @param whence  like corresponding parameter in libc's lseek, e.g. 
+  SEEK_SET or SEEK_END.
+*/
+lsn_t
+paranoia_seek(cdrom_paranoia_t *p, off_t seek, int whence)
+{
+  long sector;
+  long ret;
+  switch(whence){
+  case SEEK_SET:
+    sector=seek;
+    break;
+  case SEEK_END:
+    sector=cdda_disc_lastsector(p->d)+seek;
+    break;
+  default:
+    sector=p->cursor+seek;
+    break;
+  }
+  
+  if (cdda_sector_gettrack(p->d,sector)==-1)return(-1);
+
+  i_pipeline_drop(p);
+  i_cblock_destructor(p->root.vector);
+  p->root.vector=NULL;
+  p->root.lastsector=0;
+  p->root.returnedlimit=0;
+
+  ret=p->cursor;
+  p->cursor=sector;
+
+  i_paranoia_firstlast(p);
+  
+  /* Evil hack to fix pregap patch for NEC drives! To be rooted out in a10 */
+  p->current_firstsector=sector;
+  p->testcopy_end=0;
+  p->testcopy_last=0;
+
+  return(ret);
+}
+
+
+/* The statistics of one stage of offsets, as longs and back. */
+static void
+i_offsets_get(const struct offsets *o, long a[6])
+{
+  a[0]=o->offpoints; a[1]=o->newpoints; a[2]=o->offaccum;
+  a[3]=o->offdiff;   a[4]=o->offmin;    a[5]=o->offmax;
+}
+
+static void
+i_offsets_set(struct offsets *o, const long a[6])
+{
+  o->offpoints=a[0]; o->newpoints=a[1]; o->offaccum=a[2];
+  o->offdiff=a[3];   o->offmin=a[4];    o->offmax=a[5];
+}
+
+void
+cdio_paranoia_get_state(const cdrom_paranoia_t *p,
+			cdio_paranoia_state_t *p_state)
+{
+  p_state->i_cursor=p->cursor;
+  p_state->i_dyndrift=p->dyndrift;
+  p_state->i_dynoverlap=p->dynoverlap;
+  i_offsets_get(&p->stage1,p_state->i_stage1);
+  i_offsets_get(&p->stage2,p_state->i_stage2);
+}
+
+lsn_t
+cdio_paranoia_resume(cdrom_paranoia_t *p,
+		     const cdio_paranoia_state_t *p_state)
+{
+  /* Seeking leaves the drift and the offset statistics be. */
+  if (paranoia_seek(p,p_state->i_cursor,SEEK_SET)==-1)
+    return(-1);
+  p->dyndrift=p_state->i_dyndrift;
+  p->dynoverlap=p_state->i_dynoverlap;
+  i_offsets_set(&p->stage1,p_state->i_stage1);
+  i_offsets_set(&p->stage2,p_state->i_stage2);
+  return(p->cursor);
+}
+
+
+/* Read the sectors of plan into a new c_block, at the head of the
+ * list of c_blocks in memory.  Returns it, or NULL if nothing could
+ * be read.
+ */
+static c_block_t *
+i_read_block(cdrom_paranoia_t *p,const read_plan_t *plan,
+	     void(*callback)(long, paranoia_cb_mode_t))
+{
+  c_block_t *new=NULL;
+  read_job_t *job;
+
+  /* Create a new, empty c_block and add it to the head of the
+   * list of c_blocks in memory.  It will be empty until the end of
+   * this subroutine.
    */
-  if (anyflag) {
-    new->vector=buffer;
-    new->begin=firstread*CD_FRAMEWORDS-p->dyndrift;
-    new->size=sofar*CD_FRAMEWORDS;
-    new->flags=flags;
+  if (p->enable&(PARANOIA_MODE_OVERLAP|PARANOIA_MODE_VERIFY)) {
+    new=new_c_block(p);
+    recover_cache(p);
+  } else {
+    /* in the case of root it's just the buffer */
+    paranoia_resetall(p);	
+    new=new_c_block(p);
+  }
+
+#if TRACE_PARANOIA
+  fprintf(stderr, "Reading [%ld-%ld] from media\n",
+	  plan->readat*CD_FRAMEWORDS,
+	  (plan->readat+plan->totaltoread)*CD_FRAMEWORDS);
+#endif
+
+  /* If this very read was made ahead of time, take it, making the
+   * callbacks it would have made.  Otherwise read now.
+   */
+  job=i_pipeline_take(p,plan,callback);
+  if (!job){
+    job=i_read_job_new(p,plan);
+    i_read_sectors(job,callback);
+  }
+
+  if (job->firstread>=0)
+    p->lastread=job->lastread;
+  if (job->b_lastsector)
+    new->lastsector=-1;
+  if (job->b_no_c2)
+    p->b_no_c2=true;
+
+  /* If we managed to read any sectors at all, fill in the
+   * previously allocated c_block with the read data.  Otherwise,
+   * dispose of the c_block and return NULL.
+   */
+  if (job->b_any) {
+    new->vector=job->buffer;
+    new->alloc=p->buffers.size/sizeof(int16_t);
+    new->begin=job->firstread*CD_FRAMEWORDS-p->dyndrift;
+    new->size=job->sofar*CD_FRAMEWORDS;
+    new->flags=job->flags;
+    new->b_c2=job->b_c2;
+    job->buffer=NULL;
+    job->flags=NULL;
 
 #if TRACE_PARANOIA
     fprintf(stderr, "- Read block %ld:[%ld-%ld] from media\n",
@@ -2777,14 +2957,218 @@ i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
 #endif
   } else {
     if (new)free_c_block(new);
-    free(buffer);
-    free(flags);
     new=NULL;
   }
+  i_read_job_free(p,job);
+
+  return(new);
+}
+
+/* ===========================================================================
+ * read_c_block() (internal)
+ *
+ * This funtion reads many (p->readahead) sectors, encompassing at least
+ * the requested words.
+ *
+ * It returns a c_block which encapsulates these sectors' data and sector
+ * number.  The sectors come come from multiple low-level read requests.
+ *
+ * This function reads many sectors in order to exhaust any caching on the
+ * drive itself, as caching would simply return the same incorrect data
+ * over and over.  Paranoia depends on truly re-reading portions of the
+ * disc to make sure the reads are accurate and correct any inaccuracies.
+ *
+ * Which precise sectors are read varies ("jiggles") between calls to
+ * read_c_block, to prevent consistent errors across multiple reads
+ * from being misinterpreted as correct data.
+ *
+ * The size of each low-level read is determined by the underlying driver
+ * (p->d->nsectors), which allows the driver to specify how many sectors
+ * can be read in a single request.  Historically, the Linux kernel could
+ * only read 8 sectors at a time, with likely dropped samples between each
+ * read request.  Other operating systems may have different limitations.
+ *
+ * This function is called by paranoia_read_limited(), which breaks the
+ * c_block of read data into runs of samples that are likely to be
+ * contiguous, verifies them and stores them in verified fragments, and
+ * eventually merges the fragments into the verified root.
+ *
+ * This function returns the last c_block read or NULL on error.
+ */
+
+static c_block_t *
+i_read_c_block(cdrom_paranoia_t *p,long beginword,long endword,
+	       void(*callback)(long, paranoia_cb_mode_t))
+{
+  root_block *root=&p->root;
+  c_block_t *new=NULL;
+  read_plan_t plan;
+  long prevlastread=p->lastread;
+  long rootend=-1;
+
+  /* Work out which sectors to read.  The start of the read is
+   * jittered, so the plan is made before p->jitter moves on.
+   */
+  if (rv(root)!=NULL && rb(root)<=beginword)
+    rootend=re(root);
+  i_plan_read(p,p->cursor,rootend,p->lastread,p->jitter,&plan);
+
+  if (p->enable&(PARANOIA_MODE_VERIFY|PARANOIA_MODE_OVERLAP)){
+    p->jitter++;
+    if (p->jitter>=JIGGLE_MODULO)
+      p->jitter=0;
+  }
+
+  new=i_read_block(p,&plan,callback);
+
+  /* Work out the next read, and maybe start on it, while this block
+   * is verified.  As long as all goes well, verifying it extends the
+   * root to the end of the read before this one.
+   */
+  if (p->b_pipeline && new) {
+    if (p->enable&(PARANOIA_MODE_VERIFY|PARANOIA_MODE_OVERLAP)) {
+      if (prevlastread!=LONG_MAX)
+	i_plan_read(p,p->cursor,prevlastread*CD_FRAMEWORDS-p->dyndrift,
+		    p->lastread,p->jitter,&plan);
+      else
+	plan.totaltoread=0;
+    } else
+      i_plan_read(p,p->lastread,-1,p->lastread,p->jitter,&plan);
+    if (plan.totaltoread>0)
+      i_pipeline_start(p,&plan);
+  }
+
   return(new);
 }
 
 
+/* ===========================================================================
+ * i_c2_fragments() (internal)
+ *
+ * For PARANOIA_MODE_C2: a drive reporting C2 error pointers tells us
+ * which bytes it could not correct, so the samples it read without
+ * errors need no comparing with another read.  Take the runs of them
+ * between the edges of the read requests as verified fragments, as
+ * overlap-only reads take whole runs; stage 2 still lines them up
+ * with the root, which catches samples dropped between requests.
+ *
+ * Returns whether the block was read without any errors.  Samples
+ * with errors are usually read without on another try, so stage 1 is
+ * left for when reading again stops extending the root.
+ */
+
+static bool
+i_c2_fragments(cdrom_paranoia_t *p,c_block_t *new)
+{
+  long begin=0,end;
+  bool b_clean=true;
+
+  while (begin<cs(new)){
+    while (begin<cs(new) && new->flags[begin]&(FLAGS_EDGE|FLAGS_UNREAD)){
+      if (new->flags[begin]&FLAGS_UNREAD)b_clean=false;
+      begin++;
+    }
+    end=begin;
+    while (end<cs(new) && !(new->flags[end]&(FLAGS_EDGE|FLAGS_UNREAD)))end++;
+    if (end-begin>=MIN_WORDS_OVERLAP)
+      new_v_fragment(p,new,begin+cb(new),end+cb(new),
+		     (new->lastsector && cb(new)+end==ce(new)));
+    begin=end;
+  }
+  return(b_clean);
+}
+
+/* ===========================================================================
+ * i_test_copy() (internal)
+ *
+ * Test and copy, for PARANOIA_MODE_TESTCOPY: read the sectors the
+ * root is to be extended by twice over, at the same place and without
+ * jitter, and if the two reads agree sector for sector take the first
+ * as verified in one fragment for stage 2.  On a drive that reads
+ * accurately this leaves out the matching of stage 1, which is most
+ * of the cost of full paranoia.
+ *
+ * A read is as long as p->readahead, which is meant to be more than a
+ * drive caches, so the second is made from the disc too.  Its requests
+ * are split differently from those of the first, so samples a drive
+ * drops between requests do not come out the same in both.
+ *
+ * Sectors up to the first that differs (or that either read could not
+ * get) are still taken.  From there on the second read goes through
+ * stage 1 against the first, and reads are made as with full paranoia
+ * until the root is past the end of these (p->testcopy_end).  So they
+ * are too if the root did not take up the sectors of the last reads
+ * that agreed (p->testcopy_last).
+ *
+ * Returns false if the next read is to be made as without test and
+ * copy.
+ */
+
+#define TESTCOPY_BACKUP 2 /* sectors read again before the end of the root */
+
+static bool
+i_test_copy(cdrom_paranoia_t *p,long beginword,
+	    void(*callback)(long, paranoia_cb_mode_t))
+{
+  root_block *root=&p->root;
+  long driftcomp=(float)p->dyndrift/CD_FRAMEWORDS+.5;
+  long rootend=-1;
+  read_plan_t plan;
+  c_block_t *first,*second;
+  long i,same;
+
+  if (!(p->enable&PARANOIA_MODE_TESTCOPY && p->enable&PARANOIA_MODE_VERIFY))
+    return(false);
+
+  if (rv(root)!=NULL && rb(root)<=beginword)
+    rootend=re(root);
+  if ((rootend==-1 ? beginword : rootend)<p->testcopy_end)
+    return(false);
+  if (p->testcopy_last>rootend) {
+    p->testcopy_end=p->testcopy_last;
+    return(false);
+  }
+
+  i_plan_read(p,p->cursor,-1,p->lastread,0,&plan);
+  if (rootend!=-1)
+    plan.readat=rootend/CD_FRAMEWORDS-TESTCOPY_BACKUP+driftcomp;
+  else
+    plan.readat=p->cursor-1+driftcomp;
+
+  /* This read is not the one the pipeline expects; don't wait for it. */
+  i_pipeline_drop(p);
+
+  p->testcopy_last=0;
+  first=i_read_block(p,&plan,callback);
+  if (!first)
+    return(true);
+  plan.firstatonce=(plan.sectatonce+1)/2;
+  second=i_read_block(p,&plan,callback);
+
+  for (same=0;second && same<cs(first)/CD_FRAMEWORDS
+	 && same<cs(second)/CD_FRAMEWORDS;same++){
+    i=same*CD_FRAMEWORDS;
+    if ((first->flags[i]|second->flags[i])&FLAGS_UNREAD ||
+	memcmp(cv(first)+i,cv(second)+i,CDIO_CD_FRAMESIZE_RAW))
+      break;
+  }
+
+  if (same>0)
+    new_v_fragment(p,first,cb(first),cb(first)+same*CD_FRAMEWORDS,
+		   first->lastsector && same*CD_FRAMEWORDS==cs(first));
+
+  if (second && same*CD_FRAMEWORDS==cs(first) && cs(second)==cs(first)) {
+    /* all of it; the second read is of no more use */
+    free_c_block(second);
+    p->testcopy_last=ce(first);
+    return(true);
+  }
+
+  i_stage1(p,second ? second : first,callback);
+  p->testcopy_end=ce(first);
+  return(true);
+}
+
 /** ==========================================================================
  * cdio_paranoia_read(), cdio_paranoia_read_limited()
  *
@@ -2893,8 +3277,9 @@ cdio_paranoia_read_limited(cdrom_paranoia_t *p,
 	 re(root)<endword+(MAX_SECTOR_OVERLAP*CD_FRAMEWORDS))) 
       break;
     
-    /* Hmm, need more.  Read another block */
+    /* Hmm, need more.  Read another block, or two with test and copy */
 
+    if (!i_test_copy(p,beginword,callback))
     {
       /* Read many sectors, encompassing at least the requested words.
        *
@@ -2914,7 +3299,14 @@ cdio_paranoia_read_limited(cdrom_paranoia_t *p,
 	   * will be merged into the verified root during stage 2
 	   * overlap analysis.
 	   */
-	  if (p->enable&PARANOIA_MODE_VERIFY)
+	  if (new->b_c2){
+	    /* What the drive read without C2 errors is verified
+	     * already; stage 1 only for errors read again and again.
+	     */
+	    if (!i_c2_fragments(p,new) && p->enable&PARANOIA_MODE_VERIFY
+		&& retry_count>0)
+	      i_stage1(p,new,callback);
+	  }else if (p->enable&PARANOIA_MODE_VERIFY)
 	    i_stage1(p,new,callback);
 
 	  /* If we're only doing overlapping reads (no stage 1
@@ -3010,12 +3402,71 @@ cdio_paranoia_read_limited(cdrom_paranoia_t *p,
   } /* end while */
   p->cursor++;
 
+  /* Callers may use the drive between reads, so the read made ahead
+   * must be done.
+   */
+  i_pipeline_wait(p);
+
   /* Return a pointer into the verified root.  Thus, the caller
    * must NOT free the returned pointer!
    */
   return(rv(root)+(beginword-rb(root)));
 }
 
+/** ==========================================================================
+ * cdio_paranoia_read_range()
+ *
+ * Reads the next sector as cdio_paranoia_read_limited() does, then
+ * copies out with it as many of the sectors after it as are already
+ * in the verified root, up to i_sectors in all.  These are exactly
+ * the sectors cdio_paranoia_read_limited() would return next without
+ * going back to the drive: those whose end is at least
+ * MAX_SECTOR_OVERLAP sectors short of the end of the root when
+ * verifying (so later reads can still be lined up against it), or
+ * just in it otherwise.
+ *
+ * Returns the number of sectors copied, at least 1 unless i_sectors
+ * is 0 or the first read fails.
+ */
+long
+cdio_paranoia_read_range(cdrom_paranoia_t *p, int16_t *p_buffer,
+			 long i_sectors,
+			 void(*callback)(long int, paranoia_cb_mode_t),
+			 int max_retries)
+{
+  root_block *root=&p->root;
+  const long margin=(p->enable&(PARANOIA_MODE_VERIFY|PARANOIA_MODE_OVERLAP))
+    ? MAX_SECTOR_OVERLAP*CD_FRAMEWORDS : 0;
+  int16_t *first;
+  long beginword;
+  long i_more;
+
+  if (i_sectors<=0)
+    return(0);
+
+  first=paranoia_read_limited(p,callback,max_retries);
+  if (first==NULL)
+    return(0);
+  memcpy(p_buffer,first,CDIO_CD_FRAMESIZE_RAW);
+
+  beginword=p->cursor*CD_FRAMEWORDS;
+  if (rv(root)==NULL || rb(root)>beginword)
+    return(1);
+  i_more=(re(root)-margin-beginword)/CD_FRAMEWORDS;
+  if (i_more>i_sectors-1)
+    i_more=i_sectors-1;
+  if (i_more<=0)
+    return(1);
+
+  memcpy(p_buffer+CD_FRAMEWORDS,rv(root)+(beginword-rb(root)),
+	 i_more*CDIO_CD_FRAMESIZE_RAW);
+  p->cursor+=i_more;
+  if (p->root.returnedlimit<(p->cursor-1)*CD_FRAMEWORDS)
+    p->root.returnedlimit=(p->cursor-1)*CD_FRAMEWORDS;
+
+  return(1+i_more);
+}
+
 /* a temporary hack */
 void 
 cdio_paranoia_overlapset(cdrom_paranoia_t *p, long int overlap)
@@ -3023,3 +3474,22 @@ cdio_paranoia_overlapset(cdrom_paranoia_t *p, long int overlap)
   p->dynoverlap=overlap*CD_FRAMEWORDS;
   p->stage1.offpoints=-1; 
 }
+
+/*!
+  Turn pipelined reading on or off.  See "Reading sectors" above.
+
+  @return false if pipelining was asked for but this build has no
+  threads, true otherwise.
+*/
+bool
+cdio_paranoia_set_pipeline(cdrom_paranoia_t *p, bool b_pipeline)
+{
+#ifdef HAVE_PTHREAD
+  p->b_pipeline=b_pipeline;
+#else
+  p->b_pipeline=false;
+#endif
+  if (!p->b_pipeline)
+    i_pipeline_drop(p);
+  return(p->b_pipeline==b_pipeline);
+}
@@ -26,15 +26,11 @@
 # include <string.h>
 #endif
 
-#include <stdio.h>  /* Remove when adding cdio/logging.h */
-
-/* Useful defines */
-
-#define MIN(a, b) (a<b) ? (a) : (b)
-#define CEILING(x, y) ((x+(y-1))/y)
+#ifdef HAVE_STDLIB_H
+# include <stdlib.h>
+#endif
 
-#define	GETICB(offset)	\
-	&p_udf_fe->alloc_descs[offset]
+#include <cdio/logging.h>
 
 const char *
 udf_get_filename(const udf_dirent_t *p_udf_dirent)
@@ -104,109 +100,316 @@ udf_is_dir(const udf_dirent_t *p_udf_dirent)
 }
 
 /*
- * Translate a file offset into a logical block and then into a physical
- * block.
+ * Return true if the data of the file with file entry p_udf_fe is
+ * embedded in the file entry, in place of allocation descriptors.
  */
-static lba_t
-offset_to_lba(const udf_dirent_t *p_udf_dirent, off_t i_offset, 
-	      /*out*/ lba_t *pi_lba, /*out*/ uint32_t *pi_max_size)
+static bool
+udf_is_in_icb(const udf_file_entry_t *p_udf_fe)
+{
+  return ICBTAG_FLAG_AD_IN_ICB == 
+    (uint16_from_le(p_udf_fe->icb_tag.flags) & ICBTAG_FLAG_AD_MASK);
+}
+
+/* The most blocks an Allocation Extent Descriptor is read in, and the
+   most of them followed for one file, so that a chain that loops back
+   on itself ends. */
+#define UDF_MAX_AED_BLOCKS  16
+#define UDF_MAX_AEDS        4096
+
+/*
+ * Read the Allocation Extent Descriptor of i_len bytes at block i_pos
+ * of the partition. Return a buffer with it, which the caller frees,
+ * and set *pi_descs to the length of the allocation descriptors that
+ * follow it there. NULL is returned on error.
+ */
+static uint8_t *
+udf_read_aed(const udf_t *p_udf, uint32_t i_pos, uint32_t i_len,
+	     /*out*/ uint32_t *pi_descs)
+{
+  uint32_t i_blocks = (i_len + UDF_BLOCKSIZE - 1) / UDF_BLOCKSIZE;
+  const struct allocExtDesc *p_aed;
+  uint8_t *p_buf;
+
+  if (i_blocks > UDF_MAX_AED_BLOCKS) i_blocks = UDF_MAX_AED_BLOCKS;
+  p_buf = calloc(i_blocks, UDF_BLOCKSIZE);
+  if (!p_buf) return NULL;
+  p_aed = (const struct allocExtDesc *) p_buf;
+
+  if (DRIVER_OP_SUCCESS != udf_read_sectors(p_udf, p_buf, 
+					    p_udf->i_part_start + i_pos,
+					    i_blocks)
+      || udf_checktag(&p_aed->tag, TAGID_AED)) {
+    cdio_warn("No Allocation Extent Descriptor at block %u", 
+	      (unsigned int) i_pos);
+    free(p_buf);
+    return NULL;
+  }
+  *pi_descs = uint32_from_le(p_aed->i_alloc_descs);
+  if (*pi_descs > i_blocks * UDF_BLOCKSIZE - sizeof(struct allocExtDesc))
+    *pi_descs = i_blocks * UDF_BLOCKSIZE - sizeof(struct allocExtDesc);
+  return p_buf;
+}
+
+/*
+ * Build the extent map of a file from the allocation descriptors in its
+ * file entry, and in the Allocation Extent Descriptors they continue
+ * in: the runs of the file in file order, each with the file offset it
+ * starts at, so that the run holding any offset can be found by binary
+ * search. Runs that are adjacent on the disc are merged, so that a read
+ * over them is a single request. *pi_extents is set to the number of
+ * runs; a file whose data is in its file entry has none. NULL is
+ * returned if the allocation descriptors can't be handled.
+ */
+static udf_extent_t *
+udf_extents_new(const udf_t *p_udf, const udf_file_entry_t *p_udf_fe,
+		/*out*/ unsigned int *pi_extents)
 {
-  udf_t *p_udf = p_udf_dirent->p_udf;
-  const udf_file_entry_t *p_udf_fe = (udf_file_entry_t *) 
-    &p_udf_dirent->fe;
   const udf_icbtag_t *p_icb_tag = &p_udf_fe->icb_tag;
-  const uint16_t strat_type= uint16_from_le(p_icb_tag->strat_type);
-  
-  switch (strat_type) {
-  case 4096:
-    printf("Cannot deal with strategy4096 yet!\n");
-    return CDIO_INVALID_LBA;
-    break;
-  case ICBTAG_STRATEGY_TYPE_4:
-    {
-      uint32_t icblen = 0;
-      lba_t lsector;
-      int ad_offset, ad_num = 0;
-      uint16_t addr_ilk = uint16_from_le(p_icb_tag->flags&ICBTAG_FLAG_AD_MASK);
-      
-      switch (addr_ilk) {
-      case ICBTAG_FLAG_AD_SHORT: 
-	{
-	  udf_short_ad_t *p_icb;
-	  /*
-	   * The allocation descriptor field is filled with short_ad's.
-	   * If the offset is beyond the current extent, look for the
-	   * next extent.
-	   */
-	  do {
-	    i_offset -= icblen;
-	    ad_offset = sizeof(udf_short_ad_t) * ad_num;
-	    if (ad_offset > uint32_from_le(p_udf_fe->i_alloc_descs)) {
-	      printf("File offset out of bounds\n");
-	      return CDIO_INVALID_LBA;
-	    }
-	    p_icb = (udf_short_ad_t *) 
-	      GETICB( uint32_from_le(p_udf_fe->i_extended_attr) 
-		      + ad_offset );
-	    icblen = p_icb->len;
-	    ad_num++;
-	  } while(i_offset >= icblen);
-	  
-	  lsector = (i_offset / UDF_BLOCKSIZE) + p_icb->pos;
-	  
-	  *pi_max_size = p_icb->len;
-	}
-	break;
-      case ICBTAG_FLAG_AD_LONG: 
-	{
-	  /*
-	   * The allocation descriptor field is filled with long_ad's
-	   * If the i_offset is beyond the current extent, look for the
-	   * next extent.
-	   */
-	  udf_long_ad_t *p_icb;
-	  do {
-	    i_offset -= icblen;
-	    ad_offset = sizeof(udf_long_ad_t) * ad_num;
-	    if (ad_offset > uint32_from_le(p_udf_fe->i_alloc_descs)) {
-	      printf("File offset out of bounds\n");
-	      return CDIO_INVALID_LBA;
-	    }
-	    p_icb = (udf_long_ad_t *) 
-	      GETICB( uint32_from_le(p_udf_fe->i_extended_attr)
-		      + ad_offset );
-	    icblen = p_icb->len;
-	    ad_num++;
-	  } while(i_offset >= icblen);
-	
-	  lsector = (i_offset / UDF_BLOCKSIZE) +
-	    uint32_from_le(((udf_long_ad_t *)(p_icb))->loc.lba);
-	  
-	  *pi_max_size = p_icb->len;
+  const uint16_t strat_type = uint16_from_le(p_icb_tag->strat_type);
+  const uint16_t addr_ilk = uint16_from_le(p_icb_tag->flags) 
+    & ICBTAG_FLAG_AD_MASK;
+  uint32_t i_left = uint32_from_le(p_udf_fe->i_alloc_descs);
+  const uint8_t *p_ad = p_udf_fe->ext_attr 
+    + uint32_from_le(p_udf_fe->i_extended_attr);
+  uint8_t *p_aed = NULL;       /* the Allocation Extent Descriptor p_ad
+				  is in, if not the file entry */
+  udf_extent_t *p_extents;
+  unsigned int i_ad_size;
+  unsigned int i_extents = 0, i_max = 8, i_aeds = 0;
+  uint64_t i_offset = 0;
+
+  if (ICBTAG_STRATEGY_TYPE_4 != strat_type) {
+    cdio_warn("Unsupported ICB strategy type %u", strat_type);
+    return NULL;
+  }
+
+  switch (addr_ilk) {
+  case ICBTAG_FLAG_AD_SHORT:    i_ad_size = sizeof(udf_short_ad_t); break;
+  case ICBTAG_FLAG_AD_LONG:     i_ad_size = sizeof(udf_long_ad_t);  break;
+  case ICBTAG_FLAG_AD_EXTENDED: i_ad_size = sizeof(udf_ext_ad_t);   break;
+  case ICBTAG_FLAG_AD_IN_ICB:   i_ad_size = 0; break;
+  default:
+    cdio_warn("Unsupported allocation descriptor type %u", addr_ilk);
+    return NULL;
+  }
+
+  if (udf_get_fe_size(p_udf_fe) < sizeof(udf_file_entry_t) 
+      + uint32_from_le(p_udf_fe->i_extended_attr) + i_left) {
+    cdio_warn("Allocation descriptors run past the file entry");
+    return NULL;
+  }
+  p_extents = calloc(i_max, sizeof(udf_extent_t));
+  if (!p_extents || !i_ad_size) {
+    *pi_extents = 0;
+    return p_extents;
+  }
+
+  while (i_left >= i_ad_size) {
+    udf_extent_t *p_last = i_extents ? &p_extents[i_extents-1] : NULL;
+    uint32_t i_len_type, i_pos;
+    uint32_t i_len;
+    lba_t i_lba;
+
+    if (ICBTAG_FLAG_AD_SHORT == addr_ilk) {
+      const udf_short_ad_t *p_short_ad = (const udf_short_ad_t *) p_ad;
+      i_len_type = uint32_from_le(p_short_ad->len);
+      i_pos      = uint32_from_le(p_short_ad->pos);
+    } else if (ICBTAG_FLAG_AD_LONG == addr_ilk) {
+      /* We ignore the partition number, as elsewhere. */
+      const udf_long_ad_t *p_long_ad = (const udf_long_ad_t *) p_ad;
+      i_len_type = uint32_from_le(p_long_ad->len);
+      i_pos      = uint32_from_le(p_long_ad->loc.lba);
+    } else {
+      const udf_ext_ad_t *p_ext_ad = (const udf_ext_ad_t *) p_ad;
+      i_len_type = uint32_from_le(p_ext_ad->len);
+      i_pos      = uint32_from_le(p_ext_ad->ext_loc.lba);
+    }
+    p_ad   += i_ad_size;
+    i_left -= i_ad_size;
+    i_len = i_len_type & UDF_LENGTH_MASK;
+    if (0 == i_len) break;  /* End of the descriptors. */
+
+    switch (i_len_type & ~UDF_LENGTH_MASK) {
+    case EXT_RECORDED_ALLOCATED:
+      i_lba = i_pos + p_udf->i_part_start;
+      break;
+    case EXT_NEXT_EXTENT_ALLOCDECS:
+      /* The rest of the descriptors are in an Allocation Extent
+	 Descriptor. */
+      free(p_aed);
+      p_aed = (++i_aeds <= UDF_MAX_AEDS) 
+	? udf_read_aed(p_udf, i_pos, i_len, &i_left) : NULL;
+      if (!p_aed) {
+	free(p_extents);
+	return NULL;
+      }
+      p_ad = p_aed + sizeof(struct allocExtDesc);
+      continue;
+    default:
+      /* Allocated or not, nothing is recorded: it reads as zeros. */
+      i_lba = CDIO_INVALID_LBA;
+    }
+
+    if (p_last && 0 == p_last->i_len % UDF_BLOCKSIZE
+	&& (CDIO_INVALID_LBA == i_lba 
+	    ? CDIO_INVALID_LBA == p_last->i_lba
+	    : CDIO_INVALID_LBA != p_last->i_lba 
+	      && p_last->i_lba + p_last->i_len / UDF_BLOCKSIZE == i_lba)) {
+      p_last->i_len += i_len;
+    } else {
+      if (i_extents == i_max) {
+	udf_extent_t *p_more = 
+	  realloc(p_extents, 2 * i_max * sizeof(udf_extent_t));
+	if (!p_more) {
+	  free(p_aed);
+	  free(p_extents);
+	  return NULL;
 	}
-	break;
-      case ICBTAG_FLAG_AD_IN_ICB:
-	/*
-	 * This type means that the file *data* is stored in the
-	 * allocation descriptor field of the file entry.
-	 */
-	*pi_max_size = 0;
-	printf("Don't know how to data in ICB handle yet\n");
-	
-      case ICBTAG_FLAG_AD_EXTENDED:
-	printf("Don't know how to handle extended addresses yet\n");
-      default:
-	printf("Unsupported allocation descriptor %d\n", addr_ilk);
-	return CDIO_INVALID_LBA;
+	p_extents = p_more;
+	i_max *= 2;
       }
-      
-      *pi_lba = lsector + p_udf->i_part_start;
-      return *pi_lba;
+      p_extents[i_extents].i_offset = i_offset;
+      p_extents[i_extents].i_lba    = i_lba;
+      p_extents[i_extents].i_len    = i_len;
+      i_extents++;
     }
-  default:
-    printf("Unknown strategy type %d\n", strat_type);
-    return DRIVER_OP_ERROR;
+    i_offset += i_len;
+  }
+
+  free(p_aed);
+  *pi_extents = i_extents;
+  return p_extents;
+}
+
+/*
+ * Return the index of the extent holding file offset i_offset: the
+ * last one starting at or before it.
+ */
+static unsigned int
+udf_extent_find(const udf_extent_t *p_extents, unsigned int i_extents,
+		uint64_t i_offset)
+{
+  unsigned int i_lo = 0, i_hi = i_extents;
+
+  while (i_hi - i_lo > 1) {
+    const unsigned int i_mid = i_lo + (i_hi - i_lo) / 2;
+    if (p_extents[i_mid].i_offset <= i_offset)
+      i_lo = i_mid;
+    else
+      i_hi = i_mid;
+  }
+  return i_lo;
+}
+
+/* The most blocks asked for in a single read. */
+#define UDF_MAX_READ_BLOCKS (0x40000000 / UDF_BLOCKSIZE)
+
+/*
+  Read up to count bytes of a file of i_size bytes with extent map
+  p_extents into buf, starting i_offset bytes into the file. Whole
+  blocks are read straight into buf, a run at a time; only a partial
+  first or last block goes through a bounce buffer. Nothing here
+  touches a file position, so this may be called from several threads
+  at once.
+*/
+static ssize_t
+udf_pread_extents(const udf_t *p_udf, const udf_extent_t *p_extents,
+		  unsigned int i_extents, uint64_t i_size,
+		  void *buf, size_t count, off_t i_offset)
+{
+  uint8_t *p_buf = buf;
+  size_t i_done = 0;
+  unsigned int i;
+
+  if (i_offset < 0) return DRIVER_OP_BAD_PARAMETER;
+  if ((uint64_t) i_offset >= i_size) return 0;
+  if (count > i_size - i_offset) count = i_size - i_offset;
+
+  i = udf_extent_find(p_extents, i_extents, i_offset);
+  while (i_done < count && i < i_extents) {
+    const udf_extent_t *p_extent = &p_extents[i];
+    const uint64_t i_in = i_offset + i_done - p_extent->i_offset;
+    size_t i_len = count - i_done;
+    driver_return_code_t ret = DRIVER_OP_SUCCESS;
+
+    if (i_in >= p_extent->i_len) {
+      i++;
+      continue;
+    }
+    if (i_len > p_extent->i_len - i_in) i_len = p_extent->i_len - i_in;
+
+    if (CDIO_INVALID_LBA == p_extent->i_lba) {
+      memset(p_buf + i_done, 0, i_len);
+    } else {
+      const lba_t i_lba = p_extent->i_lba + i_in / UDF_BLOCKSIZE;
+      const uint32_t i_skip = i_in % UDF_BLOCKSIZE;
+
+      if (0 == i_skip && i_len >= UDF_BLOCKSIZE) {
+	size_t i_blocks = i_len / UDF_BLOCKSIZE;
+	if (i_blocks > UDF_MAX_READ_BLOCKS) i_blocks = UDF_MAX_READ_BLOCKS;
+	ret = udf_read_sectors(p_udf, p_buf + i_done, i_lba, i_blocks);
+	i_len = i_blocks * UDF_BLOCKSIZE;
+      } else {
+	uint8_t data[UDF_BLOCKSIZE];
+	ret = udf_read_sectors(p_udf, data, i_lba, 1);
+	if (i_len > UDF_BLOCKSIZE - i_skip) i_len = UDF_BLOCKSIZE - i_skip;
+	if (DRIVER_OP_SUCCESS == ret) 
+	  memcpy(p_buf + i_done, data + i_skip, i_len);
+      }
+    }
+    if (DRIVER_OP_SUCCESS != ret) 
+      return i_done ? (ssize_t) i_done : ret;
+    i_done += i_len;
   }
+  return i_done;
+}
+
+/*
+  Read up to count bytes at i_offset of the file of i_size bytes whose
+  data is embedded in its file entry p_udf_fe. That takes no I/O.
+*/
+static ssize_t
+udf_pread_in_icb(const udf_file_entry_t *p_udf_fe, uint64_t i_size,
+		 void *buf, size_t count, off_t i_offset)
+{
+  const uint32_t i_ea = uint32_from_le(p_udf_fe->i_extended_attr);
+  const unsigned int i_fe_size = udf_get_fe_size(p_udf_fe);
+  uint64_t i_data = uint32_from_le(p_udf_fe->i_alloc_descs);
+
+  if (i_offset < 0) return DRIVER_OP_BAD_PARAMETER;
+  if (i_fe_size < sizeof(udf_file_entry_t) + (uint64_t) i_ea) return 0;
+  if (i_data > i_fe_size - sizeof(udf_file_entry_t) - i_ea) 
+    i_data = i_fe_size - sizeof(udf_file_entry_t) - i_ea;
+  if (i_data > i_size) i_data = i_size;
+  if ((uint64_t) i_offset >= i_data) return 0;
+  if (count > i_data - i_offset) count = i_data - i_offset;
+  memcpy(buf, p_udf_fe->ext_attr + i_ea + i_offset, count);
+  return count;
+}
+
+/*
+  Read up to count bytes at i_offset of the file with file entry
+  p_udf_fe, for one-off reads where keeping an extent map isn't worth
+  it. The map is built for the call and thrown away.
+*/
+ssize_t
+udf_pread_fe(const udf_t *p_udf, const udf_file_entry_t *p_udf_fe,
+	     void *buf, size_t count, off_t i_offset)
+{
+  unsigned int i_extents = 0;
+  udf_extent_t *p_extents;
+  ssize_t i_read;
+
+  if (udf_is_in_icb(p_udf_fe))
+    return udf_pread_in_icb(p_udf_fe, uint64_from_le(p_udf_fe->info_len),
+			    buf, count, i_offset);
+  p_extents = udf_extents_new(p_udf, p_udf_fe, &i_extents);
+  if (!p_extents) return DRIVER_OP_ERROR;
+  i_read = udf_pread_extents(p_udf, p_extents, i_extents, 
+			     uint64_from_le(p_udf_fe->info_len), 
+			     buf, count, i_offset);
+  free(p_extents);
+  return i_read;
 }
 
 /**
@@ -226,26 +429,102 @@ udf_read_block(const udf_dirent_t *p_udf_dirent, void * buf, size_t count)
 {
   if (count == 0) return 0;
   else {
-    driver_return_code_t ret;
-    uint32_t i_max_size=0;
     udf_t *p_udf = p_udf_dirent->p_udf;
-    lba_t i_lba = offset_to_lba(p_udf_dirent, p_udf->i_position, &i_lba, 
-				&i_max_size);
-    if (i_lba != CDIO_INVALID_LBA) {
-      uint32_t i_max_blocks = CEILING(i_max_size, UDF_BLOCKSIZE);
-      if ( i_max_blocks < count ) {
-	printf("Warning: don't know how to handle yet\n" );
-	count = i_max_blocks;
-      }
-      ret = udf_read_sectors(p_udf, buf, i_lba, count);
-      if (DRIVER_OP_SUCCESS == ret) {
-	ssize_t i_read_len = MIN(i_max_size, count * UDF_BLOCKSIZE);
-	p_udf->i_position += i_read_len;
-	return i_read_len;
-      }
-      return ret;
-    } else {
-      return DRIVER_OP_ERROR;
-    }
+    ssize_t i_read_len = udf_pread_fe(p_udf, &p_udf_dirent->fe, buf, 
+				      count * UDF_BLOCKSIZE, 
+				      p_udf->i_position);
+    if (i_read_len > 0) 
+      p_udf->i_position += i_read_len;
+    return i_read_len;
   }
 }
+
+/*!
+  Open the file given by p_udf_dirent for reading. 
+*/
+udf_file_t *
+udf_file_open(const udf_dirent_t *p_udf_dirent)
+{
+  const udf_file_entry_t *p_udf_fe;
+  unsigned int i_fe_size;
+  udf_file_t *p_udf_file;
+
+  if (!p_udf_dirent) return NULL;
+  p_udf_fe = &p_udf_dirent->fe;
+  i_fe_size = udf_get_fe_size(p_udf_fe);
+
+  p_udf_file = calloc(1, sizeof(udf_file_t) - sizeof(udf_file_entry_t) 
+		      + i_fe_size);
+  if (!p_udf_file) return NULL;
+  p_udf_file->p_udf  = p_udf_dirent->p_udf;
+  p_udf_file->i_size = uint64_from_le(p_udf_fe->info_len);
+  memcpy(&p_udf_file->fe, p_udf_fe, i_fe_size);
+  p_udf_file->p_extents = udf_extents_new(p_udf_file->p_udf, p_udf_fe,
+					  &p_udf_file->i_extents);
+  if (!p_udf_file->p_extents) {
+    free(p_udf_file);
+    return NULL;
+  }
+  return p_udf_file;
+}
+
+/*!
+  Read up to count bytes at byte offset i_offset of p_udf_file.
+*/
+ssize_t
+udf_pread(const udf_file_t *p_udf_file, void *buf, size_t count, 
+	  off_t i_offset)
+{
+  if (!p_udf_file) return DRIVER_OP_UNINIT;
+  if (udf_is_in_icb(&p_udf_file->fe))
+    return udf_pread_in_icb(&p_udf_file->fe, p_udf_file->i_size,
+			    buf, count, i_offset);
+  return udf_pread_extents(p_udf_file->p_udf, p_udf_file->p_extents,
+			   p_udf_file->i_extents, p_udf_file->i_size,
+			   buf, count, i_offset);
+}
+
+/*!
+  Read up to count bytes at the position of p_udf_file and advance it.
+*/
+ssize_t
+udf_file_read(udf_file_t *p_udf_file, void *buf, size_t count)
+{
+  ssize_t i_read;
+
+  if (!p_udf_file) return DRIVER_OP_UNINIT;
+  i_read = udf_pread(p_udf_file, buf, count, p_udf_file->i_position);
+  if (i_read > 0) p_udf_file->i_position += i_read;
+  return i_read;
+}
+
+/*!
+  Set the position of p_udf_file, like lseek(2).
+*/
+off_t
+udf_file_seek(udf_file_t *p_udf_file, off_t i_offset, int whence)
+{
+  off_t i_base;
+
+  if (!p_udf_file) return DRIVER_OP_UNINIT;
+  switch (whence) {
+  case SEEK_SET: i_base = 0;                        break;
+  case SEEK_CUR: i_base = p_udf_file->i_position;   break;
+  case SEEK_END: i_base = p_udf_file->i_size;       break;
+  default:       return DRIVER_OP_BAD_PARAMETER;
+  }
+  if (i_base + i_offset < 0) return DRIVER_OP_BAD_PARAMETER;
+  p_udf_file->i_position = i_base + i_offset;
+  return p_udf_file->i_position;
+}
+
+/*!
+  Close p_udf_file and free the resources associated with it.
+*/
+bool
+udf_file_close(udf_file_t *p_udf_file)
+{
+  if (p_udf_file) free(p_udf_file->p_extents);
+  free(p_udf_file);
+  return true;
+}
@@ -55,6 +55,10 @@
 # include <stdlib.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
 /* These definitions are also to make debugging easy. Note that they
    have to come *before* #include <cdio/ecma_167.h> which sets 
    #defines for these.
@@ -67,6 +71,7 @@ const char VSD_STD_ID_NSR03[] = {'N', 'S', 'R', '0', '3'};
 const char VSD_STD_ID_TEA01[] = {'T', 'E', 'A', '0', '1'};
 
 #include <cdio/bytesex.h>
+#include <cdio/logging.h>
 #include "udf_private.h"
 #include "udf_fs.h"
 
@@ -116,6 +121,11 @@ const char VSD_STD_ID_TEA01[] = {'T', 'E', 'A', '0', '1'};
 static udf_dirent_t *
 udf_new_dirent(udf_file_entry_t *p_udf_fe, udf_t *p_udf,
 	       const char *psz_name, bool b_dir, bool b_parent);
+static bool udf_dirent_read_dir(udf_dirent_t *p_udf_dirent);
+static int udf_dir_find(const udf_dir_t *p_dir, const char *psz_name);
+static void udf_dirent_set_entry(udf_dirent_t *p_udf_dirent, 
+				 unsigned int i_entry);
+static void _dir_cache_remove (udf_dir_cache_t *p_cache, udf_dir_t *p_dir);
 
 /**
  * Check the descriptor tag for both the correct id and correct checksum.
@@ -143,6 +153,19 @@ udf_checktag(const udf_tag_t *p_tag, udf_Uint16_t tag_id)
   return -1;
 }
 
+/*!
+  Return the size of the file entry p_udf_fe including its extended
+  attributes and allocation descriptors, which is at most a block.
+*/
+unsigned int
+udf_get_fe_size(const udf_file_entry_t *p_udf_fe)
+{
+  const uint64_t i_size = (uint64_t) sizeof(udf_file_entry_t) 
+    + uint32_from_le(p_udf_fe->i_extended_attr) 
+    + uint32_from_le(p_udf_fe->i_alloc_descs);
+  return i_size < UDF_BLOCKSIZE ? i_size : UDF_BLOCKSIZE;
+}
+
 bool 
 udf_get_lba(const udf_file_entry_t *p_udf_fe, 
 	    /*out*/ uint32_t *start, /*out*/ uint32_t *end)
@@ -194,36 +217,34 @@ udf_get_lba(const udf_file_entry_t *p_udf_fe,
 
 #define udf_PATH_DELIMITERS "/\\"
 
-/* Searches p_udf_dirent a directory entry called psz_token.
-   Note p_udf_dirent is continuously updated. If the entry is
-   not found p_udf_dirent is useless and thus the caller should
-   not use it afterwards.
+/* Searches p_udf_dirent a directory entry called psz_token. This is
+   a hash lookup in the directory as read by udf_readdir, so costs no
+   I/O when the directory is cached.  Note p_udf_dirent is consumed:
+   it is either returned as the entry found or free'd.
 */
 static 
 udf_dirent_t *
 udf_ff_traverse(udf_dirent_t *p_udf_dirent, char *psz_token)
 {
-  while (udf_readdir(p_udf_dirent)) {
-    if (strcmp(psz_token, p_udf_dirent->psz_name) == 0) {
-      char *next_tok = strtok(NULL, udf_PATH_DELIMITERS);
-      
-      if (!next_tok)
-	return p_udf_dirent; /* found */
-      else if (p_udf_dirent->b_dir) {
-	udf_dirent_t * p_udf_dirent2 = udf_opendir(p_udf_dirent);
-	
-	if (p_udf_dirent2) {
-	  udf_dirent_t * p_udf_dirent3 = 
-	    udf_ff_traverse(p_udf_dirent2, next_tok);
+  udf_dirent_t * p_udf_dirent2;
+  char *next_tok;
+  int i_entry;
 
-	  /* if p_udf_dirent3 is null p_udf_dirent2 is free'd. */
-	  return p_udf_dirent3;
-	}
-      }
-    }
+  if (!udf_dirent_read_dir(p_udf_dirent)
+      || (i_entry = udf_dir_find(p_udf_dirent->p_dir, psz_token)) < 0) {
+    udf_dirent_free(p_udf_dirent);
+    return NULL;
   }
-  free(p_udf_dirent->psz_name);
-  return NULL;
+  udf_dirent_set_entry(p_udf_dirent, i_entry);
+
+  next_tok = strtok(NULL, udf_PATH_DELIMITERS);
+  if (!next_tok)
+    return p_udf_dirent; /* found */
+
+  p_udf_dirent2 = p_udf_dirent->b_dir ? udf_opendir(p_udf_dirent) : NULL;
+  udf_dirent_free(p_udf_dirent);
+  if (!p_udf_dirent2) return NULL;
+  return udf_ff_traverse(p_udf_dirent2, next_tok);
 }
 
 /* FIXME! */
@@ -249,8 +270,8 @@ udf_fopen(udf_dirent_t *p_udf_root, const char *psz_name)
 	udf_new_dirent(&p_udf_root->fe, p_udf_root->p_udf,
 		       p_udf_root->psz_name, p_udf_root->b_dir, 
 		       p_udf_root->b_parent);
-      p_udf_file = udf_ff_traverse(p_udf_dirent, psz_token);
-      udf_dirent_free(p_udf_dirent);
+      if (p_udf_dirent)
+	p_udf_file = udf_ff_traverse(p_udf_dirent, psz_token);
     }
     else if ( 0 == strncmp("/", psz_name, sizeof("/")) ) {
       return udf_new_dirent(&p_udf_root->fe, p_udf_root->p_udf,
@@ -285,11 +306,11 @@ static udf_dirent_t *
 udf_new_dirent(udf_file_entry_t *p_udf_fe, udf_t *p_udf,
 	       const char *psz_name, bool b_dir, bool b_parent) 
 {
-  const unsigned int i_alloc_size = p_udf_fe->i_alloc_descs
-    + p_udf_fe->i_extended_attr;
-  
+  /* Make room for a whole block's worth of file entry, as udf_readdir
+     puts the file entries of the directory's children here. */
   udf_dirent_t *p_udf_dirent = (udf_dirent_t *) 
-    calloc(1, sizeof(udf_dirent_t) + i_alloc_size);
+    calloc(1, sizeof(udf_dirent_t) - sizeof(udf_file_entry_t) 
+	   + UDF_BLOCKSIZE);
   if (!p_udf_dirent) return NULL;
   
   p_udf_dirent->psz_name     = strdup(psz_name);
@@ -297,10 +318,8 @@ udf_new_dirent(udf_file_entry_t *p_udf_fe, udf_t *p_udf,
   p_udf_dirent->b_parent     = b_parent;
   p_udf_dirent->p_udf        = p_udf;
   p_udf_dirent->i_part_start = p_udf->i_part_start;
-  p_udf_dirent->dir_left     = uint64_from_le(p_udf_fe->info_len); 
 
-  memcpy(&(p_udf_dirent->fe), p_udf_fe, 
-	 sizeof(udf_file_entry_t) + i_alloc_size);
+  memcpy(&(p_udf_dirent->fe), p_udf_fe, udf_get_fe_size(p_udf_fe));
   udf_get_lba( p_udf_fe, &(p_udf_dirent->i_loc), 
 	       &(p_udf_dirent->i_loc_end) );
   return p_udf_dirent;
@@ -316,23 +335,157 @@ udf_read_sectors (const udf_t *p_udf, void *ptr, lsn_t i_start,
 {
   driver_return_code_t ret;
   long int i_read;
-  long int i_byte_offset;
+  off_t i_byte_offset;
   
   if (!p_udf) return 0;
-  i_byte_offset = (i_start * UDF_BLOCKSIZE);
+  i_byte_offset = ((off_t) i_start * UDF_BLOCKSIZE);
 
   if (p_udf->b_stream) {
-    ret = cdio_stream_seek (p_udf->stream, i_byte_offset, SEEK_SET);
-    if (DRIVER_OP_SUCCESS != ret) return ret;
-    i_read = cdio_stream_read (p_udf->stream, ptr, UDF_BLOCKSIZE, i_blocks);
-    if (i_read) return DRIVER_OP_SUCCESS;
+    /* A positional read leaves the stream alone, so several threads
+       can read through the same udf_t. */
+    i_read = cdio_stream_pread (p_udf->stream, ptr, UDF_BLOCKSIZE, i_blocks,
+				i_byte_offset);
+    if (DRIVER_OP_UNSUPPORTED == i_read) {
+#ifdef HAVE_PTHREAD
+      pthread_mutex_lock((pthread_mutex_t *) &p_udf->mutex);
+#endif
+      ret = cdio_stream_seek (p_udf->stream, i_byte_offset, SEEK_SET);
+      i_read = (DRIVER_OP_SUCCESS == ret) 
+	? cdio_stream_read (p_udf->stream, ptr, UDF_BLOCKSIZE, i_blocks) : 0;
+#ifdef HAVE_PTHREAD
+      pthread_mutex_unlock((pthread_mutex_t *) &p_udf->mutex);
+#endif
+    }
+    if (i_read > 0) return DRIVER_OP_SUCCESS;
     return DRIVER_OP_ERROR;
   } else {
-    return cdio_read_data_sectors(p_udf->cdio, ptr, i_start, UDF_BLOCKSIZE,
-				  i_blocks);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock((pthread_mutex_t *) &p_udf->mutex);
+#endif
+    ret = cdio_read_data_sectors(p_udf->cdio, ptr, i_start, UDF_BLOCKSIZE,
+				 i_blocks);
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock((pthread_mutex_t *) &p_udf->mutex);
+#endif
+    return ret;
   }
 }
 
+/*!
+  Read the Anchor Volume Descriptor Pointer at sector 256 into p_udf.
+  Return true if it is there.
+*/
+static bool
+udf_read_anchor (udf_t *p_udf)
+{
+  uint8_t data[UDF_BLOCKSIZE];
+
+  if (DRIVER_OP_SUCCESS != udf_read_sectors (p_udf, &data, 256, 1) )
+    return false;
+  
+  memcpy(&(p_udf->anchor_vol_desc_ptr), &data, sizeof(anchor_vol_desc_ptr_t));
+
+  return 0 == udf_checktag((udf_tag_t *)&(p_udf->anchor_vol_desc_ptr), 
+			   TAGID_ANCHOR);
+}
+
+/*!
+  Note in p_udf a Partition Descriptor found in a volume descriptor
+  sequence, unless one with the same number and a higher sequence
+  number prevails over it.
+*/
+static void
+udf_add_partition (udf_t *p_udf, const partition_desc_t *p_partition)
+{
+  const partition_num_t i_number = uint16_from_le(p_partition->number);
+  const uint32_t i_seq = uint32_from_le(p_partition->vol_desc_seq_num);
+  unsigned int i;
+
+  for (i = 0; i < p_udf->i_parts; i++)
+    if (p_udf->parts[i].i_number == i_number) break;
+
+  if (i == p_udf->i_parts) {
+    if (i == UDF_MAX_PARTITIONS) {
+      cdio_warn("More than %d partitions; ignoring partition %u",
+		UDF_MAX_PARTITIONS, (unsigned int) i_number);
+      return;
+    }
+    p_udf->i_parts++;
+  } else if (p_udf->parts[i].i_seq > i_seq) 
+    return;
+
+  p_udf->parts[i].i_number = i_number;
+  p_udf->parts[i].i_start  = uint32_from_le(p_partition->start_loc);
+  p_udf->parts[i].i_seq    = i_seq;
+}
+
+/*!
+  Read the volume descriptor sequence in extent p_extent with one
+  request, and note in p_udf the Primary Volume Descriptor, the Logical
+  Volume Descriptor and the Partition Descriptors in it. Where there
+  are several of a kind, the one with the highest sequence number
+  prevails (ECMA 167r3 3/8.4.2). Return true if all three kinds are
+  there.
+*/
+static bool
+udf_read_vds (udf_t *p_udf, const udf_extent_ad_t *p_extent)
+{
+  const uint32_t i_start = uint32_from_le(p_extent->loc);
+  uint32_t i_blocks = 
+    (uint32_from_le(p_extent->len) + UDF_BLOCKSIZE - 1) / UDF_BLOCKSIZE;
+  uint8_t *p_vds;
+  uint32_t i;
+
+  if (0 == i_blocks) return false;
+  if (i_blocks > UDF_VDS_MAX_BLOCKS) i_blocks = UDF_VDS_MAX_BLOCKS;
+
+  /* Blocks past the end of a short read stay zero and so have no
+     valid tag. */
+  p_vds = calloc(i_blocks, UDF_BLOCKSIZE);
+  if (!p_vds) return false;
+  if (DRIVER_OP_SUCCESS != udf_read_sectors (p_udf, p_vds, i_start, 
+					     i_blocks)) {
+    free(p_vds);
+    return false;
+  }
+
+  for (i = 0; i < i_blocks; i++) {
+    udf_tag_t *p_tag = (udf_tag_t *) (p_vds + i * UDF_BLOCKSIZE);
+    const uint16_t i_tagid = uint16_from_le(p_tag->id);
+
+    if (udf_checktag(p_tag, i_tagid)) 
+      continue;
+
+    if (TAGID_TERM == i_tagid) 
+      break;
+
+    if (TAGID_PRI_VOL == i_tagid) {
+      const udf_pvd_t *p_pvd = (udf_pvd_t *) p_tag;
+      if (!p_udf->pvd_lba || 
+	  uint32_from_le(p_pvd->vol_desc_seq_num) > 
+	  uint32_from_le(p_udf->pvd.vol_desc_seq_num)) {
+	p_udf->pvd_lba = i_start + i;
+	memcpy(&p_udf->pvd, p_pvd, sizeof(udf_pvd_t));
+      }
+    } else if (TAGID_LOGVOL == i_tagid) {
+      const logical_vol_desc_t *p_logvol = (logical_vol_desc_t *) p_tag;
+      const uint32_t i_seq = uint32_from_le(p_logvol->seq_num);
+      if (UDF_BLOCKSIZE == uint32_from_le(p_logvol->logical_blocksize) &&
+	  (!p_udf->lvd_lba || i_seq > p_udf->lvd_seq)) {
+	p_udf->lvd_lba = i_start + i;
+	p_udf->lvd_seq = i_seq;
+	p_udf->fsd_offset = 
+	  uint32_from_le(p_logvol->lvd_use.fsd_loc.loc.lba);
+      }
+    } else if (TAGID_PARTITION == i_tagid) {
+      udf_add_partition(p_udf, (partition_desc_t *) p_tag);
+    }
+  }
+
+  free(p_vds);
+  return p_udf->pvd_lba && p_udf->lvd_lba && p_udf->i_parts;
+}
+
 /*!
   Open an UDF for reading. Maybe in the future we will have
   a mode. NULL is returned on error.
@@ -343,69 +496,75 @@ udf_t *
 udf_open (const char *psz_path)
 {
   udf_t *p_udf = (udf_t *) calloc(1, sizeof(udf_t)) ;
-  uint8_t data[UDF_BLOCKSIZE];
+  bool b_file = false;
 
   if (!p_udf) return NULL;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&p_udf->mutex, NULL);
+#endif
 
-  p_udf->cdio = cdio_open(psz_path, DRIVER_UNKNOWN);
-  if (!p_udf->cdio) {
-    /* Not a CD-ROM drive or CD Image. Maybe it's a UDF file not
-       encapsulated as a CD-ROM Image (e.g. often .UDF or (sic) .ISO)
-    */
+#ifdef HAVE_SYS_STAT_H
+  {
+    struct stat statbuf;
+    b_file = 0 == stat(psz_path, &statbuf) && S_ISREG(statbuf.st_mode);
+  }
+#endif
+
+  /* 
+     A regular file is most likely a UDF image as is (often .UDF or
+     (sic) .ISO), so try it that way first: that takes a single read,
+     where cdio_open() would go through every image driver first.
+  */
+  if (b_file) {
     p_udf->stream = cdio_stdio_new( psz_path );
     if (!p_udf->stream) 
       goto error;
     p_udf->b_stream = true;
+    if (!udf_read_anchor(p_udf)) {
+      cdio_stdio_destroy(p_udf->stream);
+      p_udf->stream = NULL;
+      p_udf->b_stream = false;
+    }
   }
 
-  /*
-   * Look for an Anchor Volume Descriptor Pointer at sector 256.
-   */
-  if (DRIVER_OP_SUCCESS != udf_read_sectors (p_udf, &data, 256, 1) )
-    goto error;
-  
-  memcpy(&(p_udf->anchor_vol_desc_ptr), &data, sizeof(anchor_vol_desc_ptr_t));
+  if (!p_udf->b_stream) {
+    p_udf->cdio = cdio_open(psz_path, DRIVER_UNKNOWN);
+    if (!p_udf->cdio) {
+      /* Not a CD-ROM drive or CD Image. Maybe it's a UDF file not
+	 encapsulated as a CD-ROM Image. */
+      if (b_file) goto error;
+      p_udf->stream = cdio_stdio_new( psz_path );
+      if (!p_udf->stream) 
+	goto error;
+      p_udf->b_stream = true;
+    }
 
-  if (udf_checktag((udf_tag_t *)&(p_udf->anchor_vol_desc_ptr), TAGID_ANCHOR))
-    goto error;
+    /*
+     * Look for an Anchor Volume Descriptor Pointer at sector 256.
+     */
+    if (!udf_read_anchor(p_udf))
+      goto error;
+  }
   
   /*
-   * Then try to find a reference to a Primary Volume Descriptor.
+   * Then index the Main Volume Descriptor Sequence, or failing that
+   * the Reserve one.
    */
   {
     const anchor_vol_desc_ptr_t *p_avdp = &p_udf->anchor_vol_desc_ptr;
-    const uint32_t mvds_start = 
-      uint32_from_le(p_avdp->main_vol_desc_seq_ext.loc);
-    const uint32_t mvds_end   = mvds_start + 
-      (uint32_from_le(p_avdp->main_vol_desc_seq_ext.len) - 1) / UDF_BLOCKSIZE;
 
-    uint32_t i_lba;
-
-    for (i_lba = mvds_start; i_lba < mvds_end; i_lba++) {
-
-      udf_pvd_t *p_pvd = (udf_pvd_t *) &data;
-      
-      if (DRIVER_OP_SUCCESS != udf_read_sectors (p_udf, p_pvd, i_lba, 1) ) 
+    if (!udf_read_vds(p_udf, &p_avdp->main_vol_desc_seq_ext)) {
+      p_udf->pvd_lba = p_udf->lvd_lba = 0;
+      p_udf->i_parts = 0;
+      if (!udf_read_vds(p_udf, &p_avdp->reserve_vol_desc_seq_ext))
 	goto error;
-
-      if (!udf_checktag(&p_pvd->tag, TAGID_PRI_VOL)) {
-	p_udf->pvd_lba = i_lba;
-	break;
-      }
-      
     }
-
-    /*
-     * If we couldn't find a reference, bail out.
-     */
-    if (i_lba == mvds_end)
-      goto error;
   }
 
   return p_udf;
 
  error:
-  free(p_udf);
+  udf_close(p_udf);
   return NULL;
 }
 
@@ -418,14 +577,9 @@ udf_open (const char *psz_path)
 int 
 udf_get_volume_id(udf_t *p_udf, /*out*/ char *psz_volid,  unsigned int i_volid)
 {
-  uint8_t data[UDF_BLOCKSIZE];
-  const udf_pvd_t *p_pvd = (udf_pvd_t *) &data;
+  const udf_pvd_t *p_pvd = &p_udf->pvd;
   unsigned int volid_len;
 
-  /* get primary volume descriptor */
-  if ( DRIVER_OP_SUCCESS != udf_read_sectors(p_udf, &data, p_udf->pvd_lba, 1) )
-    return 0;
-
   volid_len = p_pvd->vol_ident[UDF_VOLID_SIZE-1];
   if(volid_len > UDF_VOLID_SIZE-1) {
     /* this field is only UDF_VOLID_SIZE bytes something is wrong */
@@ -452,12 +606,7 @@ int
 udf_get_volumeset_id(udf_t *p_udf, /*out*/ uint8_t *volsetid,
 		     unsigned int i_volsetid)
 {
-  uint8_t data[UDF_BLOCKSIZE];
-  const udf_pvd_t *p_pvd = (udf_pvd_t *) &data;
-
-  /* get primary volume descriptor */
-  if ( DRIVER_OP_SUCCESS != udf_read_sectors(p_udf, &data, p_udf->pvd_lba, 1) )
-    return 0;
+  const udf_pvd_t *p_pvd = &p_udf->pvd;
 
   if (i_volsetid > UDF_VOLSET_ID_SIZE) {
     i_volsetid = UDF_VOLSET_ID_SIZE;
@@ -479,67 +628,47 @@ udf_get_volumeset_id(udf_t *p_udf, /*out*/ uint8_t *volsetid,
 udf_dirent_t *
 udf_get_root (udf_t *p_udf, bool b_any_partition, partition_num_t i_partition)
 {
-  const anchor_vol_desc_ptr_t *p_avdp = &p_udf->anchor_vol_desc_ptr;
-  const uint32_t mvds_start = 
-    uint32_from_le(p_avdp->main_vol_desc_seq_ext.loc);
-  const uint32_t mvds_end   = mvds_start + 
-    (uint32_from_le(p_avdp->main_vol_desc_seq_ext.len) - 1) / UDF_BLOCKSIZE;
-  uint32_t i_lba;
   uint8_t data[UDF_BLOCKSIZE];
+  unsigned int i;
 
   /* 
-     Now we have the joy of finding the Partition Descriptor and the
-     Logical Volume Descriptor for the Main Volume Descriptor
-     Sequence. Once we've got that, we use the Logical Volume
-     Descriptor to get a Fileset Descriptor and that has the Root
-     Directory File Entry.
+     udf_open() has found the Partition Descriptors and the Logical
+     Volume Descriptor of the Main Volume Descriptor Sequence. We use
+     the Logical Volume Descriptor to get a Fileset Descriptor in the
+     partition, and that has the Root Directory File Entry.
   */
-  for (i_lba = mvds_start; i_lba < mvds_end; i_lba++) {
-    uint8_t data[UDF_BLOCKSIZE];
-    
-    partition_desc_t *p_partition = (partition_desc_t *) &data;
-    
-    if (DRIVER_OP_SUCCESS != udf_read_sectors (p_udf, p_partition, i_lba, 1) ) 
-      return NULL;
-    
-    if (!udf_checktag(&p_partition->tag, TAGID_PARTITION)) {
-      const partition_num_t i_partition_check 
-	= uint16_from_le(p_partition->number);
-      if (b_any_partition || i_partition_check == i_partition) {
-	/* Squirrel away some data regarding partition */
-	p_udf->i_partition = uint16_from_le(p_partition->number);
-	p_udf->i_part_start = uint32_from_le(p_partition->start_loc);
-	if (p_udf->lvd_lba) break;
-      }
-    } else if (!udf_checktag(&p_partition->tag, TAGID_LOGVOL)) {
-      /* Get fileset descriptor */
-      logical_vol_desc_t *p_logvol = (logical_vol_desc_t *) &data;
-      bool b_valid = 
-	UDF_BLOCKSIZE == uint32_from_le(p_logvol->logical_blocksize);
-      
-      if (b_valid) {
-	p_udf->lvd_lba = i_lba;
-	p_udf->fsd_offset = 
-	  uint32_from_le(p_logvol->lvd_use.fsd_loc.loc.lba);
-	if (p_udf->i_part_start) break;
-      }
-    } 
+  for (i = 0; i < p_udf->i_parts; i++) {
+    if (b_any_partition || p_udf->parts[i].i_number == i_partition) {
+      /* Squirrel away some data regarding partition */
+      p_udf->i_partition = p_udf->parts[i].i_number;
+      p_udf->i_part_start = p_udf->parts[i].i_start;
+      break;
+    }
   }
+  if (i == p_udf->i_parts) 
+    return NULL;
+
   if (p_udf->lvd_lba && p_udf->i_part_start) {
-    udf_fsd_t *p_fsd = (udf_fsd_t *) &data;
-    
-    driver_return_code_t ret = 
-      udf_read_sectors(p_udf, p_fsd, p_udf->i_part_start + p_udf->fsd_offset,
-		       1);
+    /* The Root Directory File Entry usually follows the Fileset
+       Descriptor, so read the block after it too. */
+    uint8_t blocks[2 * UDF_BLOCKSIZE];
+    udf_fsd_t *p_fsd = (udf_fsd_t *) &blocks;
+    const uint32_t fsd_lba = p_udf->i_part_start + p_udf->fsd_offset;
     
-    if (DRIVER_OP_SUCCESS == ret && !udf_checktag(&p_fsd->tag, TAGID_FSD)) {
+    memset(blocks + UDF_BLOCKSIZE, 0, UDF_BLOCKSIZE);
+    if (DRIVER_OP_SUCCESS == udf_read_sectors(p_udf, p_fsd, fsd_lba, 2)
+	&& !udf_checktag(&p_fsd->tag, TAGID_FSD)) {
       udf_file_entry_t *p_udf_fe = (udf_file_entry_t *) &data;
-      const uint32_t parent_icb = uint32_from_le(p_fsd->root_icb.loc.lba);
+      const uint32_t root_lba = 
+	p_udf->i_part_start + uint32_from_le(p_fsd->root_icb.loc.lba);
+      driver_return_code_t ret = DRIVER_OP_SUCCESS;
       
       /* Check partition numbers match of last-read block?  */
       
-      ret = udf_read_sectors(p_udf, p_udf_fe, 
-			     p_udf->i_part_start + parent_icb, 1);
+      if (root_lba == fsd_lba + 1)
+	memcpy(&data, blocks + UDF_BLOCKSIZE, UDF_BLOCKSIZE);
+      else
+	ret = udf_read_sectors(p_udf, p_udf_fe, root_lba, 1);
       if (ret == DRIVER_OP_SUCCESS && 
 	  !udf_checktag(&p_udf_fe->tag, TAGID_FILE_ENTRY)) {
 	
@@ -567,9 +696,14 @@ udf_close (udf_t *p_udf)
   if (!p_udf) return true;
   if (p_udf->b_stream) {
     cdio_stdio_destroy(p_udf->stream);
-  } else {
+  } else if (p_udf->cdio) {
     cdio_destroy(p_udf->cdio);
   }
+  while (p_udf->dir_cache.p_lru_first)
+    _dir_cache_remove(&p_udf->dir_cache, p_udf->dir_cache.p_lru_first);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_destroy(&p_udf->mutex);
+#endif
 
   /* Get rid of root directory if allocated. */
 
@@ -577,107 +711,439 @@ udf_close (udf_t *p_udf)
   return true;
 }
 
-udf_dirent_t * 
-udf_opendir(const udf_dirent_t *p_udf_dirent)
+/* Directories are read whole: first the File Identifier Descriptors,
+   then the file entries they refer to. Those are read in block order,
+   and blocks no more than UDF_ICB_MAX_GAP apart are fetched with one
+   read of up to UDF_ICB_BATCH_BLOCKS blocks, reading the gap along,
+   which costs less than the seek it saves. */
+#define UDF_ICB_BATCH_BLOCKS 64
+#define UDF_ICB_MAX_GAP       8
+
+/* Larger directories aren't read. */
+#define UDF_DIR_MAX_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+  lba_t        lba;
+  unsigned int i_entry;
+} udf_icb_ref_t;
+
+static int
+udf_icb_ref_cmp(const void *p1, const void *p2)
 {
-  if (p_udf_dirent->b_dir && !p_udf_dirent->b_parent && p_udf_dirent->fid) {
-    udf_t *p_udf = p_udf_dirent->p_udf;
-    uint8_t data[UDF_BLOCKSIZE];
-    udf_file_entry_t *p_udf_fe = (udf_file_entry_t *) &data;
-    
-    driver_return_code_t i_ret = 
-      udf_read_sectors(p_udf, p_udf_fe, p_udf->i_part_start 
-		       + p_udf_dirent->fid->icb.loc.lba, 1);
+  const udf_icb_ref_t *p_ref1 = p1, *p_ref2 = p2;
+  if (p_ref1->lba != p_ref2->lba) return p_ref1->lba < p_ref2->lba ? -1 : 1;
+  return p_ref1->i_entry < p_ref2->i_entry ? -1 : 1;
+}
 
-    if (DRIVER_OP_SUCCESS == i_ret 
-	&& !udf_checktag(&p_udf_fe->tag, TAGID_FILE_ENTRY)) {
-      
-      if (ICBTAG_FILE_TYPE_DIRECTORY == p_udf_fe->icb_tag.file_type) {
-	udf_dirent_t *p_udf_dirent_new = 
-	  udf_new_dirent(p_udf_fe, p_udf, p_udf_dirent->psz_name, true, true);
-	return p_udf_dirent_new;
+static unsigned int
+udf_name_hash(const char *psz_name)
+{
+  unsigned int i_hash = 2166136261u;
+  for ( ; *psz_name; psz_name++)
+    i_hash = (i_hash ^ (uint8_t) *psz_name) * 16777619u;
+  return i_hash;
+}
+
+static void
+udf_dir_free(udf_dir_t *p_dir)
+{
+  if (!p_dir) return;
+  free(p_dir->entries);
+  free(p_dir->p_buckets);
+  free(p_dir->p_data);
+  free(p_dir->p_fes);
+  free(p_dir->p_names);
+  free(p_dir);
+}
+
+/* Read the file entries referred to by the i_entries entries of
+   p_dir into p_dir->p_fes, batching the reads. */
+static bool
+udf_dir_read_icbs(const udf_t *p_udf, udf_dir_t *p_dir)
+{
+  const unsigned int i_entries = p_dir->i_entries;
+  udf_icb_ref_t *p_refs = calloc(i_entries, sizeof(udf_icb_ref_t));
+  size_t *p_fe_offsets = calloc(i_entries, sizeof(size_t));
+  uint8_t *p_batch = malloc(UDF_ICB_BATCH_BLOCKS * UDF_BLOCKSIZE);
+  size_t i_fes = 0, i_fes_max = 0;
+  unsigned int i, j;
+
+  if (!p_refs || !p_fe_offsets || !p_batch) {
+    free(p_refs);
+    free(p_fe_offsets);
+    free(p_batch);
+    return false;
+  }
+
+  for (i = 0; i < i_entries; i++) {
+    p_refs[i].lba = uint32_from_le(p_dir->entries[i].fid->icb.loc.lba);
+    p_refs[i].i_entry = i;
+    p_fe_offsets[i] = (size_t) -1;
+  }
+  qsort(p_refs, i_entries, sizeof(udf_icb_ref_t), udf_icb_ref_cmp);
+
+  for (i = 0; i < i_entries; i = j) {
+    const lba_t lba = p_refs[i].lba;
+    uint32_t i_blocks;
+
+    for (j = i + 1; j < i_entries 
+	   && p_refs[j].lba - p_refs[j-1].lba <= UDF_ICB_MAX_GAP
+	   && p_refs[j].lba - lba < UDF_ICB_BATCH_BLOCKS; j++)
+      ;
+    i_blocks = p_refs[j-1].lba - lba + 1;
+    if (DRIVER_OP_SUCCESS != 
+	udf_read_sectors(p_udf, p_batch, p_udf->i_part_start + lba, i_blocks))
+      continue;
+
+    for ( ; i < j; i++) {
+      const udf_file_entry_t *p_udf_fe = (udf_file_entry_t *)
+	(p_batch + (p_refs[i].lba - lba) * UDF_BLOCKSIZE);
+      const unsigned int i_fe_size = udf_get_fe_size(p_udf_fe);
+
+      if (i_fes + i_fe_size > i_fes_max) {
+	uint8_t *p_fes;
+	i_fes_max = 2 * i_fes_max + UDF_BLOCKSIZE;
+	p_fes = realloc(p_dir->p_fes, i_fes_max);
+	if (!p_fes) break;
+	p_dir->p_fes = p_fes;
       }
+      memcpy(p_dir->p_fes + i_fes, p_udf_fe, i_fe_size);
+      p_fe_offsets[p_refs[i].i_entry] = i_fes;
+      i_fes += i_fe_size;
     }
   }
-  return NULL;
+
+  /* p_fes has stopped moving, so now the pointers can be set. */
+  for (i = 0; i < i_entries; i++)
+    if ((size_t) -1 != p_fe_offsets[i])
+      p_dir->entries[i].fe = (udf_file_entry_t *) 
+	(p_dir->p_fes + p_fe_offsets[i]);
+  p_dir->i_bytes += i_fes_max;
+
+  free(p_refs);
+  free(p_fe_offsets);
+  free(p_batch);
+  return true;
 }
 
-udf_dirent_t *
-udf_readdir(udf_dirent_t *p_udf_dirent)
+/* Read and decode the directory with file entry p_udf_fe, whose data
+   starts at lba. NULL is returned on error. */
+static udf_dir_t *
+udf_dir_read(const udf_t *p_udf, const udf_file_entry_t *p_udf_fe, lba_t lba)
 {
-  udf_t *p_udf;
-  
-  if (p_udf_dirent->dir_left <= 0) {
-    udf_dirent_free(p_udf_dirent);
+  const uint64_t i_size = uint64_from_le(p_udf_fe->info_len);
+  udf_dir_t *p_dir;
+  size_t i_names = 0, i_name = 0;
+  uint64_t i_ofs;
+  unsigned int i;
+
+  if (i_size > UDF_DIR_MAX_SIZE) {
+    cdio_warn("Directory of %lu bytes is too large", 
+	      (long unsigned int) i_size);
+    return NULL;
+  }
+  p_dir = calloc(1, sizeof(udf_dir_t));
+  if (!p_dir) return NULL;
+  p_dir->lba    = lba;
+  p_dir->i_size = i_size;
+  p_dir->p_data = malloc(i_size ? i_size : 1);
+  if (!p_dir->p_data 
+      || (ssize_t) i_size != udf_pread_fe(p_udf, p_udf_fe, p_dir->p_data, 
+					  i_size, 0)) {
+    udf_dir_free(p_dir);
     return NULL;
   }
 
-  p_udf = p_udf_dirent->p_udf;
-  if (p_udf_dirent->fid) { 
-    /* advance to next File Identifier Descriptor */
-    /* FIXME: need to advance file entry (fe) as well.  */
-    uint32_t ofs = 4 * 
-      ((sizeof(*(p_udf_dirent->fid)) + p_udf_dirent->fid->i_imp_use 
-	+ p_udf_dirent->fid->i_file_id + 3) / 4);
-    
-    p_udf_dirent->fid = 
-      (udf_fileid_desc_t *)((uint8_t *)p_udf_dirent->fid + ofs);
+  /* Count the File Identifier Descriptors and the room their names
+     need. */
+  for (i_ofs = 0; i_ofs + sizeof(udf_fileid_desc_t) <= i_size; ) {
+    const udf_fileid_desc_t *fid = (udf_fileid_desc_t *) 
+      (p_dir->p_data + i_ofs);
+    if (udf_checktag(&fid->tag, TAGID_FID)) break;
+    i_ofs += 4 * ((sizeof(*fid) + uint16_from_le(fid->i_imp_use) 
+		   + fid->i_file_id + 3) / 4);
+    if (i_ofs > i_size) break;
+    p_dir->i_entries++;
+    i_names += fid->i_file_id + 1;
   }
-  
-  if (!p_udf_dirent->fid) {
-    uint32_t i_sectors = 
-      (p_udf_dirent->i_loc_end - p_udf_dirent->i_loc + 1);
-    uint32_t size = UDF_BLOCKSIZE * i_sectors;
-    driver_return_code_t i_ret;
-
-    if (!p_udf_dirent->sector)
-      p_udf_dirent->sector = (uint8_t*) malloc(size);
-    i_ret = udf_read_sectors(p_udf, p_udf_dirent->sector, 
-			     p_udf_dirent->i_part_start+p_udf_dirent->i_loc, 
-			     i_sectors);
-    if (DRIVER_OP_SUCCESS == i_ret)
-      p_udf_dirent->fid = (udf_fileid_desc_t *) p_udf_dirent->sector;
+
+  for (p_dir->i_buckets = 1; p_dir->i_buckets < p_dir->i_entries; )
+    p_dir->i_buckets *= 2;
+  p_dir->entries   = calloc(p_dir->i_entries + 1, sizeof(udf_dir_entry_t));
+  p_dir->p_buckets = calloc(p_dir->i_buckets, sizeof(unsigned int));
+  p_dir->p_names   = malloc(i_names + 1);
+  if (!p_dir->entries || !p_dir->p_buckets || !p_dir->p_names) {
+    udf_dir_free(p_dir);
+    return NULL;
+  }
+  p_dir->i_bytes = sizeof(udf_dir_t) + i_size + i_names
+    + p_dir->i_entries * sizeof(udf_dir_entry_t) 
+    + p_dir->i_buckets * sizeof(unsigned int);
+
+  for (i = 0, i_ofs = 0; i < p_dir->i_entries; i++) {
+    udf_fileid_desc_t *fid = (udf_fileid_desc_t *) (p_dir->p_data + i_ofs);
+    udf_dir_entry_t *p_entry = &p_dir->entries[i];
+
+    p_entry->fid = fid;
+    p_entry->psz_name = p_dir->p_names + i_name;
+    if (fid->i_file_id)
+      unicode16_decode(fid->imp_use + uint16_from_le(fid->i_imp_use), 
+		       fid->i_file_id, p_entry->psz_name);
     else
-      p_udf_dirent->fid = NULL;
+      p_entry->psz_name[0] = '\0';
+    i_name += strlen(p_entry->psz_name) + 1;
+    i_ofs += 4 * ((sizeof(*fid) + uint16_from_le(fid->i_imp_use) 
+		   + fid->i_file_id + 3) / 4);
   }
-  
-  if (p_udf_dirent->fid && !udf_checktag(&(p_udf_dirent->fid->tag), TAGID_FID))
-    {
-      uint32_t ofs = 
-	4 * ((sizeof(*p_udf_dirent->fid) + p_udf_dirent->fid->i_imp_use 
-	      + p_udf_dirent->fid->i_file_id + 3) / 4);
-      
-      p_udf_dirent->dir_left -= ofs;
-      p_udf_dirent->b_dir = 
-	(p_udf_dirent->fid->file_characteristics & UDF_FILE_DIRECTORY) != 0;
-      p_udf_dirent->b_parent = 
-	(p_udf_dirent->fid->file_characteristics & UDF_FILE_PARENT) != 0;
-
-      {
-	const unsigned int i_len = p_udf_dirent->fid->i_file_id;
-	uint8_t data[UDF_BLOCKSIZE] = {0};
-	udf_file_entry_t *p_udf_fe = (udf_file_entry_t *) &data;
-
-	udf_read_sectors(p_udf, p_udf_fe, p_udf->i_part_start 
-			 + p_udf_dirent->fid->icb.loc.lba, 1);
-      
-	memcpy(&(p_udf_dirent->fe), p_udf_fe, 
-	       sizeof(udf_file_entry_t) + p_udf_fe->i_alloc_descs 
-	       + p_udf_fe->i_extended_attr );
 
-	if (strlen(p_udf_dirent->psz_name) < i_len) 
-	  p_udf_dirent->psz_name = (char *)
-	    realloc(p_udf_dirent->psz_name, sizeof(char)*i_len+1);
-	
-	unicode16_decode(p_udf_dirent->fid->imp_use 
-			 + p_udf_dirent->fid->i_imp_use, 
-			 i_len, p_udf_dirent->psz_name);
-      }
-      return p_udf_dirent;
+  /* Chains are built back to front, so that a lookup finds the first
+     of several entries with the same name, as a scan would. */
+  for (i = p_dir->i_entries; i-- > 0; ) {
+    const unsigned int i_bucket = 
+      udf_name_hash(p_dir->entries[i].psz_name) & (p_dir->i_buckets - 1);
+    p_dir->entries[i].i_hash_next = p_dir->p_buckets[i_bucket];
+    p_dir->p_buckets[i_bucket] = i + 1;
+  }
+
+  if (!udf_dir_read_icbs(p_udf, p_dir)) {
+    udf_dir_free(p_dir);
+    return NULL;
+  }
+  return p_dir;
+}
+
+/* Return the index of the first entry of p_dir called psz_name, or -1
+   if there is none. */
+static int
+udf_dir_find(const udf_dir_t *p_dir, const char *psz_name)
+{
+  unsigned int i = 
+    p_dir->p_buckets[udf_name_hash(psz_name) & (p_dir->i_buckets - 1)];
+
+  for ( ; i; i = p_dir->entries[i-1].i_hash_next)
+    if (0 == strcmp(psz_name, p_dir->entries[i-1].psz_name))
+      return i - 1;
+  return -1;
+}
+
+static void
+_dir_cache_unlink_lru (udf_dir_cache_t *p_cache, udf_dir_t *p_dir)
+{
+  if (p_dir->p_lru_prev) 
+    p_dir->p_lru_prev->p_lru_next = p_dir->p_lru_next;
+  else
+    p_cache->p_lru_first = p_dir->p_lru_next;
+  if (p_dir->p_lru_next) 
+    p_dir->p_lru_next->p_lru_prev = p_dir->p_lru_prev;
+  else
+    p_cache->p_lru_last = p_dir->p_lru_prev;
+  p_dir->p_lru_prev = p_dir->p_lru_next = NULL;
+}
+
+static void
+_dir_cache_push_lru (udf_dir_cache_t *p_cache, udf_dir_t *p_dir)
+{
+  p_dir->p_lru_prev = NULL;
+  p_dir->p_lru_next = p_cache->p_lru_first;
+  if (p_cache->p_lru_first) 
+    p_cache->p_lru_first->p_lru_prev = p_dir;
+  else
+    p_cache->p_lru_last = p_dir;
+  p_cache->p_lru_first = p_dir;
+}
+
+/* Drop p_dir from the cache. It is freed once the last directory entry
+   using it lets go. The lock must be held. */
+static void
+_dir_cache_remove (udf_dir_cache_t *p_cache, udf_dir_t *p_dir)
+{
+  udf_dir_t **pp;
+
+  _dir_cache_unlink_lru(p_cache, p_dir);
+  for (pp = &p_cache->buckets[p_dir->lba % UDF_DIR_CACHE_BUCKETS];
+       *pp; pp = &(*pp)->p_hash_next)
+    if (*pp == p_dir) {
+      *pp = p_dir->p_hash_next;
+      break;
+    }
+  p_cache->i_bytes -= p_dir->i_bytes;
+  p_dir->b_cached = false;
+  if (0 == p_dir->i_refs) udf_dir_free(p_dir);
+}
+
+/* Return the cached directory at lba, making it the most recently
+   used, or NULL if it isn't cached. The lock must be held. */
+static udf_dir_t *
+_dir_cache_find (udf_dir_cache_t *p_cache, lba_t lba, uint64_t i_size)
+{
+  udf_dir_t *p_dir;
+
+  for (p_dir = p_cache->buckets[lba % UDF_DIR_CACHE_BUCKETS]; p_dir;
+       p_dir = p_dir->p_hash_next)
+    if (p_dir->lba == lba && p_dir->i_size == i_size) {
+      _dir_cache_unlink_lru(p_cache, p_dir);
+      _dir_cache_push_lru(p_cache, p_dir);
+      return p_dir;
     }
   return NULL;
 }
 
+/* Add p_new, read without the lock held, to the cache and return it.
+   If another thread got there first p_new is freed and the directory
+   already cached is returned instead. The lock must be held. */
+static udf_dir_t *
+_dir_cache_insert (udf_dir_cache_t *p_cache, udf_dir_t *p_new)
+{
+  udf_dir_t *p_dir = _dir_cache_find(p_cache, p_new->lba, p_new->i_size);
+
+  if (p_dir) {
+    udf_dir_free(p_new);
+    return p_dir;
+  }
+  while (p_cache->p_lru_last 
+	 && p_cache->i_bytes + p_new->i_bytes > UDF_DIR_CACHE_SIZE)
+    _dir_cache_remove(p_cache, p_cache->p_lru_last);
+  p_new->p_hash_next = p_cache->buckets[p_new->lba % UDF_DIR_CACHE_BUCKETS];
+  p_cache->buckets[p_new->lba % UDF_DIR_CACHE_BUCKETS] = p_new;
+  _dir_cache_push_lru(p_cache, p_new);
+  p_cache->i_bytes += p_new->i_bytes;
+  p_new->b_cached = true;
+  return p_new;
+}
+
+/* Get the directory whose file entry p_udf_fe is, from the cache of
+   p_udf when it's there, and take a reference to it. NULL is returned
+   on error. */
+static udf_dir_t *
+udf_dir_get(udf_t *p_udf, const udf_file_entry_t *p_udf_fe)
+{
+  const uint64_t i_size = uint64_from_le(p_udf_fe->info_len);
+  uint32_t i_start, i_end;
+  lba_t lba = CDIO_INVALID_LBA;
+  udf_dir_t *p_dir = NULL;
+
+  if (udf_get_lba(p_udf_fe, &i_start, &i_end))
+    lba = p_udf->i_part_start + i_start;
+  else if (ICBTAG_FLAG_AD_IN_ICB == 
+	   (uint16_from_le(p_udf_fe->icb_tag.flags) & ICBTAG_FLAG_AD_MASK))
+    /* The directory is in its file entry, so that's where it is. */
+    lba = p_udf->i_part_start + uint32_from_le(p_udf_fe->tag.loc);
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&p_udf->mutex);
+#endif
+  if (CDIO_INVALID_LBA != lba)
+    p_dir = _dir_cache_find(&p_udf->dir_cache, lba, i_size);
+  if (p_dir) p_dir->i_refs++;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&p_udf->mutex);
+#endif
+  if (p_dir) return p_dir;
+
+  p_dir = udf_dir_read(p_udf, p_udf_fe, lba);
+  if (!p_dir) return NULL;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&p_udf->mutex);
+#endif
+  if (CDIO_INVALID_LBA != lba && p_dir->i_bytes <= UDF_DIR_CACHE_SIZE / 4)
+    p_dir = _dir_cache_insert(&p_udf->dir_cache, p_dir);
+  p_dir->i_refs++;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&p_udf->mutex);
+#endif
+  return p_dir;
+}
+
+/* Let go of p_dir, got with udf_dir_get(). */
+static void
+udf_dir_release(udf_t *p_udf, udf_dir_t *p_dir)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&p_udf->mutex);
+#endif
+  if (0 == --p_dir->i_refs && !p_dir->b_cached) 
+    udf_dir_free(p_dir);
+#ifdef HAVE_PTHREAD
+  pthread_mutex_unlock(&p_udf->mutex);
+#endif
+}
+
+/* Read the directory p_udf_dirent stands for, unless that's done. This
+   must happen before p_udf_dirent moves to the first of its entries,
+   as that replaces the directory's file entry. */
+static bool
+udf_dirent_read_dir(udf_dirent_t *p_udf_dirent)
+{
+  if (!p_udf_dirent->p_dir)
+    p_udf_dirent->p_dir = udf_dir_get(p_udf_dirent->p_udf, 
+				      &p_udf_dirent->fe);
+  return NULL != p_udf_dirent->p_dir;
+}
+
+/* Make entry i_entry of its directory the one p_udf_dirent describes. */
+static void
+udf_dirent_set_entry(udf_dirent_t *p_udf_dirent, unsigned int i_entry)
+{
+  const udf_dir_entry_t *p_entry = &p_udf_dirent->p_dir->entries[i_entry];
+  const size_t i_len = strlen(p_entry->psz_name);
+
+  p_udf_dirent->fid = p_entry->fid;
+  p_udf_dirent->b_dir = 
+    (p_entry->fid->file_characteristics & UDF_FILE_DIRECTORY) != 0;
+  p_udf_dirent->b_parent = 
+    (p_entry->fid->file_characteristics & UDF_FILE_PARENT) != 0;
+
+  if (p_entry->fe)
+    memcpy(&(p_udf_dirent->fe), p_entry->fe, udf_get_fe_size(p_entry->fe));
+  else
+    memset(&(p_udf_dirent->fe), 0, sizeof(udf_file_entry_t));
+
+  if (!p_udf_dirent->psz_name || strlen(p_udf_dirent->psz_name) < i_len) {
+    char *psz_name = realloc(p_udf_dirent->psz_name, i_len + 1);
+    if (!psz_name) return;
+    p_udf_dirent->psz_name = psz_name;
+  }
+  strcpy(p_udf_dirent->psz_name, p_entry->psz_name);
+  p_udf_dirent->i_next = i_entry + 1;
+}
+
+udf_dirent_t * 
+udf_opendir(const udf_dirent_t *p_udf_dirent)
+{
+  if (p_udf_dirent->b_dir && !p_udf_dirent->b_parent && p_udf_dirent->fid) {
+    /* udf_readdir has already fetched the file entry. */
+    const udf_file_entry_t *p_udf_fe = &p_udf_dirent->fe;
+    
+    if (!udf_checktag(&p_udf_fe->tag, TAGID_FILE_ENTRY)
+	&& ICBTAG_FILE_TYPE_DIRECTORY == p_udf_fe->icb_tag.file_type) {
+      udf_dirent_t *p_udf_dirent_new = 
+	udf_new_dirent((udf_file_entry_t *) p_udf_fe, p_udf_dirent->p_udf,
+		       p_udf_dirent->psz_name, true, true);
+      return p_udf_dirent_new;
+    }
+  }
+  return NULL;
+}
+
+/*!
+  Advance p_udf_dirent to the next entry of its directory. The first
+  call reads the whole directory, going through the directory cache of
+  the udf_t, so that later calls, and later lookups in the same
+  directory, need no I/O.
+*/
+udf_dirent_t *
+udf_readdir(udf_dirent_t *p_udf_dirent)
+{
+  if (!udf_dirent_read_dir(p_udf_dirent)
+      || p_udf_dirent->i_next >= p_udf_dirent->p_dir->i_entries) {
+    udf_dirent_free(p_udf_dirent);
+    return NULL;
+  }
+  udf_dirent_set_entry(p_udf_dirent, p_udf_dirent->i_next);
+  return p_udf_dirent;
+}
+
 /*!
   free free resources associated with p_udf_dirent.
 */
@@ -686,8 +1152,9 @@ udf_dirent_free(udf_dirent_t *p_udf_dirent)
 {
   if (p_udf_dirent) {
     p_udf_dirent->fid = NULL;
+    if (p_udf_dirent->p_dir)
+      udf_dir_release(p_udf_dirent->p_udf, p_udf_dirent->p_dir);
     free_and_null(p_udf_dirent->psz_name);
-    free_and_null(p_udf_dirent->sector);
     free_and_null(p_udf_dirent);
   }
   return true;
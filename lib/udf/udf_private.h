@@ -29,6 +29,73 @@
 #include <cdio/udf.h>
 #include "_cdio_stdio.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* Directories read through a udf_t are kept, decoded, in a small LRU
+   cache, see udf_readdir(). */
+#define UDF_DIR_CACHE_SIZE    (4 * 1024 * 1024)
+#define UDF_DIR_CACHE_BUCKETS 64
+
+/* One File Identifier Descriptor of a directory, with the file entry it
+   refers to and its decoded name. */
+typedef struct udf_dir_entry_s
+{
+  udf_fileid_desc_t *fid;         /* in the directory's data */
+  udf_file_entry_t  *fe;          /* NULL if it couldn't be read */
+  char              *psz_name;
+  unsigned int       i_hash_next; /* 1 + index of the next entry whose 
+                                     name has the same hash; 0 ends */
+} udf_dir_entry_t;
+
+/* A directory as read by udf_readdir(). Once read it doesn't change,
+   so any number of directory entries, in any threads, may share it. */
+typedef struct udf_dir_s udf_dir_t;
+
+struct udf_dir_s
+{
+  lba_t              lba;         /* start of the directory's data, */
+  uint64_t           i_size;      /* and its length: the cache key */
+  unsigned int       i_refs;      /* directory entries using it */
+  bool               b_cached;
+  size_t             i_bytes;     /* memory it takes up */
+  unsigned int       i_entries;
+  udf_dir_entry_t   *entries;     /* in directory order */
+  unsigned int       i_buckets;   /* a power of 2 */
+  unsigned int      *p_buckets;   /* 1 + index of the first entry with
+                                     each name hash; 0 if none */
+  uint8_t           *p_data;      /* the directory's data: its FIDs */
+  uint8_t           *p_fes;       /* the file entries, one after another */
+  char              *p_names;
+  udf_dir_t         *p_hash_next;
+  udf_dir_t         *p_lru_prev;  /* toward most recently used */
+  udf_dir_t         *p_lru_next;  /* toward least recently used */
+};
+
+typedef struct {
+  udf_dir_t         *buckets[UDF_DIR_CACHE_BUCKETS];
+  udf_dir_t         *p_lru_first;
+  udf_dir_t         *p_lru_last;
+  size_t             i_bytes;
+} udf_dir_cache_t;
+
+/* A volume descriptor sequence is at least 16 blocks (ECMA 167r3
+   3/8.4.2); udf_open() reads one of up to this many blocks in a single
+   request. */
+#define UDF_VDS_MAX_BLOCKS 256
+
+/* Partition descriptors udf_open() keeps from the volume descriptor
+   sequence, for udf_get_root(). */
+#define UDF_MAX_PARTITIONS 8
+
+typedef struct udf_part_s
+{
+  partition_num_t    i_number;
+  uint32_t           i_start;     /* first block of the partition */
+  uint32_t           i_seq;       /* volume descriptor sequence number */
+} udf_part_t;
+
 /* Implementation of opaque types */
 
 struct udf_s {
@@ -39,10 +106,21 @@ struct udf_s {
   CdIo_t                *cdio;    /* Cdio pointer if read device */
   anchor_vol_desc_ptr_t anchor_vol_desc_ptr;
   uint32_t              pvd_lba;  /* sector of Primary Volume Descriptor */
+  udf_pvd_t             pvd;      /* and a copy of it */
   partition_num_t       i_partition;  /* partition number */
   uint32_t              i_part_start; /* start of Partition Descriptor */
   uint32_t              lvd_lba;      /* sector of Logical Volume Descriptor */
+  uint32_t              lvd_seq;      /* its volume descriptor sequence
+                                         number */
   uint32_t              fsd_offset;   /* lba of fileset descriptor */
+  unsigned int          i_parts;      /* Partition Descriptors found */
+  udf_part_t            parts[UDF_MAX_PARTITIONS];
+  udf_dir_cache_t       dir_cache;
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t       mutex;    /* Guards dir_cache and serializes
+                                     reads when the source can't read
+                                     without seeking. */
+#endif
 };
 
 struct udf_dirent_s
@@ -55,14 +133,43 @@ struct udf_dirent_s
   udf_t             *p_udf;
   uint32_t           i_part_start;
   uint32_t           i_loc, i_loc_end;
-  uint64_t           dir_left;
-  uint8_t           *sector;
+  udf_dir_t         *p_dir;    /* entries of this directory, once read */
+  unsigned int       i_next;   /* index in p_dir of the next entry */
   udf_fileid_desc_t *fid;
 
  /* This field has to come last because it is variable in length. */
   udf_file_entry_t   fe;
 };
 
+/* A run of a file: i_len bytes from file offset i_offset on, stored
+   from absolute block i_lba on. If nothing is recorded for the run,
+   i_lba is CDIO_INVALID_LBA and the run reads as zeros. */
+typedef struct udf_extent_s
+{
+  uint64_t           i_offset;
+  uint64_t           i_len;
+  lba_t              i_lba;
+} udf_extent_t;
+
+/* A file opened for reading. It keeps its own copy of the file entry,
+   so it doesn't depend on the directory entry it was opened from. */
+struct udf_file_s
+{
+  udf_t             *p_udf;
+  uint64_t           i_size;      /* file length in bytes */
+  off_t              i_position;  /* where udf_file_read() reads next */
+  udf_extent_t      *p_extents;   /* the file's runs, in file order */
+  unsigned int       i_extents;
+
+ /* This field has to come last because it is variable in length. */
+  udf_file_entry_t   fe;
+};
+
+ssize_t udf_pread_fe(const udf_t *p_udf, const udf_file_entry_t *p_udf_fe,
+                     void *buf, size_t count, off_t i_offset);
+
+unsigned int udf_get_fe_size(const udf_file_entry_t *p_udf_fe);
+
 bool udf_get_lba(const udf_file_entry_t *p_udf_fe, 
                  /*out*/ uint32_t *start, /*out*/ uint32_t *end);
 
@@ -513,9 +513,11 @@ static void
 print_iso9660_recurse (CdIo_t *p_cdio, const char pathname[], 
 		       cdio_fs_anal_t fs)
 {
-  CdioList_t *p_entlist;
-  CdioList_t *p_dirlist =  _cdio_list_new ();
-  CdioListNode_t *entnode;
+  CdioVector_t *p_entlist;
+  CdioVector_t *p_dirlist =  _cdio_vector_new ();
+  iso9660_stat_t *p_statbuf;
+  char *psz_dirname;
+  unsigned int i;
   uint8_t i_joliet_level;
   char *translated_name = (char *) malloc(4096);
   size_t translated_name_size = 4096;
@@ -524,7 +526,7 @@ print_iso9660_recurse (CdIo_t *p_cdio, const char pathname[],
     ? 0
     : cdio_get_joliet_level(p_cdio);
 
-  p_entlist = iso9660_fs_readdir (p_cdio, pathname, false);
+  p_entlist = iso9660_fs_readdir_vector (p_cdio, pathname);
     
   printf ("%s:\n", pathname);
 
@@ -535,9 +537,8 @@ print_iso9660_recurse (CdIo_t *p_cdio, const char pathname[],
 
   /* Iterate over files in this directory */
   
-  _CDIO_LIST_FOREACH (entnode, p_entlist)
+  _CDIO_VECTOR_FOREACH (i, p_statbuf, p_entlist)
     {
-      iso9660_stat_t *p_statbuf = _cdio_list_node_data (entnode);
       char *psz_iso_name = p_statbuf->filename;
       char _fullname[4096] = { 0, };
        if (strlen(psz_iso_name) >= translated_name_size) {
@@ -564,7 +565,7 @@ print_iso9660_recurse (CdIo_t *p_cdio, const char pathname[],
       if (p_statbuf->type == _STAT_DIR
           && strcmp (psz_iso_name, ".") 
           && strcmp (psz_iso_name, ".."))
-        _cdio_list_append (p_dirlist, strdup (_fullname));
+        _cdio_vector_append (p_dirlist, strdup (_fullname));
 
       print_fs_attrs(p_statbuf, 0 == opts.no_rock_ridge, fs & CDIO_FS_ANAL_XA, 
 		     psz_iso_name, translated_name);
@@ -575,20 +576,16 @@ print_iso9660_recurse (CdIo_t *p_cdio, const char pathname[],
     }
     free (translated_name);
 
-  _cdio_list_free (p_entlist, true);
+  _cdio_vector_free (p_entlist, true);
 
   printf ("\n");
 
   /* Now recurse over the directories. */
 
-  _CDIO_LIST_FOREACH (entnode, p_dirlist)
-    {
-      char *_fullname = _cdio_list_node_data (entnode);
-
-      print_iso9660_recurse (p_cdio, _fullname, fs);
-    }
+  _CDIO_VECTOR_FOREACH (i, psz_dirname, p_dirlist)
+    print_iso9660_recurse (p_cdio, psz_dirname, fs);
 
-  _cdio_list_free (p_dirlist, true);
+  _cdio_vector_free (p_dirlist, true);
 }
 
 static void
@@ -76,15 +76,25 @@ buffering_write(int fd, char *buffer, long num)
   }
   
   if (bw_pos + num > OUTBUFSZ) {
-    /* fill our buffer first, then write, then modify buffer and num */
-    memcpy(&bw_outbuf[bw_pos], buffer, OUTBUFSZ - bw_pos);
-    if (blocking_write(fd, bw_outbuf, OUTBUFSZ)) {
-      perror("write (in buffering_write, full buffer)");
-      return(-1);
+    if (bw_pos > 0) {
+      /* fill our buffer first, then write, then modify buffer and num */
+      memcpy(&bw_outbuf[bw_pos], buffer, OUTBUFSZ - bw_pos);
+      if (blocking_write(fd, bw_outbuf, OUTBUFSZ)) {
+	perror("write (in buffering_write, full buffer)");
+	return(-1);
+      }
+      num -= (OUTBUFSZ - bw_pos);
+      buffer += (OUTBUFSZ - bw_pos);
+      bw_pos = 0;
+    }
+    if (num >= OUTBUFSZ) {
+      /* a buffer's worth or more: write it straight from the caller's */
+      if (blocking_write(fd, buffer, num)) {
+	perror("write (in buffering_write, large buffer)");
+	return(-1);
+      }
+      return(0);
     }
-    num -= (OUTBUFSZ - bw_pos);
-    buffer += (OUTBUFSZ - bw_pos);
-    bw_pos = 0;
   }
   /* save data */
   memcpy(&bw_outbuf[bw_pos], buffer, num);
@@ -93,6 +103,23 @@ buffering_write(int fd, char *buffer, long num)
   return(0);
 }
 
+/** buffering_flush() - writes out the data buffered for fd, so that
+ * it is all in the file.
+ *
+ */
+int
+buffering_flush(int fd)
+{
+  if (fd == bw_fd && bw_pos > 0) {
+    if (blocking_write(fd, bw_outbuf, bw_pos)) {
+      perror("write (in buffering_flush)");
+      return(-1);
+    }
+    bw_pos = 0;
+  }
+  return(0);
+}
+
 /** buffering_close() - writes out remaining buffered data before
  * closing file.
  *
@@ -26,6 +26,12 @@
  */
 extern long buffering_write(int outf, char *buffer, long num);
 
+/** buffering_flush() - writes out the data buffered for fd, so that
+ * it is all in the file.
+ *
+ */
+extern int buffering_flush(int fd);
+
 /** buffering_close() - writes out remaining buffered data before
  * closing file.
  *
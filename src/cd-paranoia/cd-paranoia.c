@@ -86,6 +86,10 @@ static void gettimeofday(struct timeval* tv, void* timezone);
 #include "header.h"
 #include "buffering_write.h"
 
+/* The most sectors taken from paranoia_read_range() at once; a second
+   of audio. */
+#define READ_RANGE_SECTORS 75
+
 extern int verbose;
 extern int quiet;
 
@@ -290,6 +294,45 @@ static int skipped_flag=0;
 static int abort_on_skip=0;
 static FILE *logfile = NULL;
 
+/* The checksums of the tracks ripped, by track number, for
+   --checksums, and where on the disc the next sample written is, in
+   stereo samples from the start of the (sample-offset) disc. */
+typedef struct {
+  cdio_paranoia_checksum_t sum;
+  long i_sectors;
+} track_checksum_t;
+
+static track_checksum_t *track_sums = NULL;
+static long sum_pos;
+
+/* For --journal, what it takes to carry on with a rip cut short:
+   the rip, the output file being written and how far paranoia has
+   got.  It is written to the journal every JOURNAL_SECTORS sectors
+   and when the rip is done the journal is removed. */
+#define JOURNAL_SECTORS 750
+#define JOURNAL_MAGIC "cd-paranoia journal 1"
+
+typedef struct {
+  /* the rip: the disc, the span and what is made of it */
+  int i_tracks;
+  long i_disc_last;
+  long i_first_lsn, i_last_lsn;
+  int batch, output_type, output_endian, checksums;
+  long sample_offset;
+  /* the output file, from sector batch_first; i_bytes of audio are
+     written after its header of i_header bytes */
+  char outfile_name[256];
+  long batch_first;
+  long i_header;
+  long i_bytes;
+  uint32_t i_crc32;
+  long sum_pos;
+  cdio_paranoia_state_t state;
+} journal_t;
+
+static char *journal_name = NULL;
+static journal_t journal;
+
 #if TRACE_PARANOIA
 static void
 callback(long int inpos, paranoia_cb_mode_t function)
@@ -545,11 +588,13 @@ callback(long int inpos, paranoia_cb_mode_t function)
 }
 #endif /* !TRACE_PARANOIA */
 
-static const char optstring[] = "aBcCd:efg:hi:l:m:n:o:O:pqQrRsS:Tt:VvwWx:XYZz::";
+static const char optstring[] = "2aBcCd:eEfg:hi:j:kl:m:n:o:O:pPqQrRsS:Tt:VvwWx:XYZz::";
 
 static const struct option options [] = {
 	{"abort-on-skip",             no_argument,       NULL, 'X'},
 	{"batch",                     no_argument,       NULL, 'B'},
+	{"c2-errors",                 no_argument,       NULL, '2'},
+	{"checksums",                 no_argument,       NULL, 'k'},
 	{"disable-extra-paranoia",    no_argument,       NULL, 'Y'},
 	{"disable-fragmentation",     no_argument,       NULL, 'F'},
 	{"disable-paranoia",          no_argument,       NULL, 'Z'},
@@ -561,6 +606,7 @@ static const struct option options [] = {
 	{"force-read-speed",          required_argument, NULL, 'S'},
 	{"force-search-overlap",      required_argument, NULL, 'o'},
 	{"help",                      no_argument,       NULL, 'h'},
+	{"journal",                   required_argument, NULL, 'j'},
  	{"log-summary",               required_argument, NULL, 'l'},
 	{"mmc-timeout",               required_argument, NULL, 'm'},
 	{"never-skip",                optional_argument, NULL, 'z'},
@@ -570,11 +616,13 @@ static const struct option options [] = {
 	{"output-raw-big-endian",     no_argument,       NULL, 'R'},
 	{"output-raw-little-endian",  no_argument,       NULL, 'r'},
 	{"output-wav",                no_argument,       NULL, 'w'},
+	{"pipeline",                  no_argument,       NULL, 'P'},
 	{"query",                     no_argument,       NULL, 'Q'},
 	{"quiet",                     no_argument,       NULL, 'q'},
 	{"sample-offset",             required_argument, NULL, 'O'},
 	{"search-for-drive",          no_argument,       NULL, 's'},
 	{"stderr-progress",           no_argument,       NULL, 'e'},
+	{"test-and-copy",             no_argument,       NULL, 'E'},
 	{"test-mode",                 required_argument, NULL, 'x'},
 	{"toc-bias",                  no_argument,       NULL, 'T'},
 	{"toc-offset",                required_argument, NULL, 't'},
@@ -614,6 +662,8 @@ cleanup (void)
   if (d) cdda_close(d);
   free_and_null(force_cdrom_device);
   free_and_null(span);
+  free_and_null(track_sums);
+  free_and_null(journal_name);
   if(logfile && logfile != stdout) {
       fclose(logfile);
       logfile = NULL;
@@ -656,6 +706,267 @@ get_int_arg(char c, long int *pi_arg)
   }
 }
 
+/* Sum n bytes of audio about to be written into the checksums of the
+   tracks they are of.  They are byte-swapped from the order of this
+   host if b_swapped. */
+static void
+checksum_audio(const char *buf, long n, bool b_swapped)
+{
+  int16_t host[CD_FRAMEWORDS];
+
+  while (n >= 4) {
+    const lsn_t lsn = sum_pos / (CD_FRAMEWORDS/2);
+    const int i_track = cdda_sector_gettrack(d, lsn);
+    const bool b_track = i_track >= 1 && i_track <= CDIO_CD_MAX_TRACKS
+      && track_sums[i_track].i_sectors;
+    /* up to the end of the track, or of the sector if not in one */
+    long i_bytes = ((b_track ? cdda_track_lastsector(d, i_track) : lsn) + 1)
+      * CDIO_CD_FRAMESIZE_RAW - sum_pos * 4;
+    long i;
+
+    if (i_bytes > n) i_bytes = n;
+    if (i_bytes > CDIO_CD_FRAMESIZE_RAW) i_bytes = CDIO_CD_FRAMESIZE_RAW;
+    if (b_track) {
+      const int16_t *samples = (const int16_t *) buf;
+      if (b_swapped) {
+	for (i=0; i<i_bytes/2; i++)
+	  host[i]=UINT16_SWAP_LE_BE_C(samples[i]);
+	samples = host;
+      }
+      paranoia_checksum_add(&track_sums[i_track].sum, samples, i_bytes/2);
+    }
+    buf += i_bytes;
+    n -= i_bytes;
+    sum_pos += i_bytes/4;
+  }
+}
+
+/* Write n bytes of audio, summing them first for --checksums and
+   --journal. */
+static int
+write_audio(int fd, char *buf, long n, bool b_swapped)
+{
+  if (track_sums)
+    checksum_audio(buf, n, b_swapped);
+  if (journal_name) {
+    journal.i_crc32 = paranoia_crc32(journal.i_crc32, buf, n);
+    journal.i_bytes += n;
+  }
+  return buffering_write(fd, buf, n);
+}
+
+/* Write the journal: first the audio it vouches for to the output
+   file out, then the journal to a file of its own, put in place of
+   the last one at once. */
+static bool
+write_journal(int out)
+{
+  char tmp_name[1024];
+  const long *o1 = journal.state.i_stage1;
+  const long *o2 = journal.state.i_stage2;
+  FILE *f;
+  int i_track;
+  bool b_ok;
+
+  if (buffering_flush(out))
+    return false;
+#ifdef HAVE_FSYNC
+  if (fsync(out))
+    return false;
+#endif
+
+  snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", journal_name);
+  f = fopen(tmp_name, "w");
+  if (!f)
+    return false;
+  fprintf(f, "%s\n", JOURNAL_MAGIC);
+  fprintf(f, "disc %d %ld\n", journal.i_tracks, journal.i_disc_last);
+  fprintf(f, "span %ld %ld\n", journal.i_first_lsn, journal.i_last_lsn);
+  fprintf(f, "options %d %d %d %d %ld\n", journal.batch,
+	  journal.output_type, journal.output_endian, journal.checksums,
+	  journal.sample_offset);
+  fprintf(f, "file %ld %ld %ld %08x %ld\n", journal.batch_first,
+	  journal.i_header, journal.i_bytes, journal.i_crc32,
+	  journal.sum_pos);
+  fprintf(f, "paranoia %ld %ld %ld "
+	  "%ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld\n",
+	  (long) journal.state.i_cursor, journal.state.i_dyndrift,
+	  journal.state.i_dynoverlap,
+	  o1[0], o1[1], o1[2], o1[3], o1[4], o1[5],
+	  o2[0], o2[1], o2[2], o2[3], o2[4], o2[5]);
+  for (i_track=1; track_sums && i_track<=CDIO_CD_MAX_TRACKS; i_track++) {
+    const cdio_paranoia_checksum_t *sum = &track_sums[i_track].sum;
+    if (!sum->i_samples) continue;
+    fprintf(f, "sum %d %08x %08x %08x %u %08x %u %u\n", i_track,
+	    sum->i_crc32, sum->i_ar_v1, sum->i_ar_v2, sum->i_samples,
+	    sum->i_ar_hi, sum->i_ar_from, sum->i_ar_to);
+  }
+  /* last, being the rest of its line */
+  fprintf(f, "output %s\n", journal.outfile_name);
+
+  b_ok = 0 == fflush(f);
+#ifdef HAVE_FSYNC
+  b_ok = b_ok && 0 == fsync(fileno(f));
+#endif
+  b_ok = 0 == fclose(f) && b_ok;
+  if (!b_ok || rename(tmp_name, journal_name)) {
+    unlink(tmp_name);
+    return false;
+  }
+  return true;
+}
+
+/* Read the journal in f into j and the checksums it has, if any,
+   into track_sums.  Returns false if it is not one. */
+static bool
+read_journal(FILE *f, journal_t *j)
+{
+  char line[1024];
+  bool b_file = false, b_paranoia = false;
+
+  if (!fgets(line, sizeof(line), f)
+      || strncmp(line, JOURNAL_MAGIC "\n", sizeof(JOURNAL_MAGIC)))
+    return false;
+  memset(j, 0, sizeof(*j));
+
+  while (fgets(line, sizeof(line), f)) {
+    long *o1 = j->state.i_stage1;
+    long *o2 = j->state.i_stage2;
+    unsigned int crc, v1, v2, samples, hi, from, to;
+    long cursor;
+    int i_track;
+
+    if (1 == sscanf(line, "sum %d", &i_track)) {
+      cdio_paranoia_checksum_t *sum;
+      if (!track_sums)
+	continue; /* the options will not match */
+      if (i_track < 1 || i_track > CDIO_CD_MAX_TRACKS
+	  || 8 != sscanf(line, "sum %d %x %x %x %u %x %u %u", &i_track,
+			 &crc, &v1, &v2, &samples, &hi, &from, &to))
+	return false;
+      sum = &track_sums[i_track].sum;
+      sum->i_crc32 = crc;
+      sum->i_ar_v1 = v1;
+      sum->i_ar_v2 = v2;
+      sum->i_samples = samples;
+      sum->i_ar_hi = hi;
+      sum->i_ar_from = from;
+      sum->i_ar_to = to;
+    } else if (0 == strncmp(line, "output ", 7)) {
+      const size_t i_len = strcspn(line + 7, "\n");
+      /* No output file name of ours is this long: the journal is not
+	 ours either. */
+      if (i_len >= sizeof(j->outfile_name))
+	return false;
+      memcpy(j->outfile_name, line + 7, i_len);
+      j->outfile_name[i_len] = '\0';
+      return b_file && b_paranoia;
+    } else if (5 == sscanf(line, "file %ld %ld %ld %x %ld", &j->batch_first,
+			   &j->i_header, &j->i_bytes, &crc, &j->sum_pos)) {
+      j->i_crc32 = crc;
+      b_file = true;
+    } else if (15 == sscanf(line, "paranoia %ld %ld %ld "
+			    "%ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld",
+			    &cursor, &j->state.i_dyndrift,
+			    &j->state.i_dynoverlap,
+			    &o1[0], &o1[1], &o1[2], &o1[3], &o1[4], &o1[5],
+			    &o2[0], &o2[1], &o2[2], &o2[3], &o2[4], &o2[5])) {
+      j->state.i_cursor = cursor;
+      b_paranoia = true;
+    } else if (2 != sscanf(line, "disc %d %ld", &j->i_tracks,
+			   &j->i_disc_last)
+	       && 2 != sscanf(line, "span %ld %ld", &j->i_first_lsn,
+			      &j->i_last_lsn)
+	       && 5 != sscanf(line, "options %d %d %d %d %ld", &j->batch,
+			      &j->output_type, &j->output_endian,
+			      &j->checksums, &j->sample_offset))
+      return false;
+  }
+  /* cut short before the output file */
+  return false;
+}
+
+/* Open the output file named psz_name afresh or, when resuming, as
+   the journal left it: the audio in it checked against the journal's
+   CRC32 and anything after that cut off. */
+static int
+open_output(char *psz_name, bool b_resume)
+{
+  char buf[CDIO_CD_FRAMESIZE_RAW * 16];
+  uint32_t i_crc32 = 0;
+  long i_pos;
+  int fd;
+
+  if (!b_resume)
+    return open(psz_name, O_RDWR|O_CREAT|O_TRUNC, 0666);
+
+  if (strcmp(psz_name, journal.outfile_name)) {
+    report3("The journal %s is of a rip to %s; remove it to rip afresh.",
+	    journal_name, journal.outfile_name);
+    exit(1);
+  }
+  fd = open(psz_name, O_RDWR);
+  if (fd == -1)
+    return -1;
+
+  for (i_pos = 0; i_pos < journal.i_header + journal.i_bytes; ) {
+    long n = journal.i_header + journal.i_bytes - i_pos;
+    if (n > (long) sizeof(buf)) n = sizeof(buf);
+    n = read(fd, buf, n);
+    if (n <= 0) break;
+    if (i_pos + n > journal.i_header) {
+      const long i_skip = i_pos < journal.i_header
+	? journal.i_header - i_pos : 0;
+      i_crc32 = paranoia_crc32(i_crc32, buf + i_skip, n - i_skip);
+    }
+    i_pos += n;
+  }
+  if (i_pos < journal.i_header + journal.i_bytes
+      || i_crc32 != journal.i_crc32) {
+    report3("%s is not as the journal %s left it; remove the journal "
+	    "to rip afresh.", psz_name, journal_name);
+    exit(1);
+  }
+
+  /* what was written after the journal's last word is not vouched
+     for, so it is read again */
+#ifdef HAVE_FTRUNCATE
+  if (ftruncate(fd, i_pos)) {
+    close(fd);
+    return -1;
+  }
+#endif
+  lseek(fd, i_pos, SEEK_SET);
+  return fd;
+}
+
+/* Print the checksums of the tracks ripped and the AccurateRip
+   identification of the disc to look them up by. */
+static void
+print_checksums(FILE *f, const cdio_paranoia_accuraterip_id_t *p_id)
+{
+  int i_track;
+
+  if (p_id->i_tracks)
+    fprintf(f, "AccurateRip disc dBAR-%03d-%08x-%08x-%08x:\n"
+	    "  http://www.accuraterip.com/accuraterip/%x/%x/%x/"
+	    "dBAR-%03d-%08x-%08x-%08x.bin\n",
+	    p_id->i_tracks, p_id->i_id1, p_id->i_id2, p_id->i_cddb,
+	    p_id->i_id1 & 0xf, (p_id->i_id1 >> 4) & 0xf,
+	    (p_id->i_id1 >> 8) & 0xf,
+	    p_id->i_tracks, p_id->i_id1, p_id->i_id2, p_id->i_cddb);
+  fprintf(f, "track  CRC32     AR v1     AR v2\n");
+  for (i_track=1; i_track<=CDIO_CD_MAX_TRACKS; i_track++) {
+    const track_checksum_t *t = &track_sums[i_track];
+    if (!t->sum.i_samples) continue;
+    fprintf(f, "%5d  %08x  %08x  %08x%s\n", i_track, t->sum.i_crc32,
+	    t->sum.i_ar_v1, t->sum.i_ar_v2,
+	    t->sum.i_samples < t->i_sectors * (CD_FRAMEWORDS/2)
+	    ? "  (part of the track only)" : "");
+  }
+  fflush(f);
+}
+
 int 
 main(int argc,char *argv[])
 {
@@ -665,6 +976,9 @@ main(int argc,char *argv[])
   int   output_endian        =  0; /* -1=host, 0=little, 1=big */
   int   query_only           =  0;
   int   batch                =  0;
+  int   pipeline             =  0;
+  int   checksums            =  0;
+  cdio_paranoia_accuraterip_id_t accuraterip_id;
   long int force_cdrom_overlap  = -1;
   long int force_cdrom_sectors  = -1;
   long int force_cdrom_speed    = -1;
@@ -703,6 +1017,12 @@ main(int argc,char *argv[])
       fprintf(stderr,
 	      "Sending all callback output to stderr for wrapper script\n");
       break;
+    case 'E':
+      paranoia_mode|=PARANOIA_MODE_TESTCOPY;
+      break;
+    case '2':
+      paranoia_mode|=PARANOIA_MODE_C2;
+      break;
     case 'f':
       output_type=3;
       output_endian=1;
@@ -757,6 +1077,16 @@ main(int argc,char *argv[])
       output_type=0;
       output_endian=-1;
       break;
+    case 'P':
+      pipeline=1;
+      break;
+    case 'j':
+      if (journal_name) free(journal_name);
+      journal_name=strdup(optarg);
+      break;
+    case 'k':
+      checksums=1;
+      break;
     case 'r':
       output_type=0;
       output_endian=0;
@@ -953,6 +1283,11 @@ main(int argc,char *argv[])
 
   if (query_only) exit(0);
 
+  /* AccurateRip knows the disc by its table of contents as it is,
+     before any offset below. */
+  if (checksums)
+    paranoia_accuraterip_id(d, &accuraterip_id);
+
   /* bias the disc.  A hack.  Of course. this is never the default. */
   /* 
      Some CD-ROM/CD-R drives will add an offset to the position on
@@ -1084,13 +1419,19 @@ main(int argc,char *argv[])
 
     {
       long cursor;
+      bool b_resume=false;
+      long journal_cursor;
       int16_t offset_buffer[1176];
+      /* sectors read from paranoia at a time, at most */
+      int16_t readbuf_range[READ_RANGE_SECTORS*CD_FRAMEWORDS];
       int offset_buffer_used=0;
       int offset_skip=sample_offset*4;
 
       p=paranoia_init(d);
       paranoia_modeset(p,paranoia_mode);
       if(force_cdrom_overlap!=-1)paranoia_overlapset(p,force_cdrom_overlap);
+      if(pipeline && !paranoia_set_pipeline(p,true))
+	report("Built without threads; reading without pipelining.");
 
       if(verbose) {
 	cdda_verbose_set(d,CDDA_MESSAGE_LOGIT,CDDA_MESSAGE_LOGIT);
@@ -1113,13 +1454,88 @@ main(int argc,char *argv[])
 	 need to set the disc length forward here so that the libs are
 	 willing to read past, assuming that works on the hardware, of
 	 course */
+      if (checksums) {
+	const int i_first_audio = cdda_sector_gettrack(d, cdda_disc_firstsector(d));
+	const int i_last_audio = cdda_sector_gettrack(d, cdda_disc_lastsector(d));
+	int i_track;
+
+	track_sums = calloc(CDIO_CD_MAX_TRACKS+1, sizeof(track_checksum_t));
+	for (i_track=i_first_audio; i_track<=i_last_audio; i_track++) {
+	  track_checksum_t *t = &track_sums[i_track];
+	  if (!cdda_track_audiop(d, i_track)) continue;
+	  t->i_sectors = cdda_track_lastsector(d, i_track)
+	    - cdda_track_firstsector(d, i_track) + 1;
+	  paranoia_checksum_init(&t->sum, t->i_sectors,
+				 i_track == i_first_audio,
+				 i_track == i_last_audio);
+	}
+      }
+
+      if (journal_name && optind+1<argc && !strcmp(argv[optind+1],"-")) {
+	report("Not keeping a journal of a rip to stdout.");
+	free_and_null(journal_name);
+      }
+      if (journal_name) {
+	FILE *f = fopen(journal_name, "r");
+
+	journal.i_tracks = d->tracks;
+	journal.i_disc_last = cdda_disc_lastsector(d);
+	journal.i_first_lsn = i_first_lsn;
+	journal.i_last_lsn = i_last_lsn;
+	journal.batch = batch;
+	journal.output_type = output_type;
+	journal.output_endian = output_endian;
+	journal.checksums = checksums;
+	journal.sample_offset = sample_offset;
+
+	if (f) {
+	  journal_t j;
+	  if (!read_journal(f, &j)) {
+	    report2("%s is not a journal of cd-paranoia.", journal_name);
+	    exit(1);
+	  }
+	  fclose(f);
+	  if (j.i_tracks != journal.i_tracks
+	      || j.i_disc_last != journal.i_disc_last
+	      || j.i_first_lsn != journal.i_first_lsn
+	      || j.i_last_lsn != journal.i_last_lsn
+	      || j.batch != journal.batch
+	      || j.output_type != journal.output_type
+	      || j.output_endian != journal.output_endian
+	      || j.checksums != journal.checksums
+	      || j.sample_offset != journal.sample_offset) {
+	    report2("The journal %s is of another disc, span or options; "
+		    "remove it to rip afresh.", journal_name);
+	    exit(1);
+	  }
+	  journal = j;
+	  /* carry on from the last sector the journal vouches for */
+	  cursor = paranoia_resume(p, &journal.state);
+	  if (cursor == -1 || cursor <= i_first_lsn || cursor > i_last_lsn) {
+	    report2("The journal %s is cut short; remove it to rip afresh.",
+		    journal_name);
+	    exit(1);
+	  }
+	  offset_skip = 0;
+	  b_resume = true;
+	  {
+	    char buffer[256];
+	    snprintf(buffer, sizeof(buffer),
+		     "Resuming from sector %ld, as journaled in %s\n",
+		     cursor, journal_name);
+	    report(buffer);
+	  }
+	}
+      }
+      journal_cursor=cursor;
+
       if(sample_offset)
 	d->disc_toc[d->tracks].dwStartSector++;
 
       while(cursor<=i_last_lsn){
 	char outfile_name[256];
 	if ( batch ){
-	  batch_first = cursor;
+	  batch_first = b_resume ? journal.batch_first : cursor;
 	  batch_track = cdda_sector_gettrack(d,cursor);
 	  batch_last  = cdda_track_lastsector(d, batch_track);
 	  if (batch_last>i_last_lsn) batch_last=i_last_lsn;
@@ -1181,7 +1597,7 @@ main(int argc,char *argv[])
 	      }
 	    }
 	    
-	    out=open(outfile_name,O_RDWR|O_CREAT|O_TRUNC,0666);
+	    out=open_output(outfile_name,b_resume);
 	    if(out==-1){
 	      report3("Cannot open specified output file %s: %s",
 		      outfile_name, strerror(errno));
@@ -1215,7 +1631,7 @@ main(int argc,char *argv[])
 	    break;
 	  }
 	  
-	  out = open(outfile_name, O_RDWR|O_CREAT|O_TRUNC, 0666);
+	  out = open_output(outfile_name, b_resume);
 	  if(out==-1){
 	    report3("Cannot open default output file %s: %s", outfile_name,
 		    strerror(errno));
@@ -1229,7 +1645,7 @@ main(int argc,char *argv[])
 
 	}
 	
-	switch(output_type) {
+	if (!b_resume) switch(output_type) {
 	case 0: /* raw */
 	  break;
 	case 1: /* wav */
@@ -1244,13 +1660,26 @@ main(int argc,char *argv[])
 	}
 	
 	/* Off we go! */
+	sum_pos=batch_first*(CD_FRAMEWORDS/2);
+	if (b_resume) {
+	  sum_pos=journal.sum_pos;
+	  b_resume=false;
+	} else if (journal_name) {
+	  snprintf(journal.outfile_name, sizeof(journal.outfile_name), "%s",
+		   outfile_name);
+	  journal.batch_first=batch_first;
+	  journal.i_header=lseek(out, 0, SEEK_CUR);
+	  journal.i_bytes=0;
+	  journal.i_crc32=0;
+	}
 
 	if(offset_buffer_used){
 	  /* partial sector from previous batch read */
 	  cursor++;
-	  if (buffering_write(out,
-			      ((char *)offset_buffer)+offset_buffer_used,
-			      CDIO_CD_FRAMESIZE_RAW-offset_buffer_used)){
+	  if (write_audio(out,
+			  ((char *)offset_buffer)+offset_buffer_used,
+			  CDIO_CD_FRAMESIZE_RAW-offset_buffer_used,
+			  output_endian!=bigendianp())){
 	    report2("Error writing output: %s", strerror(errno));
 	    exit(1);
 	  }
@@ -1258,10 +1687,16 @@ main(int argc,char *argv[])
 	
 	skipped_flag=0;
 	while(cursor<=batch_last){
-	  /* read a sector */
-	  int16_t *readbuf=paranoia_read_limited(p, callback, max_retries);
+	  /* read as many sectors as paranoia has ready, at least one */
+	  long i_sectors=paranoia_read_range(p, readbuf_range,
+					     batch_last-cursor+1<READ_RANGE_SECTORS
+					     ? batch_last-cursor+1
+					     : READ_RANGE_SECTORS,
+					     callback, max_retries);
+	  int16_t *readbuf;
 	  char *err=cdda_errors(d);
 	  char *mes=cdda_messages(d);
+	  long i;
 
 	  if(mes || err)
 	    fprintf(stderr,"\r                               "
@@ -1270,7 +1705,7 @@ main(int argc,char *argv[])
 	  
 	  if (err) free(err);
 	  if (mes) free(mes);
-	  if( readbuf==NULL) {
+	  if (i_sectors<=0) {
 	    skipped_flag=1;
 	    report("\nparanoia_read: Unrecoverable error, bailing.\n");
 	    break;
@@ -1281,32 +1716,39 @@ main(int argc,char *argv[])
 	  }
 
 	  skipped_flag=0;
-	  cursor++;
 	  
 	  if (output_endian!=bigendianp()) {
-	    int i;
-	    for (i=0; i<CDIO_CD_FRAMESIZE_RAW/2; i++)
-	      readbuf[i]=UINT16_SWAP_LE_BE_C(readbuf[i]);
+	    for (i=0; i<i_sectors*CDIO_CD_FRAMESIZE_RAW/2; i++)
+	      readbuf_range[i]=UINT16_SWAP_LE_BE_C(readbuf_range[i]);
 	  }
 	  
-	  callback(cursor*(CD_FRAMEWORDS)-1,-2);
+	  for (i=0; i<i_sectors; i++) {
+	    cursor++;
+	    callback(cursor*(CD_FRAMEWORDS)-1,-2);
+	  }
 
-	  if (buffering_write(out,((char *)readbuf)+offset_skip,
-			     CDIO_CD_FRAMESIZE_RAW-offset_skip)){
+	  if (write_audio(out,((char *)readbuf_range)+offset_skip,
+			  i_sectors*CDIO_CD_FRAMESIZE_RAW-offset_skip,
+			  output_endian!=bigendianp())){
 	    report2("Error writing output: %s", strerror(errno));
 	    exit(1);
 	  }
 	  offset_skip=0;
-	  
-	  if (output_endian != bigendianp()){
-	    int i;
-	    for (i=0; i<CDIO_CD_FRAMESIZE_RAW/2; i++)
-	      readbuf[i] = UINT16_SWAP_LE_BE_C(readbuf[i]);
+
+	  /* Journal how far we have got, now and then.  Not at the end
+	     of a file, where a sample offset has a sector more to read. */
+	  if(journal_name && cursor<=batch_last
+	     && cursor-journal_cursor>=JOURNAL_SECTORS){
+	    journal.sum_pos=sum_pos;
+	    paranoia_get_state(p, &journal.state);
+	    if (!write_journal(out))
+	      report3("Cannot write the journal %s: %s", journal_name,
+		      strerror(errno));
+	    journal_cursor=cursor;
 	  }
 
 	  /* One last bit of silliness to deal with sample offsets */
 	  if(sample_offset && cursor>batch_last){
-	    int i;
 	    /* read a sector and output the partial offset.  Save the
                rest for the next batch iteration */
 	    readbuf=paranoia_read_limited(p,callback,max_retries);
@@ -1337,8 +1779,8 @@ main(int argc,char *argv[])
 	  
 	    callback(cursor*(CD_FRAMEWORDS),-2);
 
-	    if(buffering_write(out,(char *)offset_buffer,
-			       offset_buffer_used)){
+	    if(write_audio(out,(char *)offset_buffer,offset_buffer_used,
+			   output_endian!=bigendianp())){
 	      report2("Error writing output: %s", strerror(errno));
 	      exit(1);
 	    }
@@ -1350,6 +1792,14 @@ main(int argc,char *argv[])
 	  /* remove the file */
 	  report2("\nRemoving aborted file: %s", outfile_name);
 	  unlink(outfile_name);
+	  if(track_sums){
+	    /* nor count what was in it */
+	    int i_track;
+	    for(i_track=cdda_sector_gettrack(d,batch_first);
+		i_track<=cdda_sector_gettrack(d,batch_last);i_track++)
+	      if(i_track>=1 && i_track<=CDIO_CD_MAX_TRACKS)
+		track_sums[i_track].sum.i_samples=0;
+	  }
 	  /* make the cursor correct if we have another track */
 	  if(batch_track!=-1){
 	    batch_track++;
@@ -1367,6 +1817,15 @@ main(int argc,char *argv[])
     }
   }
 
+  if (track_sums) {
+    print_checksums(stderr, &accuraterip_id);
+    if (logfile && logfile != stdout)
+      print_checksums(logfile, &accuraterip_id);
+  }
+
+  if (journal_name)
+    unlink(journal_name);
+
   report("Done.\n\n");
 
   return 0;
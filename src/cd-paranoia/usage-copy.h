@@ -29,6 +29,10 @@ const char usage_help[] =
 "  -Q --query                      : autosense drive, query disc and quit\n"
 "  -B --batch                      : 'batch' mode (saves each track to a\n"
 "                                    seperate file.\n"
+"  -k --checksums                  : print the CRC32 and AccurateRip\n"
+"                                    checksums of the tracks ripped\n"
+"  -j --journal             <file> : journal the rip in file, to carry on\n"
+"                                    with it if it is cut short\n"
 "  -s --search-for-drive           : do an exhaustive search for drive\n"
 "  -h --help                       : print help\n"
 "\n"
@@ -68,8 +72,15 @@ const char usage_help[] =
 "  -Z --disable-paranoia           : disable all paranoia checking\n"
 "  -Y --disable-extra-paranoia     : only do cdda2wav-style overlap checking\n"
 "  -X --abort-on-skip              : abort on imperfect reads/skips\n"
+"  -P --pipeline                   : read the next block while verifying\n"
+"                                    the last one\n"
+"  -E --test-and-copy              : read twice and compare, verifying by\n"
+"                                    overlap only where the reads differ\n"
+"  -2 --c2-errors                  : take what the drive reads without C2\n"
+"                                    errors as verified\n"
 "  -x --test-flags=mask            : simulate CD-reading errors of ilk-mask n\n"
 "                                    mask & 0x10  - simulate underrun errors\n"
+"                                    mask & 0x400 - simulate C2 errors\n"
 "\n"
 "OUTPUT SMILIES:\n"
 "  :-)   Normal operation, low/no jitter\n"
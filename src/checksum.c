@@ -0,0 +1,331 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* CRC-32 (ISO 3309), MD5 (RFC 1321), SHA-1 and SHA-256 (FIPS 180-2). */
+
+#include "checksum.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <cdio/util.h>
+
+static const struct {
+  const char *psz_name;
+  checksum_algo_t algo;
+} algo_names[] = {
+  { "crc32",  CHECKSUM_CRC32 },
+  { "md5",    CHECKSUM_MD5 },
+  { "sha1",   CHECKSUM_SHA1 },
+  { "sha256", CHECKSUM_SHA256 }
+};
+
+bool
+checksum_algo_from_name (const char psz_name[],
+                         /*out*/ checksum_algo_t *p_algo)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(algo_names) / sizeof(algo_names[0]); i++)
+    if (!strcmp(psz_name, algo_names[i].psz_name)) {
+      *p_algo = algo_names[i].algo;
+      return true;
+    }
+  return false;
+}
+
+const char *
+checksum_algo_name (checksum_algo_t algo)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(algo_names) / sizeof(algo_names[0]); i++)
+    if (algo == algo_names[i].algo)
+      return algo_names[i].psz_name;
+  return "?";
+}
+
+#define ROL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t
+_get_le32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint32_t
+_get_be32 (const uint8_t *p)
+{
+  return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* MD5: one 64-byte block. */
+static void
+_md5_block (uint32_t state[4], const uint8_t *p_block)
+{
+  static const uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+  };
+  static const uint8_t S[4][4] = {
+    { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 }
+  };
+  uint32_t M[16];
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  unsigned int i;
+
+  for (i = 0; i < 16; i++) M[i] = _get_le32(p_block + 4*i);
+
+  for (i = 0; i < 64; i++) {
+    uint32_t f, t;
+    unsigned int g;
+    switch (i / 16) {
+    case 0:  f = (b & c) | (~b & d); g = i;               break;
+    case 1:  f = (d & b) | (~d & c); g = (5*i + 1) % 16;  break;
+    case 2:  f = b ^ c ^ d;          g = (3*i + 5) % 16;  break;
+    default: f = c ^ (b | ~d);       g = (7*i) % 16;      break;
+    }
+    t = d;
+    d = c;
+    c = b;
+    b = b + ROL32(a + f + K[i] + M[g], S[i / 16][i % 4]);
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+}
+
+/* SHA-1: one 64-byte block. */
+static void
+_sha1_block (uint32_t state[5], const uint8_t *p_block)
+{
+  uint32_t W[80];
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+    e = state[4];
+  unsigned int i;
+
+  for (i = 0; i < 16; i++) W[i] = _get_be32(p_block + 4*i);
+  for (i = 16; i < 80; i++)
+    W[i] = ROL32(W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16], 1);
+
+  for (i = 0; i < 80; i++) {
+    uint32_t f, k, t;
+    if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5a827999; }
+    else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ed9eba1; }
+    else if (i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8f1bbcdc; }
+    else             { f = b ^ c ^ d;                    k = 0xca62c1d6; }
+    t = ROL32(a, 5) + f + e + k + W[i];
+    e = d;
+    d = c;
+    c = ROL32(b, 30);
+    b = a;
+    a = t;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+}
+
+/* SHA-256: one 64-byte block. */
+static void
+_sha256_block (uint32_t state[8], const uint8_t *p_block)
+{
+  static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+  uint32_t W[64];
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+    e = state[4], f = state[5], g = state[6], h = state[7];
+  unsigned int i;
+
+  for (i = 0; i < 16; i++) W[i] = _get_be32(p_block + 4*i);
+  for (i = 16; i < 64; i++) {
+    uint32_t s0 = ROR32(W[i-15], 7) ^ ROR32(W[i-15], 18) ^ (W[i-15] >> 3);
+    uint32_t s1 = ROR32(W[i-2], 17) ^ ROR32(W[i-2], 19) ^ (W[i-2] >> 10);
+    W[i] = W[i-16] + s0 + W[i-7] + s1;
+  }
+
+  for (i = 0; i < 64; i++) {
+    uint32_t S1 = ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = h + S1 + ch + K[i] + W[i];
+    uint32_t S0 = ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = S0 + maj;
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+static void
+_checksum_block (checksum_t *p_sum, const uint8_t *p_block)
+{
+  switch (p_sum->algo) {
+  case CHECKSUM_MD5:    _md5_block(p_sum->state, p_block);    break;
+  case CHECKSUM_SHA1:   _sha1_block(p_sum->state, p_block);   break;
+  case CHECKSUM_SHA256: _sha256_block(p_sum->state, p_block); break;
+  default: break;
+  }
+}
+
+void
+checksum_init (checksum_t *p_sum, checksum_algo_t algo)
+{
+  static const uint32_t sha256_init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  memset(p_sum, 0, sizeof(checksum_t));
+  p_sum->algo = algo;
+  switch (algo) {
+  case CHECKSUM_CRC32:
+    /* cdio_crc32() starts from 0, as memset leaves it. */
+    break;
+  case CHECKSUM_SHA256:
+    memcpy(p_sum->state, sha256_init, sizeof(sha256_init));
+    break;
+  case CHECKSUM_SHA1:
+    p_sum->state[4] = 0xc3d2e1f0;
+    /* The first four words are the same as MD5's. */
+  case CHECKSUM_MD5:
+    p_sum->state[0] = 0x67452301;
+    p_sum->state[1] = 0xefcdab89;
+    p_sum->state[2] = 0x98badcfe;
+    p_sum->state[3] = 0x10325476;
+    break;
+  }
+}
+
+void
+checksum_update (checksum_t *p_sum, const void *p_data, size_t i_len)
+{
+  const uint8_t *p = p_data;
+  unsigned int i_have = p_sum->i_bytes % 64;
+
+  p_sum->i_bytes += i_len;
+  if (CHECKSUM_CRC32 == p_sum->algo) {
+    p_sum->state[0] = cdio_crc32(p_sum->state[0], p, i_len);
+    return;
+  }
+
+  if (i_have) {
+    unsigned int i_fill = 64 - i_have;
+    if (i_len < i_fill) {
+      memcpy(p_sum->block + i_have, p, i_len);
+      return;
+    }
+    memcpy(p_sum->block + i_have, p, i_fill);
+    _checksum_block(p_sum, p_sum->block);
+    p += i_fill;
+    i_len -= i_fill;
+  }
+  for ( ; i_len >= 64; p += 64, i_len -= 64)
+    _checksum_block(p_sum, p);
+  memcpy(p_sum->block, p, i_len);
+}
+
+unsigned int
+checksum_size (checksum_algo_t algo)
+{
+  switch (algo) {
+  case CHECKSUM_CRC32: return 4;
+  case CHECKSUM_MD5:   return 16;
+  case CHECKSUM_SHA1:  return 20;
+  default:             return 32;
+  }
+}
+
+unsigned int
+checksum_final (checksum_t *p_sum, /*out*/ uint8_t digest[CHECKSUM_MAX_SIZE])
+{
+  const uint64_t i_bits = p_sum->i_bytes * 8;
+  const unsigned int i_words = checksum_size(p_sum->algo) / 4;
+  unsigned int i_have = p_sum->i_bytes % 64;
+  unsigned int i;
+
+  if (CHECKSUM_CRC32 != p_sum->algo) {
+    /* Pad with a 1 bit, zeros and the length in bits. */
+    p_sum->block[i_have++] = 0x80;
+    if (i_have > 56) {
+      memset(p_sum->block + i_have, 0, 64 - i_have);
+      _checksum_block(p_sum, p_sum->block);
+      i_have = 0;
+    }
+    memset(p_sum->block + i_have, 0, 56 - i_have);
+    for (i = 0; i < 8; i++)
+      p_sum->block[56 + i] = (CHECKSUM_MD5 == p_sum->algo)
+        ? (uint8_t) (i_bits >> (8 * i)) : (uint8_t) (i_bits >> (56 - 8 * i));
+    _checksum_block(p_sum, p_sum->block);
+  }
+
+  /* MD5 is little-endian, the others big-endian. */
+  for (i = 0; i < i_words; i++) {
+    uint32_t w = p_sum->state[i];
+    if (CHECKSUM_MD5 == p_sum->algo) {
+      digest[4*i]   = w;
+      digest[4*i+1] = w >> 8;
+      digest[4*i+2] = w >> 16;
+      digest[4*i+3] = w >> 24;
+    } else {
+      digest[4*i]   = w >> 24;
+      digest[4*i+1] = w >> 16;
+      digest[4*i+2] = w >> 8;
+      digest[4*i+3] = w;
+    }
+  }
+  return 4 * i_words;
+}
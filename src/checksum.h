@@ -0,0 +1,68 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* CRC-32, MD5, SHA-1 and SHA-256 digests for the standalone programs. */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include <sys/types.h>
+#include <cdio/types.h>
+
+typedef enum {
+  CHECKSUM_CRC32,  /**< CRC-32 as used by zip, gzip and cksfv */
+  CHECKSUM_MD5,
+  CHECKSUM_SHA1,
+  CHECKSUM_SHA256
+} checksum_algo_t;
+
+/* The largest digest, SHA-256, in bytes. */
+#define CHECKSUM_MAX_SIZE 32
+
+typedef struct {
+  checksum_algo_t algo;
+  uint32_t state[8];
+  uint64_t i_bytes;     /* bytes hashed so far */
+  uint8_t  block[64];   /* partial block for MD5 and SHA */
+} checksum_t;
+
+/*! Look up an algorithm by its name ("crc32", "md5", "sha1" or
+    "sha256"). false is returned if there is no such algorithm. */
+bool checksum_algo_from_name (const char psz_name[],
+                              /*out*/ checksum_algo_t *p_algo);
+
+/*! Return the name of algo, as checksum_algo_from_name() takes it. */
+const char *checksum_algo_name (checksum_algo_t algo);
+
+/*! Return the size of algo's digests in bytes. */
+unsigned int checksum_size (checksum_algo_t algo);
+
+/*! Start a new digest of the kind algo in p_sum. */
+void checksum_init (checksum_t *p_sum, checksum_algo_t algo);
+
+/*! Add i_len bytes at p_data to p_sum. */
+void checksum_update (checksum_t *p_sum, const void *p_data, size_t i_len);
+
+/*! Finish p_sum and put its digest, most significant byte first, in
+    digest. The size of the digest in bytes is returned. */
+unsigned int checksum_final (checksum_t *p_sum,
+                             /*out*/ uint8_t digest[CHECKSUM_MAX_SIZE]);
+
+#endif /* CHECKSUM_H */
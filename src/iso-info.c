@@ -21,6 +21,7 @@
 */
 #include "getopt.h"
 #include "util.h"
+#include "manifest.h"
 #undef err_exit
 
 #define err_exit(fmt, args...)			    \
@@ -69,6 +70,9 @@ static struct arguments
   int            no_rock_ridge;
   int            print_iso9660;
   int            print_iso9660_short;
+  unsigned int   i_threads;
+  int            manifest;
+  checksum_algo_t manifest_algo;
 } opts;
      
 /* Configuration option codes */
@@ -79,6 +83,8 @@ enum {
 
   /* These are the remaining configuration options */
   OP_VERSION,  
+  OP_THREADS,
+  OP_MANIFEST,
   
 };
 
@@ -94,6 +100,10 @@ parse_options (int argc, char *argv[])
     "  -i, --input[=FILE]     Filename to read ISO-9960 image from\n"
     "  -f                     Generate output similar to 'find . -print'\n"
     "  -l, --iso9660          Generate output similar to 'ls -lR'\n"
+    "  --manifest[=ALGORITHM] List a checksum of every file, as md5sum and\n"
+    "                         the like do; ALGORITHM is crc32, md5, sha1\n"
+    "                         or sha256 (the default). UDF images are\n"
+    "                         accepted too\n"
     "  --no-header            Don't display header and copyright (for regression\n"
     "                         testing)\n"
 #ifdef HAVE_JOLIET    
@@ -102,6 +112,8 @@ parse_options (int argc, char *argv[])
     "  --no-rock-ridge        Don't use Rock-Ridge-extension information\n"
     "  --no-xa                Don't use XA-extension information\n"
     "  -q, --quiet            Don't produce warning output\n"
+    "  --threads=INT          Read directories with INT threads; 0, the\n"
+    "                         default, picks a number from the CPUs present\n"
     "  -V, --version          display version and copyright information and exit\n"
     "\n"
     "Help options:\n"
@@ -110,14 +122,16 @@ parse_options (int argc, char *argv[])
 
   static const char usageText[] =
     "Usage: %s [-d|--debug INT] [-i|--input FILE] [-f] [-l|--iso9660]\n"
+    "        [--manifest[=ALGORITHM]]\n"
     "        [--no-header] [--no-joliet] [--no-rock-ridge] [--no-xa] [-q|--quiet]\n"
-    "        [-V|--version] [-?|--help] [--usage]\n";
+    "        [--threads INT] [-V|--version] [-?|--help] [--usage]\n";
 
   static const char optionsString[] = "d:i::flqV?";
   static const struct option optionsTable[] = {
     {"debug", required_argument, NULL, 'd'},
     {"input", optional_argument, NULL, 'i'},
     {"iso9660", no_argument, NULL, 'l'},
+    {"manifest", optional_argument, NULL, OP_MANIFEST},
     {"no-header", no_argument, &opts.no_header, 1 },
 #ifdef HAVE_JOLIET    
     {"no-joliet", no_argument, &opts.no_joliet, 1 },
@@ -125,6 +139,7 @@ parse_options (int argc, char *argv[])
     {"no-rock-ridge", no_argument, &opts.no_rock_ridge, 1 },
     {"no-xa", no_argument, &opts.no_xa, 1 },
     {"quiet", no_argument, NULL, 'q'},
+    {"threads", required_argument, NULL, OP_THREADS},
     {"version", no_argument, NULL, 'V'},
 
     {"help", no_argument, NULL, '?' },
@@ -144,6 +159,16 @@ parse_options (int argc, char *argv[])
       case 'l': opts.print_iso9660 = 1; break;
       case 'q': opts.silent = 1; break;
       case 'V': opts.version_only = 1; break;
+      case OP_THREADS: opts.i_threads = atoi(optarg); break;
+      case OP_MANIFEST:
+        opts.manifest = 1;
+        if (optarg && !checksum_algo_from_name(optarg, &opts.manifest_algo)) {
+          report(stderr, "%s: unknown checksum algorithm %s\n",
+                 program_name, optarg);
+          free(program_name);
+          exit(EXIT_FAILURE);
+        }
+        break;
 	
       case '?':
         fprintf(stdout, helpText, program_name);
@@ -193,59 +218,46 @@ _log_handler (cdio_log_level_t level, const char message[])
   gl_default_cdio_log_handler (level, message);
 }
 
-static void
-print_iso9660_recurse (iso9660_t *p_iso, const char psz_path[])
+/* iso9660_ifs_walk() callback: list the directory psz_path. */
+static int
+print_iso9660_dir (const char psz_path[], iso9660_stat_t **pp_entries,
+		   unsigned int i_entries, void *p_user_data)
 {
-  CdioList_t *entlist;
-  CdioList_t *dirlist =  _cdio_list_new ();
-  CdioListNode_t *entnode;
+  iso9660_t *p_iso = p_user_data;
   uint8_t i_joliet_level = iso9660_ifs_get_joliet_level(p_iso);
-  char *translated_name = (char *) malloc(4096);
-  size_t translated_name_size = 4096;
-  entlist = iso9660_ifs_readdir (p_iso, psz_path);
+  char *translated_name = NULL;
+  size_t translated_name_size = 0;
+  unsigned int i;
     
   if (opts.print_iso9660) {
     printf ("%s:\n", psz_path);
   }
 
-  if (NULL == entlist) {
+  if (NULL == pp_entries) {
     report( stderr, "Error getting above directory information\n" );
-    return;
+    return 0;
   }
 
   /* Iterate over files in this directory */
   
-  _CDIO_LIST_FOREACH (entnode, entlist)
+  for (i = 0; i < i_entries; i++)
     {
-      iso9660_stat_t *p_statbuf = _cdio_list_node_data (entnode);
+      iso9660_stat_t *p_statbuf = pp_entries[i];
       char *psz_iso_name = p_statbuf->filename;
-      char _fullname[4096] = { 0, };
-       if (strlen(psz_iso_name) >= translated_name_size) {
-         translated_name_size = strlen(psz_iso_name)+1;
-         free(translated_name);
-         translated_name = (char *) malloc(translated_name_size);
-         if (!translated_name) {
-           report( stderr, "Error allocating memory\n" );
-           return;
-         }
-       }
-
-      if (yep != p_statbuf->rr.b3_rock || 1 == opts.no_rock_ridge) {
-	iso9660_name_translate_ext(psz_iso_name, translated_name, 
-				   i_joliet_level);
-	snprintf (_fullname, sizeof (_fullname), "%s%s", psz_path, 
-		  translated_name);
-      } else {
-	snprintf (_fullname, sizeof (_fullname), "%s%s", psz_path, 
-		  psz_iso_name);
+
+      if (strlen(psz_iso_name) >= translated_name_size) {
+	translated_name_size = strlen(psz_iso_name)+1;
+	free(translated_name);
+	translated_name = (char *) malloc(translated_name_size);
+	if (!translated_name) {
+	  report( stderr, "Error allocating memory\n" );
+	  return 1;
+	}
       }
-      
-      strncat (_fullname, "/", sizeof (_fullname));
 
-      if (p_statbuf->type == _STAT_DIR
-          && strcmp (psz_iso_name, ".") 
-          && strcmp (psz_iso_name, ".."))
-        _cdio_list_append (dirlist, strdup (_fullname));
+      if (yep != p_statbuf->rr.b3_rock || 1 == opts.no_rock_ridge)
+	iso9660_name_translate_ext(psz_iso_name, translated_name, 
+				   i_joliet_level);
 
       if (opts.print_iso9660) {
 	print_fs_attrs(p_statbuf, 
@@ -257,35 +269,25 @@ print_iso9660_recurse (iso9660_t *p_iso, const char psz_path[])
 	  printf("%9u %s%s\n", (unsigned int) p_statbuf->size, psz_path, 
 		 yep == p_statbuf->rr.b3_rock 
 		 ? psz_iso_name : translated_name);
-      if (p_statbuf->rr.i_symlink) {
-	free(p_statbuf->rr.psz_symlink);
-	p_statbuf->rr.i_symlink = 0;
-      }
     }
-    free (translated_name);
-
-  _cdio_list_free (entlist, true);
+  free (translated_name);
 
   if (opts.print_iso9660) {
     printf ("\n");
   }
-
-  /* Now recurse over the directories. */
-
-  _CDIO_LIST_FOREACH (entnode, dirlist)
-    {
-      char *_fullname = _cdio_list_node_data (entnode);
-
-      print_iso9660_recurse (p_iso, _fullname);
-    }
-
-  _cdio_list_free (dirlist, true);
+  return 0;
 }
 
 static void
-print_iso9660_fs (iso9660_t *iso)
+print_iso9660_fs (iso9660_t *p_iso)
 {
-  print_iso9660_recurse (iso, "/");
+  unsigned int flags = ISO9660_WALK_ORDERED | ISO9660_WALK_TRANSLATE;
+
+  if (opts.no_rock_ridge) flags |= ISO9660_WALK_IGNORE_ROCK;
+
+  /* Directories are read ahead in parallel but listed in the same
+     order as a plain recursion would list them. */
+  iso9660_ifs_walk (p_iso, print_iso9660_dir, p_iso, opts.i_threads, flags);
 }
 
 
@@ -304,6 +306,9 @@ init(void)
   opts.debug_level         = 0;
   opts.print_iso9660       = 0;
   opts.print_iso9660_short = 0;
+  opts.i_threads           = 0;
+  opts.manifest            = 0;
+  opts.manifest_algo       = CHECKSUM_SHA256;
 }
 
 #define print_vd_info(title, fn)	  \
@@ -321,6 +326,7 @@ main(int argc, char *argv[])
 
   iso9660_t           *p_iso=NULL;
   iso_extension_mask_t iso_extension_mask = ISO_EXTENSION_ALL;
+  int                  rc = EXIT_SUCCESS;
       
   init();
 
@@ -328,7 +334,11 @@ main(int argc, char *argv[])
      be reflected in `arguments'. */
   parse_options(argc, argv);
   
-  print_version(program_name, CDIO_VERSION, opts.no_header, opts.version_only);
+  /* With --quiet a manifest is all that is printed, so that md5sum -c
+     and the like can read it. */
+  if (opts.version_only || !(opts.manifest && opts.silent))
+    print_version(program_name, CDIO_VERSION, opts.no_header, 
+                  opts.version_only);
 
   if (opts.debug_level == 3) {
     cdio_loglevel_default = CDIO_LOG_INFO;
@@ -346,6 +356,23 @@ main(int argc, char *argv[])
   
   p_iso = iso9660_open_ext (source_name, iso_extension_mask);
 
+  if (p_iso==NULL && opts.manifest) {
+    udf_t *p_udf = udf_open (source_name);
+    if (p_udf) {
+      if (opts.silent == 0) {
+        printf(STRONG "UDF image: %s\n", source_name);
+        printf(STRONG "Manifest (%s)\n" NORMAL, 
+               checksum_algo_name(opts.manifest_algo));
+      }
+      if (manifest_udf(p_udf, opts.manifest_algo, opts.i_threads, stdout))
+        rc = EXIT_FAILURE;
+      udf_close(p_udf);
+      free(source_name);
+      free(program_name);
+      return rc;
+    }
+  }
+
   if (p_iso==NULL) {
     free(source_name);
     err_exit("Error in opening ISO-9660 image%s\n", "");
@@ -372,9 +399,18 @@ main(int argc, char *argv[])
     print_iso9660_fs(p_iso);
   }
 
+  if (opts.manifest) {
+    if (opts.silent == 0)
+      printf(STRONG "Manifest (%s)\n" NORMAL, 
+             checksum_algo_name(opts.manifest_algo));
+    if (manifest_iso9660(p_iso, opts.manifest_algo, 0 == opts.no_rock_ridge,
+                         opts.i_threads, stdout))
+      rc = EXIT_FAILURE;
+  }
+
   free(source_name);
   iso9660_close(p_iso);
   /* Not reached:*/
   free(program_name);
-  return(EXIT_SUCCESS);
+  return(rc);
 }
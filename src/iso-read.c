@@ -207,7 +207,6 @@ main(int argc, char *argv[])
 {
   iso9660_stat_t *statbuf;
   FILE *outfd;
-  int i;
   iso9660_t *iso;
   
   init();
@@ -251,39 +250,68 @@ main(int argc, char *argv[])
       return 3;
     }
 
-  /* Copy the blocks from the ISO-9660 filesystem to the local filesystem. */
-  for (i = 0; i < statbuf->size; i += ISO_BLOCKSIZE)
+  /* Copy the file from the ISO-9660 filesystem to the local filesystem. */
+  if (!opts.ignore)
     {
-      char buf[ISO_BLOCKSIZE];
-
-      memset (buf, 0, ISO_BLOCKSIZE);
-      
-      if ( ISO_BLOCKSIZE != iso9660_iso_seek_read (iso, buf, statbuf->lsn 
-						   + (i / ISO_BLOCKSIZE),
-						   1) )
-      {
-	report(stderr, "Error reading ISO 9660 file at lsn %lu\n",
-	       (long unsigned int) statbuf->lsn + (i / ISO_BLOCKSIZE));
-	if (!opts.ignore) return 4;
-      }
-      
-      
-      fwrite (buf, ISO_BLOCKSIZE, 1, outfd);
-      
-      if (ferror (outfd))
+      if (!iso9660_ifs_copy_file (iso, statbuf, fileno (outfd)))
 	{
-	  perror ("fwrite()");
-	  return 5;
+	  report(stderr, "Error copying ISO 9660 file %s\n", opts.file_name);
+	  return 4;
 	}
     }
-  
-  fflush (outfd);
+  else
+    {
+      /* Read large pieces, but go block by block through a piece
+	 that has errors so that only the bad blocks are left as
+	 zeros. */
+      const long int i_bufsize = 256 * ISO_BLOCKSIZE;
+      char *buf = malloc (i_bufsize);
+      uint64_t i_pos;
+
+      if (!buf)
+	{
+	  report(stderr, "%s: Out of memory\n", program_name);
+	  return 5;
+	}
 
-  /* Make sure the file size has the exact same byte size. Without the
-     truncate below, the file will a multiple of ISO_BLOCKSIZE.
-   */
-  if (ftruncate (fileno (outfd), statbuf->size))
-    perror ("ftruncate()");
+      for (i_pos = 0; i_pos < statbuf->total_size; i_pos += i_bufsize)
+	{
+	  long int i_want = i_bufsize;
+	  long int i_read;
+
+	  if (i_want > statbuf->total_size - i_pos)
+	    i_want = statbuf->total_size - i_pos;
+
+	  i_read = iso9660_ifs_read_file (iso, statbuf, i_pos, buf, i_want);
+	  if (i_read != i_want)
+	    {
+	      long int i;
+	      for (i = 0; i < i_want; i += ISO_BLOCKSIZE)
+		{
+		  long int i_block = (i_want - i < ISO_BLOCKSIZE) 
+		    ? i_want - i : ISO_BLOCKSIZE;
+		  if (iso9660_ifs_read_file (iso, statbuf, i_pos + i, buf + i,
+					     i_block) != i_block)
+		    {
+		      report(stderr, 
+			     "Error reading ISO 9660 file at offset %lu\n",
+			     (long unsigned int) (i_pos + i));
+		      memset (buf + i, 0, i_block);
+		    }
+		}
+	    }
+
+	  fwrite (buf, i_want, 1, outfd);
+
+	  if (ferror (outfd))
+	    {
+	      perror ("fwrite()");
+	      free (buf);
+	      return 5;
+	    }
+	}
+      free (buf);
+    }
 
   fclose (outfd);
   iso9660_close(iso);
@@ -0,0 +1,431 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checksum manifests of the files in ISO 9660 and UDF images.
+
+   The files are listed first, each with the block its data starts
+   at. The list is then handed out to the worker threads sorted by
+   that block, so that together they read the image roughly from
+   front to back, and the digests are printed in the order the files
+   were listed. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+#include "manifest.h"
+#include <cdio/bytesex.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/* How much of a file a worker reads at a time. */
+#define MANIFEST_CHUNK (1024 * 1024)
+
+/* Most threads picked when the caller leaves it to us; beyond this
+   the image, not hashing, is the bottleneck. */
+#define MANIFEST_MAX_AUTO_THREADS 8
+
+typedef struct {
+  char     *psz_path;
+  lsn_t     lsn;       /* where the data starts, for scheduling */
+  void     *p_file;    /* iso9660_stat_t * or udf_file_t * */
+  uint8_t   digest[CHECKSUM_MAX_SIZE];
+  bool      b_ok;
+} manifest_file_t;
+
+typedef struct manifest_s manifest_t;
+
+/* Read up to i_len bytes of p_file at i_pos, like pread(2). */
+typedef long int (*manifest_read_t) (manifest_t *p_manifest,
+                                     const manifest_file_t *p_file,
+                                     uint64_t i_pos, void *p_buf,
+                                     long int i_len);
+
+struct manifest_s {
+  checksum_algo_t   algo;
+  manifest_read_t   read;
+  void             *p_source;  /* iso9660_t * or udf_t * */
+  manifest_file_t  *p_files;
+  unsigned int      i_files, i_max;
+  manifest_file_t **pp_order;  /* p_files sorted by lsn */
+  unsigned int      i_next;    /* next entry of pp_order to hash */
+  bool              b_error;   /* listing the files failed */
+#ifdef HAVE_PTHREAD
+  pthread_mutex_t   mutex;
+#endif
+};
+
+static bool
+_manifest_add (manifest_t *p_manifest, const char psz_dir[],
+               const char psz_name[], lsn_t lsn, void *p_file)
+{
+  manifest_file_t *p_entry;
+
+  if (p_manifest->i_files == p_manifest->i_max) {
+    unsigned int i_max = p_manifest->i_max ? 2 * p_manifest->i_max : 256;
+    manifest_file_t *p_files =
+      realloc(p_manifest->p_files, i_max * sizeof(manifest_file_t));
+    if (!p_files) return false;
+    p_manifest->p_files = p_files;
+    p_manifest->i_max = i_max;
+  }
+  p_entry = &p_manifest->p_files[p_manifest->i_files];
+  memset(p_entry, 0, sizeof(manifest_file_t));
+  p_entry->psz_path = malloc(strlen(psz_dir) + strlen(psz_name) + 1);
+  if (!p_entry->psz_path) return false;
+  strcpy(p_entry->psz_path, psz_dir);
+  strcat(p_entry->psz_path, psz_name);
+  p_entry->lsn = lsn;
+  p_entry->p_file = p_file;
+  p_manifest->i_files++;
+  return true;
+}
+
+static int
+_manifest_lsn_cmp (const void *p1, const void *p2)
+{
+  const manifest_file_t *p_a = *(manifest_file_t * const *) p1;
+  const manifest_file_t *p_b = *(manifest_file_t * const *) p2;
+
+  if (p_a->lsn != p_b->lsn) return (p_a->lsn < p_b->lsn) ? -1 : 1;
+  return (p_a < p_b) ? -1 : (p_a > p_b);
+}
+
+static void
+_manifest_hash_file (manifest_t *p_manifest, manifest_file_t *p_file,
+                     uint8_t *p_buf)
+{
+  checksum_t sum;
+  uint64_t i_pos = 0;
+  long int i_read;
+
+  checksum_init(&sum, p_manifest->algo);
+  while ((i_read = p_manifest->read(p_manifest, p_file, i_pos, p_buf,
+                                    MANIFEST_CHUNK)) > 0) {
+    checksum_update(&sum, p_buf, i_read);
+    i_pos += i_read;
+  }
+  p_file->b_ok = (0 == i_read);
+  checksum_final(&sum, p_file->digest);
+}
+
+static void *
+_manifest_worker (void *p_arg)
+{
+  manifest_t *p_manifest = p_arg;
+  uint8_t *p_buf = malloc(MANIFEST_CHUNK);
+
+  if (!p_buf) return NULL;
+  for (;;) {
+    unsigned int i;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_lock(&p_manifest->mutex);
+#endif
+    i = p_manifest->i_next++;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_unlock(&p_manifest->mutex);
+#endif
+    if (i >= p_manifest->i_files) break;
+    _manifest_hash_file(p_manifest, p_manifest->pp_order[i], p_buf);
+  }
+  free(p_buf);
+  return NULL;
+}
+
+/* Hash everything listed in p_manifest and print the manifest. The
+   number of files that could not be read is returned. */
+static int
+_manifest_run (manifest_t *p_manifest, unsigned int i_threads, FILE *p_out)
+{
+  const unsigned int i_size = checksum_size(p_manifest->algo);
+  unsigned int i, k;
+  int i_bad = 0;
+#ifdef HAVE_PTHREAD
+  pthread_t *p_threads = NULL;
+  unsigned int i_started = 0;
+#endif
+
+  if (0 == i_threads) {
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    long int i_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    i_threads = (i_cpus > 0) ? (unsigned int) i_cpus : 1;
+#else
+    i_threads = 1;
+#endif
+    if (i_threads > MANIFEST_MAX_AUTO_THREADS)
+      i_threads = MANIFEST_MAX_AUTO_THREADS;
+  }
+  if (i_threads > p_manifest->i_files)
+    i_threads = p_manifest->i_files ? p_manifest->i_files : 1;
+
+  p_manifest->pp_order = malloc((p_manifest->i_files + 1)
+                                * sizeof(manifest_file_t *));
+  if (!p_manifest->pp_order) return p_manifest->i_files;
+  for (i = 0; i < p_manifest->i_files; i++)
+    p_manifest->pp_order[i] = &p_manifest->p_files[i];
+  qsort(p_manifest->pp_order, p_manifest->i_files,
+        sizeof(manifest_file_t *), _manifest_lsn_cmp);
+  p_manifest->i_next = 0;
+
+#ifdef HAVE_PTHREAD
+  pthread_mutex_init(&p_manifest->mutex, NULL);
+  if (i_threads > 1) {
+    p_threads = calloc(i_threads - 1, sizeof(pthread_t));
+    if (p_threads)
+      for (i = 0; i < i_threads - 1; i++) {
+        if (pthread_create(&p_threads[i], NULL, _manifest_worker,
+                           p_manifest))
+          break;
+        i_started++;
+      }
+  }
+#endif
+
+  _manifest_worker(p_manifest);
+
+#ifdef HAVE_PTHREAD
+  for (i = 0; i < i_started; i++)
+    pthread_join(p_threads[i], NULL);
+  free(p_threads);
+  pthread_mutex_destroy(&p_manifest->mutex);
+#endif
+
+  for (i = 0; i < p_manifest->i_files; i++) {
+    const manifest_file_t *p_file = &p_manifest->p_files[i];
+    if (!p_file->b_ok) {
+      fprintf(stderr, "Error reading %s\n", p_file->psz_path);
+      i_bad++;
+      continue;
+    }
+    for (k = 0; k < i_size; k++)
+      fprintf(p_out, "%02x", p_file->digest[k]);
+    fprintf(p_out, "  %s\n", p_file->psz_path);
+  }
+  return i_bad;
+}
+
+static void
+_manifest_free (manifest_t *p_manifest, void (*free_file) (void *))
+{
+  unsigned int i;
+
+  for (i = 0; i < p_manifest->i_files; i++) {
+    free(p_manifest->p_files[i].psz_path);
+    free_file(p_manifest->p_files[i].p_file);
+  }
+  free(p_manifest->p_files);
+  free(p_manifest->pp_order);
+}
+
+/* ISO 9660 */
+
+typedef struct {
+  manifest_t *p_manifest;
+  uint8_t     i_joliet_level;
+  bool        b_rock;
+} iso9660_list_t;
+
+/* iso9660_ifs_walk() callback: add the files of psz_path. */
+static int
+_iso9660_list_dir (const char psz_path[], iso9660_stat_t **pp_entries,
+                   unsigned int i_entries, void *p_user_data)
+{
+  iso9660_list_t *p_list = p_user_data;
+  manifest_t *p_manifest = p_list->p_manifest;
+  unsigned int i;
+
+  if (!pp_entries) {
+    p_manifest->b_error = true;
+    return 1;
+  }
+
+  for (i = 0; i < i_entries; i++) {
+    const iso9660_stat_t *p_statbuf = pp_entries[i];
+    char *psz_name = malloc(strlen(p_statbuf->filename) + 1);
+    iso9660_stat_t *p_copy;
+    bool b_ok;
+
+    /* Symbolic links and device files have no data of their own. */
+    if (_STAT_DIR == p_statbuf->type
+        || (p_list->b_rock && yep == p_statbuf->rr.b3_rock
+            && !S_ISREG(p_statbuf->rr.st_mode))) {
+      free(psz_name);
+      continue;
+    }
+    p_copy = iso9660_stat_dup(p_statbuf);
+    if (!psz_name || !p_copy) {
+      free(psz_name);
+      free(p_copy);
+      p_manifest->b_error = true;
+      return 1;
+    }
+
+    if (yep == p_statbuf->rr.b3_rock && p_list->b_rock)
+      strcpy(psz_name, p_statbuf->filename);
+    else
+      iso9660_name_translate_ext(p_statbuf->filename, psz_name,
+                                 p_list->i_joliet_level);
+    /* psz_path always starts with "/", which manifests leave out. */
+    b_ok = _manifest_add(p_manifest, psz_path + 1, psz_name,
+                         p_statbuf->lsn, p_copy);
+    free(psz_name);
+    if (!b_ok) {
+      free(p_copy);
+      p_manifest->b_error = true;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static long int
+_iso9660_read (manifest_t *p_manifest, const manifest_file_t *p_file,
+               uint64_t i_pos, void *p_buf, long int i_len)
+{
+  return iso9660_ifs_read_file(p_manifest->p_source, p_file->p_file, i_pos,
+                               p_buf, i_len);
+}
+
+int
+manifest_iso9660 (iso9660_t *p_iso, checksum_algo_t algo, bool b_rock,
+                  unsigned int i_threads, FILE *p_out)
+{
+  unsigned int flags = ISO9660_WALK_ORDERED | ISO9660_WALK_TRANSLATE;
+  const unsigned int i_decode = iso9660_ifs_get_decode(p_iso);
+  manifest_t manifest;
+  iso9660_list_t list;
+  int i_bad = -1;
+
+  memset(&manifest, 0, sizeof(manifest));
+  manifest.algo = algo;
+  manifest.read = _iso9660_read;
+  manifest.p_source = p_iso;
+
+  list.p_manifest = &manifest;
+  list.i_joliet_level = iso9660_ifs_get_joliet_level(p_iso);
+  list.b_rock = b_rock;
+  if (!b_rock) flags |= ISO9660_WALK_IGNORE_ROCK;
+
+  /* Names and extents are all we need, and with Rock Ridge the file
+     modes to pass over symbolic links and device files. */
+  iso9660_ifs_set_decode(p_iso, b_rock
+                         ? ISO9660_DECODE_NAME | ISO9660_DECODE_ATTRS
+                         : ISO9660_DECODE_NAME);
+  if (iso9660_ifs_walk(p_iso, _iso9660_list_dir, &list, i_threads, flags)
+      && !manifest.b_error)
+    i_bad = _manifest_run(&manifest, i_threads, p_out);
+  iso9660_ifs_set_decode(p_iso, i_decode);
+
+  _manifest_free(&manifest, free);
+  return i_bad;
+}
+
+/* UDF */
+
+/* Add the files of the directory p_udf_dirent, called psz_path, and of
+   its subdirectories. p_udf_dirent is freed. */
+static bool
+_udf_list_dir (manifest_t *p_manifest, udf_dirent_t *p_udf_dirent,
+               const char psz_path[])
+{
+  while (udf_readdir(p_udf_dirent)) {
+    const char *psz_name = udf_get_filename(p_udf_dirent);
+    udf_fileid_desc_t fid;
+    lsn_t lsn = 0;
+
+    if (udf_is_dir(p_udf_dirent)) {
+      udf_dirent_t *p_subdir = udf_opendir(p_udf_dirent);
+      if (p_subdir) {
+        char *psz_subpath = malloc(strlen(psz_path) + strlen(psz_name) + 2);
+        bool b_ok = (NULL != psz_subpath);
+        if (b_ok) {
+          sprintf(psz_subpath, "%s%s/", psz_path, psz_name);
+          b_ok = _udf_list_dir(p_manifest, p_subdir, psz_subpath);
+        } else
+          udf_dirent_free(p_subdir);
+        free(psz_subpath);
+        if (!b_ok) {
+          udf_dirent_free(p_udf_dirent);
+          return false;
+        }
+      }
+    } else {
+      /* If this fails, reading the file does and it is reported. */
+      udf_file_t *p_file = udf_file_open(p_udf_dirent);
+
+      /* The file's data almost always comes right after its file
+         entry, so that is a good enough place to schedule it by. */
+      if (udf_get_fileid_descriptor(p_udf_dirent, &fid))
+        lsn = uint32_from_le(fid.icb.loc.lba);
+      if (!_manifest_add(p_manifest, psz_path, psz_name, lsn, p_file)) {
+        if (p_file) udf_file_close(p_file);
+        udf_dirent_free(p_udf_dirent);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static long int
+_udf_read (manifest_t *p_manifest, const manifest_file_t *p_file,
+           uint64_t i_pos, void *p_buf, long int i_len)
+{
+  if (!p_file->p_file) return -1;
+  return udf_pread(p_file->p_file, p_buf, i_len, i_pos);
+}
+
+static void
+_udf_file_free (void *p_file)
+{
+  if (p_file) udf_file_close(p_file);
+}
+
+int
+manifest_udf (udf_t *p_udf, checksum_algo_t algo, unsigned int i_threads,
+              FILE *p_out)
+{
+  udf_dirent_t *p_root = udf_get_root(p_udf, true, 0);
+  manifest_t manifest;
+  int i_bad = -1;
+
+  if (!p_root) return -1;
+
+  memset(&manifest, 0, sizeof(manifest));
+  manifest.algo = algo;
+  manifest.read = _udf_read;
+  manifest.p_source = p_udf;
+
+  if (_udf_list_dir(&manifest, p_root, ""))
+    i_bad = _manifest_run(&manifest, i_threads, p_out);
+
+  _manifest_free(&manifest, _udf_file_free);
+  return i_bad;
+}
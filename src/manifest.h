@@ -0,0 +1,48 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checksum manifests of the files in ISO 9660 and UDF images. */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <cdio/iso9660.h>
+#include <cdio/udf.h>
+#include "checksum.h"
+
+/*! Print a line "DIGEST  PATH" to p_out for every file of p_iso, in
+    the order "iso-info -f" lists them, which md5sum, sha1sum and
+    sha256sum -c accept. PATH is relative to the root directory and
+    uses Rock Ridge names when b_rock is set and translated ISO 9660
+    names otherwise.
+
+    The files are read in the order their data is recorded, so that
+    the image is read front to back, and hashed by up to i_threads
+    threads; 0 picks a number from the processors available.
+
+    The number of files that could not be read is returned, or -1 if
+    the file system itself could not be.
+*/
+int manifest_iso9660 (iso9660_t *p_iso, checksum_algo_t algo, bool b_rock,
+                      unsigned int i_threads, FILE *p_out);
+
+/*! Same as manifest_iso9660() for the UDF file system p_udf. */
+int manifest_udf (udf_t *p_udf, checksum_algo_t algo,
+                  unsigned int i_threads, FILE *p_out);
+
+#endif /* MANIFEST_H */
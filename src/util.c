@@ -468,11 +468,12 @@ print_fs_attrs(iso9660_stat_t *p_statbuf, bool b_rock, bool b_xa,
 	       const char *psz_name_translated)
 {
   char date_str[30];
+  char attr_str[ISO9660_XA_ATTR_STR_SIZE]; /* room for either kind */
 
 #ifdef HAVE_ROCK
   if (yep == p_statbuf->rr.b3_rock && b_rock) {
     report ( stdout, "  %s %3d %d %d [LSN %6lu] %9u",
-	     iso9660_get_rock_attr_str (p_statbuf->rr.st_mode),
+	     iso9660_get_rock_attr_str_r (p_statbuf->rr.st_mode, attr_str),
 	     p_statbuf->rr.st_nlinks,
 	     p_statbuf->rr.st_uid,
 	     p_statbuf->rr.st_gid,
@@ -485,7 +486,7 @@ print_fs_attrs(iso9660_stat_t *p_statbuf, bool b_rock, bool b_xa,
 #endif
   if (b_xa) {
     report ( stdout, "  %s %d %d [fn %.2d] [LSN %6lu] ",
-	     iso9660_get_xa_attr_str (p_statbuf->xa.attributes),
+	     iso9660_get_xa_attr_str_r (p_statbuf->xa.attributes, attr_str),
 	     uint16_from_be (p_statbuf->xa.user_id),
 	     uint16_from_be (p_statbuf->xa.group_id),
 	     p_statbuf->xa.filenum,
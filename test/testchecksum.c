@@ -0,0 +1,390 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checks paranoia's CRC32 and AccurateRip checksums
+   (lib/paranoia/checksum.c): every kernel against the scalar ones,
+   the checksums of tracks summed piece by piece against sums worked
+   out straight from their definitions, and the AccurateRip
+   identification of cdda.cue. Also checks the digests of iso-info
+   --manifest (src/checksum.c) against known answers.
+
+     testchecksum -b
+
+   times each kernel instead. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <sys/time.h>
+
+#include "p_block.h"
+#include "checksum.h"
+#include "../src/checksum.h"
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define CDDA_IMAGE TEST_DIR "/cdda.cue"
+
+/* Samples of a track, a little over 12 sectors, for the checksums of
+   a whole track. */
+#define TRACK_SECTORS 13
+#define TRACK_WORDS (TRACK_SECTORS * CD_FRAMEWORDS)
+
+/* 5 sectors but one sample, in stereo samples. */
+#define AR_SKIP 2940
+
+/* A small deterministic generator, so failures can be reproduced. */
+static unsigned long int i_seed = 1;
+
+static unsigned long int
+next_random(unsigned long int i_range)
+{
+  i_seed = i_seed * 1103515245 + 12345;
+  return ((i_seed >> 16) & 0x7fffffff) % i_range;
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* The CRC32 of n bytes, a bit at a time. */
+static uint32_t
+ref_crc32(const uint8_t *p, long n)
+{
+  uint32_t crc = 0xffffffff;
+  long i;
+  int k;
+  for (i = 0; i < n; i++) {
+    crc ^= p[i];
+    for (k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+/* Check the kernels in use against the scalar ones, on pieces of
+   buf of every length up to 300 bytes and some longer, at every
+   alignment. */
+static int
+check_kernels(const checksum_kernels_t *scalar, const uint8_t *buf,
+	      long i_bytes)
+{
+  long n, offset;
+
+  if (checksum_kernels->crc32(0, (const uint8_t *) "123456789", 9)
+      != 0xcbf43926) {
+    printf("the CRC32 of \"123456789\" is %08x, not cbf43926\n",
+	   checksum_kernels->crc32(0, (const uint8_t *) "123456789", 9));
+    return 1;
+  }
+
+  for (n = 0; n < i_bytes - 16; n = n < 300 ? n + 1 : n * 3 + 7)
+    for (offset = 0; offset < 16; offset++) {
+      const uint32_t crc = next_random(0x10000) << 16 | next_random(0x10000);
+      if (checksum_kernels->crc32(crc, buf + offset, n)
+	  != scalar->crc32(crc, buf + offset, n)) {
+	printf("CRC32 of %ld bytes at %ld after %08x differs\n",
+	       n, offset, crc);
+	return 2;
+      }
+    }
+
+  for (n = 0; n < 200; n++)
+    for (offset = 0; offset < 4; offset++) {
+      const uint32_t i_mult = 1 + next_random(100000000);
+      uint32_t lo = next_random(0x10000), hi = next_random(0x10000);
+      uint32_t ref_lo = lo, ref_hi = hi;
+      checksum_kernels->accuraterip((const int16_t *) buf + 2*offset, n,
+				    i_mult, &lo, &hi);
+      scalar->accuraterip((const int16_t *) buf + 2*offset, n, i_mult,
+			  &ref_lo, &ref_hi);
+      if (lo != ref_lo || hi != ref_hi) {
+	printf("AccurateRip sums of %ld samples at %ld from %u differ\n",
+	       n, offset, i_mult);
+	return 3;
+      }
+    }
+  return 0;
+}
+
+/* Sum the checksums of a track in pieces of random sizes and check
+   them against those worked out from the whole of it. */
+static int
+check_track(const int16_t *samples, bool b_first, bool b_last)
+{
+  const long i_stereo = TRACK_WORDS / 2;
+  cdio_paranoia_checksum_t sum;
+  uint32_t v1 = 0, v2_lo = 0, v2_hi = 0;
+  uint8_t bytes[TRACK_WORDS * 2];
+  long i, n;
+
+  for (i = 0; i < i_stereo; i++) {
+    const uint32_t i_mult = i + 1;
+    const uint32_t w = (uint16_t) samples[2*i]
+      | (uint32_t) (uint16_t) samples[2*i+1] << 16;
+    if ((b_first && i_mult < AR_SKIP) || (b_last && i_mult > i_stereo - AR_SKIP))
+      continue;
+    v1 += w * i_mult;
+    v2_lo += (uint32_t) ((uint64_t) w * i_mult);
+    v2_hi += (uint32_t) (((uint64_t) w * i_mult) >> 32);
+  }
+  for (i = 0; i < TRACK_WORDS; i++) {
+    bytes[2*i] = samples[i] & 0xff;
+    bytes[2*i+1] = (samples[i] >> 8) & 0xff;
+  }
+
+  cdio_paranoia_checksum_init(&sum, TRACK_SECTORS, b_first, b_last);
+  for (i = 0; i < TRACK_WORDS; i += n) {
+    n = 2 * (1 + (long) next_random(next_random(2) ? 8 : 1200));
+    if (n > TRACK_WORDS - i) n = TRACK_WORDS - i;
+    cdio_paranoia_checksum_add(&sum, samples + i, n);
+  }
+
+  if (sum.i_samples != i_stereo || sum.i_crc32 != ref_crc32(bytes, sizeof(bytes))
+      || sum.i_ar_v1 != v1 || sum.i_ar_v2 != v2_lo + v2_hi) {
+    printf("checksums of a track%s%s: %u samples, CRC32 %08x, AccurateRip "
+	   "%08x %08x; expected %ld, %08x, %08x %08x\n",
+	   b_first ? ", first" : "", b_last ? ", last" : "",
+	   sum.i_samples, sum.i_crc32, sum.i_ar_v1, sum.i_ar_v2,
+	   i_stereo, ref_crc32(bytes, sizeof(bytes)), v1, v2_lo + v2_hi);
+    return 1;
+  }
+  return 0;
+}
+
+/* Known answers for the digests of src/checksum.c, from zlib's
+   crc32(), md5sum, sha1sum and sha256sum. A NULL psz_data stands for
+   i_len letters 'a', which puts the end of the data on either side of
+   where the padding of MD5 and SHA needs another block. */
+static const struct {
+  const char *psz_data;
+  unsigned int i_len;
+  const char *psz_digest[4]; /* CRC32, MD5, SHA-1, SHA-256 */
+} digest_vectors[] = {
+  { "", 0,
+    { "00000000", "d41d8cd98f00b204e9800998ecf8427e",
+      "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" } },
+  { "abc", 3,
+    { "352441c2", "900150983cd24fb0d6963f7d28e17f72",
+      "a9993e364706816aba3e25717850c26c9cd0d89d",
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" } },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56,
+    { "171a3f5f", "8215ef0796a20bcaaae116d3876c664a",
+      "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" } },
+  { NULL, 55,
+    { "aadfe34e", "ef1772b6dff9a122358552954ad0df65",
+      "c1c8bbdc22796e28c0e15163d20899b65621d65a",
+      "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318" } },
+  { NULL, 56,
+    { "79790d37", "3b0c8ac703f828b04c6c197006d17218",
+      "c2db330f6083854c99d4b5bfb6e8f29f201be699",
+      "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a" } },
+  { NULL, 63,
+    { "6824c5de", "b06521f39153d618550606be297466d5",
+      "03f09f5b158a7a8cdad920bddc29b81c18a551f5",
+      "7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34" } },
+  { NULL, 64,
+    { "89b46555", "014842d480b571495a4a0363793f7367",
+      "0098ba824b5c16427bd7a1122a5a442a25ec644d",
+      "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb" } },
+  { NULL, 65,
+    { "f33faf5d", "c743a45e0d2e6a95cb859adae0248435",
+      "11655326c708d70319be2610e8a57d9a5b959d3b",
+      "635361c48bb9eab14198e76ea8ab7f1a41685d6ad62aa9146d301d4f17eb0ae0" } },
+  { NULL, 119,
+    { "4144ebae", "8a7bd0732ed6a28ce75f6dabc90e1613",
+      "ee971065aaa017e0632a8ca6c77bb3bf8b1dfc56",
+      "31eba51c313a5c08226adf18d4a359cfdfd8d2e816b13f4af952f7ea6584dcfb" } },
+  { NULL, 120,
+    { "d9987447", "5f61c0ccad4cac44c75ff505e1f1e537",
+      "f34c1488385346a55709ba056ddd08280dd4c6d6",
+      "2f3d335432c70b580af0e8e1b3674a7c020d683aa5f73aaaedfdc55af904c21c" } }
+};
+
+/* Check each digest of each known answer, with the data added all at
+   once and in pieces of every size up to 7 bytes. */
+static int
+check_digests(void)
+{
+  const checksum_algo_t algos[4] = {
+    CHECKSUM_CRC32, CHECKSUM_MD5, CHECKSUM_SHA1, CHECKSUM_SHA256
+  };
+  uint8_t data[128];
+  unsigned int v, a, i_piece;
+
+  for (a = 0; a < 4; a++) {
+    checksum_algo_t algo;
+    if (!checksum_algo_from_name(checksum_algo_name(algos[a]), &algo)
+	|| algo != algos[a]) {
+      printf("checksum algorithm %s doesn't look itself up\n",
+	     checksum_algo_name(algos[a]));
+      return 1;
+    }
+  }
+
+  for (v = 0; v < sizeof(digest_vectors) / sizeof(digest_vectors[0]); v++) {
+    const unsigned int i_len = digest_vectors[v].i_len;
+    if (digest_vectors[v].psz_data)
+      memcpy(data, digest_vectors[v].psz_data, i_len);
+    else
+      memset(data, 'a', i_len);
+
+    for (a = 0; a < 4; a++)
+      for (i_piece = 0; i_piece <= 7; i_piece++) {
+	const char *psz_want = digest_vectors[v].psz_digest[a];
+	uint8_t digest[CHECKSUM_MAX_SIZE];
+	char psz_got[2 * CHECKSUM_MAX_SIZE + 1];
+	checksum_t sum;
+	unsigned int i, n;
+
+	checksum_init(&sum, algos[a]);
+	if (0 == i_piece)
+	  checksum_update(&sum, data, i_len);
+	else
+	  for (i = 0; i < i_len; i += i_piece)
+	    checksum_update(&sum, data + i, 
+			    i_len - i < i_piece ? i_len - i : i_piece);
+	n = checksum_final(&sum, digest);
+	for (i = 0; i < n; i++)
+	  sprintf(psz_got + 2*i, "%02x", digest[i]);
+	psz_got[2*n] = '\0';
+
+	if (n != checksum_size(algos[a]) || strcmp(psz_got, psz_want)) {
+	  printf("%s of %u bytes in pieces of %u is %s, not %s\n",
+		 checksum_algo_name(algos[a]), i_len, i_piece, psz_got,
+		 psz_want);
+	  return 2;
+	}
+      }
+  }
+  return 0;
+}
+
+/* cdda.cue is one track of 302 sectors from the start of the disc. */
+static int
+check_disc_id(void)
+{
+  cdrom_drive_t *d = cdio_cddap_identify(CDDA_IMAGE, CDDA_MESSAGE_FORGETIT,
+					 NULL);
+  cdio_paranoia_accuraterip_id_t id;
+
+  if (!d || 0 != cdio_cddap_open(d)) {
+    printf("Unable to open %s\n", CDDA_IMAGE);
+    return 77;
+  }
+  if (0 != cdio_paranoia_accuraterip_id(d, &id)) {
+    printf("no AccurateRip identification for %s\n", CDDA_IMAGE);
+    return 1;
+  }
+  printf("%s is dBAR-%03d-%08x-%08x-%08x\n", CDDA_IMAGE, id.i_tracks,
+	 id.i_id1, id.i_id2, id.i_cddb);
+  if (id.i_tracks != 1 || id.i_id1 != 302 || id.i_id2 != 1 + 302 * 2
+      || id.i_cddb != 0x02000401) {
+    printf("expected dBAR-001-0000012e-0000025d-02000401\n");
+    return 2;
+  }
+  cdio_cddap_close(d);
+  return 0;
+}
+
+/* Time each kernel over buf, in MB/s. */
+static void
+bench(const uint8_t *buf, long i_bytes, const char psz_name[])
+{
+  const int i_repeat = 200;
+  double d_start, d_crc, d_ar;
+  uint32_t crc = 0, lo = 0, hi = 0;
+  int k;
+
+  d_start = now();
+  for (k = 0; k < i_repeat; k++)
+    crc = checksum_kernels->crc32(crc, buf, i_bytes);
+  d_crc = now() - d_start;
+
+  d_start = now();
+  for (k = 0; k < i_repeat; k++)
+    checksum_kernels->accuraterip((const int16_t *) buf, i_bytes / 4, 1,
+				  &lo, &hi);
+  d_ar = now() - d_start;
+
+  printf("%-13s CRC32 %7.0f MB/s  AccurateRip %7.0f MB/s  (%08x %08x)\n",
+	 psz_name, d_crc > 0 ? i_repeat * i_bytes / d_crc / 1e6 : 0,
+	 d_ar > 0 ? i_repeat * i_bytes / d_ar / 1e6 : 0, crc, lo + hi);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const bool b_bench = argc > 1 && 0 == strcmp(argv[1], "-b");
+  const long i_bytes = 1024 * CDIO_CD_FRAMESIZE_RAW;
+  const checksum_kernels_t *scalar;
+  uint8_t *buf = malloc(i_bytes);
+  int16_t samples[TRACK_WORDS];
+  long i;
+  int impl;
+  int rc;
+
+  for (i = 0; i < i_bytes; i++)
+    buf[i] = next_random(256);
+
+  i_checksum_use(CHECKSUM_SCALAR);
+  scalar = checksum_kernels;
+  for (impl = CHECKSUM_SCALAR; impl < CHECKSUM_IMPLS; impl++) {
+    if (!i_checksum_use(impl)) continue;
+    if (b_bench) {
+      bench(buf, i_bytes, i_checksum_name(impl));
+      continue;
+    }
+    printf("checking %s kernels\n", i_checksum_name(impl));
+    rc = check_kernels(scalar, buf, 4096);
+    if (rc) return 10 * impl + rc;
+  }
+  free(buf);
+  if (b_bench)
+    return 0;
+
+  /* The samples of a track, with loud ones to make the AccurateRip
+     products overflow 32 bits. */
+  for (i = 0; i < TRACK_WORDS; i++)
+    samples[i] = next_random(0x10000) - 0x8000;
+  for (impl = 0; impl < 4; impl++) {
+    rc = check_track(samples, impl & 1, impl & 2);
+    if (rc) return 50 + impl;
+  }
+
+  rc = check_digests();
+  if (rc) return 60 + rc;
+
+  return check_disc_id();
+}
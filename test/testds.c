@@ -0,0 +1,150 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Tests the CdioVector_t routines of <cdio/ds.h>. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <cdio/ds.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#define N 1000
+
+typedef struct {
+  int i_key;
+  int i_seq;    /* position before sorting, to check stability */
+} item_t;
+
+static int
+item_cmp (const void *p_data1, const void *p_data2)
+{
+  const item_t *p_item1 = p_data1;
+  const item_t *p_item2 = p_data2;
+  return p_item1->i_key - p_item2->i_key;
+}
+
+static int
+key_cmp (const void *p_key, const void *p_data)
+{
+  return *(const int *) p_key - ((const item_t *) p_data)->i_key;
+}
+
+int
+main (int argc, const char *argv[])
+{
+  CdioVector_t *p_vector = _cdio_vector_new ();
+  item_t *p_item;
+  unsigned int i;
+  unsigned int i_index;
+  int i_key;
+
+  if (NULL == p_vector) {
+    printf("_cdio_vector_new failed\n");
+    return 1;
+  }
+
+  if (0 != _cdio_vector_length (p_vector)
+      || NULL != _cdio_vector_get (p_vector, 0)
+      || _cdio_vector_bsearch (p_vector, &i_key, key_cmp, &i_index)
+      || 0 != i_index) {
+    printf("new vector is not empty\n");
+    return 2;
+  }
+
+  /* Keys repeat every 100 elements, in a scrambled order. */
+  for (i = 0; i < N; i++) {
+    p_item = malloc (sizeof (item_t));
+    p_item->i_key = (i * 37) % 100;
+    p_item->i_seq = i;
+    if (!_cdio_vector_append (p_vector, p_item)) {
+      printf("_cdio_vector_append failed\n");
+      return 3;
+    }
+  }
+
+  if (N != _cdio_vector_length (p_vector)
+      || 37 != ((item_t *) _cdio_vector_get (p_vector, 1))->i_key
+      || (void *) _cdio_vector_data (p_vector)[N - 1]
+         != _cdio_vector_get (p_vector, N - 1)
+      || NULL != _cdio_vector_get (p_vector, N)) {
+    printf("vector does not hold what was appended\n");
+    return 4;
+  }
+
+  _cdio_vector_sort (p_vector, item_cmp);
+
+  for (i = 1; i < N; i++) {
+    const item_t *p_prev = _cdio_vector_get (p_vector, i - 1);
+    p_item = _cdio_vector_get (p_vector, i);
+    if (p_prev->i_key > p_item->i_key
+        || (p_prev->i_key == p_item->i_key && p_prev->i_seq > p_item->i_seq)) {
+      printf("sort is wrong or unstable at %u\n", i);
+      return 5;
+    }
+  }
+
+  /* Every key is there 10 times; the search gives the first. */
+  for (i_key = 0; i_key < 100; i_key++) {
+    if (!_cdio_vector_bsearch (p_vector, &i_key, key_cmp, &i_index)
+        || i_index != (unsigned int) i_key * 10) {
+      printf("key %d not found at %u\n", i_key, i_key * 10);
+      return 6;
+    }
+  }
+  i_key = 1000;
+  if (_cdio_vector_bsearch (p_vector, &i_key, key_cmp, &i_index)
+      || N != i_index) {
+    printf("key %d found or put at %u\n", i_key, i_index);
+    return 7;
+  }
+
+  /* Insert a new key where the search says, then remove it again. */
+  p_item = malloc (sizeof (item_t));
+  p_item->i_key = 50;
+  p_item->i_seq = -1;
+  _cdio_vector_bsearch (p_vector, &p_item->i_key, key_cmp, &i_index);
+  if (!_cdio_vector_insert (p_vector, i_index, p_item)
+      || N + 1 != _cdio_vector_length (p_vector)
+      || p_item != _cdio_vector_get (p_vector, 500)
+      || 49 != ((item_t *) _cdio_vector_get (p_vector, 499))->i_key
+      || 50 != ((item_t *) _cdio_vector_get (p_vector, 501))->i_key) {
+    printf("_cdio_vector_insert failed\n");
+    return 8;
+  }
+  _cdio_vector_remove (p_vector, 500, true);
+  if (N != _cdio_vector_length (p_vector)
+      || -1 == ((item_t *) _cdio_vector_get (p_vector, 500))->i_seq) {
+    printf("_cdio_vector_remove failed\n");
+    return 9;
+  }
+
+  i_index = 0;
+  _CDIO_VECTOR_FOREACH (i, p_item, p_vector)
+    i_index++;
+  if (N != i_index) {
+    printf("_CDIO_VECTOR_FOREACH visited %u elements\n", i_index);
+    return 10;
+  }
+
+  _cdio_vector_free (p_vector, true);
+  return 0;
+}
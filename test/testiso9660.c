@@ -32,7 +32,33 @@
 #ifdef HAVE_STDIO_H
 #include <stdio.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <cdio/iso9660.h>
+#include <cdio/bytesex.h>
+
+#ifdef HAVE_PTHREAD
+/* Format the mode p_data points to over and over with the
+   library-buffer function, while another thread does the same with
+   another mode. Return non-NULL if the string ever comes back wrong. */
+static void *
+rock_attr_thread(void *p_data)
+{
+  const posix_mode_t st_mode = *(posix_mode_t *) p_data;
+  char psz_expect[ISO9660_ROCK_ATTR_STR_SIZE];
+  unsigned int i;
+
+  iso9660_get_rock_attr_str_r(st_mode, psz_expect);
+  for (i = 0; i < 100000; i++)
+    if (strcmp(psz_expect, iso9660_get_rock_attr_str(st_mode)))
+      return p_data;
+  return NULL;
+}
+#endif
 
 static bool 
 time_compare(struct tm *p_tm1, struct tm *p_tm2) 
@@ -286,5 +312,53 @@ main (int argc, const char *argv[])
     }
   }
 
+  /*********************************************
+   * Test attribute strings
+   *********************************************/
+
+  {
+    char buf[ISO9660_XA_ATTR_STR_SIZE];
+    const char *psz_dir = iso9660_get_rock_attr_str(S_IFDIR | 0755);
+    unsigned int i;
+
+    for (i = 0; i < 15; i++) 
+      iso9660_get_rock_attr_str(S_IFREG | 0644);
+    if (strcmp("drwxr-xr-x", psz_dir)) {
+      printf("iso9660_get_rock_attr_str() gave %s\n", psz_dir);
+      return 47;
+    }
+    if (strcmp("-rw-r--r--", 
+               iso9660_get_rock_attr_str_r(S_IFREG | 0644, buf))) {
+      printf("iso9660_get_rock_attr_str_r() gave %s\n", buf);
+      return 48;
+    }
+    if (strcmp("d---1xrxrxr", 
+               iso9660_get_xa_attr_str_r(uint16_to_be(XA_FORM1_DIR), buf))
+        || strcmp(buf, iso9660_get_xa_attr_str(uint16_to_be(XA_FORM1_DIR)))) {
+      printf("iso9660_get_xa_attr_str_r() gave %s\n", buf);
+      return 49;
+    }
+  }
+
+#ifdef HAVE_PTHREAD
+  {
+    posix_mode_t modes[2] = { S_IFDIR | 0755, S_IFLNK | 0777 };
+    pthread_t threads[2];
+    void *p_result[2];
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+      if (pthread_create(&threads[i], NULL, rock_attr_thread, &modes[i]))
+        return 50;
+    for (i = 0; i < 2; i++)
+      pthread_join(threads[i], &p_result[i]);
+    if (p_result[0] || p_result[1]) {
+      printf("iso9660_get_rock_attr_str() strings changed under another "
+             "thread\n");
+      return 51;
+    }
+  }
+#endif
+
   return 0;
 }
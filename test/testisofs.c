@@ -0,0 +1,842 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Tests the iso9660_ifs_* filesystem routines on the Rock Ridge
+   image in the libcdio distribution. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include <cdio/cdio.h>
+#include <cdio/bytesex.h>
+#include <cdio/iso9660.h>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define ISO9660_IMAGE TEST_DIR "/copying-rr.iso"
+#define ISO9660_PLAIN_IMAGE TEST_DIR "/copying.iso"
+
+/* Check that the arena readdir and iso9660_ifs_readdir_vector give
+   the same entries as iso9660_ifs_readdir for psz_path, whose stat is
+   p_dir. */
+static int
+check_readdir_arena(iso9660_t *p_iso, iso9660_arena_t *p_arena,
+                    const char psz_path[], const iso9660_stat_t *p_dir)
+{
+  CdioList_t *p_entlist = iso9660_ifs_readdir (p_iso, psz_path);
+  CdioVector_t *p_entvector = iso9660_ifs_readdir_vector (p_iso, psz_path);
+  CdioListNode_t *p_entnode;
+  unsigned int i_entries = 0;
+  unsigned int i = 0;
+  iso9660_stat_t **pp_stat =
+    iso9660_ifs_readdir_arena (p_iso, p_dir, p_arena, &i_entries);
+
+  if (NULL == p_entlist || NULL == p_entvector || NULL == pp_stat) {
+    printf("Reading directory %s failed\n", psz_path);
+    return 1;
+  }
+
+  if (i_entries != _cdio_list_length (p_entlist)) {
+    printf("%s: arena readdir gives %u entries, readdir gives %u\n",
+           psz_path, i_entries, _cdio_list_length (p_entlist));
+    return 2;
+  }
+
+  if (i_entries != _cdio_vector_length (p_entvector)) {
+    printf("%s: vector readdir gives %u entries, readdir gives %u\n",
+           psz_path, _cdio_vector_length (p_entvector), i_entries);
+    return 6;
+  }
+
+  _CDIO_LIST_FOREACH (p_entnode, p_entlist) {
+    iso9660_stat_t *p_statbuf = _cdio_list_node_data (p_entnode);
+    iso9660_stat_t *p_vectorbuf = _cdio_vector_get (p_entvector, i);
+    iso9660_stat_t *p_arenabuf = pp_stat[i++];
+
+    if (strcmp(p_statbuf->filename, p_vectorbuf->filename)
+        || p_statbuf->lsn != p_vectorbuf->lsn) {
+      printf("%s: entry %s differs from vector entry %s\n",
+             psz_path, p_statbuf->filename, p_vectorbuf->filename);
+      return 7;
+    }
+    free(p_vectorbuf->rr.psz_symlink);
+
+    if (strcmp(p_statbuf->filename, p_arenabuf->filename)
+        || p_statbuf->lsn  != p_arenabuf->lsn
+        || p_statbuf->size != p_arenabuf->size
+        || p_statbuf->type != p_arenabuf->type
+        || p_statbuf->rr.st_mode != p_arenabuf->rr.st_mode) {
+      printf("%s: entry %s differs from arena entry %s\n",
+             psz_path, p_statbuf->filename, p_arenabuf->filename);
+      return 3;
+    }
+    if (p_statbuf->rr.i_symlink != p_arenabuf->rr.i_symlink
+        || (p_statbuf->rr.i_symlink
+            && strcmp(p_statbuf->rr.psz_symlink,
+                      p_arenabuf->rr.psz_symlink))) {
+      printf("%s: symbolic link of %s differs in arena entry\n",
+             psz_path, p_statbuf->filename);
+      return 4;
+    }
+    free(p_statbuf->rr.psz_symlink);
+  }
+
+  if (NULL != pp_stat[i]) {
+    printf("%s: arena readdir result is not NULL terminated\n", psz_path);
+    return 5;
+  }
+
+  _cdio_list_free (p_entlist, true);
+  _cdio_vector_free (p_entvector, true);
+  return 0;
+}
+
+/* iso9660_ifs_walk() callback: append each directory path and the
+   number of entries in it to the string buffer p_user_data. */
+typedef struct {
+  char   psz_log[4096];
+  size_t i_len;
+} walk_log_t;
+
+static int
+log_dir(const char psz_path[], iso9660_stat_t **pp_entries,
+        unsigned int i_entries, void *p_user_data)
+{
+  walk_log_t *p_log = p_user_data;
+  p_log->i_len += snprintf(p_log->psz_log + p_log->i_len,
+                           sizeof(p_log->psz_log) - p_log->i_len,
+                           "%s %u\n", psz_path, pp_entries ? i_entries : 0);
+  return 0;
+}
+
+static int
+stop_walk(const char psz_path[], iso9660_stat_t **pp_entries,
+          unsigned int i_entries, void *p_user_data)
+{
+  (*(unsigned int *) p_user_data)++;
+  return 1;
+}
+
+/* An ordered walk must give the same result whatever the number of
+   threads, and stopping early must be reported. */
+static int
+check_walk(iso9660_t *p_iso)
+{
+  walk_log_t serial, parallel;
+  unsigned int i_calls = 0;
+
+  memset(&serial, 0, sizeof(serial));
+  memset(&parallel, 0, sizeof(parallel));
+
+  if (!iso9660_ifs_walk(p_iso, log_dir, &serial, 1, ISO9660_WALK_ORDERED)) {
+    printf("Serial walk failed\n");
+    return 1;
+  }
+  if (strncmp(serial.psz_log, "/ ", 2)) {
+    printf("Serial walk did not start at the root:\n%s", serial.psz_log);
+    return 2;
+  }
+  if (!iso9660_ifs_walk(p_iso, log_dir, &parallel, 4, 
+                        ISO9660_WALK_ORDERED)) {
+    printf("Parallel walk failed\n");
+    return 3;
+  }
+  if (strcmp(serial.psz_log, parallel.psz_log)) {
+    printf("Serial walk:\n%sdiffers from parallel walk:\n%s",
+           serial.psz_log, parallel.psz_log);
+    return 4;
+  }
+  if (iso9660_ifs_walk(p_iso, stop_walk, &i_calls, 4, 0) || 1 != i_calls) {
+    printf("Stopping a walk didn't work (%u calls)\n", i_calls);
+    return 5;
+  }
+  return 0;
+}
+
+/* Look up psz_path in p_iso, twice so the second lookup goes through
+   the cached name index. Return the LSN found, or 0 if none was. */
+static lsn_t
+lookup_lsn(iso9660_t *p_iso, const char psz_path[])
+{
+  lsn_t lsn = 0;
+  unsigned int i;
+
+  for (i = 0; i < 2; i++) {
+    iso9660_stat_t *p_stat = iso9660_ifs_stat(p_iso, psz_path);
+    if (!p_stat) return 0;
+    if (i && lsn != p_stat->lsn) {
+      printf("%s: second lookup gives LSN %lu, first %lu\n", psz_path,
+             (long unsigned int) p_stat->lsn, (long unsigned int) lsn);
+      lsn = 0;
+    } else
+      lsn = p_stat->lsn;
+    free(p_stat->rr.psz_symlink);
+    free(p_stat);
+  }
+  return lsn;
+}
+
+/* Path lookups match Rock Ridge names as is and plain ISO 9660 names
+   either as recorded or translated. */
+static int
+check_lookup(iso9660_t *p_iso)
+{
+  iso9660_t *p_plain;
+  lsn_t lsn;
+
+  if (!lookup_lsn(p_iso, "/copy/COPYING")) {
+    printf("/copy/COPYING not found\n");
+    return 1;
+  }
+  if (lookup_lsn(p_iso, "/copy/nosuchfile") 
+      || lookup_lsn(p_iso, "/nosuchdir/x")) {
+    printf("Found a file that doesn't exist\n");
+    return 2;
+  }
+
+  p_plain = iso9660_open (ISO9660_PLAIN_IMAGE);
+  if (!p_plain) {
+    printf("Sorry, couldn't open ISO9660 image %s\n", ISO9660_PLAIN_IMAGE);
+    return 3;
+  }
+  lsn = lookup_lsn(p_plain, "/COPYING.;1");
+  if (!lsn || lsn != lookup_lsn(p_plain, "/copying")) {
+    printf("/COPYING.;1 and /copying should be the same file\n");
+    return 4;
+  }
+  if (lookup_lsn(p_plain, "/COPYING")) {
+    printf("/COPYING should not match a translated name\n");
+    return 5;
+  }
+  iso9660_close(p_plain);
+  return 0;
+}
+
+/* Read all of p_stat with iso9660_ifs_read_file() into a malloc'd
+   buffer, in pieces of i_piece bytes. */
+static uint8_t *
+read_whole_file(iso9660_t *p_iso, const iso9660_stat_t *p_stat,
+                long int i_piece)
+{
+  uint8_t *p_buf = malloc(p_stat->total_size + 1);
+  uint64_t i_pos;
+
+  for (i_pos = 0; p_buf && i_pos < p_stat->total_size; i_pos += i_piece) {
+    long int i_want = i_piece;
+    if (i_want > p_stat->total_size - i_pos) 
+      i_want = p_stat->total_size - i_pos;
+    if (iso9660_ifs_read_file(p_iso, p_stat, i_pos, p_buf + i_pos, i_piece)
+        != i_want) {
+      printf("Reading %ld bytes at %lu failed\n", i_want, 
+             (long unsigned int) i_pos);
+      free(p_buf);
+      return NULL;
+    }
+  }
+  return p_buf;
+}
+
+/* Make a copy of ISO9660_PLAIN_IMAGE in which COPYING.;1 is recorded
+   as a multi-extent file: one extent of two blocks and one with the
+   rest. */
+static bool
+make_multiextent_image(const char psz_out[], lsn_t root_lsn)
+{
+  FILE *p_in = fopen(ISO9660_PLAIN_IMAGE, "rb");
+  FILE *p_out = fopen(psz_out, "wb");
+  uint8_t *p_image;
+  uint8_t *p_dir;
+  long int i_size;
+  unsigned int offset;
+  bool b_ok = false;
+
+  if (!p_in || !p_out) return false;
+  fseek(p_in, 0, SEEK_END);
+  i_size = ftell(p_in);
+  fseek(p_in, 0, SEEK_SET);
+  p_image = malloc(i_size);
+  if (p_image && 1 == fread(p_image, i_size, 1, p_in)) {
+    p_dir = p_image + root_lsn * ISO_BLOCKSIZE;
+    for (offset = 0; offset < ISO_BLOCKSIZE && p_dir[offset]; 
+         offset += p_dir[offset]) {
+      iso9660_dir_t *p_record = (iso9660_dir_t *) &p_dir[offset];
+      if (!strncmp(p_record->filename, "COPYING", 7)) {
+        unsigned int i_len = p_dir[offset];
+        unsigned int i_end = offset;
+        uint32_t i_file = from_733(p_record->size);
+        iso9660_dir_t *p_tail;
+
+        while (i_end < ISO_BLOCKSIZE && p_dir[i_end]) i_end += p_dir[i_end];
+        if (i_end + i_len > ISO_BLOCKSIZE) break;
+        /* Make room right after the record for its continuation. */
+        memmove(&p_dir[offset + 2*i_len], &p_dir[offset + i_len], 
+                i_end - offset - i_len);
+        p_tail = (iso9660_dir_t *) &p_dir[offset + i_len];
+        memcpy(p_tail, p_record, i_len);
+        p_record->file_flags |= ISO_MULTIEXTENT;
+        p_record->size = to_733(2 * ISO_BLOCKSIZE);
+        p_tail->extent = to_733(from_733(p_record->extent) + 2);
+        p_tail->size   = to_733(i_file - 2 * ISO_BLOCKSIZE);
+        b_ok = 1 == fwrite(p_image, i_size, 1, p_out);
+        break;
+      }
+    }
+  }
+  free(p_image);
+  fclose(p_in);
+  fclose(p_out);
+  return b_ok;
+}
+
+/* Scratch image for check_read_file(), named so that the image globs
+   of check_fuzzyiso.sh never pick it up half-written. */
+#define MULTI_IMAGE "testisofs-multi.tmp"
+
+/* File reads must give the same bytes as reading the blocks one by
+   one, whatever the offset and size of the pieces, and follow all
+   extents of a multi-extent file. */
+static int
+check_read_file(void)
+{
+  const char psz_copy[] = "testisofs.out";
+  const char psz_multi[] = MULTI_IMAGE;
+  iso9660_t *p_plain = iso9660_open (ISO9660_PLAIN_IMAGE);
+  iso9660_t *p_multi;
+  iso9660_stat_t *p_stat;
+  iso9660_stat_t *p_root;
+  uint8_t *p_whole, *p_pieces, *p_blocks;
+  CdioList_t *p_entlist;
+  FILE *p_file;
+  lsn_t root_lsn;
+  uint32_t i;
+
+  if (!p_plain) return 1;
+  p_stat = iso9660_ifs_stat(p_plain, "/copying");
+  p_root = iso9660_ifs_stat(p_plain, "/");
+  if (!p_stat || !p_root || 1 != p_stat->i_extents 
+      || p_stat->total_size != p_stat->size) {
+    printf("Bad stat for /copying\n");
+    return 2;
+  }
+  root_lsn = p_root->lsn;
+
+  p_blocks = calloc(1, p_stat->secsize * ISO_BLOCKSIZE);
+  for (i = 0; i < p_stat->secsize; i++)
+    iso9660_iso_seek_read(p_plain, p_blocks + i * ISO_BLOCKSIZE, 
+                          p_stat->lsn + i, 1);
+  p_whole  = read_whole_file(p_plain, p_stat, p_stat->size + 4096);
+  p_pieces = read_whole_file(p_plain, p_stat, 1000);
+  if (!p_whole || !p_pieces 
+      || memcmp(p_whole, p_blocks, p_stat->size)
+      || memcmp(p_pieces, p_blocks, p_stat->size)) {
+    printf("iso9660_ifs_read_file gives the wrong data\n");
+    return 3;
+  }
+  free(p_pieces);
+  if (0 != iso9660_ifs_read_file(p_plain, p_stat, p_stat->size, p_blocks, 
+                                 10)) {
+    printf("Reading past the end of the file should give nothing\n");
+    return 4;
+  }
+
+  /* iso9660_ifs_copy_file() */
+  p_file = fopen(psz_copy, "w+b");
+  if (!p_file || !iso9660_ifs_copy_file(p_plain, p_stat, fileno(p_file))) {
+    printf("iso9660_ifs_copy_file failed\n");
+    return 5;
+  }
+  memset(p_blocks, 0, p_stat->size);
+  fseek(p_file, 0, SEEK_SET);
+  if (1 != fread(p_blocks, p_stat->size, 1, p_file) 
+      || memcmp(p_whole, p_blocks, p_stat->size) || fgetc(p_file) != EOF) {
+    printf("iso9660_ifs_copy_file gives the wrong data\n");
+    return 6;
+  }
+  fclose(p_file);
+  remove(psz_copy);
+  iso9660_close(p_plain);
+
+  /* The same file, recorded in two extents. */
+  if (!make_multiextent_image(psz_multi, root_lsn)) {
+    printf("Couldn't make %s\n", psz_multi);
+    return 7;
+  }
+  p_multi = iso9660_open (psz_multi);
+  if (!p_multi) return 8;
+  p_entlist = iso9660_ifs_readdir (p_multi, "/");
+  if (!p_entlist || 3 != _cdio_list_length (p_entlist)) {
+    printf("Extents of a multi-extent file should give one entry\n");
+    return 9;
+  }
+  _cdio_list_free (p_entlist, true);
+
+  free(p_stat->rr.psz_symlink);
+  free(p_stat);
+  p_stat = iso9660_ifs_stat(p_multi, "/copying");
+  {
+    /* Reuse any memory the lookup freed, so that extents left
+       pointing into it read back as garbage. */
+    void *p_churn[64];
+    unsigned int i;
+    for (i = 0; i < 64; i++) {
+      p_churn[i] = malloc(16 + 8 * i);
+      if (p_churn[i]) memset(p_churn[i], 0xff, 16 + 8 * i);
+    }
+    for (i = 0; i < 64; i++)
+      free(p_churn[i]);
+  }
+  if (!p_stat || 2 != p_stat->i_extents 
+      || p_stat->total_size != 2 * ISO_BLOCKSIZE + p_stat->p_extents[1].size) {
+    printf("Bad stat for the multi-extent /copying\n");
+    return 10;
+  }
+  p_pieces = read_whole_file(p_multi, p_stat, 3000);
+  if (!p_pieces || memcmp(p_whole, p_pieces, p_stat->total_size)) {
+    printf("Reading a multi-extent file gives the wrong data\n");
+    return 11;
+  }
+  free(p_pieces);
+
+  /* A copy keeps the extents once the entry copied is gone. */
+  {
+    iso9660_stat_t *p_copy = iso9660_stat_dup(p_stat);
+    free(p_stat->rr.psz_symlink);
+    free(p_stat);
+    p_stat = p_copy;
+  }
+  p_pieces = p_stat ? read_whole_file(p_multi, p_stat, 5000) : NULL;
+  if (!p_pieces || 2 != p_stat->i_extents
+      || memcmp(p_whole, p_pieces, p_stat->total_size)) {
+    printf("A copy of a multi-extent entry gives the wrong data\n");
+    return 12;
+  }
+  free(p_pieces);
+  iso9660_close(p_multi);
+
+  free(p_whole);
+  free(p_blocks);
+  free(p_stat->rr.psz_symlink);
+  free(p_stat);
+  free(p_root->rr.psz_symlink);
+  free(p_root);
+  return 0;
+}
+
+/* The tree check_build() builds an image from. */
+#define BUILD_TREE "testisofs-tree"
+#define BUILD_LONG_NAME \
+  "a-name-that-is-much-longer-than-iso-9660-allows-but-rock-ridge-" \
+  "and-joliet-can-keep.txt"
+static const char *build_files[] = {
+  "hello.txt", "a+b.txt", "a-b.txt", "empty", BUILD_LONG_NAME,
+  "sub/deep/data.bin", NULL
+};
+
+static bool
+write_test_file(const char psz_path[], const uint8_t *p_data, size_t i_size)
+{
+  FILE *p_file = fopen(psz_path, "wb");
+  bool b_ok = p_file && (0 == i_size || 1 == fwrite(p_data, i_size, 1, p_file));
+  if (p_file) fclose(p_file);
+  return b_ok;
+}
+
+static void
+remove_build_tree(void)
+{
+  char psz_path[300];
+  unsigned int i;
+
+  for (i = 0; build_files[i]; i++) {
+    snprintf(psz_path, sizeof(psz_path), BUILD_TREE "/%s", build_files[i]);
+    unlink(psz_path);
+  }
+  unlink(BUILD_TREE "/link");
+  rmdir(BUILD_TREE "/sub/deep");
+  rmdir(BUILD_TREE "/sub");
+  rmdir(BUILD_TREE);
+}
+
+static bool
+check_build_file(iso9660_t *p_iso, const char psz_path[],
+                 const uint8_t *p_data, size_t i_size)
+{
+  iso9660_stat_t *p_stat = iso9660_ifs_stat(p_iso, psz_path);
+  uint8_t *p_buf;
+  bool b_ok;
+
+  if (!p_stat || p_stat->total_size != i_size) {
+    printf("Bad stat for %s in the built image\n", psz_path);
+    return false;
+  }
+  p_buf = malloc(i_size + 1);
+  b_ok = p_buf
+    && (long int) i_size == iso9660_ifs_read_file(p_iso, p_stat, 0, p_buf,
+                                                  i_size + 1)
+    && 0 == memcmp(p_buf, p_data, i_size);
+  if (!b_ok) printf("Wrong data for %s in the built image\n", psz_path);
+  free(p_buf);
+  free(p_stat->rr.psz_symlink);
+  free(p_stat);
+  return b_ok;
+}
+
+/* Scratch image for check_build(), kept out of the image globs like
+   MULTI_IMAGE. */
+#define BUILD_IMAGE "testisofs-build.tmp"
+
+/* Build an image from a small tree and read it back with Rock Ridge
+   and with Joliet. */
+static int
+check_build(void)
+{
+  const char psz_image[] = BUILD_IMAGE;
+  uint8_t data[5000];
+  iso9660_builder_t *p_builder;
+  iso9660_t *p_iso;
+  iso9660_stat_t *p_stat;
+  CdioList_t *p_entlist;
+  CdioListNode_t *p_entnode;
+  uint32_t i_blocks;
+  struct stat st;
+  unsigned int i;
+  int fd;
+  int rc = 0;
+
+  for (i = 0; i < sizeof(data); i++) data[i] = i * 7 + (i >> 8);
+  remove_build_tree();
+  if (mkdir(BUILD_TREE, 0755) || mkdir(BUILD_TREE "/sub", 0755)
+      || mkdir(BUILD_TREE "/sub/deep", 0755)
+      || !write_test_file(BUILD_TREE "/hello.txt",
+                          (const uint8_t *) "Hello, world\n", 13)
+      || !write_test_file(BUILD_TREE "/a+b.txt", (const uint8_t *) "plus", 4)
+      || !write_test_file(BUILD_TREE "/a-b.txt", (const uint8_t *) "minus", 5)
+      || !write_test_file(BUILD_TREE "/empty", NULL, 0)
+      || !write_test_file(BUILD_TREE "/" BUILD_LONG_NAME, data, 100)
+      || !write_test_file(BUILD_TREE "/sub/deep/data.bin", data, sizeof(data))
+      || symlink("sub/deep/data.bin", BUILD_TREE "/link")) {
+    printf("Couldn't make the tree " BUILD_TREE "\n");
+    remove_build_tree();
+    return 1;
+  }
+
+  p_builder = iso9660_builder_new("TESTISOFS", NULL, NULL, "TESTISOFS",
+                                  ISO9660_BUILD_ROCK | ISO9660_BUILD_JOLIET);
+  if (!p_builder || !iso9660_builder_scan(p_builder, BUILD_TREE, 2)) {
+    printf("Scanning " BUILD_TREE " failed\n");
+    remove_build_tree();
+    return 2;
+  }
+  i_blocks = iso9660_builder_get_blocks(p_builder);
+  fd = open(psz_image, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || !iso9660_builder_write(p_builder, fd)) {
+    printf("Writing %s failed\n", psz_image);
+    remove_build_tree();
+    return 3;
+  }
+  close(fd);
+  iso9660_builder_free(p_builder);
+  remove_build_tree();
+  if (stat(psz_image, &st) || st.st_size != (off_t) i_blocks * ISO_BLOCKSIZE) {
+    printf("%s should have %u blocks\n", psz_image, (unsigned int) i_blocks);
+    return 4;
+  }
+
+  /* Rock Ridge */
+  p_iso = iso9660_open_ext(psz_image, ISO_EXTENSION_ROCK_RIDGE);
+  if (!p_iso) return 5;
+  p_entlist = iso9660_ifs_readdir(p_iso, "/");
+  if (!p_entlist || 9 != _cdio_list_length(p_entlist)) {
+    printf("The root of the built image should have 9 entries\n");
+    return 6;
+  }
+  _CDIO_LIST_FOREACH (p_entnode, p_entlist) {
+    p_stat = _cdio_list_node_data (p_entnode);
+    free(p_stat->rr.psz_symlink);
+  }
+  _cdio_list_free(p_entlist, true);
+  if (!check_build_file(p_iso, "/hello.txt", 
+                        (const uint8_t *) "Hello, world\n", 13)
+      || !check_build_file(p_iso, "/a+b.txt", (const uint8_t *) "plus", 4)
+      || !check_build_file(p_iso, "/a-b.txt", (const uint8_t *) "minus", 5)
+      || !check_build_file(p_iso, "/empty", NULL, 0)
+      || !check_build_file(p_iso, "/" BUILD_LONG_NAME, data, 100)
+      || !check_build_file(p_iso, "/sub/deep/data.bin", data, sizeof(data)))
+    return 7;
+  p_stat = iso9660_ifs_stat(p_iso, "/link");
+  if (!p_stat || !p_stat->rr.psz_symlink 
+      || strcmp(p_stat->rr.psz_symlink, "sub/deep/data.bin")) {
+    printf("/link should be a symbolic link to sub/deep/data.bin\n");
+    return 8;
+  }
+  free(p_stat->rr.psz_symlink);
+  free(p_stat);
+  iso9660_close(p_iso);
+
+#ifdef HAVE_JOLIET
+  p_iso = iso9660_open_ext(psz_image, ISO_EXTENSION_JOLIET);
+  if (!p_iso) return 9;
+  if (3 != iso9660_ifs_get_joliet_level(p_iso)) {
+    printf("The built image should have Joliet level 3\n");
+    return 10;
+  }
+  p_entlist = iso9660_ifs_readdir(p_iso, "/");
+  if (!p_entlist || 8 != _cdio_list_length(p_entlist)) {
+    printf("The Joliet root of the built image should have 8 entries\n");
+    return 11;
+  }
+  _cdio_list_free(p_entlist, true);
+  if (!check_build_file(p_iso, "/a+b.txt", (const uint8_t *) "plus", 4)
+      || !check_build_file(p_iso, "/sub/deep/data.bin", data, sizeof(data)))
+    rc = 12;
+  iso9660_close(p_iso);
+#endif
+
+  return rc;
+}
+
+/* Scratch image for check_fuzzy(), kept out of the image globs like
+   MULTI_IMAGE. */
+#define FUZZY_IMAGE "testisofs-fuzzy.tmp"
+
+/* A fuzzy open has to find the primary volume descriptor of an image
+   that has lost its first blocks and is no longer block-aligned, but
+   only when the search reaches that far. */
+static int
+check_fuzzy(void)
+{
+  const char psz_fuzzy[] = FUZZY_IMAGE;
+  const long int i_cut = 10 * ISO_BLOCKSIZE + 3;
+  FILE *p_in = fopen(ISO9660_PLAIN_IMAGE, "rb");
+  FILE *p_out = fopen(psz_fuzzy, "wb");
+  iso9660_t *p_plain, *p_fuzzy;
+  iso9660_stat_t *p_plain_stat, *p_stat;
+  uint8_t *p_want, *p_got;
+  uint8_t *p_image;
+  char *psz_id = NULL;
+  long int i_size;
+  bool b_ok = false;
+
+  if (!p_in || !p_out) return 1;
+  fseek(p_in, 0, SEEK_END);
+  i_size = ftell(p_in);
+  fseek(p_in, 0, SEEK_SET);
+  p_image = malloc(i_size);
+  if (p_image && 1 == fread(p_image, i_size, 1, p_in))
+    b_ok = 1 == fwrite(p_image + i_cut, i_size - i_cut, 1, p_out);
+  free(p_image);
+  fclose(p_in);
+  fclose(p_out);
+  if (!b_ok) {
+    printf("Couldn't make %s\n", psz_fuzzy);
+    return 2;
+  }
+
+  p_fuzzy = iso9660_open_fuzzy (psz_fuzzy, 5);
+  if (p_fuzzy) {
+    printf("A fuzz of 5 should not reach the PVD at block 6\n");
+    return 3;
+  }
+  p_fuzzy = iso9660_open_fuzzy (psz_fuzzy, 3000);
+  if (!p_fuzzy || !iso9660_ifs_get_volume_id(p_fuzzy, &psz_id)
+      || strcmp(psz_id, "CDROM")) {
+    printf("Fuzzy open of %s failed\n", psz_fuzzy);
+    return 4;
+  }
+  free(psz_id);
+
+  p_plain = iso9660_open (ISO9660_PLAIN_IMAGE);
+  if (!p_plain) return 5;
+  p_plain_stat = iso9660_ifs_stat(p_plain, "/copying");
+  p_stat = iso9660_ifs_stat(p_fuzzy, "/copying");
+  if (!p_plain_stat || !p_stat || p_stat->size != p_plain_stat->size) {
+    printf("Bad stat for /copying in %s\n", psz_fuzzy);
+    return 6;
+  }
+  p_want = read_whole_file(p_plain, p_plain_stat, 4096);
+  p_got  = read_whole_file(p_fuzzy, p_stat, 4096);
+  if (!p_want || !p_got || memcmp(p_want, p_got, p_stat->size)) {
+    printf("Fuzzy open of %s gives the wrong data\n", psz_fuzzy);
+    return 7;
+  }
+  free(p_want);
+  free(p_got);
+  free(p_stat->rr.psz_symlink);
+  free(p_stat);
+  free(p_plain_stat->rr.psz_symlink);
+  free(p_plain_stat);
+  iso9660_close(p_plain);
+  iso9660_close(p_fuzzy);
+  return 0;
+}
+
+/* With ISO9660_DECODE_NAME only the names and extents are filled in,
+   and they must be the same as when everything is decoded. */
+static int
+check_decode(iso9660_t *p_iso)
+{
+  iso9660_arena_t *p_arena = iso9660_arena_new(0);
+  iso9660_stat_t **pp_all, **pp_names;
+  iso9660_stat_t *p_all, *p_name;
+  unsigned int i_all = 0, i_names = 0;
+  unsigned int i;
+  int rc = 0;
+
+  if (ISO9660_DECODE_ALL != iso9660_ifs_get_decode(p_iso)) {
+    printf("Everything should be decoded by default\n");
+    return 1;
+  }
+  p_all = iso9660_ifs_stat(p_iso, "/copy/COPYING");
+  iso9660_ifs_set_decode(p_iso, ISO9660_DECODE_NAME);
+  p_name = iso9660_ifs_stat(p_iso, "/copy/COPYING");
+  if (!p_all || !p_name || p_all->lsn != p_name->lsn 
+      || p_all->size != p_name->size || yep != p_name->rr.b3_rock) {
+    printf("Bad stat for /copy/COPYING decoding names only\n");
+    return 2;
+  }
+  if (!p_all->rr.st_mode || !p_all->tm.tm_year 
+      || !p_all->rr.modify.b_used) {
+    printf("Rock Ridge attributes or times missing for /copy/COPYING\n");
+    return 3;
+  }
+  if (p_name->rr.st_mode || p_name->tm.tm_year 
+      || p_name->rr.modify.b_used) {
+    printf("Attributes or times decoded when only names were asked for\n");
+    return 4;
+  }
+  free(p_all);
+  free(p_name);
+
+  iso9660_ifs_set_decode(p_iso, ISO9660_DECODE_ATTRS);
+  p_name = iso9660_ifs_stat(p_iso, "/copy/COPYING");
+  if (!p_name || !p_name->rr.st_mode || p_name->rr.modify.b_used) {
+    printf("ISO9660_DECODE_ATTRS should give modes but not times\n");
+    return 5;
+  }
+  free(p_name);
+
+  iso9660_ifs_set_decode(p_iso, ISO9660_DECODE_NAME);
+  pp_names = iso9660_ifs_readdir_arena(p_iso, NULL, p_arena, &i_names);
+  iso9660_ifs_set_decode(p_iso, ISO9660_DECODE_ALL);
+  pp_all = iso9660_ifs_readdir_arena(p_iso, NULL, p_arena, &i_all);
+  if (!pp_names || !pp_all || i_names != i_all) {
+    printf("readdir decoding names only gives %u entries, not %u\n", 
+           i_names, i_all);
+    return 6;
+  }
+  for (i = 0; i < i_all; i++)
+    if (strcmp(pp_names[i]->filename, pp_all[i]->filename)
+        || pp_names[i]->lsn != pp_all[i]->lsn) {
+      printf("Entry %u is %s decoding names only, %s otherwise\n", i,
+             pp_names[i]->filename, pp_all[i]->filename);
+      rc = 7;
+    }
+  iso9660_arena_free(p_arena);
+  return rc;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  iso9660_t *p_iso;
+  iso9660_arena_t *p_arena;
+  iso9660_stat_t **pp_root;
+  unsigned int i_root = 0;
+  unsigned int i;
+  int rc;
+
+  p_iso = iso9660_open_ext (ISO9660_IMAGE, ISO_EXTENSION_ALL);
+  if (!p_iso) {
+    fprintf(stderr, "Sorry, couldn't open ISO9660 image %s\n",
+            ISO9660_IMAGE);
+    return 1;
+  }
+
+  p_arena = iso9660_arena_new(0);
+  if (!p_arena) {
+    fprintf(stderr, "Couldn't create an arena\n");
+    return 2;
+  }
+
+  rc = check_readdir_arena(p_iso, p_arena, "/", NULL);
+  if (rc) return 10+rc;
+
+  /* Walk the subdirectories with the arena entries of the root. */
+  pp_root = iso9660_ifs_readdir_arena (p_iso, NULL, p_arena, &i_root);
+  for (i = 0; i < i_root; i++) {
+    iso9660_stat_t *p_stat = pp_root[i];
+    char psz_path[300];
+
+    if (p_stat->type != _STAT_DIR || !strcmp(p_stat->filename, ".")
+        || !strcmp(p_stat->filename, ".."))
+      continue;
+    snprintf(psz_path, sizeof(psz_path), "/%s/", p_stat->filename);
+    rc = check_readdir_arena(p_iso, p_arena, psz_path, p_stat);
+    if (rc) return 20+rc;
+  }
+
+  /* After a reset the arena must hand out the same results again. */
+  iso9660_arena_reset(p_arena);
+  rc = check_readdir_arena(p_iso, p_arena, "/", NULL);
+  if (rc) return 30+rc;
+
+  rc = check_walk(p_iso);
+  if (rc) return 40+rc;
+
+  rc = check_lookup(p_iso);
+  if (rc) return 50+rc;
+
+  rc = check_read_file();
+  remove(MULTI_IMAGE);
+  if (rc) return 60+rc;
+
+  rc = check_build();
+  remove(BUILD_IMAGE);
+  if (rc) return 70+rc;
+
+  rc = check_fuzzy();
+  remove(FUZZY_IMAGE);
+  if (rc) return 80+rc;
+
+  rc = check_decode(p_iso);
+  if (rc) return 90+rc;
+
+  iso9660_arena_free(p_arena);
+  iso9660_close(p_iso);
+  return 0;
+}
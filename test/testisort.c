@@ -0,0 +1,347 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checks that paranoia's sample index (lib/paranoia/isort.c) finds
+   the same samples, in the same order, as the 65536 linked lists it
+   replaced, on the samples of cdda.bin and on some silence.
+
+     testisort -b [file]
+
+   times building and searching the old index against the new one
+   instead, the way try_sort_sync() searches, on cdda.bin or on the
+   raw CD audio in file: cdda.bin is mostly silence, so a rip of some
+   music gives a truer picture. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <sys/time.h>
+
+#include "p_block.h"
+#include "isort.h"
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define CDDA_IMAGE TEST_DIR "/cdda.bin"
+
+/* The size paranoia indexes, readahead sectors of samples. */
+#define MAXSIZE (150 * CD_FRAMEWORDS)
+
+#define SETUPS 60
+#define SEARCHES 200
+
+/* The index as it was: a list head for every sample value and a link
+   for every sample. */
+
+typedef struct ref_link {
+  struct ref_link *next;
+} ref_link_t;
+
+typedef struct {
+  int16_t *vector;
+  long size;
+  long sorted;
+  long lo, hi;
+  ref_link_t **head;
+  ref_link_t *revindex;
+} ref_sort_t;
+
+#define ref_ipos(i,l) ((l)-(i)->revindex)
+
+static ref_sort_t *
+ref_alloc(long size)
+{
+  ref_sort_t *ret = calloc(1, sizeof(ref_sort_t));
+  ret->head = calloc(65536, sizeof(ref_link_t *));
+  ret->revindex = calloc(size, sizeof(ref_link_t));
+  return ret;
+}
+
+static void
+ref_free(ref_sort_t *i)
+{
+  free(i->head);
+  free(i->revindex);
+  free(i);
+}
+
+static void
+ref_setup(ref_sort_t *i, int16_t *vector, long abspos, long size,
+	  long sortlo, long sorthi)
+{
+  memset(i->head, 0, 65536 * sizeof(ref_link_t *));
+  i->sorted = 0;
+  i->vector = vector;
+  i->size = size;
+  i->lo = min(size, max(sortlo - abspos, 0));
+  i->hi = max(0, min(sorthi - abspos, size));
+}
+
+static ref_link_t *
+ref_getmatch(ref_sort_t *i, long post, long overlap, int value)
+{
+  ref_link_t *ret;
+  long j;
+
+  if (!i->sorted) {
+    for (j = i->hi - 1; j >= i->lo; j--) {
+      ref_link_t **hv = i->head + i->vector[j] + 32768;
+      i->revindex[j].next = *hv;
+      *hv = i->revindex + j;
+    }
+    i->sorted = 1;
+  }
+
+  post = max(0, min(i->size, post));
+  i->lo = max(0, post - overlap);
+  i->hi = min(i->size, post + overlap);
+
+  for (ret = i->head[value + 32768]; ret; ret = ret->next)
+    if (ref_ipos(i, ret) >= i->lo) {
+      if (ref_ipos(i, ret) >= i->hi)
+	ret = NULL;
+      break;
+    }
+  return ret;
+}
+
+static ref_link_t *
+ref_nextmatch(ref_sort_t *i, ref_link_t *prev)
+{
+  ref_link_t *ret = prev->next;
+  if (!ret || ref_ipos(i, ret) >= i->hi)
+    return NULL;
+  return ret;
+}
+
+/* A small deterministic generator, so failures can be reproduced. */
+static unsigned long int i_seed = 1;
+
+static unsigned long int
+next_random(unsigned long int i_range)
+{
+  i_seed = i_seed * 1103515245 + 12345;
+  return ((i_seed >> 16) & 0x7fffffff) % i_range;
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Index windows of samples of up to maxsize samples, with ranges to
+   index and searches like paranoia's, and check that both indexes
+   give the same matches. */
+static int
+check_index(int16_t *samples, long i_samples, long maxsize)
+{
+  sort_info_t *i = sort_alloc(maxsize);
+  ref_sort_t *ref = ref_alloc(maxsize);
+  int setup, search;
+
+  for (setup = 0; setup < SETUPS; setup++) {
+    const long size = setup % 4 ? maxsize : 1 + (long) next_random(maxsize);
+    const long start = next_random(i_samples - size + 1);
+    long abspos = 1000000 + next_random(1000000);
+    /* Mostly the whole vector, sometimes part of it or beyond it. */
+    const long sortlo = abspos + (setup % 3 ? 0 : (long) next_random(size))
+      - (setup % 5 ? 0 : 100);
+    const long sorthi = abspos + size
+      - (setup % 3 ? 0 : (long) next_random(size)) + (setup % 7 ? 0 : 100);
+
+    sort_setup(i, samples + start, &abspos, size, sortlo, sorthi);
+    ref_setup(ref, samples + start, abspos, size, sortlo, sorthi);
+
+    for (search = 0; search < SEARCHES; search++) {
+      const long post = (long) next_random(size + 200) - 100;
+      const long overlap = search % 4 ? (long) next_random(size + 1)
+	: MAX_SECTOR_OVERLAP * CD_FRAMEWORDS;
+      /* Mostly a sample that is there. */
+      const int value = search % 8
+	? samples[start + next_random(size)]
+	: (int) next_random(65536) - 32768;
+      sort_link_t *l = sort_getmatch(i, post, overlap, value);
+      ref_link_t *r = ref_getmatch(ref, post, overlap, value);
+      long n = 0;
+
+      for (; l && r; l = sort_nextmatch(i, l), r = ref_nextmatch(ref, r)) {
+	if (ipos(i, l) != ref_ipos(ref, r)) {
+	  printf("match %ld of %d near %ld (%ld) in %ld samples at %ld is "
+		 "at %ld, not %ld\n", n, value, post, overlap, size, start,
+		 ipos(i, l), (long) ref_ipos(ref, r));
+	  return 1;
+	}
+	n++;
+      }
+      if (l || r) {
+	printf("%s matches of %d near %ld (%ld) in %ld samples at %ld "
+	       "after %ld\n", l ? "more" : "fewer", value, post, overlap,
+	       size, start, n);
+	return 2;
+      }
+    }
+  }
+
+  sort_free(i);
+  ref_free(ref);
+  return 0;
+}
+
+/* Search the index of a vector around every step samples for the
+   sample there, if it is silence or if it is not, visiting every
+   match.  The number of matches is returned. */
+static long
+bench_search(sort_info_t *i, ref_sort_t *ref, int16_t *vector, long step,
+	     bool b_silence, bool b_reference)
+{
+  const long overlap = MAX_SECTOR_OVERLAP * CD_FRAMEWORDS;
+  long i_matches = 0;
+  long post;
+
+  for (post = 0; post < MAXSIZE; post += step) {
+    const int value = vector[post];
+    if ((0 == value) != b_silence)
+      continue;
+    if (b_reference) {
+      ref_link_t *r = ref_getmatch(ref, post, overlap, value);
+      for (; r; r = ref_nextmatch(ref, r))
+	i_matches++;
+    } else {
+      sort_link_t *l = sort_getmatch(i, post, overlap, value);
+      for (; l; l = sort_nextmatch(i, l))
+	i_matches++;
+    }
+  }
+  return i_matches;
+}
+
+/* Time indexing windows of MAXSIZE samples and searching them.  Most
+   of cdda.bin is silence, so every third sample of the rest is
+   searched for, and every quarter sector of the silence. */
+static void
+bench(int16_t *samples, long i_samples, bool b_reference)
+{
+  sort_info_t *i = sort_alloc(MAXSIZE);
+  ref_sort_t *ref = ref_alloc(MAXSIZE);
+  double d_start, d_index = 0, d_sound = 0, d_silence = 0;
+  long i_sound = 0, i_silence = 0;
+  long abspos = 0;
+  long start;
+  int k;
+
+  for (k = 0; k < 2; k++)
+    for (start = 0; start + MAXSIZE <= i_samples; start += 2 * CD_FRAMEWORDS) {
+      int16_t *vector = samples + start;
+
+      /* The index is built by the first search. */
+      d_start = now();
+      if (b_reference) {
+	ref_setup(ref, vector, abspos, MAXSIZE, 0, MAXSIZE);
+	ref_getmatch(ref, 0, 0, 0);
+      } else {
+	sort_setup(i, vector, &abspos, MAXSIZE, 0, MAXSIZE);
+	sort_getmatch(i, 0, 0, 0);
+      }
+      d_index += now() - d_start;
+
+      d_start = now();
+      i_sound += bench_search(i, ref, vector, 3, false, b_reference);
+      d_sound += now() - d_start;
+
+      d_start = now();
+      i_silence += bench_search(i, ref, vector, CD_FRAMEWORDS / 4, true,
+				 b_reference);
+      d_silence += now() - d_start;
+    }
+
+  printf("%-6s %5ld KiB  index %6.3f s  sound %6.3f s (%ld matches)  "
+	 "silence %6.3f s (%ld matches)\n",
+	 b_reference ? "lists" : "sorted",
+	 b_reference
+	 ? (long) (65536 * sizeof(ref_link_t *)
+		   + 65536 * sizeof(long) /* bucketusage */
+		   + MAXSIZE * sizeof(ref_link_t)) / 1024
+	 : (long) (((i->blocks << i->hashbits) + MAXSIZE)
+		   * sizeof(sort_link_t)) / 1024,
+	 d_index, d_sound, i_sound, d_silence, i_silence);
+
+  sort_free(i);
+  ref_free(ref);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const bool b_bench = argc > 1 && 0 == strcmp(argv[1], "-b");
+  const char *psz_image = b_bench && argc > 2 ? argv[2] : CDDA_IMAGE;
+  FILE *p_file = fopen(psz_image, "rb");
+  int16_t *samples;
+  long i_samples;
+  int rc;
+
+  if (!p_file) {
+    perror(psz_image);
+    return 77;
+  }
+  fseek(p_file, 0, SEEK_END);
+  i_samples = ftell(p_file) / sizeof(int16_t);
+  rewind(p_file);
+
+  samples = malloc(i_samples * sizeof(int16_t));
+  if (!samples || i_samples < MAXSIZE
+      || 1 != fread(samples, i_samples * sizeof(int16_t), 1, p_file)) {
+    printf("Couldn't read %s\n", psz_image);
+    return 77;
+  }
+  fclose(p_file);
+
+  if (b_bench) {
+    bench(samples, i_samples, true);
+    bench(samples, i_samples, false);
+    free(samples);
+    return 0;
+  }
+
+  /* The size paranoia uses, which takes three blocks of the index, and
+     a small one. */
+  rc = check_index(samples, i_samples, MAXSIZE);
+  if (rc) return rc;
+  rc = check_index(samples, i_samples, 1000);
+  if (rc) return 10 + rc;
+
+  /* Silence, where every sample is in the same bucket. */
+  memset(samples, 0, MAXSIZE * sizeof(int16_t));
+  rc = check_index(samples, MAXSIZE, MAXSIZE);
+  if (rc) return 20 + rc;
+
+  free(samples);
+  return 0;
+}
@@ -0,0 +1,343 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Checks that paranoia's run-matching kernels (lib/paranoia/match.c)
+   give what the one-sample-at-a-time loops they replaced gave, on the
+   samples of cdda.bin read twice with jitter, damage and read flags.
+
+     testmatch -b
+
+   times the old loops against each kernel instead. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#include <sys/time.h>
+
+#include "p_block.h"
+#include "gap.h"
+#include "match.h"
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define CDDA_IMAGE TEST_DIR "/cdda.bin"
+
+/* How far B lags A, in samples. */
+#define JITTER 37
+
+#define TRIALS 40000
+
+/* The loops of i_paranoia_overlap(), i_paranoia_overlap2(),
+   i_paranoia_overlap_r() and i_paranoia_overlap_f() as they were. */
+
+static long
+ref_overlap(int16_t *buffA,int16_t *buffB,
+	    long offsetA, long offsetB,
+	    long sizeA,long sizeB,
+	    long *ret_begin, long *ret_end)
+{
+  long beginA=offsetA,endA=offsetA;
+  long beginB=offsetB,endB=offsetB;
+
+  for(; beginA>=0 && beginB>=0; beginA--,beginB--)
+    if (buffA[beginA] != buffB[beginB]) break;
+  beginA++;
+  beginB++;
+
+  for(; endA<sizeA && endB<sizeB; endA++,endB++)
+    if (buffA[endA] != buffB[endB]) break;
+
+  if (ret_begin) *ret_begin = beginA;
+  if (ret_end) *ret_end = endA;
+  return (endA-beginA);
+}
+
+static long
+ref_overlap2(int16_t *buffA,int16_t *buffB,
+	     unsigned char *flagsA, unsigned char *flagsB,
+	     long offsetA, long offsetB,
+	     long sizeA,long sizeB,
+	     long *ret_begin, long *ret_end)
+{
+  long beginA=offsetA, endA=offsetA;
+  long beginB=offsetB, endB=offsetB;
+
+  for (; beginA>=0 && beginB>=0; beginA--,beginB--) {
+    if (buffA[beginA] != buffB[beginB]) break;
+    if ((flagsA[beginA]&flagsB[beginB]&FLAGS_EDGE)) {
+      beginA--;
+      beginB--;
+      break;
+    }
+    if ((flagsA[beginA]&FLAGS_UNREAD) || (flagsB[beginB]&FLAGS_UNREAD))
+      break;
+  }
+  beginA++;
+  beginB++;
+
+  for (; endA<sizeA && endB<sizeB; endA++,endB++) {
+    if (buffA[endA] != buffB[endB]) break;
+    if ((flagsA[endA]&flagsB[endB]&FLAGS_EDGE) && endA!=beginA){
+      break;
+    }
+    if ((flagsA[endA]&FLAGS_UNREAD) || (flagsB[endB]&FLAGS_UNREAD))
+      break;
+  }
+
+  if (ret_begin) *ret_begin = beginA;
+  if (ret_end) *ret_end = endA;
+  return (endA-beginA);
+}
+
+static long
+ref_overlap_r(int16_t *buffA,int16_t *buffB,
+	      long offsetA, long offsetB)
+{
+  long beginA=offsetA;
+  long beginB=offsetB;
+
+  for( ; beginA>=0 && beginB>=0; beginA--,beginB-- )
+    if (buffA[beginA] != buffB[beginB]) break;
+  beginA++;
+  beginB++;
+
+  return(offsetA-beginA);
+}
+
+static long
+ref_overlap_f(int16_t *buffA,int16_t *buffB,
+	      long offsetA, long offsetB,
+	      long sizeA,long sizeB)
+{
+  long endA=offsetA;
+  long endB=offsetB;
+
+  for(;endA<sizeA && endB<sizeB;endA++,endB++)
+    if(buffA[endA]!=buffB[endB])break;
+
+  return(endA-offsetA);
+}
+
+/* A small deterministic generator, so failures can be reproduced. */
+static unsigned long int i_seed = 1;
+
+static unsigned long int
+next_random(unsigned long int i_range)
+{
+  i_seed = i_seed * 1103515245 + 12345;
+  return ((i_seed >> 16) & 0x7fffffff) % i_range;
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Compare the kernels in use against the reference loops on windows
+   of A and B around samples that should line up. */
+static int
+check_kernels(int16_t *A, int16_t *B, unsigned char *flagsA,
+	      unsigned char *flagsB, long i_samples)
+{
+  long i;
+
+  for (i = 0; i < TRIALS; i++) {
+    /* Windows from a few samples, to exercise the kernels' tails, to
+       several sectors. */
+    const long sizeA = 1 + next_random(i % 4 ? 64 : 8 * CD_FRAMEWORDS);
+    const long sizeB = 1 + next_random(i % 4 ? 64 : 8 * CD_FRAMEWORDS);
+    const long startA = next_random(i_samples - sizeA - JITTER);
+    long startB = startA + next_random(2 * JITTER);
+    long offsetA, offsetB;
+    long begin, end, ref_begin, ref_end, ret, ref_ret;
+
+    if (startB + sizeB > i_samples) startB = i_samples - sizeB;
+    offsetA = next_random(sizeA);
+    /* Mostly the sample B jittered onto A[offsetA]. */
+    offsetB = (i % 8) ? offsetA + startA - (startB - JITTER)
+      : (long) next_random(sizeB);
+    if (offsetB < 0 || offsetB >= sizeB) offsetB = next_random(sizeB);
+
+    ref_ret = ref_overlap(A+startA, B+startB, offsetA, offsetB,
+			  sizeA, sizeB, &ref_begin, &ref_end);
+    ret = i_paranoia_overlap(A+startA, B+startB, offsetA, offsetB,
+			     sizeA, sizeB, &begin, &end);
+    if (ret != ref_ret || begin != ref_begin || end != ref_end) {
+      printf("i_paranoia_overlap(%ld, %ld, %ld, %ld) at %ld, %ld gives "
+	     "%ld [%ld, %ld), not %ld [%ld, %ld)\n", offsetA, offsetB,
+	     sizeA, sizeB, startA, startB, ret, begin, end,
+	     ref_ret, ref_begin, ref_end);
+      return 1;
+    }
+
+    ref_ret = ref_overlap2(A+startA, B+startB, flagsA+startA, flagsB+startB,
+			   offsetA, offsetB, sizeA, sizeB,
+			   &ref_begin, &ref_end);
+    ret = i_paranoia_overlap2(A+startA, B+startB, flagsA+startA,
+			      flagsB+startB, offsetA, offsetB, sizeA, sizeB,
+			      &begin, &end);
+    if (ret != ref_ret || begin != ref_begin || end != ref_end) {
+      printf("i_paranoia_overlap2(%ld, %ld, %ld, %ld) at %ld, %ld gives "
+	     "%ld [%ld, %ld), not %ld [%ld, %ld)\n", offsetA, offsetB,
+	     sizeA, sizeB, startA, startB, ret, begin, end,
+	     ref_ret, ref_begin, ref_end);
+      return 2;
+    }
+
+    ref_ret = ref_overlap_r(A+startA, B+startB, offsetA, offsetB);
+    ret = i_paranoia_overlap_r(A+startA, B+startB, offsetA, offsetB);
+    if (ret != ref_ret) {
+      printf("i_paranoia_overlap_r(%ld, %ld) at %ld, %ld gives %ld, "
+	     "not %ld\n", offsetA, offsetB, startA, startB, ret, ref_ret);
+      return 3;
+    }
+
+    ref_ret = ref_overlap_f(A+startA, B+startB, offsetA, offsetB,
+			    sizeA, sizeB);
+    ret = i_paranoia_overlap_f(A+startA, B+startB, offsetA, offsetB,
+			       sizeA, sizeB);
+    if (ret != ref_ret) {
+      printf("i_paranoia_overlap_f(%ld, %ld, %ld, %ld) at %ld, %ld gives "
+	     "%ld, not %ld\n", offsetA, offsetB, sizeA, sizeB, startA,
+	     startB, ret, ref_ret);
+      return 4;
+    }
+  }
+  return 0;
+}
+
+/* Time extending runs across the whole of A and B from seeds every
+   sector, in samples compared per second. */
+static void
+bench(int16_t *A, int16_t *B, unsigned char *flagsA,
+      unsigned char *flagsB, long i_samples, const char psz_name[],
+      bool b_reference)
+{
+  const int i_repeat = 200;
+  double d_start, d_secs;
+  long i_compared = 0;
+  long i, offset;
+  int k;
+
+  d_start = now();
+  for (k = 0; k < i_repeat; k++)
+    for (offset = JITTER; offset < i_samples; offset += CD_FRAMEWORDS) {
+      long begin, end;
+      i = b_reference
+	? ref_overlap2(A, B, flagsA, flagsB, offset, offset - JITTER,
+		       i_samples, i_samples - JITTER, &begin, &end)
+	: i_paranoia_overlap2(A, B, flagsA, flagsB, offset, offset - JITTER,
+			      i_samples, i_samples - JITTER, &begin, &end);
+      i_compared += i;
+    }
+  d_secs = now() - d_start;
+  printf("%-10s %8.3f s  %8.0f Msamples/s\n", psz_name, d_secs,
+	 d_secs > 0 ? i_compared / d_secs / 1e6 : 0);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const bool b_bench = argc > 1 && 0 == strcmp(argv[1], "-b");
+  FILE *p_file = fopen(CDDA_IMAGE, "rb");
+  int16_t *A, *B;
+  unsigned char *flagsA, *flagsB;
+  long i_samples;
+  long i;
+  int impl;
+  int rc;
+
+  if (!p_file) {
+    perror(CDDA_IMAGE);
+    return 77;
+  }
+  fseek(p_file, 0, SEEK_END);
+  i_samples = ftell(p_file) / sizeof(int16_t);
+  rewind(p_file);
+
+  A = malloc(i_samples * sizeof(int16_t));
+  B = malloc(i_samples * sizeof(int16_t));
+  flagsA = calloc(i_samples, 1);
+  flagsB = calloc(i_samples, 1);
+  if (!A || !B || !flagsA || !flagsB
+      || 1 != fread(A, i_samples * sizeof(int16_t), 1, p_file)) {
+    printf("Couldn't read %s\n", CDDA_IMAGE);
+    return 77;
+  }
+  fclose(p_file);
+
+  /* B is A read again JITTER samples late, with damage now and then
+     in runs of a few samples. */
+  memcpy(B, A + JITTER, (i_samples - JITTER) * sizeof(int16_t));
+  memset(B + i_samples - JITTER, 0, JITTER * sizeof(int16_t));
+  if (!b_bench)
+    for (i = next_random(3000); i < i_samples; i += 1 + next_random(3000)) {
+      long j, i_len = 1 + next_random(4);
+      for (j = i; j < i + i_len && j < i_samples; j++)
+	B[j] ^= 1 + next_random(0x7fff);
+    }
+
+  /* Read edges every sector, offset differently in the two reads,
+     and stretches of unread samples. */
+  for (i = 0; i < i_samples; i += CD_FRAMEWORDS) {
+    flagsA[i] |= FLAGS_EDGE;
+    if (i + 5 < i_samples) flagsB[i + 5] |= FLAGS_EDGE;
+    if (i + CD_FRAMEWORDS - JITTER < i_samples)
+      flagsB[i + CD_FRAMEWORDS - JITTER] |= FLAGS_EDGE;
+  }
+  if (!b_bench)
+    for (i = next_random(20000); i < i_samples; i += next_random(20000)) {
+      long j, i_len = 1 + next_random(200);
+      unsigned char *flags = next_random(2) ? flagsA : flagsB;
+      for (j = i; j < i + i_len && j < i_samples; j++)
+	flags[j] |= FLAGS_UNREAD;
+    }
+
+  if (b_bench)
+    bench(A, B, flagsA, flagsB, i_samples, "loops", true);
+
+  for (impl = MATCH_SCALAR; impl < MATCH_IMPLS; impl++) {
+    if (!i_match_use(impl)) continue;
+    if (b_bench) {
+      bench(A, B, flagsA, flagsB, i_samples, i_match_name(impl), false);
+      continue;
+    }
+    printf("checking %s kernels\n", i_match_name(impl));
+    rc = check_kernels(A, B, flagsA, flagsB, i_samples);
+    if (rc) return 10 * impl + rc;
+  }
+
+  free(A);
+  free(B);
+  free(flagsA);
+  free(flagsB);
+  return 0;
+}
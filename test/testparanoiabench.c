@@ -0,0 +1,478 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmarks paranoia on a simulated drive.
+
+     testparanoiabench [sectors]
+
+   makes up a multi-track disc of about that many sectors (3000 by
+   default), and reads it through paranoia in each paranoia mode from
+   a drive that goes wrong in each of several ways: reads that start
+   off by some samples (jitter), samples dropped or duplicated within
+   a read, a drive that is off by a constant number of samples from
+   some point on (drift), and a range that often cannot be read.  The
+   drive's errors come from a seeded generator, so the same reads are
+   made each run.
+
+   For each mode and error model it reports sectors/s, how many
+   sectors were read from the drive for each sector returned, how many
+   fixups paranoia made, the pooled memory paranoia used at most, how
+   many sectors came out wrong, and how many times the audio returned
+   slipped: skipped or repeated samples.  Paranoia keeps the audio
+   whole but cannot know where a drive that jitters on the very first
+   read should have started, nor how long digital silence should last,
+   so a sector is only wrong if it is not the disc shifted by a few
+   samples, and a shift that changes across silence is no slip.  The
+   last sector is not checked: once shifted, its last samples would
+   have to be read from beyond the end of the disc.
+
+   Reading in full paranoia mode, with or without test and copy
+   ("tcopy"), from a drive that only jitters or drops and duplicates
+   samples must give back every sector, without slips; otherwise the
+   test fails.  A drive that drifts slips itself, and one that cannot
+   read some sectors loses them. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cdio/paranoia.h>
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#include <sys/time.h>
+
+#define SKIP_TEST_RC 77
+
+/* The cue sheet and bin go in a directory of their own, so that the
+   image globs of check_fuzzyiso.sh never pick the bin up half-written;
+   libcdio looks for the bin beside the cue, under the same name. */
+#define BENCH_DIR "paranoia-bench"
+#define BENCH_CUE BENCH_DIR "/bench.cue"
+#define BENCH_BIN BENCH_DIR "/bench.bin"
+
+/* Stereo samples (frames) in a sector. */
+#define SECTOR_FRAMES (CDIO_CD_FRAMESIZE_RAW / 4)
+
+#define TRACKS 5
+
+/* What the simulated drive gets wrong.  Chances are in percent, and
+   places on the disc in thousandths of it. */
+typedef struct {
+  const char *psz_name;
+  int  i_jitter;         /* chance a request starts off ... */
+  long i_jitter_frames;  /* ... by up to this many frames either way */
+  int  i_dropdupe;       /* chance a request drops or duplicates ... */
+  long i_dropdupe_frames;/* ... up to this many frames part way in */
+  long i_drift_frames;   /* frames the drive is off by ... */
+  long i_drift_at;       /* ... from here on */
+  long i_bad_begin;      /* sectors the drive can often not read */
+  long i_bad_end;
+  int  i_bad;            /* chance a read of them fails */
+  bool b_exact;          /* whether the exact modes must get it all right */
+} error_model_t;
+
+static const error_model_t models[] = {
+  {"clean",         0,    0,  0,  0,   0,    0,   0,   0,  0, true},
+  {"jitter-small", 30,   16,  0,  0,   0,    0,   0,   0,  0, true},
+  {"jitter-large", 30,  256,  0,  0,   0,    0,   0,   0,  0, true},
+  {"drop-dupe",     0,    0, 20, 32,   0,    0,   0,   0,  0, true},
+  {"drift",         0,    0,  0,  0,  25,  333,   0,   0,  0, false},
+  {"unreadable",    0,    0,  0,  0,   0,    0, 500, 510, 50, false},
+  {"everything",   30,   64, 10, 32,  25,  333, 500, 510, 50, false},
+};
+
+#define MODELS (sizeof(models) / sizeof(models[0]))
+
+/* The most frames a sector read can be off by and still be right. */
+#define MAX_SHIFT 1024
+
+static const struct {
+  const char *psz_name;
+  int mode_flags;
+  bool b_exact;          /* whether it must get it all right */
+} modes[] = {
+  {"full",    PARANOIA_MODE_FULL ^ PARANOIA_MODE_NEVERSKIP, true},
+  {"tcopy",   (PARANOIA_MODE_FULL ^ PARANOIA_MODE_NEVERSKIP)
+              | PARANOIA_MODE_TESTCOPY,                     true},
+  {"overlap", PARANOIA_MODE_OVERLAP,                        false},
+  {"disable", PARANOIA_MODE_DISABLE,                        false},
+};
+
+#define MODES (sizeof(modes) / sizeof(modes[0]))
+
+/* The disc, in frames of two host-order samples, with MAX_SHIFT
+   frames of silence either side like the drive gives beyond it. */
+static int16_t *disc_padded;
+static int16_t *disc;
+static long i_disc_sectors;
+
+/* The error model the drive follows, and what it has been asked. */
+static const error_model_t *model;
+static unsigned long int i_sectors_read;
+
+static long callbacks[PARANOIA_CB_READERR + 1];
+
+static const int16_t silence[CD_FRAMEWORDS];
+
+/* A small deterministic generator, so runs can be compared. */
+static unsigned long int i_seed;
+
+static unsigned long int
+next_random(unsigned long int i_range)
+{
+  i_seed = i_seed * 1103515245 + 12345;
+  return ((i_seed >> 16) & 0x7fffffff) % i_range;
+}
+
+static double
+now(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int16_t
+triangle(long i, long period, int amplitude)
+{
+  long phase = i % period;
+  long half = period / 2;
+  return (int16_t) ((phase < half ? phase : period - phase)
+		    * 2 * amplitude / half - amplitude);
+}
+
+/* Make up a disc of tracks that are each hard on paranoia in their
+   own way: a tone, dense "music", a quiet track that starts with
+   digital silence, a short loop, and loud noise.  The tone and loop
+   have some noise in them: exactly periodic audio has no one right
+   alignment for paranoia to find. */
+static void
+make_disc(long sectors, long *track_sectors)
+{
+  long frames;
+  long i;
+  int t;
+
+  i_disc_sectors = sectors;
+  frames = sectors * SECTOR_FRAMES;
+  disc_padded = calloc(frames + 2 * MAX_SHIFT, 2 * sizeof(int16_t));
+  disc = disc_padded + 2 * MAX_SHIFT;
+  i_seed = 1;
+
+  for (t = 0; t < TRACKS; t++)
+    track_sectors[t] = sectors / TRACKS;
+  track_sectors[TRACKS - 1] += sectors % TRACKS;
+
+  for (i = 0; i < frames; i++) {
+    const int t = (int) (i / (track_sectors[0] * SECTOR_FRAMES));
+    int16_t left, right;
+
+    switch (t < TRACKS ? t : TRACKS - 1) {
+    case 0:
+      left = triangle(i, 100, 8000) + (int16_t) next_random(401) - 200;
+      right = triangle(i, 150, 8000) + (int16_t) next_random(401) - 200;
+      break;
+    case 1:
+      left = triangle(i, 37, 3000) + triangle(i, 211, 6000)
+	+ triangle(i, 1013, 9000) + (int16_t) next_random(1001) - 500;
+      right = triangle(i, 41, 3000) + triangle(i, 223, 6000)
+	+ triangle(i, 997, 9000) + (int16_t) next_random(1001) - 500;
+      break;
+    case 2:
+      if (i % (track_sectors[0] * SECTOR_FRAMES) < 150 * SECTOR_FRAMES)
+	left = right = 0;
+      else {
+	left = (int16_t) next_random(41) - 20;
+	right = (int16_t) next_random(41) - 20;
+      }
+      break;
+    case 3:
+      left = triangle(i % 1000, 250, 12000) + triangle(i % 1000, 1000, 6000)
+	+ (int16_t) next_random(401) - 200;
+      right = -left;
+      break;
+    default:
+      left = (int16_t) next_random(60001) - 30000;
+      right = (int16_t) next_random(60001) - 30000;
+      break;
+    }
+    disc[2 * i] = left;
+    disc[2 * i + 1] = right;
+  }
+}
+
+/* Write a cue sheet for the disc and a bin file of its size, so that
+   libcdio sees its tracks.  The bin is never read. */
+static bool
+write_cue(const long *track_sectors)
+{
+  FILE *p_cue, *p_bin;
+  long lsn = 0;
+  int t;
+
+  mkdir(BENCH_DIR, 0755);
+  p_cue = fopen(BENCH_CUE, "w");
+  p_bin = fopen(BENCH_BIN, "wb");
+  if (!p_cue || !p_bin)
+    return false;
+
+  fprintf(p_cue, "FILE \"bench.bin\" BINARY\n");
+  for (t = 0; t < TRACKS; t++) {
+    fprintf(p_cue, "  TRACK %02d AUDIO\n", t + 1);
+    fprintf(p_cue, "    INDEX 01 %02ld:%02ld:%02ld\n",
+	    lsn / (60 * 75), (lsn / 75) % 60, lsn % 75);
+    lsn += track_sectors[t];
+  }
+  fclose(p_cue);
+
+  fseek(p_bin, i_disc_sectors * CDIO_CD_FRAMESIZE_RAW - 1, SEEK_SET);
+  fputc(0, p_bin);
+  fclose(p_bin);
+  return true;
+}
+
+/* Remove what write_cue() wrote, however the benchmark ends. */
+static void
+remove_cue(void)
+{
+  remove(BENCH_CUE);
+  remove(BENCH_BIN);
+  rmdir(BENCH_DIR);
+}
+
+/* The drive: hand out the frames of the disc from where the model
+   says the read lands, rather than where it was asked to start. */
+static long
+model_read(cdrom_drive_t *d, void *p, lsn_t begin, long sectors)
+{
+  int16_t *p_out = p;
+  const long frames = sectors * SECTOR_FRAMES;
+  long from = (long) begin * SECTOR_FRAMES;
+  long split = frames;
+  long shift = 0;
+  long i;
+
+  i_sectors_read += sectors;
+
+  if (model->i_bad_end > model->i_bad_begin) {
+    const long bad_begin = i_disc_sectors * model->i_bad_begin / 1000;
+    const long bad_end = i_disc_sectors * model->i_bad_end / 1000;
+    if (begin < bad_end && begin + sectors > bad_begin
+	&& (long) next_random(100) < model->i_bad) {
+      if (begin >= bad_begin)
+	return -1;
+      sectors = bad_begin - begin;
+    }
+  }
+
+  if (model->i_drift_frames
+      && begin >= i_disc_sectors * model->i_drift_at / 1000)
+    from += model->i_drift_frames;
+
+  if (model->i_jitter && (long) next_random(100) < model->i_jitter)
+    from += (long) next_random(2 * model->i_jitter_frames + 1)
+      - model->i_jitter_frames;
+
+  if (model->i_dropdupe && (long) next_random(100) < model->i_dropdupe) {
+    split = (long) next_random(frames);
+    shift = (long) next_random(2 * model->i_dropdupe_frames + 1)
+      - model->i_dropdupe_frames;
+  }
+
+  for (i = 0; i < sectors * SECTOR_FRAMES; i++) {
+    const long frame = from + i + (i >= split ? shift : 0);
+    if (frame >= 0 && frame < i_disc_sectors * SECTOR_FRAMES) {
+      p_out[2 * i] = disc[2 * frame];
+      p_out[2 * i + 1] = disc[2 * frame + 1];
+    } else
+      p_out[2 * i] = p_out[2 * i + 1] = 0;
+  }
+  return sectors;
+}
+
+static void
+callback(long int inpos, paranoia_cb_mode_t function)
+{
+  if (function <= PARANOIA_CB_READERR)
+    callbacks[function]++;
+}
+
+/* Pooled memory paranoia had at most: all the pools ever got. */
+static long
+pooled_kib(const cdrom_paranoia_t *p)
+{
+  cdio_paranoia_pool_stats_t stats;
+  long bytes = 0;
+  int kind;
+
+  for (kind = PARANOIA_POOL_BUFFERS; kind <= PARANOIA_POOL_NODES; kind++) {
+    paranoia_pool_stats(p, kind, &stats);
+    bytes += stats.i_allocs * stats.i_size;
+  }
+  return bytes / 1024;
+}
+
+/* Whether a sector read is the disc's sector i_lsn shifted by shift
+   frames. */
+static bool
+sector_at(const int16_t *p_sector, lsn_t i_lsn, long shift)
+{
+  const long from = (long) i_lsn * SECTOR_FRAMES + shift;
+
+  return 0 == memcmp(p_sector, disc + 2 * from, CDIO_CD_FRAMESIZE_RAW);
+}
+
+/* Find the shift by which a sector read is the disc's sector i_lsn,
+   trying the shift of the last sector first.  Returns false if the
+   sector is wrong. */
+static bool
+find_shift(const int16_t *p_sector, lsn_t i_lsn, long *p_shift)
+{
+  long shift;
+
+  if (sector_at(p_sector, i_lsn, *p_shift))
+    return true;
+  for (shift = 0; shift <= MAX_SHIFT; shift++) {
+    if (sector_at(p_sector, i_lsn, shift)) {
+      *p_shift = shift;
+      return true;
+    }
+    if (sector_at(p_sector, i_lsn, -shift)) {
+      *p_shift = -shift;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Read the whole disc in one mode from a drive following one model,
+   report how it went, and return the number of sectors that came out
+   wrong or slipped. */
+static long
+bench(cdrom_drive_t *d, int i_mode, const error_model_t *p_model)
+{
+  cdrom_paranoia_t *p = paranoia_init(d);
+  const lsn_t i_first = cdio_cddap_disc_firstsector(d);
+  const lsn_t i_last = cdio_cddap_disc_lastsector(d);
+  long i_wrong = 0;
+  long i_slips = 0;
+  long shift = 0;
+  bool b_aligned = false;
+  bool b_silent = false;
+  double d_time = 0;
+  lsn_t i_lsn;
+
+  model = p_model;
+  i_seed = 1;
+  i_sectors_read = 0;
+  memset(callbacks, 0, sizeof(callbacks));
+
+  paranoia_modeset(p, modes[i_mode].mode_flags);
+  paranoia_seek(p, i_first, SEEK_SET);
+
+  for (i_lsn = i_first; i_lsn <= i_last; i_lsn++) {
+    const double d_start = now();
+    int16_t *p_readbuf = paranoia_read_limited(p, callback, 20);
+    const long last_shift = shift;
+
+    d_time += now() - d_start;
+    if (i_lsn == i_last)
+      break;
+    if (!p_readbuf || !find_shift(p_readbuf, i_lsn - i_first, &shift))
+      i_wrong++;
+    else {
+      if (b_aligned && !b_silent && shift != last_shift)
+	i_slips++;
+      b_aligned = true;
+    }
+    b_silent = p_readbuf && !memcmp(p_readbuf, silence, CDIO_CD_FRAMESIZE_RAW);
+  }
+
+  printf("%-7s %-12s %8.0f %6.2f %6ld %6ld %6ld %7ld %6ld %6ld\n",
+	 modes[i_mode].psz_name, p_model->psz_name,
+	 (i_last - i_first + 1) / d_time,
+	 (double) i_sectors_read / (i_last - i_first + 1),
+	 callbacks[PARANOIA_CB_FIXUP_EDGE] + callbacks[PARANOIA_CB_FIXUP_ATOM]
+	 + callbacks[PARANOIA_CB_FIXUP_DROPPED]
+	 + callbacks[PARANOIA_CB_FIXUP_DUPED],
+	 callbacks[PARANOIA_CB_SKIP], callbacks[PARANOIA_CB_READERR],
+	 pooled_kib(p), i_wrong, i_slips);
+
+  paranoia_free(p);
+  return i_wrong + i_slips;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const long sectors = argc > 1 ? atol(argv[1]) : 3000;
+  long track_sectors[TRACKS];
+  cdrom_drive_t *d;
+  unsigned int i_mode, i_model;
+  int i_rc = 0;
+
+  if (sectors < 50 * TRACKS) {
+    printf("usage: %s [sectors]; at least %d sectors\n", argv[0],
+	   50 * TRACKS);
+    return 1;
+  }
+
+  make_disc(sectors, track_sectors);
+  atexit(remove_cue);
+  if (!write_cue(track_sectors)) {
+    printf("Couldn't write %s\n", BENCH_CUE);
+    return SKIP_TEST_RC;
+  }
+
+  d = cdio_cddap_identify(BENCH_CUE, CDDA_MESSAGE_FORGETIT, NULL);
+  if (!d || 0 != cdio_cddap_open(d)) {
+    printf("Unable to open %s\n", BENCH_CUE);
+    return SKIP_TEST_RC;
+  }
+  /* The simulated drive hands out samples in the order of this host. */
+  d->read_audio = model_read;
+  d->b_swap_bytes = false;
+
+  printf("%-7s %-12s %8s %6s %6s %6s %6s %7s %6s %6s\n", "mode", "drive",
+	 "sect/s", "reads", "fixups", "skips", "errors", "KiB", "wrong",
+	 "slips");
+  for (i_mode = 0; i_mode < MODES; i_mode++)
+    for (i_model = 0; i_model < MODELS; i_model++) {
+      const long i_wrong = bench(d, i_mode, &models[i_model]);
+      if (i_wrong && modes[i_mode].b_exact && models[i_model].b_exact) {
+	printf("  %s paranoia mode should have read every sector\n",
+	       modes[i_mode].psz_name);
+	i_rc = 2;
+      }
+    }
+
+  cdio_cddap_close(d);
+  free(disc_padded);
+  return i_rc;
+}
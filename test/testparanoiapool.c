@@ -0,0 +1,182 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Reads cdda.cue through paranoia, a sector and then many sectors at
+   a time, and checks that the memory of the blocks read and verified
+   is used again rather than got afresh for every read. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <cdio/paranoia.h>
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define CDDA_IMAGE TEST_DIR "/cdda.cue"
+#define CDDA_BIN   TEST_DIR "/cdda.bin"
+
+#define SKIP_TEST_RC 77
+
+/* More than paranoia keeps at once: its cache of blocks, the root and
+   the block being read. */
+#define MAX_BUFFERS 20
+
+static const char *pool_names[] = { "buffers", "flags", "nodes" };
+
+/* The most sectors asked of paranoia_read_range() at a time. */
+#define RANGE_SECTORS 40
+
+/* Read the whole disc at mode_flags, a sector at a time or, if
+   b_range, as many as paranoia has verified, comparing the samples
+   read with those of the image if there is one to compare with. */
+static int
+read_disc(cdrom_paranoia_t *p, cdrom_drive_t *d, int mode_flags,
+	  bool b_range, const uint8_t *p_bin, long i_bin_sectors)
+{
+  const lsn_t i_first = cdio_cddap_disc_firstsector(d);
+  const lsn_t i_last  = cdio_cddap_disc_lastsector(d);
+  static int16_t range_buf[RANGE_SECTORS * CDIO_CD_FRAMESIZE_RAW / 2];
+  lsn_t i_lsn;
+
+  paranoia_modeset(p, mode_flags);
+  paranoia_seek(p, i_first, SEEK_SET);
+
+  for (i_lsn = i_first; i_lsn <= i_last; ) {
+    const int16_t *p_readbuf = range_buf;
+    long i_sectors = 1;
+    long i;
+
+    if (b_range) {
+      i_sectors = i_last - i_lsn + 1;
+      if (i_sectors > RANGE_SECTORS)
+	i_sectors = RANGE_SECTORS;
+      i_sectors = paranoia_read_range(p, range_buf, i_sectors, NULL, 20);
+    } else
+      p_readbuf = paranoia_read(p, NULL);
+    if (!p_readbuf || i_sectors <= 0) {
+      printf("paranoia read error at sector %ld\n", (long) i_lsn);
+      return 1;
+    }
+    for (i = 0; i < i_sectors; i++, i_lsn++)
+      if (p_bin && i_lsn - i_first < i_bin_sectors
+	  && 0 != memcmp((const uint8_t *) p_readbuf
+			 + i * CDIO_CD_FRAMESIZE_RAW,
+			 p_bin + (i_lsn - i_first) * CDIO_CD_FRAMESIZE_RAW,
+			 CDIO_CD_FRAMESIZE_RAW)) {
+	printf("sector %ld read with mode %x%s differs from the image\n",
+	       (long) i_lsn, mode_flags, b_range ? " as a range" : "");
+	return 2;
+      }
+  }
+  if (i_lsn != i_last + 1) {
+    printf("read %ld sectors past the end of the disc\n",
+	   (long) (i_lsn - i_last - 1));
+    return 5;
+  }
+  return 0;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  cdrom_drive_t *d = cdio_cddap_identify(CDDA_IMAGE, CDDA_MESSAGE_FORGETIT,
+					 NULL);
+  cdrom_paranoia_t *p;
+  cdio_paranoia_pool_stats_t stats[3];
+  uint8_t *p_bin = NULL;
+  long i_bin_sectors = 0;
+  int i_kind;
+  int i_rc;
+
+  if (!d || 0 != cdio_cddap_open(d)) {
+    printf("Unable to open %s\n", CDDA_IMAGE);
+    return SKIP_TEST_RC;
+  }
+
+#ifndef WORDS_BIGENDIAN
+  /* The image holds little-endian samples, which paranoia returns in
+     the order of this host. */
+  {
+    FILE *p_file = fopen(CDDA_BIN, "rb");
+    if (p_file) {
+      fseek(p_file, 0, SEEK_END);
+      i_bin_sectors = ftell(p_file) / CDIO_CD_FRAMESIZE_RAW;
+      rewind(p_file);
+      p_bin = malloc(i_bin_sectors * CDIO_CD_FRAMESIZE_RAW);
+      if (1 != fread(p_bin, i_bin_sectors * CDIO_CD_FRAMESIZE_RAW, 1,
+		     p_file)) {
+	free(p_bin);
+	p_bin = NULL;
+      }
+      fclose(p_file);
+    }
+  }
+#endif
+
+  p = paranoia_init(d);
+
+  i_rc = read_disc(p, d, PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP,
+		   false, p_bin, i_bin_sectors);
+  if (!i_rc)
+    i_rc = read_disc(p, d, PARANOIA_MODE_DISABLE, false, p_bin,
+		     i_bin_sectors);
+  if (!i_rc)
+    i_rc = read_disc(p, d, PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP,
+		     false, p_bin, i_bin_sectors);
+  if (!i_rc)
+    i_rc = read_disc(p, d, PARANOIA_MODE_FULL^PARANOIA_MODE_NEVERSKIP,
+		     true, p_bin, i_bin_sectors);
+  if (!i_rc)
+    i_rc = read_disc(p, d, PARANOIA_MODE_DISABLE, true, p_bin,
+		     i_bin_sectors);
+  if (i_rc)
+    return i_rc;
+
+  for (i_kind = PARANOIA_POOL_BUFFERS; i_kind <= PARANOIA_POOL_NODES;
+       i_kind++) {
+    paranoia_pool_stats(p, i_kind, &stats[i_kind]);
+    printf("%-7s got %lu, reused %lu, kept %lu\n", pool_names[i_kind],
+	   stats[i_kind].i_allocs, stats[i_kind].i_reuses,
+	   stats[i_kind].i_free);
+    if (0 == stats[i_kind].i_reuses) {
+      printf("no %s were used again\n", pool_names[i_kind]);
+      return 3;
+    }
+  }
+
+  if (stats[PARANOIA_POOL_BUFFERS].i_allocs > MAX_BUFFERS) {
+    printf("%lu buffers were allocated; expected at most %d\n",
+	   stats[PARANOIA_POOL_BUFFERS].i_allocs, MAX_BUFFERS);
+    return 4;
+  }
+
+  paranoia_free(p);
+  cdio_cddap_close(d);
+  free(p_bin);
+  return 0;
+}
@@ -0,0 +1,856 @@
+/*
+  Copyright (C) 2008 Rocky Bernstein <rocky@gnu.org>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Tests the libudf file reading routines on the UDF image in the
+   libcdio distribution. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include <cdio/cdio.h>
+#include <cdio/udf.h>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+#define UDF_IMAGE TEST_DIR "/udf102.iso"
+
+/* The length of /COPYING in udf102.iso */
+#define COPYING_SIZE 17992
+
+/* Where things are in udf102.iso: the partition, and the file entry
+   and data of /COPYING. */
+#define UDF102_BLOCKS    383
+#define PART_START       263
+#define COPYING_FE_LBA   266
+#define COPYING_DATA_LBA 267
+
+/* Images the checks below write, named so that the image globs of
+   check_fuzzyiso.sh never pick them up half-written. */
+#define FRAGMENTED_IMAGE "testudf-frag.tmp"
+#define BIG_DIR_IMAGE    "testudf-dir.tmp"
+#define VDS_IMAGE        "testudf-vds.tmp"
+#define ICB_IMAGE        "testudf-icb.tmp"
+#define AED_IMAGE        "testudf-aed.tmp"
+
+/* Where things are in a file entry with no extended attributes: its
+   ICB flags, which say how its data is allocated, its length, the
+   length of its allocation descriptors, and those. */
+#define FE_FLAGS          34
+#define FE_INFO_LEN       56
+#define FE_ALLOC_DESCS   172
+#define FE_ADS           176
+
+/* The Main and Reserve Volume Descriptor Sequences of udf102.iso: a
+   Primary Volume Descriptor first, a Partition Descriptor third, and a
+   Terminating Descriptor sixth. */
+#define MAIN_VDS_LBA     32
+#define RESERVE_VDS_LBA  48
+
+/* /COPYING read with udf_read_block(), to compare the rest against. */
+static uint8_t copying[COPYING_SIZE];
+
+/* Read all of p_udf_file with udf_file_read() in i_chunk-byte pieces
+   into buf. Return the number of bytes read. */
+static size_t
+read_in_chunks(udf_file_t *p_udf_file, uint8_t *buf, size_t i_chunk)
+{
+  size_t i_total = 0;
+  ssize_t i_read;
+
+  while ((i_read = udf_file_read(p_udf_file, buf + i_total, i_chunk)) > 0)
+    i_total += i_read;
+  return i_total;
+}
+
+static void
+put_le32(uint8_t *p, uint32_t i)
+{
+  p[0] = i; p[1] = i >> 8; p[2] = i >> 16; p[3] = i >> 24;
+}
+
+/* Set the checksum of the descriptor tag at p_tag. */
+static void
+set_tag_checksum(uint8_t *p_tag)
+{
+  uint8_t i_cksum = 0;
+  unsigned int i;
+
+  for (i = 0; i < 16; i++) 
+    if (i != 4) i_cksum += p_tag[i];
+  p_tag[4] = i_cksum;
+}
+
+/* Return udf102.iso in a buffer of i_blocks blocks, the ones past
+   the end of the image zeroed. */
+static uint8_t *
+read_udf102(unsigned int i_blocks)
+{
+  uint8_t *p_image = calloc(i_blocks, UDF_BLOCKSIZE);
+  FILE *p_file = fopen(UDF_IMAGE, "rb");
+  bool b_ok = p_image && p_file 
+    && UDF102_BLOCKS == fread(p_image, UDF_BLOCKSIZE, UDF102_BLOCKS, p_file);
+
+  if (p_file) fclose(p_file);
+  if (!b_ok) {
+    free(p_image);
+    return NULL;
+  }
+  return p_image;
+}
+
+/* Write the i_blocks blocks of p_image to psz_image and free it. */
+static bool
+write_image(const char psz_image[], uint8_t *p_image, unsigned int i_blocks)
+{
+  FILE *p_file = fopen(psz_image, "wb");
+  bool b_ok = p_file 
+    && i_blocks == fwrite(p_image, UDF_BLOCKSIZE, i_blocks, p_file);
+
+  if (p_file && fclose(p_file)) b_ok = false;
+  free(p_image);
+  return b_ok;
+}
+
+/* Write a copy of udf102.iso in which the data of /COPYING is
+   scattered over extents past the end of the original image, out of
+   order, and its fourth block is not recorded, so reads as zeros. Two
+   of the extents are adjacent. */
+static bool
+make_fragmented_image(void)
+{
+  static const struct { uint32_t i_block, i_blocks, i_to; } runs[] = {
+    {0, 2, 390}, {2, 1, 386}, {3, 1, 0}, {4, 2, 383}, {6, 1, 385}, 
+    {7, 2, 387}
+  };
+  const unsigned int i_runs = sizeof(runs) / sizeof(runs[0]);
+  uint8_t *p_image = read_udf102(392);
+  uint8_t *p_fe;
+  unsigned int i;
+
+  if (!p_image) return false;
+  p_fe = p_image + COPYING_FE_LBA * UDF_BLOCKSIZE;
+
+  /* The file entry has no extended attributes and one long_ad. */
+  put_le32(p_fe + FE_ALLOC_DESCS, i_runs * 16);
+  for (i = 0; i < i_runs; i++) {
+    uint8_t *p_ad = p_fe + FE_ADS + 16 * i;
+    uint32_t i_len = runs[i].i_blocks * UDF_BLOCKSIZE;
+
+    if (runs[i].i_block + runs[i].i_blocks == 9)
+      i_len -= 9 * UDF_BLOCKSIZE - COPYING_SIZE;
+    memset(p_ad, 0, 16);
+    if (runs[i].i_to) {
+      put_le32(p_ad, i_len);
+      put_le32(p_ad + 4, runs[i].i_to - PART_START);
+      memcpy(p_image + runs[i].i_to * UDF_BLOCKSIZE, 
+             p_image + (COPYING_DATA_LBA + runs[i].i_block) * UDF_BLOCKSIZE,
+             runs[i].i_blocks * UDF_BLOCKSIZE);
+    } else {
+      put_le32(p_ad, i_len | 0x80000000);
+    }
+  }
+  return write_image(FRAGMENTED_IMAGE, p_image, 392);
+}
+
+/* Write a copy of udf102.iso whose root directory has BIG_DIR_FILES
+   files besides its parent entry, named file0000, file0001 and so on.
+   Their file entries are copies of that of /COPYING, BIG_DIR_FES of
+   them, spread over blocks past the end of the original image with
+   gaps between them, and the files refer to them out of order. */
+#define BIG_DIR_FILES 1500
+#define BIG_DIR_FES    100
+
+static bool
+make_big_directory_image(void)
+{
+  const unsigned int i_fid_size = 48;  /* 38 bytes, an 8-character name
+                                          with its compression id, and
+                                          padding */
+  const unsigned int i_dir_size = 40 + BIG_DIR_FILES * i_fid_size;
+  const unsigned int i_dir_lba = UDF102_BLOCKS;
+  const unsigned int i_fe_lba = 
+    i_dir_lba + (i_dir_size + UDF_BLOCKSIZE - 1) / UDF_BLOCKSIZE;
+  const unsigned int i_blocks = i_fe_lba + 3 * BIG_DIR_FES;
+  uint8_t *p_image = read_udf102(i_blocks);
+  uint8_t *p_root_fe, *p_dir;
+  unsigned int i;
+
+  if (!p_image) return false;
+  p_root_fe = p_image + (PART_START + 1) * UDF_BLOCKSIZE;
+  p_dir = p_image + i_dir_lba * UDF_BLOCKSIZE;
+
+  /* Keep the parent entry, which is the first 40 bytes of the root
+     directory. */
+  memcpy(p_dir, p_image + (PART_START + 2) * UDF_BLOCKSIZE, 40);
+  for (i = 0; i < BIG_DIR_FILES; i++) {
+    uint8_t *p_fid = p_dir + 40 + i * i_fid_size;
+
+    memcpy(p_fid, p_dir, 16);          /* the tag */
+    p_fid[16] = 1;                     /* file version number */
+    p_fid[18] = 0;                     /* file characteristics */
+    p_fid[19] = 9;                     /* length of the name */
+    put_le32(p_fid + 20, UDF_BLOCKSIZE);
+    put_le32(p_fid + 24, i_fe_lba + 3 * ((i * 37) % BIG_DIR_FES) 
+             - PART_START);
+    p_fid[38] = 8;                     /* 8-bit characters */
+    sprintf((char *) p_fid + 39, "file%04u", i);
+    p_fid[47] = 0;
+    put_le32(p_fid + 12, i_dir_lba - PART_START + (40 + i * i_fid_size) 
+             / UDF_BLOCKSIZE);
+    set_tag_checksum(p_fid);
+  }
+  for (i = 0; i < BIG_DIR_FES; i++)
+    memcpy(p_image + (i_fe_lba + 3 * i) * UDF_BLOCKSIZE,
+           p_image + COPYING_FE_LBA * UDF_BLOCKSIZE, UDF_BLOCKSIZE);
+
+  /* Point the root's file entry, which has one long_ad, at the new
+     directory. */
+  put_le32(p_root_fe + FE_INFO_LEN, i_dir_size);
+  put_le32(p_root_fe + FE_INFO_LEN + 4, 0);
+  put_le32(p_root_fe + FE_ADS, i_dir_size);
+  put_le32(p_root_fe + FE_ADS + 4, i_dir_lba - PART_START);
+  return write_image(BIG_DIR_IMAGE, p_image, i_blocks);
+}
+
+static int
+check_pread(const udf_file_t *p_udf_file, const uint8_t *p_expect)
+{
+  static const struct { off_t i_offset; size_t i_count; } reads[] = {
+    {0, 1}, {0, 2048}, {1, 2047}, {2047, 2}, {2048, 2048}, {100, 6000},
+    {4095, 4098}, {COPYING_SIZE - 10, 10}, {COPYING_SIZE - 10, 5000},
+    {0, COPYING_SIZE}, {3, COPYING_SIZE}
+  };
+  uint8_t buf[COPYING_SIZE];
+  unsigned int i;
+
+  for (i = 0; i < sizeof(reads) / sizeof(reads[0]); i++) {
+    const off_t i_offset = reads[i].i_offset;
+    size_t i_expect = reads[i].i_count;
+    ssize_t i_read = udf_pread(p_udf_file, buf, reads[i].i_count, i_offset);
+
+    if (i_expect > COPYING_SIZE - i_offset)
+      i_expect = COPYING_SIZE - i_offset;
+    if (i_read != (ssize_t) i_expect
+        || memcmp(buf, p_expect + i_offset, i_expect)) {
+      printf("udf_pread of %u bytes at %u gave wrong data\n",
+             (unsigned int) reads[i].i_count, (unsigned int) i_offset);
+      return 1;
+    }
+  }
+  if (0 != udf_pread(p_udf_file, buf, 10, COPYING_SIZE)
+      || 0 != udf_pread(p_udf_file, buf, 10, COPYING_SIZE + 5000)) {
+    printf("udf_pread at or past the end should read nothing\n");
+    return 2;
+  }
+  return 0;
+}
+
+#ifdef HAVE_PTHREAD
+#define PREAD_THREADS 4
+
+static void *
+pread_thread(void *p_data)
+{
+  const udf_file_t *p_udf_file = p_data;
+  unsigned int i_seed = (unsigned int) (size_t) &i_seed;
+  uint8_t buf[3000];
+  unsigned int i;
+
+  for (i = 0; i < 500; i++) {
+    const off_t i_offset = rand_r(&i_seed) % COPYING_SIZE;
+    size_t i_count = 1 + rand_r(&i_seed) % sizeof(buf);
+    ssize_t i_read = udf_pread(p_udf_file, buf, i_count, i_offset);
+
+    if (i_count > COPYING_SIZE - i_offset)
+      i_count = COPYING_SIZE - i_offset;
+    if (i_read != (ssize_t) i_count
+        || memcmp(buf, copying + i_offset, i_count))
+      return p_data;
+  }
+  return NULL;
+}
+
+/* Several threads doing random reads through one handle. */
+static int
+check_threads(const udf_file_t *p_udf_file)
+{
+  pthread_t threads[PREAD_THREADS];
+  unsigned int i;
+  int rc = 0;
+
+  for (i = 0; i < PREAD_THREADS; i++)
+    if (pthread_create(&threads[i], NULL, pread_thread,
+                       (void *) p_udf_file))
+      return 1;
+  for (i = 0; i < PREAD_THREADS; i++) {
+    void *p_result;
+    pthread_join(threads[i], &p_result);
+    if (p_result) rc = 2;
+  }
+  if (rc) printf("Concurrent udf_pread gave wrong data\n");
+  return rc;
+}
+#endif /*HAVE_PTHREAD*/
+
+/* Read /COPYING from the fragmented image, both with udf_read_block()
+   and through a handle. */
+static int
+check_fragmented(void)
+{
+  uint8_t expect[COPYING_SIZE], buf[COPYING_SIZE + UDF_BLOCKSIZE];
+  udf_t *p_udf;
+  udf_dirent_t *p_udf_root, *p_udf_dirent;
+  udf_file_t *p_udf_file;
+  size_t i_total = 0;
+  ssize_t i_read;
+  int rc;
+
+  if (!make_fragmented_image()) {
+    printf("Couldn't write %s\n", FRAGMENTED_IMAGE);
+    return 1;
+  }
+  memcpy(expect, copying, COPYING_SIZE);
+  memset(expect + 3 * UDF_BLOCKSIZE, 0, UDF_BLOCKSIZE);
+
+  p_udf = udf_open(FRAGMENTED_IMAGE);
+  p_udf_root = p_udf ? udf_get_root(p_udf, true, 0) : NULL;
+  p_udf_dirent = p_udf_root ? udf_fopen(p_udf_root, "/COPYING") : NULL;
+  if (!p_udf_dirent) {
+    printf("Couldn't find /COPYING in %s\n", FRAGMENTED_IMAGE);
+    return 2;
+  }
+
+  /* Several blocks at a time, so reads span extents. */
+  while ((i_read = udf_read_block(p_udf_dirent, buf + i_total, 3)) > 0)
+    i_total += i_read;
+  if (COPYING_SIZE != i_total || memcmp(buf, expect, COPYING_SIZE)) {
+    printf("udf_read_block of a fragmented file gave wrong data\n");
+    return 3;
+  }
+
+  p_udf_file = udf_file_open(p_udf_dirent);
+  udf_dirent_free(p_udf_dirent);
+  if (!p_udf_file) return 4;
+  rc = check_pread(p_udf_file, expect);
+  if (rc) return 4 + rc;
+
+  udf_file_close(p_udf_file);
+  udf_dirent_free(p_udf_root);
+  udf_close(p_udf);
+  return 0;
+}
+
+/* Write a copy of udf102.iso whose Main Volume Descriptor Sequence
+   either has a later Primary Volume Descriptor, naming the volume
+   "NEW", before its Terminating Descriptor and another one, naming it
+   "OLD", after (b_reserve false), or lacks its Partition Descriptor
+   (b_reserve true). */
+static bool
+make_vds_image(bool b_reserve)
+{
+  uint8_t *p_image = read_udf102(UDF102_BLOCKS);
+  uint8_t *p_vds;
+
+  if (!p_image) return false;
+  p_vds = p_image + MAIN_VDS_LBA * UDF_BLOCKSIZE;
+  if (b_reserve) {
+    memset(p_vds + 2 * UDF_BLOCKSIZE, 0, UDF_BLOCKSIZE);
+  } else {
+    /* udf_checktag() only checks the tag, so the descriptor bodies
+       can be changed. */
+    memcpy(p_vds + 6 * UDF_BLOCKSIZE, p_vds + 5 * UDF_BLOCKSIZE, 
+           UDF_BLOCKSIZE);
+    memcpy(p_vds + 5 * UDF_BLOCKSIZE, p_vds, UDF_BLOCKSIZE);
+    put_le32(p_vds + 5 * UDF_BLOCKSIZE + 16, 5);
+    p_vds[5 * UDF_BLOCKSIZE + 24 + 6] = 'W';
+    memcpy(p_vds + 7 * UDF_BLOCKSIZE, p_vds, UDF_BLOCKSIZE);
+    put_le32(p_vds + 7 * UDF_BLOCKSIZE + 16, 9);
+    memcpy(p_vds + 7 * UDF_BLOCKSIZE + 24 + 2, "O\0L\0D", 5);
+  }
+  return write_image(VDS_IMAGE, p_image, UDF102_BLOCKS);
+}
+
+/* Mount the volume descriptor sequence images and check which
+   descriptors prevail. */
+static int
+check_vds(void)
+{
+  static const char *volume_ids[] = { "NEW", "NEU" };
+  unsigned int i;
+
+  for (i = 0; i < 2; i++) {
+    udf_t *p_udf;
+    udf_dirent_t *p_udf_root, *p_udf_dirent;
+    char psz_volid[UDF_VOLID_SIZE];
+
+    if (!make_vds_image(1 == i)) {
+      printf("Couldn't write %s\n", VDS_IMAGE);
+      return 1;
+    }
+    p_udf = udf_open(VDS_IMAGE);
+    if (!p_udf) {
+      printf("Couldn't open %s as UDF\n", VDS_IMAGE);
+      return 2;
+    }
+    memset(psz_volid, 0, sizeof(psz_volid));
+    if (!udf_get_volume_id(p_udf, psz_volid, sizeof(psz_volid) - 1)
+        || strcmp(volume_ids[i], psz_volid)) {
+      printf("Volume id is \"%s\", not \"%s\"\n", psz_volid, 
+             volume_ids[i]);
+      return 3;
+    }
+    p_udf_root = udf_get_root(p_udf, true, 0);
+    p_udf_dirent = p_udf_root ? udf_fopen(p_udf_root, "/COPYING") : NULL;
+    if (!p_udf_dirent 
+        || COPYING_SIZE != udf_get_file_length(p_udf_dirent)) {
+      printf("Couldn't find /COPYING in %s\n", VDS_IMAGE);
+      return 4;
+    }
+    if (udf_get_root(p_udf, false, 1)) {
+      printf("Found a root in partition 1, which isn't there\n");
+      return 5;
+    }
+    udf_dirent_free(p_udf_dirent);
+    udf_dirent_free(p_udf_root);
+    udf_close(p_udf);
+  }
+  return 0;
+}
+
+/* List the big root directory, and look up each of its files. */
+static int
+check_big_directory(void)
+{
+  udf_t *p_udf;
+  udf_dirent_t *p_udf_root, *p_udf_dirent;
+  udf_file_t *p_udf_file;
+  uint8_t buf[32];
+  unsigned int i;
+
+  if (!make_big_directory_image()) {
+    printf("Couldn't write %s\n", BIG_DIR_IMAGE);
+    return 1;
+  }
+  p_udf = udf_open(BIG_DIR_IMAGE);
+  p_udf_root = p_udf ? udf_get_root(p_udf, true, 0) : NULL;
+  if (!p_udf_root) {
+    printf("Couldn't find / in %s\n", BIG_DIR_IMAGE);
+    return 2;
+  }
+
+  /* The first entry is the parent. */
+  p_udf_dirent = udf_fopen(p_udf_root, "/");
+  if (!p_udf_dirent || !udf_readdir(p_udf_dirent)) return 3;
+  for (i = 0; i < BIG_DIR_FILES && udf_readdir(p_udf_dirent); i++) {
+    char psz_name[10];
+    snprintf(psz_name, sizeof(psz_name), "file%04u", i);
+    if (strcmp(psz_name, udf_get_filename(p_udf_dirent))
+        || udf_is_dir(p_udf_dirent)
+        || COPYING_SIZE != udf_get_file_length(p_udf_dirent)) {
+      printf("Entry %u of the root directory is wrong\n", i);
+      return 4;
+    }
+  }
+  if (i != BIG_DIR_FILES || udf_readdir(p_udf_dirent)) {
+    printf("The root directory should have %u files\n", BIG_DIR_FILES);
+    return 5;
+  }
+
+  for (i = BIG_DIR_FILES; i-- > 0; ) {
+    char psz_path[11];
+    snprintf(psz_path, sizeof(psz_path), "/file%04u", i);
+    p_udf_dirent = udf_fopen(p_udf_root, psz_path);
+    if (!p_udf_dirent || strcmp(psz_path + 1, udf_get_filename(p_udf_dirent))
+        || COPYING_SIZE != udf_get_file_length(p_udf_dirent)) {
+      printf("Couldn't find %s\n", psz_path);
+      return 6;
+    }
+    if (0 == i % 250) {
+      p_udf_file = udf_file_open(p_udf_dirent);
+      if (!p_udf_file || sizeof(buf) != udf_pread(p_udf_file, buf, 
+                                                  sizeof(buf), 0)
+          || memcmp(buf, copying, sizeof(buf))) {
+        printf("Couldn't read %s\n", psz_path);
+        return 7;
+      }
+      udf_file_close(p_udf_file);
+    }
+    udf_dirent_free(p_udf_dirent);
+  }
+  if (udf_fopen(p_udf_root, "/file9999") || udf_fopen(p_udf_root, "/file")) {
+    printf("udf_fopen found a file that isn't there\n");
+    return 8;
+  }
+
+  udf_dirent_free(p_udf_root);
+  udf_close(p_udf);
+  return 0;
+}
+
+/* How many bytes of /COPYING are embedded in its file entry in the
+   ICB image. */
+#define ICB_DATA_SIZE 1500
+
+/* Set the file entry p_fe to say its data is embedded in it, and put
+   the i_size bytes at p_data there. */
+static void
+embed_data(uint8_t *p_fe, const uint8_t *p_data, uint32_t i_size)
+{
+  p_fe[FE_FLAGS] = (p_fe[FE_FLAGS] & ~7) | 3;
+  put_le32(p_fe + FE_INFO_LEN, i_size);
+  put_le32(p_fe + FE_INFO_LEN + 4, 0);
+  put_le32(p_fe + FE_ALLOC_DESCS, i_size);
+  memmove(p_fe + FE_ADS, p_data, i_size);
+}
+
+/* Write a copy of udf102.iso in which both the root directory and the
+   first ICB_DATA_SIZE bytes of /COPYING, as all of it, are embedded in
+   their file entries. The blocks they were in are zeroed. */
+static bool
+make_icb_image(void)
+{
+  uint8_t *p_image = read_udf102(UDF102_BLOCKS);
+  uint8_t *p_root_fe, *p_fe;
+  uint32_t i_dir_size;
+
+  if (!p_image) return false;
+  p_root_fe = p_image + (PART_START + 1) * UDF_BLOCKSIZE;
+  p_fe = p_image + COPYING_FE_LBA * UDF_BLOCKSIZE;
+
+  i_dir_size = p_root_fe[FE_INFO_LEN] | p_root_fe[FE_INFO_LEN + 1] << 8;
+  embed_data(p_root_fe, p_image + (PART_START + 2) * UDF_BLOCKSIZE, 
+             i_dir_size);
+  memset(p_image + (PART_START + 2) * UDF_BLOCKSIZE, 0, UDF_BLOCKSIZE);
+  embed_data(p_fe, p_image + COPYING_DATA_LBA * UDF_BLOCKSIZE, 
+             ICB_DATA_SIZE);
+  memset(p_image + COPYING_DATA_LBA * UDF_BLOCKSIZE, 0, 
+         9 * UDF_BLOCKSIZE);
+  return write_image(ICB_IMAGE, p_image, UDF102_BLOCKS);
+}
+
+/* List the embedded root directory of the ICB image and read the
+   embedded /COPYING. */
+static int
+check_in_icb(void)
+{
+  uint8_t buf[2 * UDF_BLOCKSIZE];
+  udf_t *p_udf;
+  udf_dirent_t *p_udf_root, *p_udf_dirent;
+  udf_file_t *p_udf_file;
+
+  if (!make_icb_image()) {
+    printf("Couldn't write %s\n", ICB_IMAGE);
+    return 1;
+  }
+  p_udf = udf_open(ICB_IMAGE);
+  p_udf_root = p_udf ? udf_get_root(p_udf, true, 0) : NULL;
+  p_udf_dirent = p_udf_root ? udf_fopen(p_udf_root, "/") : NULL;
+  if (!p_udf_dirent || !udf_readdir(p_udf_dirent) 
+      || !udf_readdir(p_udf_dirent)
+      || strcmp("COPYING", udf_get_filename(p_udf_dirent))
+      || udf_readdir(p_udf_dirent)) {
+    printf("Couldn't list the embedded root directory of %s\n", 
+           ICB_IMAGE);
+    return 2;
+  }
+
+  p_udf_dirent = udf_fopen(p_udf_root, "/COPYING");
+  if (!p_udf_dirent 
+      || ICB_DATA_SIZE != udf_get_file_length(p_udf_dirent)) {
+    printf("Couldn't find /COPYING in %s\n", ICB_IMAGE);
+    return 3;
+  }
+  if (ICB_DATA_SIZE != udf_read_block(p_udf_dirent, buf, 1)
+      || memcmp(buf, copying, ICB_DATA_SIZE)
+      || 0 != udf_read_block(p_udf_dirent, buf, 1)) {
+    printf("udf_read_block of an embedded file gave wrong data\n");
+    return 4;
+  }
+
+  p_udf_file = udf_file_open(p_udf_dirent);
+  udf_dirent_free(p_udf_dirent);
+  if (!p_udf_file
+      || 100 != udf_pread(p_udf_file, buf, 100, 1000)
+      || memcmp(buf, copying + 1000, 100)
+      || ICB_DATA_SIZE - 1400 != udf_pread(p_udf_file, buf, 1000, 1400)
+      || memcmp(buf, copying + 1400, ICB_DATA_SIZE - 1400)
+      || 0 != udf_pread(p_udf_file, buf, 10, ICB_DATA_SIZE)) {
+    printf("udf_pread of an embedded file gave wrong data\n");
+    return 5;
+  }
+
+  udf_file_close(p_udf_file);
+  udf_dirent_free(p_udf_root);
+  udf_close(p_udf);
+  return 0;
+}
+
+#define AED_LBA        UDF102_BLOCKS
+#define AED_DATA_LBA   (UDF102_BLOCKS + 2)
+#define AED_BLOCKS     (UDF102_BLOCKS + 6)
+
+/* Put an allocation descriptor of i_len bytes at absolute block i_lba,
+   or of the type and length given by i_len_type if i_lba is 0, at
+   p_ad. Return the descriptor's size. */
+static unsigned int
+put_ad(uint8_t *p_ad, bool b_extended, uint32_t i_len_type, uint32_t i_lba)
+{
+  const unsigned int i_size = b_extended ? 20 : 16;
+
+  memset(p_ad, 0, i_size);
+  put_le32(p_ad, i_len_type);
+  if (b_extended) {
+    put_le32(p_ad + 4, i_len_type & 0x3FFFFFFF);
+    put_le32(p_ad + 8, i_len_type & 0x3FFFFFFF);
+    p_ad += 8;
+  }
+  put_le32(p_ad + 4, i_lba - PART_START);
+  return i_size;
+}
+
+/* Make the block p_aed an Allocation Extent Descriptor at absolute
+   block i_lba, with i_descs bytes of allocation descriptors. */
+static void
+set_aed(uint8_t *p_aed, uint32_t i_lba, uint32_t i_descs)
+{
+  memset(p_aed, 0, 24);
+  p_aed[0] = 2;                        /* TAGID_AED */
+  p_aed[1] = 1;
+  p_aed[2] = 2;                        /* descriptor version */
+  put_le32(p_aed + 12, i_lba - PART_START);
+  put_le32(p_aed + 20, i_descs);
+  set_tag_checksum(p_aed);
+}
+
+/* Write a copy of udf102.iso in which the allocation descriptors of
+   /COPYING, extended ones if b_extended, go on in a chain of two
+   Allocation Extent Descriptors past the end of the original image.
+   The last run of the file is moved past them too. */
+static bool
+make_aed_image(bool b_extended)
+{
+  const uint32_t i_next = 0xC0000000 | UDF_BLOCKSIZE;
+  uint8_t *p_image = read_udf102(AED_BLOCKS);
+  uint8_t *p_fe, *p_aed, *p_ad;
+
+  if (!p_image) return false;
+  p_fe = p_image + COPYING_FE_LBA * UDF_BLOCKSIZE;
+
+  /* Blocks 0 and 1 of the file, then on to the first AED. */
+  p_fe[FE_FLAGS] = (p_fe[FE_FLAGS] & ~7) | (b_extended ? 2 : 1);
+  p_ad = p_fe + FE_ADS;
+  p_ad += put_ad(p_ad, b_extended, 2 * UDF_BLOCKSIZE, COPYING_DATA_LBA);
+  p_ad += put_ad(p_ad, b_extended, i_next, AED_LBA);
+  put_le32(p_fe + FE_ALLOC_DESCS, p_ad - p_fe - FE_ADS);
+
+  /* Blocks 2, and 3 and 4, then on to the second. */
+  p_aed = p_image + AED_LBA * UDF_BLOCKSIZE;
+  p_ad = p_aed + 24;
+  p_ad += put_ad(p_ad, b_extended, UDF_BLOCKSIZE, COPYING_DATA_LBA + 2);
+  p_ad += put_ad(p_ad, b_extended, 2 * UDF_BLOCKSIZE, 
+                 COPYING_DATA_LBA + 3);
+  p_ad += put_ad(p_ad, b_extended, i_next, AED_LBA + 1);
+  set_aed(p_aed, AED_LBA, p_ad - p_aed - 24);
+
+  /* Blocks 5 to 8, which are moved. */
+  p_aed += UDF_BLOCKSIZE;
+  p_ad = p_aed + 24;
+  p_ad += put_ad(p_ad, b_extended, COPYING_SIZE - 5 * UDF_BLOCKSIZE, 
+                 AED_DATA_LBA);
+  set_aed(p_aed, AED_LBA + 1, p_ad - p_aed - 24);
+  memcpy(p_image + AED_DATA_LBA * UDF_BLOCKSIZE,
+         p_image + (COPYING_DATA_LBA + 5) * UDF_BLOCKSIZE, 
+         4 * UDF_BLOCKSIZE);
+  memset(p_image + (COPYING_DATA_LBA + 5) * UDF_BLOCKSIZE, 0, 
+         4 * UDF_BLOCKSIZE);
+  return write_image(AED_IMAGE, p_image, AED_BLOCKS);
+}
+
+/* Read /COPYING through its chain of Allocation Extent Descriptors,
+   with long and then extended allocation descriptors. */
+static int
+check_aed(void)
+{
+  unsigned int i;
+
+  for (i = 0; i < 2; i++) {
+    uint8_t buf[COPYING_SIZE + UDF_BLOCKSIZE];
+    udf_t *p_udf;
+    udf_dirent_t *p_udf_root, *p_udf_dirent;
+    udf_file_t *p_udf_file;
+    size_t i_total = 0;
+    ssize_t i_read;
+    int rc;
+
+    if (!make_aed_image(1 == i)) {
+      printf("Couldn't write %s\n", AED_IMAGE);
+      return 1;
+    }
+    p_udf = udf_open(AED_IMAGE);
+    p_udf_root = p_udf ? udf_get_root(p_udf, true, 0) : NULL;
+    p_udf_dirent = p_udf_root ? udf_fopen(p_udf_root, "/COPYING") : NULL;
+    if (!p_udf_dirent) {
+      printf("Couldn't find /COPYING in %s\n", AED_IMAGE);
+      return 2;
+    }
+    while ((i_read = udf_read_block(p_udf_dirent, buf + i_total, 2)) > 0)
+      i_total += i_read;
+    if (COPYING_SIZE != i_total || memcmp(buf, copying, COPYING_SIZE)) {
+      printf("udf_read_block over Allocation Extent Descriptors "
+             "gave wrong data\n");
+      return 3;
+    }
+    p_udf_file = udf_file_open(p_udf_dirent);
+    udf_dirent_free(p_udf_dirent);
+    if (!p_udf_file) return 4;
+    rc = check_pread(p_udf_file, copying);
+    if (rc) return 4 + rc;
+
+    udf_file_close(p_udf_file);
+    udf_dirent_free(p_udf_root);
+    udf_close(p_udf);
+  }
+  return 0;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  udf_t *p_udf;
+  udf_dirent_t *p_udf_root, *p_udf_dirent;
+  udf_file_t *p_udf_file, *p_udf_file2;
+  uint8_t buf[COPYING_SIZE + UDF_BLOCKSIZE], buf2[COPYING_SIZE];
+  size_t i_total = 0;
+  ssize_t i_read;
+  int rc;
+
+  p_udf = udf_open(UDF_IMAGE);
+  if (!p_udf) {
+    printf("Couldn't open %s as UDF\n", UDF_IMAGE);
+    return 1;
+  }
+  p_udf_root = udf_get_root(p_udf, true, 0);
+  if (!p_udf_root) {
+    printf("Couldn't find / in %s\n", UDF_IMAGE);
+    return 2;
+  }
+  p_udf_dirent = udf_fopen(p_udf_root, "/COPYING");
+  if (!p_udf_dirent || COPYING_SIZE != udf_get_file_length(p_udf_dirent)) {
+    printf("Couldn't find /COPYING in %s\n", UDF_IMAGE);
+    return 3;
+  }
+
+  while ((i_read = udf_read_block(p_udf_dirent, buf + i_total, 1)) > 0)
+    i_total += i_read;
+  if (COPYING_SIZE != i_total
+      || memcmp(buf, "\t\t    GNU GENERAL PUBLIC LICENSE", 32)) {
+    printf("udf_read_block read %u bytes of /COPYING\n",
+           (unsigned int) i_total);
+    return 4;
+  }
+  memcpy(copying, buf, COPYING_SIZE);
+
+  /* A handle outlives the directory entry it was opened from. */
+  p_udf_file  = udf_file_open(p_udf_dirent);
+  p_udf_file2 = udf_file_open(p_udf_dirent);
+  udf_dirent_free(p_udf_dirent);
+  if (!p_udf_file || !p_udf_file2) return 5;
+
+  rc = check_pread(p_udf_file, copying);
+  if (rc) return 10 + rc;
+
+  /* Two handles read interleaved keep their own positions. */
+  memset(buf, 0, sizeof(buf));
+  i_total = 0;
+  while (i_total < COPYING_SIZE) {
+    i_read = udf_file_read(p_udf_file, buf + i_total, 1000);
+    if (i_read <= 0) break;
+    i_total += i_read;
+    if (udf_file_read(p_udf_file2, buf2, 777) < 0) break;
+  }
+  if (COPYING_SIZE != i_total || memcmp(buf, copying, COPYING_SIZE)) {
+    printf("Interleaved udf_file_read gave wrong data\n");
+    return 20;
+  }
+  if (0 != udf_file_seek(p_udf_file2, 0, SEEK_SET)
+      || COPYING_SIZE != read_in_chunks(p_udf_file2, buf2, 4096)
+      || memcmp(buf2, copying, COPYING_SIZE)) {
+    printf("udf_file_read after rewinding gave wrong data\n");
+    return 21;
+  }
+  if (COPYING_SIZE - 10 != udf_file_seek(p_udf_file2, -10, SEEK_END)
+      || 10 != udf_file_read(p_udf_file2, buf2, 100)
+      || memcmp(buf2, copying + COPYING_SIZE - 10, 10)
+      || 0 != udf_file_read(p_udf_file2, buf2, 100)) {
+    printf("udf_file_read at the end gave wrong data\n");
+    return 22;
+  }
+  if (udf_file_seek(p_udf_file2, -1, SEEK_SET) >= 0) {
+    printf("udf_file_seek to before the start should fail\n");
+    return 23;
+  }
+
+#ifdef HAVE_PTHREAD
+  rc = check_threads(p_udf_file);
+  if (rc) return 30 + rc;
+#endif
+
+  udf_file_close(p_udf_file);
+  udf_file_close(p_udf_file2);
+  udf_dirent_free(p_udf_root);
+  udf_close(p_udf);
+
+  rc = check_fragmented();
+  remove(FRAGMENTED_IMAGE);
+  if (rc) return 40 + rc;
+  rc = check_big_directory();
+  remove(BIG_DIR_IMAGE);
+  if (rc) return 50 + rc;
+  rc = check_vds();
+  remove(VDS_IMAGE);
+  if (rc) return 60 + rc;
+  rc = check_in_icb();
+  remove(ICB_IMAGE);
+  if (rc) return 70 + rc;
+  rc = check_aed();
+  remove(AED_IMAGE);
+  if (rc) return 80 + rc;
+  return 0;
+}
+
+/*
+ * Local variables:
+ *  c-file-style: "gnu"
+ *  tab-width: 8
+ *  indent-tabs-mode: nil
+ * End:
+ */